@@ -0,0 +1,95 @@
+/*
+ This file is part of SpatGRIS.
+
+ Developers: Gaël Lane Lépine, Samuel Béland, Olivier Bélanger, Nicolas Masson
+
+ SpatGRIS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ SpatGRIS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with SpatGRIS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sg_AudioSlab.hpp"
+#include "../Data/sg_constants.hpp"
+#include <algorithm>
+#include <cstdint>
+
+#if JUCE_LINUX
+    #include <sys/mman.h>
+#endif
+
+namespace gris
+{
+namespace
+{
+#if JUCE_LINUX
+constexpr std::size_t HUGE_PAGE_SIZE{ 2 * 1024 * 1024 };
+#endif
+constexpr std::size_t SMALL_PAGE_SIZE{ 4096 };
+
+//==============================================================================
+constexpr std::size_t roundUp(std::size_t const value, std::size_t const multiple) noexcept
+{
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+} // namespace
+
+//==============================================================================
+void AudioSlab::allocate(std::size_t const numChannels, std::size_t const numSamplesPerChannel, bool const useHugePages)
+{
+    release();
+    if (numChannels == 0) {
+        return;
+    }
+
+    static constexpr auto SAMPLES_PER_CACHE_LINE{ CACHE_LINE_SIZE / sizeof(float) };
+    auto stride{ roundUp(numSamplesPerChannel, SAMPLES_PER_CACHE_LINE) };
+    if ((stride * sizeof(float)) % SMALL_PAGE_SIZE == 0) {
+        stride += SAMPLES_PER_CACHE_LINE;
+    }
+
+#if JUCE_LINUX
+    auto const alignment{ useHugePages ? HUGE_PAGE_SIZE : CACHE_LINE_SIZE };
+#else
+    juce::ignoreUnused(useHugePages);
+    auto const alignment{ CACHE_LINE_SIZE };
+#endif
+    auto const numBytes{ roundUp(numChannels * stride * sizeof(float), alignment) };
+
+    // Not value-initialized : the pages must not be touched before madvise() can back them with huge pages.
+    mStorage.reset(new std::byte[numBytes + alignment]);
+    auto const address{ reinterpret_cast<std::uintptr_t>(mStorage.get()) };
+    auto * const alignedStart{ mStorage.get() + (roundUp(address, alignment) - address) };
+
+#if JUCE_LINUX
+    if (useHugePages) {
+        mIsUsingHugePages = madvise(alignedStart, numBytes, MADV_HUGEPAGE) == 0;
+    }
+#endif
+
+    mData = reinterpret_cast<float *>(alignedStart);
+    mStride = stride;
+    mNumChannels = numChannels;
+    std::fill_n(mData, numChannels * stride, 0.0f);
+}
+
+//==============================================================================
+void AudioSlab::release() noexcept
+{
+    mStorage.reset();
+    mData = nullptr;
+    mStride = 0;
+    mNumChannels = 0;
+    mIsUsingHugePages = false;
+}
+
+} // namespace gris
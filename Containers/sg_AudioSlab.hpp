@@ -0,0 +1,80 @@
+/*
+ This file is part of SpatGRIS.
+
+ Developers: Gaël Lane Lépine, Samuel Béland, Olivier Bélanger, Nicolas Masson
+
+ SpatGRIS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ SpatGRIS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with SpatGRIS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <cstddef>
+#include <memory>
+#include "../Data/sg_Macros.hpp"
+
+namespace gris
+{
+//==============================================================================
+/** A single block of memory that holds the samples of many mono channels.
+ *
+ * Every channel starts on a cache line boundary and the channels are getStride() samples apart. The stride is padded so
+ * that neighbouring channels never sit a multiple of 4 KiB apart, which would make them compete for the same cache
+ * sets.
+ *
+ * On Linux, the slab can be backed by transparent huge pages to reduce the TLB misses when hundreds of channels are
+ * processed in the same block. This is a hint : the kernel is free to ignore it.
+ */
+class AudioSlab
+{
+    std::unique_ptr<std::byte[]> mStorage{};
+    float * mData{};
+    std::size_t mStride{};
+    std::size_t mNumChannels{};
+    bool mIsUsingHugePages{};
+
+public:
+    //==============================================================================
+    AudioSlab() = default;
+    ~AudioSlab() = default;
+    SG_DELETE_COPY(AudioSlab)
+    SG_DEFAULT_MOVE(AudioSlab)
+    //==============================================================================
+    /** Replaces the slab with a new silent one. Allocates. */
+    void allocate(std::size_t numChannels, std::size_t numSamplesPerChannel, bool useHugePages);
+    void release() noexcept;
+    //==============================================================================
+    [[nodiscard]] float * getChannel(std::size_t const index) noexcept
+    {
+        jassert(index < mNumChannels);
+        return mData + index * mStride;
+    }
+    [[nodiscard]] float const * getChannel(std::size_t const index) const noexcept
+    {
+        jassert(index < mNumChannels);
+        return mData + index * mStride;
+    }
+    //==============================================================================
+    [[nodiscard]] float * data() noexcept { return mData; }
+    [[nodiscard]] float const * data() const noexcept { return mData; }
+    [[nodiscard]] std::size_t getStride() const noexcept { return mStride; }
+    [[nodiscard]] std::size_t getNumChannels() const noexcept { return mNumChannels; }
+    [[nodiscard]] bool isUsingHugePages() const noexcept { return mIsUsingHugePages; }
+
+private:
+    //==============================================================================
+    JUCE_LEAK_DETECTOR(AudioSlab)
+};
+
+} // namespace gris
@@ -0,0 +1,337 @@
+/*
+ This file is part of SpatGRIS.
+
+ Developers: Gaël Lane Lépine, Samuel Béland, Olivier Bélanger, Nicolas Masson
+
+ SpatGRIS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ SpatGRIS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with SpatGRIS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sg_HotMemory.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+#if JUCE_LINUX || JUCE_MAC
+    #include <sys/mman.h>
+    #include <unistd.h>
+#elif JUCE_WINDOWS
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#endif
+
+namespace gris
+{
+namespace
+{
+#if JUCE_LINUX
+constexpr std::uintptr_t HUGE_PAGE_SIZE{ 2 * 1024 * 1024 };
+#endif
+
+//==============================================================================
+std::size_t getPageSize() noexcept
+{
+#if JUCE_LINUX || JUCE_MAC
+    static auto const pageSize{ static_cast<std::size_t>(sysconf(_SC_PAGESIZE)) };
+    return pageSize;
+#else
+    return 4096;
+#endif
+}
+
+//==============================================================================
+bool lockPages([[maybe_unused]] std::uintptr_t const begin, [[maybe_unused]] std::uintptr_t const end) noexcept
+{
+#if JUCE_LINUX || JUCE_MAC
+    return mlock(reinterpret_cast<void *>(begin), end - begin) == 0;
+#elif JUCE_WINDOWS
+    return VirtualLock(reinterpret_cast<void *>(begin), end - begin) != 0;
+#else
+    return false;
+#endif
+}
+
+//==============================================================================
+void unlockPages([[maybe_unused]] std::uintptr_t const begin, [[maybe_unused]] std::uintptr_t const end) noexcept
+{
+#if JUCE_LINUX || JUCE_MAC
+    munlock(reinterpret_cast<void *>(begin), end - begin);
+#elif JUCE_WINDOWS
+    VirtualUnlock(reinterpret_cast<void *>(begin), end - begin);
+#endif
+}
+
+//==============================================================================
+/** How many locked regions include each page, for every HotMemory of the process. Only touched by the message and
+ * builder threads. */
+struct PageLockCounts {
+    std::mutex mutex{};
+    std::unordered_map<std::uintptr_t, std::size_t> counts{};
+};
+
+PageLockCounts & getPageLockCounts() noexcept
+{
+    static PageLockCounts pageLockCounts{};
+    return pageLockCounts;
+}
+
+//==============================================================================
+/** @return the first and the past-the-end pages of a region. */
+std::pair<std::uintptr_t, std::uintptr_t> getPageRange(std::byte const * const data,
+                                                       std::size_t const numBytes) noexcept
+{
+    auto const pageSize{ getPageSize() };
+    auto const begin{ reinterpret_cast<std::uintptr_t>(data) };
+    return { begin / pageSize * pageSize, (begin + numBytes + pageSize - 1) / pageSize * pageSize };
+}
+
+//==============================================================================
+/** Calls function(runBegin, runEnd) for every run of contiguous pages of [begin, end) that satisfy predicate(page). */
+template<typename Predicate, typename Function>
+void forEachPageRun(std::uintptr_t const begin,
+                    std::uintptr_t const end,
+                    Predicate && predicate,
+                    Function && function) noexcept
+{
+    auto const pageSize{ getPageSize() };
+    auto runBegin{ end };
+    for (auto page{ begin }; page < end; page += pageSize) {
+        if (predicate(page)) {
+            runBegin = std::min(runBegin, page);
+            continue;
+        }
+        if (runBegin != end) {
+            function(runBegin, page);
+            runBegin = end;
+        }
+    }
+    if (runBegin != end) {
+        function(runBegin, end);
+    }
+}
+
+//==============================================================================
+/** Locks the pages of a region that are not locked yet. All or nothing : on failure, the counts are left untouched. */
+bool lockRegion(std::byte const * const data, std::size_t const numBytes) noexcept
+{
+    auto & pageLockCounts{ getPageLockCounts() };
+    std::lock_guard<std::mutex> const lock{ pageLockCounts.mutex };
+    auto & counts{ pageLockCounts.counts };
+    auto const [begin, end] = getPageRange(data, numBytes);
+    auto const isUnlocked = [&](std::uintptr_t const page) { return counts.find(page) == counts.end(); };
+
+    std::vector<std::pair<std::uintptr_t, std::uintptr_t>> lockedRuns{};
+    auto success{ true };
+    forEachPageRun(begin, end, isUnlocked, [&](std::uintptr_t const runBegin, std::uintptr_t const runEnd) {
+        if (!success) {
+            return;
+        }
+        if (lockPages(runBegin, runEnd)) {
+            lockedRuns.emplace_back(runBegin, runEnd);
+        } else {
+            success = false;
+        }
+    });
+
+    if (!success) {
+        for (auto const & [runBegin, runEnd] : lockedRuns) {
+            unlockPages(runBegin, runEnd);
+        }
+        return false;
+    }
+
+    for (auto page{ begin }; page < end; page += getPageSize()) {
+        ++counts[page];
+    }
+    return true;
+}
+
+//==============================================================================
+/** Unlocks the pages of a locked region that no other locked region includes. */
+void unlockRegion(std::byte const * const data, std::size_t const numBytes) noexcept
+{
+    auto & pageLockCounts{ getPageLockCounts() };
+    std::lock_guard<std::mutex> const lock{ pageLockCounts.mutex };
+    auto & counts{ pageLockCounts.counts };
+    auto const [begin, end] = getPageRange(data, numBytes);
+
+    for (auto page{ begin }; page < end; page += getPageSize()) {
+        auto const count{ counts.find(page) };
+        jassert(count != counts.end());
+        if (count != counts.end() && --count->second == 0) {
+            counts.erase(count);
+        }
+    }
+
+    auto const isUnlocked = [&](std::uintptr_t const page) { return counts.find(page) == counts.end(); };
+    forEachPageRun(begin, end, isUnlocked, unlockPages);
+}
+
+} // namespace
+
+//==============================================================================
+HotMemory::~HotMemory()
+{
+    unlock();
+}
+
+//==============================================================================
+void HotMemory::add(void const * const data, std::size_t const numBytes)
+{
+    if (data == nullptr || numBytes == 0) {
+        return;
+    }
+    // Registering a region does not write to it : only prefault() and lock() touch the memory.
+    mRegions.push_back(Region{ static_cast<std::byte *>(const_cast<void *>(data)), numBytes });
+}
+
+//==============================================================================
+void HotMemory::add(juce::AudioBuffer<float> const & buffer)
+{
+    auto const numBytes{ static_cast<std::size_t>(buffer.getNumSamples()) * sizeof(float) };
+    for (int channel{}; channel < buffer.getNumChannels(); ++channel) {
+        add(buffer.getReadPointer(channel), numBytes);
+    }
+}
+
+//==============================================================================
+void HotMemory::add(AudioSlab const & slab)
+{
+    add(slab.data(), slab.getNumChannels() * slab.getStride() * sizeof(float));
+}
+
+//==============================================================================
+void HotMemory::adviseHugePages() noexcept
+{
+#if JUCE_LINUX
+    for (auto const & region : mRegions) {
+        // Only the whole huge pages inside the region can be advised.
+        auto const begin{ reinterpret_cast<std::uintptr_t>(region.data) };
+        auto const end{ begin + region.numBytes };
+        auto const alignedBegin{ (begin + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE };
+        auto const alignedEnd{ end / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE };
+        if (alignedEnd <= alignedBegin) {
+            continue;
+        }
+        auto const numBytes{ alignedEnd - alignedBegin };
+        if (madvise(reinterpret_cast<void *>(alignedBegin), numBytes, MADV_HUGEPAGE) == 0) {
+            mNumHugePageBytes += numBytes;
+        }
+    }
+#endif
+}
+
+//==============================================================================
+void HotMemory::prefault() const noexcept
+{
+    auto const pageSize{ getPageSize() };
+    for (auto const & region : mRegions) {
+        // Reading a page that was never written to maps the shared zero page : it has to be a write.
+        auto * const end{ region.data + region.numBytes };
+        for (auto * byte{ region.data }; byte < end; byte += pageSize) {
+            auto * const volatileByte{ reinterpret_cast<std::byte volatile *>(byte) };
+            *volatileByte = *volatileByte;
+        }
+        auto * const lastByte{ reinterpret_cast<std::byte volatile *>(end - 1) };
+        *lastByte = *lastByte;
+    }
+}
+
+//==============================================================================
+bool HotMemory::lock() noexcept
+{
+    unlock();
+    auto success{ true };
+    for (auto & region : mRegions) {
+        region.isLocked = lockRegion(region.data, region.numBytes);
+        if (region.isLocked) {
+            mNumLockedBytes += region.numBytes;
+        } else {
+            success = false;
+        }
+    }
+    return success;
+}
+
+//==============================================================================
+void HotMemory::unlock() noexcept
+{
+    for (auto & region : mRegions) {
+        if (region.isLocked) {
+            unlockRegion(region.data, region.numBytes);
+            region.isLocked = false;
+        }
+    }
+    mNumLockedBytes = 0;
+}
+
+//==============================================================================
+void HotMemory::clear() noexcept
+{
+    unlock();
+    mRegions.clear();
+    mNumHugePageBytes = 0;
+}
+
+//==============================================================================
+HotMemory::Report HotMemory::getReport() const
+{
+    Report report{};
+    report.numLockedBytes = mNumLockedBytes;
+    report.numHugePageBytes = mNumHugePageBytes;
+    for (auto const & region : mRegions) {
+        report.numBytes += region.numBytes;
+    }
+
+#if JUCE_LINUX || JUCE_MAC
+    auto const pageSize{ getPageSize() };
+    std::size_t numResidentBytes{};
+    #if JUCE_LINUX
+    std::vector<unsigned char> pages{};
+    #else
+    std::vector<char> pages{};
+    #endif
+    for (auto const & region : mRegions) {
+        // mincore() wants a page-aligned address.
+        auto const begin{ reinterpret_cast<std::uintptr_t>(region.data) };
+        auto const alignedBegin{ begin / pageSize * pageSize };
+        auto const numBytes{ region.numBytes + (begin - alignedBegin) };
+        auto const numPages{ (numBytes + pageSize - 1) / pageSize };
+        pages.resize(numPages);
+        if (mincore(reinterpret_cast<void *>(alignedBegin), numBytes, pages.data()) != 0) {
+            return report;
+        }
+        auto const numResidentPages{ static_cast<std::size_t>(
+            std::count_if(pages.cbegin(), pages.cend(), [](auto const page) { return (page & 1) != 0; })) };
+        // Regions rarely start and end on page boundaries : don't count more than the region itself.
+        numResidentBytes += std::min(numResidentPages * pageSize, region.numBytes);
+    }
+    report.numResidentBytes = numResidentBytes;
+#endif
+
+    return report;
+}
+
+//==============================================================================
+std::size_t HotMemory::getNumLockedPages() noexcept
+{
+    auto & pageLockCounts{ getPageLockCounts() };
+    std::lock_guard<std::mutex> const lock{ pageLockCounts.mutex };
+    return pageLockCounts.counts.size();
+}
+
+} // namespace gris
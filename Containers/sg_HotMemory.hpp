@@ -0,0 +1,109 @@
+/*
+ This file is part of SpatGRIS.
+
+ Developers: Gaël Lane Lépine, Samuel Béland, Olivier Bélanger, Nicolas Masson
+
+ SpatGRIS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ SpatGRIS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with SpatGRIS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "../Data/sg_Macros.hpp"
+#include "sg_AudioSlab.hpp"
+#include "tl/optional.hpp"
+#include <cstddef>
+#include <vector>
+
+namespace gris
+{
+//==============================================================================
+/** The memory regions that the audio thread touches while rendering a block.
+ *
+ * Freshly allocated memory is only backed by physical pages once it is first written to, so the first blocks rendered
+ * by a new algorithm take page faults. Once the regions are listed, prefault() takes these faults ahead of time and
+ * lock() keeps the pages from being swapped out. Locking is limited by RLIMIT_MEMLOCK on Linux and by the working set
+ * size on Windows, so it can fail : the memory is then simply not locked.
+ *
+ * Page locks do not nest in the OS : unlocking a region would also unlock the pages that it shares with other locked
+ * regions, e.g. the ones of the algorithm that replaced this one. Every HotMemory of the process therefore counts the
+ * locks of each page, and a page is only unlocked once the last region that includes it is.
+ */
+class HotMemory
+{
+public:
+    //==============================================================================
+    struct Report {
+        /** The size of the listed regions. */
+        std::size_t numBytes{};
+        /** How much of it is in physical memory right now, or tl::nullopt if the platform cannot tell. */
+        tl::optional<std::size_t> numResidentBytes{};
+        std::size_t numLockedBytes{};
+        /** How much of it was advised to use transparent huge pages. */
+        std::size_t numHugePageBytes{};
+    };
+
+private:
+    //==============================================================================
+    struct Region {
+        std::byte * data{};
+        std::size_t numBytes{};
+        bool isLocked{};
+    };
+    //==============================================================================
+    std::vector<Region> mRegions{};
+    std::size_t mNumLockedBytes{};
+    std::size_t mNumHugePageBytes{};
+
+public:
+    //==============================================================================
+    HotMemory() = default;
+    ~HotMemory();
+    SG_DELETE_COPY_AND_MOVE(HotMemory)
+    //==============================================================================
+    void add(void const * data, std::size_t numBytes);
+    template<typename T>
+    void add(T const & object)
+    {
+        add(&object, sizeof(T));
+    }
+    template<typename T>
+    void add(std::vector<T> const & vector)
+    {
+        add(vector.data(), vector.size() * sizeof(T));
+    }
+    void add(juce::AudioBuffer<float> const & buffer);
+    void add(AudioSlab const & slab);
+    //==============================================================================
+    /** Asks the kernel to back the regions with transparent huge pages. Only does something on Linux. */
+    void adviseHugePages() noexcept;
+    /** Writes to every page of the regions, without changing their content. Nothing else should be writing to them. */
+    void prefault() const noexcept;
+    /** @return true if every region could be locked in physical memory. */
+    bool lock() noexcept;
+    /** Only unlocks the pages that no other locked region includes. */
+    void unlock() noexcept;
+    /** Unlocks and forgets the regions. */
+    void clear() noexcept;
+    //==============================================================================
+    [[nodiscard]] Report getReport() const;
+    /** @return how many pages the HotMemory instances of the process are keeping locked. */
+    [[nodiscard]] static std::size_t getNumLockedPages() noexcept;
+
+private:
+    //==============================================================================
+    JUCE_LEAK_DETECTOR(HotMemory)
+};
+
+} // namespace gris
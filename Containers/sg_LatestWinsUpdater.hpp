@@ -0,0 +1,227 @@
+/*
+ This file is part of SpatGRIS.
+
+ Developers: Gaël Lane Lépine, Samuel Béland, Olivier Bélanger, Nicolas Masson
+
+ SpatGRIS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ SpatGRIS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with SpatGRIS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "../Data/sg_Macros.hpp"
+
+namespace gris
+{
+//==============================================================================
+/** A lock-free multiple-writers/single-reader version of AtomicUpdater.
+ *
+ * Any number of threads (e.g. the OSC thread, the message thread and an automation thread) can push new values
+ * concurrently. The reader always ends up with the value of the write that started last, never with an older one :
+ * every token is stamped with a sequence number when it is acquired, and the most recent token is published as a
+ * single (sequence, index) word, so a slow writer cannot overwrite a newer value and the reader never goes back in
+ * time.
+ *
+ * The interface is the same as AtomicUpdater's. At any time, the reader holds up to two tokens (while it swaps them),
+ * one token is published and every writer holds one token (the one it writes to, or the one its write just replaced) :
+ * CAPACITY has to be at least the maximum number of concurrent writers plus three. The default allows for the OSC
+ * thread, the message thread and one automation thread.
+ */
+template<typename T, size_t CAPACITY = 6>
+class LatestWinsUpdater
+{
+    static_assert(CAPACITY >= 4);
+    static_assert(CAPACITY < 256);
+
+public:
+    static constexpr size_t NUM_TOKENS = CAPACITY;
+    //==============================================================================
+    /** An update token. Use the get() method to access its data. */
+    class Token
+    {
+        friend LatestWinsUpdater;
+
+        // The actual data
+        T mValue{};
+        std::atomic<bool> mIsFree{ true };
+        std::uint64_t mSequence{};
+
+    public:
+        [[nodiscard]] T & get() noexcept { return mValue; }
+        [[nodiscard]] T const & get() const noexcept { return mValue; }
+    };
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+    static_assert(std::atomic<bool>::is_always_lock_free);
+
+private:
+    //==============================================================================
+    // The low byte of a published word holds the token index plus one, the rest holds the sequence number. Zero means
+    // that nothing was published since the last read.
+    static constexpr std::uint64_t INDEX_BITS = 8;
+    static constexpr std::uint64_t INDEX_MASK = (std::uint64_t{ 1 } << INDEX_BITS) - 1;
+    //==============================================================================
+    std::array<Token, CAPACITY> mData{};
+    std::atomic<std::uint64_t> mMostRecent{};
+    std::atomic<std::uint64_t> mNextSequence{ 1 };
+    // Reader only
+    std::uint64_t mReaderSequence{};
+
+public:
+    //==============================================================================
+    LatestWinsUpdater() = default;
+    ~LatestWinsUpdater() = default;
+    SG_DELETE_COPY_AND_MOVE(LatestWinsUpdater)
+    //==============================================================================
+    /** @returns a pointer to a previously unused token, stamped with a new sequence number. Use setMostRecent() to
+     * return the data to the updater after writing to it. Can be called from any number of threads. */
+    Token * acquire() noexcept;
+    /** Updates a local token pointer to the most recently pushed token. Has to be called from a single thread.
+     *
+     * @param[out] tokenToUpdate the token address that should be updated (or not). This has to be nullptr when called
+     * for the first time. Subsequent calls must always pass the token that they got through the last getMostRecent()
+     * call so that the updater knows when the data isn't in use anymore.
+     */
+    void getMostRecent(Token *& tokenToUpdate) noexcept;
+    /** Publishes a token, unless a token that was acquired after it is already published. Can be called from any
+     * number of threads.
+     *
+     * @param newMostRecent the address of a token acquired with acquire() that should replace the reader's token ASAP.
+     */
+    void setMostRecent(Token * newMostRecent) noexcept;
+    /** Calls function(value, tokenIndex) on the value of every token, e.g. to point them to preallocated storage. Has
+     * to be called before the updater is shared with other threads. */
+    template<typename Function>
+    void initializeTokens(Function && function) noexcept;
+
+private:
+    //==============================================================================
+    [[nodiscard]] std::uint64_t pack(Token const & token) const noexcept;
+    [[nodiscard]] Token & getToken(std::uint64_t published) noexcept;
+    [[nodiscard]] static std::uint64_t getSequence(std::uint64_t const published) noexcept
+    {
+        return published >> INDEX_BITS;
+    }
+};
+
+//==============================================================================
+template<typename T, size_t CAPACITY>
+typename LatestWinsUpdater<T, CAPACITY>::Token * LatestWinsUpdater<T, CAPACITY>::acquire() noexcept
+{
+    // Find a free token. A token can be freed right behind the scan while another one gets taken ahead of it, so a
+    // single pass is not enough when every token is in use at some point : try again a few times.
+    static constexpr auto MAX_NUM_PASSES = 64;
+    for (int pass{}; pass < MAX_NUM_PASSES; ++pass) {
+        for (auto & token : mData) {
+            auto expected{ true };
+            if (token.mIsFree.compare_exchange_strong(expected, false)) {
+                token.mSequence = mNextSequence.fetch_add(1);
+                return &token;
+            }
+        }
+    }
+    // More concurrent writers than the capacity allows
+    jassertfalse;
+    return nullptr;
+}
+
+//==============================================================================
+template<typename T, size_t CAPACITY>
+void LatestWinsUpdater<T, CAPACITY>::getMostRecent(Token *& tokenToUpdate) noexcept
+{
+    auto const published{ mMostRecent.exchange(0) };
+    if (published == 0) {
+        // No new token : tokenToUpdate is already the most recent one
+        return;
+    }
+
+    auto & mostRecent{ getToken(published) };
+    jassert(&mostRecent != tokenToUpdate);
+    jassert(!mostRecent.mIsFree.load());
+
+    if (tokenToUpdate != nullptr && getSequence(published) < mReaderSequence) {
+        // A slow writer published after our last read, but its value is older than the one we already have.
+        mostRecent.mIsFree.store(true);
+        return;
+    }
+
+    if (tokenToUpdate) {
+        jassert(!tokenToUpdate->mIsFree.load());
+        tokenToUpdate->mIsFree.store(true);
+    }
+    tokenToUpdate = &mostRecent;
+    mReaderSequence = getSequence(published);
+}
+
+//==============================================================================
+template<typename T, size_t CAPACITY>
+void LatestWinsUpdater<T, CAPACITY>::setMostRecent(Token * newMostRecent) noexcept
+{
+    jassert(newMostRecent);
+    jassert(!newMostRecent->mIsFree.load());
+
+    auto const desired{ pack(*newMostRecent) };
+    auto expected{ mMostRecent.load() };
+    do {
+        if (expected != 0 && getSequence(expected) > newMostRecent->mSequence) {
+            // A newer value is already waiting for the reader : this one is obsolete.
+            newMostRecent->mIsFree.store(true);
+            return;
+        }
+    } while (!mMostRecent.compare_exchange_weak(expected, desired));
+
+    if (expected == 0) {
+        // This was the first token pushed since the last read
+        return;
+    }
+    // This update replaced an unread token: free it
+    auto & replaced{ getToken(expected) };
+    jassert(!replaced.mIsFree.load());
+    replaced.mIsFree.store(true);
+}
+
+//==============================================================================
+template<typename T, size_t CAPACITY>
+template<typename Function>
+void LatestWinsUpdater<T, CAPACITY>::initializeTokens(Function && function) noexcept
+{
+    for (size_t i{}; i < CAPACITY; ++i) {
+        jassert(mData[i].mIsFree.load());
+        function(mData[i].mValue, i);
+    }
+}
+
+//==============================================================================
+template<typename T, size_t CAPACITY>
+std::uint64_t LatestWinsUpdater<T, CAPACITY>::pack(Token const & token) const noexcept
+{
+    auto const index{ static_cast<std::uint64_t>(&token - mData.data()) };
+    jassert(index < CAPACITY);
+    return (token.mSequence << INDEX_BITS) | (index + 1);
+}
+
+//==============================================================================
+template<typename T, size_t CAPACITY>
+typename LatestWinsUpdater<T, CAPACITY>::Token &
+    LatestWinsUpdater<T, CAPACITY>::getToken(std::uint64_t const published) noexcept
+{
+    auto const index{ (published & INDEX_MASK) - 1 };
+    jassert(index < CAPACITY);
+    return mData[static_cast<size_t>(index)];
+}
+
+} // namespace gris
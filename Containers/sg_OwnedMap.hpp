@@ -20,11 +20,14 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include <algorithm>
 #include <array>
 #include <bitset>
 #include <cstddef>
 #include <iterator>
 #include <memory>
+#include <span>
+#include <vector>
 #include "../Data/StrongTypes/sg_StrongIndex.hpp"
 #include "../Data/sg_Macros.hpp"
 
@@ -32,6 +35,8 @@ namespace gris
 {
 //==============================================================================
 /** A heap-allocated fixed-capacity associative map of objects accessed using a strongly-typed index.
+ *
+ * Like StaticMap, the used keys are kept in a sorted, packed array so that iterating costs the number of entries.
  */
 template<typename KeyType, typename ValueType, size_t CAPACITY>
 class OwnedMap
@@ -56,6 +61,8 @@ private:
     //==============================================================================
     std::array<Node, CAPACITY> mData{};
     std::bitset<CAPACITY> mUsed{};
+    std::array<KeyType, CAPACITY> mUsedKeys{};
+    size_t mNumUsed{};
 
 public:
     //==============================================================================
@@ -78,6 +85,13 @@ public:
     [[nodiscard]] bool contains(KeyType const & key) const noexcept;
     [[nodiscard]] KeyType getNextUsedKey(KeyType const & key) const noexcept;
     [[nodiscard]] KeyType getFirstUsedKey() const noexcept;
+    /** @return the used keys, in increasing order. */
+    [[nodiscard]] std::span<KeyType const> getUsedKeys() const noexcept;
+    /** Calls function(key, value) for every entry, in increasing key order. */
+    template<typename Function>
+    void forEach(Function && function);
+    template<typename Function>
+    void forEach(Function && function) const;
     [[nodiscard]] juce::String toString() const noexcept
     {
         juce::String result("(");
@@ -93,12 +107,12 @@ public:
     class iterator
     {
         OwnedMap * mOwnedMap{};
-        KeyType mCurrentKey{};
+        size_t mPosition{};
 
     public:
         //==============================================================================
         iterator() = default;
-        iterator(OwnedMap & map, KeyType key);
+        iterator(OwnedMap & map, size_t position);
         ~iterator() = default;
         SG_DEFAULT_COPY_AND_MOVE(iterator)
         //==============================================================================
@@ -125,12 +139,12 @@ public:
     class const_iterator
     {
         OwnedMap const * mOwnedMap{};
-        KeyType mCurrentKey{};
+        size_t mPosition{};
 
     public:
         //==============================================================================
         const_iterator() = default;
-        const_iterator(OwnedMap const & map, KeyType key);
+        const_iterator(OwnedMap const & map, size_t position);
         ~const_iterator() = default;
         SG_DEFAULT_COPY_AND_MOVE(const_iterator)
         //==============================================================================
@@ -162,6 +176,9 @@ public:
     [[nodiscard]] const_iterator cend() const noexcept;
 
 private:
+    //==============================================================================
+    void addUsedKey(KeyType key) noexcept;
+    void removeUsedKey(KeyType key) noexcept;
     //==============================================================================
     JUCE_LEAK_DETECTOR(OwnedMap)
 };
@@ -189,8 +206,11 @@ OwnedMap<KeyType, ValueType, CAPACITY>::~OwnedMap() noexcept
 template<typename KeyType, typename ValueType, size_t CAPACITY>
 OwnedMap<KeyType, ValueType, CAPACITY>::OwnedMap(OwnedMap && other) noexcept : mData(other.mData)
                                                                              , mUsed(other.mUsed)
+                                                                             , mUsedKeys(other.mUsedKeys)
+                                                                             , mNumUsed(other.mNumUsed)
 {
     other.mUsed.reset();
+    other.mNumUsed = 0;
 }
 
 //==============================================================================
@@ -200,20 +220,19 @@ OwnedMap<KeyType, ValueType, CAPACITY> & OwnedMap<KeyType, ValueType, CAPACITY>:
     clear();
     mData = other.mData;
     mUsed = other.mUsed;
+    mUsedKeys = other.mUsedKeys;
+    mNumUsed = other.mNumUsed;
     other.mUsed.reset();
+    other.mNumUsed = 0;
     return *this;
 }
 
 template<typename KeyType, typename ValueType, size_t Capacity>
 std::vector<KeyType> OwnedMap<KeyType, ValueType, Capacity>::getKeys() const noexcept
 {
-    JUCE_ASSERT_MESSAGE_THREAD;
-    std::vector<KeyType> result{};
-    result.reserve(size());
-    for (auto const & node : *this) {
-        result.push_back(node.key);
-    }
-    return result;
+    SG_ASSERT_BUILDER_THREAD;
+    auto const usedKeys{ getUsedKeys() };
+    return std::vector<KeyType>{ usedKeys.begin(), usedKeys.end() };
 }
 
 //==============================================================================
@@ -237,13 +256,14 @@ void OwnedMap<KeyType, ValueType, CAPACITY>::clear() noexcept
         delete node.value;
     }
     mUsed.reset();
+    mNumUsed = 0;
 }
 
 //==============================================================================
 template<typename KeyType, typename ValueType, size_t CAPACITY>
 int OwnedMap<KeyType, ValueType, CAPACITY>::size() const noexcept
 {
-    return narrow<int>(mUsed.count());
+    return narrow<int>(mNumUsed);
 }
 
 //==============================================================================
@@ -333,6 +353,7 @@ ValueType & OwnedMap<KeyType, ValueType, CAPACITY>::add(KeyType const key, std::
     jassert(mData[index].key == key);
     mData[index].value = value.release();
     mUsed.set(index);
+    addUsedKey(key);
     return *mData[index].value;
 }
 
@@ -345,13 +366,64 @@ void OwnedMap<KeyType, ValueType, CAPACITY>::remove(KeyType const key) noexcept
     jassert(mUsed.test(index));
     delete mData[index].value;
     mUsed.reset(index);
+    removeUsedKey(key);
+}
+
+//==============================================================================
+template<typename KeyType, typename ValueType, size_t CAPACITY>
+std::span<KeyType const> OwnedMap<KeyType, ValueType, CAPACITY>::getUsedKeys() const noexcept
+{
+    return std::span<KeyType const>{ mUsedKeys.data(), mNumUsed };
+}
+
+//==============================================================================
+template<typename KeyType, typename ValueType, size_t CAPACITY>
+template<typename Function>
+void OwnedMap<KeyType, ValueType, CAPACITY>::forEach(Function && function)
+{
+    for (auto const key : getUsedKeys()) {
+        function(key, *mData[toIndex(key)].value);
+    }
+}
+
+//==============================================================================
+template<typename KeyType, typename ValueType, size_t CAPACITY>
+template<typename Function>
+void OwnedMap<KeyType, ValueType, CAPACITY>::forEach(Function && function) const
+{
+    for (auto const key : getUsedKeys()) {
+        function(key, static_cast<ValueType const &>(*mData[toIndex(key)].value));
+    }
+}
+
+//==============================================================================
+template<typename KeyType, typename ValueType, size_t CAPACITY>
+void OwnedMap<KeyType, ValueType, CAPACITY>::addUsedKey(KeyType const key) noexcept
+{
+    jassert(mNumUsed < CAPACITY);
+    auto const end{ mUsedKeys.begin() + narrow<std::ptrdiff_t>(mNumUsed) };
+    auto const position{ std::lower_bound(mUsedKeys.begin(), end, key) };
+    std::move_backward(position, end, end + 1);
+    *position = key;
+    ++mNumUsed;
+}
+
+//==============================================================================
+template<typename KeyType, typename ValueType, size_t CAPACITY>
+void OwnedMap<KeyType, ValueType, CAPACITY>::removeUsedKey(KeyType const key) noexcept
+{
+    auto const end{ mUsedKeys.begin() + narrow<std::ptrdiff_t>(mNumUsed) };
+    auto const position{ std::lower_bound(mUsedKeys.begin(), end, key) };
+    jassert(position != end && *position == key);
+    std::move(position + 1, end, position);
+    --mNumUsed;
 }
 
 //==============================================================================
 template<typename KeyType, typename ValueType, size_t CAPACITY>
-OwnedMap<KeyType, ValueType, CAPACITY>::iterator::iterator(OwnedMap & map, KeyType const key)
+OwnedMap<KeyType, ValueType, CAPACITY>::iterator::iterator(OwnedMap & map, size_t const position)
     : mOwnedMap(&map)
-    , mCurrentKey(key)
+    , mPosition(position)
 {
 }
 
@@ -359,21 +431,21 @@ OwnedMap<KeyType, ValueType, CAPACITY>::iterator::iterator(OwnedMap & map, KeyTy
 template<typename KeyType, typename ValueType, size_t CAPACITY>
 bool OwnedMap<KeyType, ValueType, CAPACITY>::iterator::operator==(iterator const & other) const noexcept
 {
-    return mCurrentKey == other.mCurrentKey;
+    return mPosition == other.mPosition;
 }
 
 //==============================================================================
 template<typename KeyType, typename ValueType, size_t CAPACITY>
 bool OwnedMap<KeyType, ValueType, CAPACITY>::iterator::operator!=(iterator const & other) const noexcept
 {
-    return mCurrentKey != other.mCurrentKey;
+    return mPosition != other.mPosition;
 }
 
 //==============================================================================
 template<typename KeyType, typename ValueType, size_t CAPACITY>
 bool OwnedMap<KeyType, ValueType, CAPACITY>::iterator::operator<(iterator const & other) const noexcept
 {
-    return mCurrentKey < other.mCurrentKey;
+    return mPosition < other.mPosition;
 }
 
 //==============================================================================
@@ -381,7 +453,7 @@ template<typename KeyType, typename ValueType, size_t CAPACITY>
 typename OwnedMap<KeyType, ValueType, CAPACITY>::iterator::reference
     OwnedMap<KeyType, ValueType, CAPACITY>::iterator::operator*()
 {
-    return mOwnedMap->getNode(mCurrentKey);
+    return mOwnedMap->getNode(mOwnedMap->mUsedKeys[mPosition]);
 }
 
 //==============================================================================
@@ -389,7 +461,7 @@ template<typename KeyType, typename ValueType, size_t CAPACITY>
 typename OwnedMap<KeyType, ValueType, CAPACITY>::iterator::reference
     OwnedMap<KeyType, ValueType, CAPACITY>::iterator::operator*() const
 {
-    return mOwnedMap->getNode(mCurrentKey);
+    return mOwnedMap->getNode(mOwnedMap->mUsedKeys[mPosition]);
 }
 
 //==============================================================================
@@ -397,7 +469,7 @@ template<typename KeyType, typename ValueType, size_t CAPACITY>
 typename OwnedMap<KeyType, ValueType, CAPACITY>::iterator::pointer
     OwnedMap<KeyType, ValueType, CAPACITY>::iterator::operator->()
 {
-    return &mOwnedMap->getNode(mCurrentKey);
+    return &mOwnedMap->getNode(mOwnedMap->mUsedKeys[mPosition]);
 }
 
 //==============================================================================
@@ -405,7 +477,7 @@ template<typename KeyType, typename ValueType, size_t CAPACITY>
 typename OwnedMap<KeyType, ValueType, CAPACITY>::iterator::pointer
     OwnedMap<KeyType, ValueType, CAPACITY>::iterator::operator->() const
 {
-    return &mOwnedMap->getNode(mCurrentKey);
+    return &mOwnedMap->getNode(mOwnedMap->mUsedKeys[mPosition]);
 }
 
 //==============================================================================
@@ -413,7 +485,7 @@ template<typename KeyType, typename ValueType, size_t CAPACITY>
 typename OwnedMap<KeyType, ValueType, CAPACITY>::iterator &
     OwnedMap<KeyType, ValueType, CAPACITY>::iterator::operator++() noexcept
 {
-    mCurrentKey = mOwnedMap->getNextUsedKey(mCurrentKey);
+    ++mPosition;
     return *this;
 }
 
@@ -429,9 +501,9 @@ typename OwnedMap<KeyType, ValueType, CAPACITY>::iterator
 
 //==============================================================================
 template<typename KeyType, typename ValueType, size_t CAPACITY>
-OwnedMap<KeyType, ValueType, CAPACITY>::const_iterator::const_iterator(OwnedMap const & map, KeyType const key)
+OwnedMap<KeyType, ValueType, CAPACITY>::const_iterator::const_iterator(OwnedMap const & map, size_t const position)
     : mOwnedMap(&map)
-    , mCurrentKey(key)
+    , mPosition(position)
 {
 }
 
@@ -439,21 +511,21 @@ OwnedMap<KeyType, ValueType, CAPACITY>::const_iterator::const_iterator(OwnedMap
 template<typename KeyType, typename ValueType, size_t CAPACITY>
 bool OwnedMap<KeyType, ValueType, CAPACITY>::const_iterator::operator==(const_iterator const & other) const noexcept
 {
-    return mCurrentKey == other.mCurrentKey;
+    return mPosition == other.mPosition;
 }
 
 //==============================================================================
 template<typename KeyType, typename ValueType, size_t CAPACITY>
 bool OwnedMap<KeyType, ValueType, CAPACITY>::const_iterator::operator!=(const_iterator const & other) const noexcept
 {
-    return mCurrentKey != other.mCurrentKey;
+    return mPosition != other.mPosition;
 }
 
 //==============================================================================
 template<typename KeyType, typename ValueType, size_t CAPACITY>
 bool OwnedMap<KeyType, ValueType, CAPACITY>::const_iterator::operator<(const_iterator const & other) const noexcept
 {
-    return mCurrentKey < other.mCurrentKey;
+    return mPosition < other.mPosition;
 }
 
 //==============================================================================
@@ -461,7 +533,7 @@ template<typename KeyType, typename ValueType, size_t CAPACITY>
 typename OwnedMap<KeyType, ValueType, CAPACITY>::const_iterator::reference
     OwnedMap<KeyType, ValueType, CAPACITY>::const_iterator::operator*()
 {
-    return mOwnedMap->getConstNode(mCurrentKey);
+    return mOwnedMap->getConstNode(mOwnedMap->mUsedKeys[mPosition]);
 }
 
 //==============================================================================
@@ -469,7 +541,7 @@ template<typename KeyType, typename ValueType, size_t CAPACITY>
 typename OwnedMap<KeyType, ValueType, CAPACITY>::const_iterator::reference
     OwnedMap<KeyType, ValueType, CAPACITY>::const_iterator::operator*() const
 {
-    return mOwnedMap->getConstNode(mCurrentKey);
+    return mOwnedMap->getConstNode(mOwnedMap->mUsedKeys[mPosition]);
 }
 
 //==============================================================================
@@ -477,7 +549,7 @@ template<typename KeyType, typename ValueType, size_t CAPACITY>
 typename OwnedMap<KeyType, ValueType, CAPACITY>::const_iterator::pointer
     OwnedMap<KeyType, ValueType, CAPACITY>::const_iterator::operator->()
 {
-    return &mOwnedMap->getConstNode(mCurrentKey);
+    return &mOwnedMap->getConstNode(mOwnedMap->mUsedKeys[mPosition]);
 }
 
 //==============================================================================
@@ -485,7 +557,7 @@ template<typename KeyType, typename ValueType, size_t CAPACITY>
 typename OwnedMap<KeyType, ValueType, CAPACITY>::const_iterator::pointer
     OwnedMap<KeyType, ValueType, CAPACITY>::const_iterator::operator->() const
 {
-    return &mOwnedMap->getConstNode(mCurrentKey);
+    return &mOwnedMap->getConstNode(mOwnedMap->mUsedKeys[mPosition]);
 }
 
 //==============================================================================
@@ -493,7 +565,7 @@ template<typename KeyType, typename ValueType, size_t CAPACITY>
 typename OwnedMap<KeyType, ValueType, CAPACITY>::const_iterator &
     OwnedMap<KeyType, ValueType, CAPACITY>::const_iterator ::operator++() noexcept
 {
-    mCurrentKey = mOwnedMap->getNextUsedKey(mCurrentKey);
+    ++mPosition;
     return *this;
 }
 
@@ -511,14 +583,14 @@ typename OwnedMap<KeyType, ValueType, CAPACITY>::const_iterator
 template<typename KeyType, typename ValueType, size_t CAPACITY>
 typename OwnedMap<KeyType, ValueType, CAPACITY>::iterator OwnedMap<KeyType, ValueType, CAPACITY>::begin() noexcept
 {
-    return iterator{ *this, getFirstUsedKey() };
+    return iterator{ *this, 0 };
 }
 
 //==============================================================================
 template<typename KeyType, typename ValueType, size_t CAPACITY>
 typename OwnedMap<KeyType, ValueType, CAPACITY>::iterator OwnedMap<KeyType, ValueType, CAPACITY>::end() noexcept
 {
-    return iterator{ *this, KeyType{ narrow<typename KeyType::type>(CAPACITY) + KeyType::OFFSET } };
+    return iterator{ *this, mNumUsed };
 }
 
 //==============================================================================
@@ -526,7 +598,7 @@ template<typename KeyType, typename ValueType, size_t CAPACITY>
 typename OwnedMap<KeyType, ValueType, CAPACITY>::const_iterator
     OwnedMap<KeyType, ValueType, CAPACITY>::begin() const noexcept
 {
-    return const_iterator{ *this, getFirstUsedKey() };
+    return const_iterator{ *this, 0 };
 }
 
 //==============================================================================
@@ -534,7 +606,7 @@ template<typename KeyType, typename ValueType, size_t CAPACITY>
 typename OwnedMap<KeyType, ValueType, CAPACITY>::const_iterator
     OwnedMap<KeyType, ValueType, CAPACITY>::end() const noexcept
 {
-    return const_iterator{ *this, KeyType{ narrow<typename KeyType::type>(CAPACITY) + KeyType::OFFSET } };
+    return const_iterator{ *this, mNumUsed };
 }
 
 //==============================================================================
@@ -542,7 +614,7 @@ template<typename KeyType, typename ValueType, size_t CAPACITY>
 typename OwnedMap<KeyType, ValueType, CAPACITY>::const_iterator
     OwnedMap<KeyType, ValueType, CAPACITY>::cbegin() const noexcept
 {
-    return const_iterator{ *this, getFirstUsedKey() };
+    return const_iterator{ *this, 0 };
 }
 
 //==============================================================================
@@ -550,7 +622,7 @@ template<typename KeyType, typename ValueType, size_t CAPACITY>
 typename OwnedMap<KeyType, ValueType, CAPACITY>::const_iterator
     OwnedMap<KeyType, ValueType, CAPACITY>::cend() const noexcept
 {
-    return const_iterator{ *this, KeyType{ narrow<typename KeyType::type>(CAPACITY) + KeyType::OFFSET } };
+    return const_iterator{ *this, mNumUsed };
 }
 
 } // namespace gris
@@ -0,0 +1,165 @@
+/*
+ This file is part of SpatGRIS.
+
+ Developers: Gaël Lane Lépine, Samuel Béland, Olivier Bélanger, Nicolas Masson
+
+ SpatGRIS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ SpatGRIS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with SpatGRIS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "../Data/sg_Macros.hpp"
+
+namespace gris
+{
+//==============================================================================
+/** A single-writer/single-reader version of AtomicUpdater for small trivially copyable values.
+ *
+ * The published value lives in a single slot guarded by a sequence number : the writer makes the sequence odd, copies
+ * the value in and makes it even again. The reader copies the value out and keeps it only if the sequence did not move
+ * in the meantime. There are no tokens to scan for, and nothing to free.
+ *
+ * The reader never waits for the writer : when its copy is torn a few times in a row (e.g. if the writer was preempted
+ * in the middle of a write), it keeps its previous value and gets the new one on its next call. Copying is done one
+ * word at a time, so keep the payload small (a few floats, like DopplerSpatData) : larger payloads are better served
+ * by a TripleBuffer.
+ *
+ * The interface is the same as AtomicUpdater's.
+ */
+template<typename T>
+class SeqLock
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    static_assert(std::is_default_constructible_v<T>);
+    static constexpr auto MAX_NUM_READ_ATTEMPTS = 4;
+    static constexpr size_t NUM_WORDS = (sizeof(T) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+
+public:
+    //==============================================================================
+    /** An update token. Use the get() method to access its data. */
+    class Token
+    {
+        friend SeqLock;
+
+        // The actual data
+        T mValue{};
+
+    public:
+        [[nodiscard]] T & get() noexcept { return mValue; }
+        [[nodiscard]] T const & get() const noexcept { return mValue; }
+    };
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+
+private:
+    //==============================================================================
+    using Words = std::array<std::uint64_t, NUM_WORDS>;
+    //==============================================================================
+    // Odd while a write is in progress. Zero means that nothing was ever published.
+    std::atomic<std::uint64_t> mSequence{};
+    std::array<std::atomic<std::uint64_t>, NUM_WORDS> mWords{};
+    // Writer only
+    Token mWriterToken{};
+    // Reader only
+    Token mReaderToken{};
+    std::uint64_t mReaderSequence{};
+
+public:
+    //==============================================================================
+    SeqLock() = default;
+    ~SeqLock() = default;
+    SG_DELETE_COPY_AND_MOVE(SeqLock)
+    //==============================================================================
+    /** @returns the writer's token. Use setMostRecent() to publish the data after writing to it. Never fails. */
+    Token * acquire() noexcept;
+    /** Updates a local token pointer to the most recently pushed value.
+     *
+     * @param[out] tokenToUpdate the token address that should be updated (or not). This has to be nullptr when called
+     * for the first time. Subsequent calls must always pass the token that they got through the last getMostRecent()
+     * call.
+     */
+    void getMostRecent(Token *& tokenToUpdate) noexcept;
+    /** Publishes the writer's token.
+     *
+     * @param newMostRecent the address of the token returned by acquire().
+     */
+    void setMostRecent(Token * newMostRecent) noexcept;
+};
+
+//==============================================================================
+template<typename T>
+typename SeqLock<T>::Token * SeqLock<T>::acquire() noexcept
+{
+    return &mWriterToken;
+}
+
+//==============================================================================
+template<typename T>
+void SeqLock<T>::getMostRecent(Token *& tokenToUpdate) noexcept
+{
+    jassert(tokenToUpdate == nullptr || tokenToUpdate == &mReaderToken);
+
+    for (int attempt{}; attempt < MAX_NUM_READ_ATTEMPTS; ++attempt) {
+        auto const sequence{ mSequence.load(std::memory_order_acquire) };
+        if (sequence == mReaderSequence) {
+            // No new value : tokenToUpdate is already the most recent one
+            return;
+        }
+        if (sequence % 2 != 0) {
+            // A write is in progress
+            continue;
+        }
+
+        // Acquiring every word keeps the second load of the sequence after them.
+        Words words;
+        for (size_t i{}; i < NUM_WORDS; ++i) {
+            words[i] = mWords[i].load(std::memory_order_acquire);
+        }
+        if (mSequence.load(std::memory_order_relaxed) != sequence) {
+            // Torn read
+            continue;
+        }
+
+        std::memcpy(&mReaderToken.mValue, words.data(), sizeof(T));
+        mReaderSequence = sequence;
+        tokenToUpdate = &mReaderToken;
+        return;
+    }
+}
+
+//==============================================================================
+template<typename T>
+void SeqLock<T>::setMostRecent(Token * newMostRecent) noexcept
+{
+    jassert(newMostRecent == &mWriterToken);
+
+    Words words{};
+    std::memcpy(words.data(), &newMostRecent->mValue, sizeof(T));
+
+    auto const sequence{ mSequence.load(std::memory_order_relaxed) };
+    mSequence.store(sequence + 1, std::memory_order_relaxed);
+    // Releasing every word makes the odd sequence visible to any reader that sees one of them.
+    for (size_t i{}; i < NUM_WORDS; ++i) {
+        mWords[i].store(words[i], std::memory_order_release);
+    }
+    mSequence.store(sequence + 2, std::memory_order_release);
+}
+
+} // namespace gris
@@ -0,0 +1,50 @@
+/*
+ This file is part of SpatGRIS.
+
+ Developers: Gaël Lane Lépine, Samuel Béland, Olivier Bélanger, Nicolas Masson
+
+ SpatGRIS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ SpatGRIS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with SpatGRIS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+#include "sg_SeqLock.hpp"
+#include "sg_TripleBuffer.hpp"
+
+namespace gris
+{
+//==============================================================================
+/** Payloads up to this size go through a SeqLock by default : two cache lines, or 16 floats. */
+constexpr std::size_t SEQLOCK_MAX_PAYLOAD_BYTES = 128;
+
+//==============================================================================
+/** Chooses the single-writer/single-reader updater of a payload type.
+ *
+ * Small trivially copyable values use a SeqLock, everything else uses a TripleBuffer. Specialize this for a payload
+ * type to override the choice.
+ */
+template<typename T>
+struct SnapshotUpdaterSelector {
+    using type = std::conditional_t<std::is_trivially_copyable_v<T> && sizeof(T) <= SEQLOCK_MAX_PAYLOAD_BYTES,
+                                    SeqLock<T>,
+                                    TripleBuffer<T>>;
+};
+
+/** The cheapest replacement for an AtomicUpdater<T> that only ever has one writer. */
+template<typename T>
+using SnapshotUpdater = typename SnapshotUpdaterSelector<T>::type;
+
+} // namespace gris
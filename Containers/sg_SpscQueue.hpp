@@ -0,0 +1,113 @@
+/*
+ This file is part of SpatGRIS.
+
+ Developers: Gaël Lane Lépine, Samuel Béland, Olivier Bélanger, Nicolas Masson
+
+ SpatGRIS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ SpatGRIS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with SpatGRIS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <cstddef>
+#include "../Data/sg_Macros.hpp"
+
+namespace gris
+{
+//==============================================================================
+/** A lock-free, fixed-capacity, single-producer/single-consumer queue.
+ *
+ * Unlike an AtomicUpdater, every pushed value reaches the reader, in order. Nothing allocates once the queue is
+ * constructed, so both ends can be used from the audio thread.
+ */
+template<typename T, size_t CAPACITY>
+class SpscQueue
+{
+    // An AbstractFifo always keeps one slot free.
+    std::array<T, CAPACITY + 1> mData{};
+    juce::AbstractFifo mFifo{ static_cast<int>(CAPACITY + 1) };
+
+public:
+    //==============================================================================
+    SpscQueue() = default;
+    ~SpscQueue() = default;
+    SG_DELETE_COPY_AND_MOVE(SpscQueue)
+    //==============================================================================
+    /** Writer side. @return false if the queue is full, in which case the value is dropped. */
+    [[nodiscard]] bool push(T const & value) noexcept;
+    /** Reader side. @return the oldest value, or nullptr if the queue is empty. Stays valid until pop(). */
+    [[nodiscard]] T const * peek() const noexcept;
+    /** Reader side. Removes the oldest value. The queue must not be empty. */
+    void pop() noexcept;
+    //==============================================================================
+    [[nodiscard]] bool isEmpty() const noexcept;
+    [[nodiscard]] size_t getNumFreeSlots() const noexcept;
+    [[nodiscard]] static constexpr size_t getCapacity() noexcept { return CAPACITY; }
+
+private:
+    //==============================================================================
+    JUCE_LEAK_DETECTOR(SpscQueue)
+};
+
+//==============================================================================
+template<typename T, size_t CAPACITY>
+bool SpscQueue<T, CAPACITY>::push(T const & value) noexcept
+{
+    auto const scope{ mFifo.write(1) };
+    if (scope.blockSize1 == 0) {
+        return false;
+    }
+    mData[static_cast<size_t>(scope.startIndex1)] = value;
+    return true;
+}
+
+//==============================================================================
+template<typename T, size_t CAPACITY>
+T const * SpscQueue<T, CAPACITY>::peek() const noexcept
+{
+    int start1{};
+    int size1{};
+    int start2{};
+    int size2{};
+    mFifo.prepareToRead(1, start1, size1, start2, size2);
+    if (size1 == 0) {
+        return nullptr;
+    }
+    return &mData[static_cast<size_t>(start1)];
+}
+
+//==============================================================================
+template<typename T, size_t CAPACITY>
+void SpscQueue<T, CAPACITY>::pop() noexcept
+{
+    jassert(!isEmpty());
+    mFifo.finishedRead(1);
+}
+
+//==============================================================================
+template<typename T, size_t CAPACITY>
+bool SpscQueue<T, CAPACITY>::isEmpty() const noexcept
+{
+    return mFifo.getNumReady() == 0;
+}
+
+//==============================================================================
+template<typename T, size_t CAPACITY>
+size_t SpscQueue<T, CAPACITY>::getNumFreeSlots() const noexcept
+{
+    return static_cast<size_t>(mFifo.getFreeSpace());
+}
+
+} // namespace gris
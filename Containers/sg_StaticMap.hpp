@@ -25,6 +25,7 @@
 #include <bitset>
 #include <cstddef>
 #include <iterator>
+#include <span>
 #include <vector>
 #include "../Data/StrongTypes/sg_StrongIndex.hpp"
 #include "../Data/sg_Macros.hpp"
@@ -35,6 +36,9 @@ namespace gris
 /** A stack-allocated fixed-capacity associative map of objects accessed using a strongly-typed index.
  *
  * Values have to be trivial since the destructor is sometimes omitted.
+ *
+ * The used keys are also kept in a sorted, packed array so that iterating costs the number of entries rather than the
+ * capacity.
  */
 template<typename KeyType, typename ValueType, size_t Capacity>
 class StaticMap
@@ -58,6 +62,8 @@ private:
     //==============================================================================
     std::array<Node, CAPACITY> mData{};
     std::bitset<CAPACITY> mUsed{};
+    std::array<KeyType, CAPACITY> mUsedKeys{};
+    size_t mNumUsed{};
 
 public:
     //==============================================================================
@@ -87,10 +93,6 @@ public:
         //==============================================================================
         [[nodiscard]] bool operator==(iterator const & other) const;
         [[nodiscard]] bool operator!=(iterator const & other) const;
-
-    private:
-        //==============================================================================
-        void skipUntilValid();
     };
 
     //==============================================================================
@@ -120,10 +122,6 @@ public:
         //==============================================================================
         [[nodiscard]] bool operator==(const_iterator const & other) const;
         [[nodiscard]] bool operator!=(const_iterator const & other) const;
-
-    private:
-        //==============================================================================
-        void skipUntilValid();
     };
     friend const_iterator;
     //==============================================================================
@@ -144,6 +142,13 @@ public:
     [[nodiscard]] bool hasSameKeys(StaticMap const & other) const noexcept;
     [[nodiscard]] ValueType & operator[](KeyType key);
     [[nodiscard]] ValueType const & operator[](KeyType key) const;
+    /** @return the used keys, in increasing order. */
+    [[nodiscard]] std::span<KeyType const> getUsedKeys() const noexcept;
+    /** Calls function(key, value) for every entry, in increasing key order. */
+    template<typename Function>
+    void forEach(Function && function);
+    template<typename Function>
+    void forEach(Function && function) const;
     //==============================================================================
     [[nodiscard]] iterator begin();
     [[nodiscard]] iterator end();
@@ -157,6 +162,10 @@ private:
     [[nodiscard]] size_t toIndex(KeyType key) const;
     [[nodiscard]] Node & operator[](size_t index);
     [[nodiscard]] Node const & operator[](size_t index) const;
+    [[nodiscard]] Node & getUsedNode(size_t position);
+    [[nodiscard]] Node const & getUsedNode(size_t position) const;
+    void addUsedKey(KeyType key);
+    void removeUsedKey(KeyType key);
 };
 
 //==============================================================================
@@ -165,7 +174,6 @@ StaticMap<KeyType, ValueType, Capacity>::iterator::iterator(StaticMap & manager,
     : mManager(manager)
     , mIndex(index)
 {
-    skipUntilValid();
 }
 
 //==============================================================================
@@ -173,7 +181,7 @@ template<typename KeyType, typename ValueType, size_t Capacity>
 typename StaticMap<KeyType, ValueType, Capacity>::iterator::reference
     StaticMap<KeyType, ValueType, Capacity>::iterator ::operator*() const
 {
-    return mManager[mIndex];
+    return mManager.getUsedNode(mIndex);
 }
 
 //==============================================================================
@@ -181,7 +189,7 @@ template<typename KeyType, typename ValueType, size_t Capacity>
 typename StaticMap<KeyType, ValueType, Capacity>::iterator::pointer
     StaticMap<KeyType, ValueType, Capacity>::iterator::operator->()
 {
-    return &mManager[mIndex];
+    return &mManager.getUsedNode(mIndex);
 }
 
 //==============================================================================
@@ -190,7 +198,6 @@ typename StaticMap<KeyType, ValueType, Capacity>::iterator &
     StaticMap<KeyType, ValueType, Capacity>::iterator::operator++()
 {
     ++mIndex;
-    skipUntilValid();
     return *this;
 }
 
@@ -218,23 +225,12 @@ bool StaticMap<KeyType, ValueType, Capacity>::iterator::operator!=(iterator cons
     return mIndex != other.mIndex;
 }
 
-//==============================================================================
-template<typename KeyType, typename ValueType, size_t Capacity>
-void StaticMap<KeyType, ValueType, Capacity>::iterator::skipUntilValid()
-{
-    while (mIndex < CAPACITY && !mManager.mUsed.test(mIndex)) {
-        ++mIndex;
-    }
-    mIndex = std::min(mIndex, CAPACITY);
-}
-
 //==============================================================================
 template<typename KeyType, typename ValueType, size_t Capacity>
 StaticMap<KeyType, ValueType, Capacity>::const_iterator::const_iterator(StaticMap const & manager, size_t const index)
     : mManager(manager)
     , mIndex(index)
 {
-    skipUntilValid();
 }
 
 //==============================================================================
@@ -242,7 +238,7 @@ template<typename KeyType, typename ValueType, size_t Capacity>
 typename StaticMap<KeyType, ValueType, Capacity>::const_iterator::reference
     StaticMap<KeyType, ValueType, Capacity>::const_iterator::operator*() const
 {
-    return mManager[mIndex];
+    return mManager.getUsedNode(mIndex);
 }
 
 //==============================================================================
@@ -250,7 +246,7 @@ template<typename KeyType, typename ValueType, size_t Capacity>
 typename StaticMap<KeyType, ValueType, Capacity>::const_iterator::pointer
     StaticMap<KeyType, ValueType, Capacity>::const_iterator::operator->()
 {
-    return &mManager[mIndex];
+    return &mManager.getUsedNode(mIndex);
 }
 
 //==============================================================================
@@ -259,7 +255,6 @@ typename StaticMap<KeyType, ValueType, Capacity>::const_iterator &
     StaticMap<KeyType, ValueType, Capacity>::const_iterator::operator++()
 {
     ++mIndex;
-    skipUntilValid();
     return *this;
 }
 
@@ -287,15 +282,6 @@ bool StaticMap<KeyType, ValueType, Capacity>::const_iterator::operator!=(const_i
     return mIndex != other.mIndex;
 }
 
-//==============================================================================
-template<typename KeyType, typename ValueType, size_t Capacity>
-void StaticMap<KeyType, ValueType, Capacity>::const_iterator::skipUntilValid()
-{
-    while (mIndex < Capacity && !mManager.mUsed.test(mIndex)) {
-        ++mIndex;
-    }
-}
-
 //==============================================================================
 template<typename KeyType, typename ValueType, size_t Capacity>
 StaticMap<KeyType, ValueType, Capacity>::StaticMap()
@@ -310,14 +296,14 @@ StaticMap<KeyType, ValueType, Capacity>::StaticMap()
 template<typename KeyType, typename ValueType, size_t Capacity>
 bool StaticMap<KeyType, ValueType, Capacity>::isEmpty() const
 {
-    return mUsed.none();
+    return mNumUsed == 0;
 }
 
 //==============================================================================
 template<typename KeyType, typename ValueType, size_t Capacity>
 size_t StaticMap<KeyType, ValueType, Capacity>::size() const
 {
-    return mUsed.count();
+    return mNumUsed;
 }
 
 //==============================================================================
@@ -325,6 +311,7 @@ template<typename KeyType, typename ValueType, size_t Capacity>
 void StaticMap<KeyType, ValueType, Capacity>::clear()
 {
     mUsed.reset();
+    mNumUsed = 0;
 }
 
 //==============================================================================
@@ -339,6 +326,7 @@ void StaticMap<KeyType, ValueType, Capacity>::add(KeyType const key, ValueType c
     jassert(node.key == key);
     node.value = value;
     mUsed.set(index);
+    addUsedKey(key);
 }
 
 //==============================================================================
@@ -349,6 +337,7 @@ void StaticMap<KeyType, ValueType, Capacity>::add(KeyType const key)
     jassert(!mUsed.test(index));
     jassert(mData[index].key == key);
     mUsed.set(index);
+    addUsedKey(key);
 }
 
 //==============================================================================
@@ -358,43 +347,38 @@ void StaticMap<KeyType, ValueType, Capacity>::remove(KeyType const key)
     auto const index{ toIndex(key) };
     jassert(mUsed.test(index));
     mUsed.set(index, false);
+    removeUsedKey(key);
 }
 
 //==============================================================================
 template<typename KeyType, typename ValueType, size_t Capacity>
 void StaticMap<KeyType, ValueType, Capacity>::fill(KeyType firstKey, ValueType const & value)
 {
-    for (auto & node : mData) {
+    for (size_t index{}; index < CAPACITY; ++index) {
+        auto & node{ mData[index] };
         node.key = firstKey++;
         node.value = value;
+        mUsedKeys[index] = node.key;
     }
     mUsed.set();
+    mNumUsed = CAPACITY;
 }
 
 //==============================================================================
 template<typename KeyType, typename ValueType, size_t Capacity>
 juce::Array<KeyType> StaticMap<KeyType, ValueType, Capacity>::getKeys() const noexcept
 {
-    JUCE_ASSERT_MESSAGE_THREAD;
-    juce::Array<KeyType> result{};
-    result.ensureStorageAllocated(narrow<int>(size()));
-    for (auto const & node : *this) {
-        result.add(node.key);
-    }
-    return result;
+    SG_ASSERT_BUILDER_THREAD;
+    return juce::Array<KeyType>{ mUsedKeys.data(), narrow<int>(mNumUsed) };
 }
 
 //==============================================================================
 template<typename KeyType, typename ValueType, size_t Capacity>
 std::vector<KeyType> StaticMap<KeyType, ValueType, Capacity>::getKeyVector() const noexcept
 {
-    JUCE_ASSERT_MESSAGE_THREAD;
-    std::vector<KeyType> result{};
-    result.reserve(size());
-    for (auto const & node : *this) {
-        result.push_back(node.key);
-    }
-    return result;
+    SG_ASSERT_BUILDER_THREAD;
+    auto const usedKeys{ getUsedKeys() };
+    return std::vector<KeyType>{ usedKeys.begin(), usedKeys.end() };
 }
 
 //==============================================================================
@@ -430,6 +414,35 @@ ValueType const & StaticMap<KeyType, ValueType, Capacity>::operator[](KeyType co
     return mData[index].value;
 }
 
+//==============================================================================
+template<typename KeyType, typename ValueType, size_t Capacity>
+std::span<KeyType const> StaticMap<KeyType, ValueType, Capacity>::getUsedKeys() const noexcept
+{
+    return std::span<KeyType const>{ mUsedKeys.data(), mNumUsed };
+}
+
+//==============================================================================
+template<typename KeyType, typename ValueType, size_t Capacity>
+template<typename Function>
+void StaticMap<KeyType, ValueType, Capacity>::forEach(Function && function)
+{
+    for (size_t position{}; position < mNumUsed; ++position) {
+        auto & node{ getUsedNode(position) };
+        function(node.key, node.value);
+    }
+}
+
+//==============================================================================
+template<typename KeyType, typename ValueType, size_t Capacity>
+template<typename Function>
+void StaticMap<KeyType, ValueType, Capacity>::forEach(Function && function) const
+{
+    for (size_t position{}; position < mNumUsed; ++position) {
+        auto const & node{ getUsedNode(position) };
+        function(node.key, node.value);
+    }
+}
+
 //==============================================================================
 template<typename KeyType, typename ValueType, size_t Capacity>
 typename StaticMap<KeyType, ValueType, Capacity>::iterator StaticMap<KeyType, ValueType, Capacity>::begin()
@@ -441,7 +454,7 @@ typename StaticMap<KeyType, ValueType, Capacity>::iterator StaticMap<KeyType, Va
 template<typename KeyType, typename ValueType, size_t Capacity>
 typename StaticMap<KeyType, ValueType, Capacity>::iterator StaticMap<KeyType, ValueType, Capacity>::end()
 {
-    return iterator{ *this, CAPACITY };
+    return iterator{ *this, mNumUsed };
 }
 
 //==============================================================================
@@ -455,7 +468,7 @@ typename StaticMap<KeyType, ValueType, Capacity>::const_iterator StaticMap<KeyTy
 template<typename KeyType, typename ValueType, size_t Capacity>
 typename StaticMap<KeyType, ValueType, Capacity>::const_iterator StaticMap<KeyType, ValueType, Capacity>::end() const
 {
-    return const_iterator{ *this, CAPACITY };
+    return const_iterator{ *this, mNumUsed };
 }
 
 //==============================================================================
@@ -469,7 +482,7 @@ typename StaticMap<KeyType, ValueType, Capacity>::const_iterator StaticMap<KeyTy
 template<typename KeyType, typename ValueType, size_t Capacity>
 typename StaticMap<KeyType, ValueType, Capacity>::const_iterator StaticMap<KeyType, ValueType, Capacity>::cend() const
 {
-    return const_iterator{ *this, CAPACITY };
+    return const_iterator{ *this, mNumUsed };
 }
 
 //==============================================================================
@@ -499,4 +512,45 @@ typename StaticMap<KeyType, ValueType, Capacity>::Node const &
     return mData[index];
 }
 
+//==============================================================================
+template<typename KeyType, typename ValueType, size_t Capacity>
+typename StaticMap<KeyType, ValueType, Capacity>::Node &
+    StaticMap<KeyType, ValueType, Capacity>::getUsedNode(size_t const position)
+{
+    jassert(position < mNumUsed);
+    return mData[toIndex(mUsedKeys[position])];
+}
+
+//==============================================================================
+template<typename KeyType, typename ValueType, size_t Capacity>
+typename StaticMap<KeyType, ValueType, Capacity>::Node const &
+    StaticMap<KeyType, ValueType, Capacity>::getUsedNode(size_t const position) const
+{
+    jassert(position < mNumUsed);
+    return mData[toIndex(mUsedKeys[position])];
+}
+
+//==============================================================================
+template<typename KeyType, typename ValueType, size_t Capacity>
+void StaticMap<KeyType, ValueType, Capacity>::addUsedKey(KeyType const key)
+{
+    jassert(mNumUsed < CAPACITY);
+    auto const end{ mUsedKeys.begin() + narrow<std::ptrdiff_t>(mNumUsed) };
+    auto const position{ std::lower_bound(mUsedKeys.begin(), end, key) };
+    std::move_backward(position, end, end + 1);
+    *position = key;
+    ++mNumUsed;
+}
+
+//==============================================================================
+template<typename KeyType, typename ValueType, size_t Capacity>
+void StaticMap<KeyType, ValueType, Capacity>::removeUsedKey(KeyType const key)
+{
+    auto const end{ mUsedKeys.begin() + narrow<std::ptrdiff_t>(mNumUsed) };
+    auto const position{ std::lower_bound(mUsedKeys.begin(), end, key) };
+    jassert(position != end && *position == key);
+    std::move(position + 1, end, position);
+    --mNumUsed;
+}
+
 } // namespace gris
@@ -21,10 +21,17 @@
 
 #include <JuceHeader.h>
 #include "Data/StrongTypes/sg_OutputPatch.hpp"
+#include "sg_AudioSlab.hpp"
 #include "sg_OwnedMap.hpp"
 #include "sg_StaticVector.hpp"
+#include <array>
+#include <atomic>
+#include <bit>
+#include <bitset>
 #include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <utility>
 #include "../Data/StrongTypes/sg_SourceIndex.hpp"
 #include "../Data/sg_constants.hpp"
 
@@ -33,7 +40,15 @@ namespace gris
 //==============================================================================
 /** Holds multiple audio buffers that can be accessed using a strongly typed index value.
  *
- * Note that all buffers are mono.
+ * Note that all buffers are mono. Their samples live in a single AudioSlab : the juce::AudioBuffers only refer to it.
+ * Kernels that don't need the key-based API can use getRawChannels() instead.
+ *
+ * The channels that were accessed for writing since the last silence() are tracked. silence() only clears those and
+ * copyToPhysicalOutput() zero-fills the others instead of copying them. Hosts can also use isDirty() to skip them.
+ *
+ * For the duration of a block, channels can also be bound to memory owned by someone else (typically the host's input
+ * or output channels). The algorithms then read and write the host's memory directly and no copy is needed. Memory that
+ * must not be written to (the host's inputs) is bound read-only.
  */
 template<typename KeyType, size_t Capacity>
 class TaggedAudioBuffer
@@ -48,52 +63,183 @@ private:
     //==============================================================================
     using container_type = OwnedMap<key_type, value_type, Capacity>;
     container_type mBuffers{};
+    AudioSlab mSlab{};
+    /** The channels' samples, indexed by key. nullptr for keys that are not in use. */
+    std::array<float *, Capacity> mChannels{};
+    /** Where the channels are in the slab, indexed by key. Differs from mChannels only for the bound channels. */
+    std::array<float *, Capacity> mSlabChannels{};
+    std::bitset<Capacity> mBoundChannels{};
+    /** The bound channels that refer to memory that must never be written to. */
+    std::bitset<Capacity> mReadOnlyChannels{};
+    /** One bit per key. Words rather than a std::bitset so that they can be marked concurrently. */
+    std::array<std::uint64_t, (Capacity + 63) / 64> mDirtyChannels{};
     int mNumSamples{};
 
 public:
     //==============================================================================
-    using iterator = typename container_type::iterator;
     using const_iterator = typename container_type::const_iterator;
     //==============================================================================
-    void init(juce::Array<key_type> const & channels)
+    void init(juce::Array<key_type> const & channels, bool const useHugePages = false)
     {
-        JUCE_ASSERT_MESSAGE_THREAD;
+        SG_ASSERT_BUILDER_THREAD;
         jassert(channels.size() <= narrow<int>(CAPACITY));
 
         mBuffers.clear();
+        mChannels.fill(nullptr);
+        mSlabChannels.fill(nullptr);
+        mBoundChannels.reset();
+        mReadOnlyChannels.reset();
+        mDirtyChannels.fill(0);
+        mSlab.allocate(narrow<std::size_t>(channels.size()), MAX_NUM_SAMPLES, useHugePages);
+
+        std::size_t slabIndex{};
         for (auto const key : channels) {
-            mBuffers.add(key, std::make_unique<juce::AudioBuffer<float>>(1, MAX_NUM_SAMPLES));
-            mBuffers[key].clear();
+            auto & channel{ mChannels[getIndex(key)] };
+            channel = mSlab.getChannel(slabIndex++);
+            mSlabChannels[getIndex(key)] = channel;
+            mBuffers.add(key, std::make_unique<juce::AudioBuffer<float>>(&channel, 1, MAX_NUM_SAMPLES));
         }
     }
     //==============================================================================
+    /** Does not allocate : the buffers are only made to refer to a shorter part of their slab channel. */
     void setNumSamples(int const numSamples)
     {
         JUCE_ASSERT_MESSAGE_THREAD;
         jassert(numSamples <= MAX_NUM_SAMPLES);
+        jassert(mBoundChannels.none());
         mNumSamples = numSamples;
         for (auto buffer : mBuffers) {
-            buffer.value->setSize(1, numSamples);
+            buffer.value->setDataToReferTo(&mChannels[getIndex(buffer.key)], 1, numSamples);
+        }
+    }
+    //==============================================================================
+    /** Makes a channel use externally owned memory until unbindAll() is called. Does not allocate.
+     *
+     * The memory has to hold at least getNumSamples() samples. The algorithms will write to it.
+     */
+    void bind(key_type const key, float * const externalChannel) noexcept { bind(key, externalChannel, false); }
+    //==============================================================================
+    /** Same as above, for memory that must not be written to, such as the host's inputs.
+     *
+     * Only sources should be bound this way : the algorithms never write to their sources buffer. The mutable accessors
+     * assert that they are not used on such a channel and silence() gives the channel its own memory back instead of
+     * clearing it.
+     */
+    void bind(key_type const key, float const * const externalChannel) noexcept
+    {
+        // juce::AudioBuffer only refers to mutable memory : the constness is enforced by mReadOnlyChannels instead.
+        bind(key, const_cast<float *>(externalChannel), true);
+    }
+    //==============================================================================
+    /** Binds every channel to externalChannels[key - OFFSET], for the keys that fit in numExternalChannels. */
+    void bindAll(float * const * externalChannels, int const numExternalChannels) noexcept
+    {
+        for (auto buffer : mBuffers) {
+            auto const index{ getIndex(buffer.key) };
+            if (index < narrow<std::size_t>(numExternalChannels)) {
+                bind(buffer.key, externalChannels[index]);
+            }
         }
     }
     //==============================================================================
+    /** Read-only version of bindAll(). */
+    void bindAll(float const * const * externalChannels, int const numExternalChannels) noexcept
+    {
+        for (auto buffer : mBuffers) {
+            auto const index{ getIndex(buffer.key) };
+            if (index < narrow<std::size_t>(numExternalChannels)) {
+                bind(buffer.key, externalChannels[index]);
+            }
+        }
+    }
+    //==============================================================================
+    /** Gives their own memory back to the bound channels. Should be called at the end of the block. */
+    void unbindAll() noexcept
+    {
+        if (mBoundChannels.none()) {
+            return;
+        }
+        for (auto buffer : mBuffers) {
+            auto const index{ getIndex(buffer.key) };
+            if (mBoundChannels.test(index)) {
+                unbind(index, *buffer.value);
+                // Whatever was left in the slab channel before it got bound was never cleared.
+                markDirty(index);
+            }
+        }
+        jassert(mBoundChannels.none());
+    }
+    //==============================================================================
+    [[nodiscard]] bool isBound(key_type const key) const noexcept { return mBoundChannels.test(getIndex(key)); }
+    [[nodiscard]] bool isReadOnly(key_type const key) const noexcept { return mReadOnlyChannels.test(getIndex(key)); }
+    //==============================================================================
     [[nodiscard]] bool contains(key_type const key) const noexcept { return mBuffers.contains(key); }
     //==============================================================================
     [[nodiscard]] int size() const { return mBuffers.size(); }
     //==============================================================================
+    /** Clears the dirty channels. */
     void silence()
     {
-        for (auto buffer : mBuffers) {
-            buffer.value->clear();
+        for (std::size_t wordIndex{}; wordIndex < mDirtyChannels.size(); ++wordIndex) {
+            auto word{ std::exchange(mDirtyChannels[wordIndex], std::uint64_t{}) };
+            while (word != 0) {
+                auto const index{ wordIndex * 64 + narrow<std::size_t>(std::countr_zero(word)) };
+                word &= word - 1;
+                clear(index);
+            }
         }
     }
     //==============================================================================
-    void silence(key_type const channel) { (*this)[channel].clear(); }
+    void silence(key_type const channel)
+    {
+        auto const index{ getIndex(channel) };
+        mDirtyChannels[index / 64] &= ~(std::uint64_t{ 1 } << (index % 64));
+        clear(index);
+    }
+    //==============================================================================
+    /** @return false if the channel is known to be silent. */
+    [[nodiscard]] bool isDirty(key_type const key) const noexcept
+    {
+        auto const index{ getIndex(key) };
+        return (mDirtyChannels[index / 64] & (std::uint64_t{ 1 } << (index % 64))) != 0;
+    }
     //==============================================================================
-    [[nodiscard]] value_type & operator[](key_type const key) { return mBuffers[key]; }
+    /** Marks the channel as dirty : use the const overload for read-only access. */
+    [[nodiscard]] value_type & operator[](key_type const key)
+    {
+        jassert(!isReadOnly(key));
+        markDirty(getIndex(key));
+        return mBuffers[key];
+    }
     //==============================================================================
     [[nodiscard]] value_type const & operator[](key_type const key) const { return mBuffers[key]; }
     //==============================================================================
+    /** Direct access to the samples of a channel, without going through its juce::AudioBuffer. Marks it as dirty. */
+    [[nodiscard]] float * getChannel(key_type const key) noexcept
+    {
+        jassert(mChannels[getIndex(key)] != nullptr);
+        jassert(!isReadOnly(key));
+        markDirty(getIndex(key));
+        return mChannels[getIndex(key)];
+    }
+    [[nodiscard]] float const * getChannel(key_type const key) const noexcept
+    {
+        jassert(mChannels[getIndex(key)] != nullptr);
+        return mChannels[getIndex(key)];
+    }
+    //==============================================================================
+    /** @return CAPACITY channel pointers indexed by key (without its offset). Unused keys are nullptr.
+     *
+     * Writes through these pointers are not tracked : call markDirty() for every channel that gets written to.
+     */
+    [[nodiscard]] float * const * getRawChannels() noexcept { return mChannels.data(); }
+    [[nodiscard]] float const * const * getRawChannels() const noexcept { return mChannels.data(); }
+    //==============================================================================
+    /** @return the distance in samples between two consecutive channels of the slab. */
+    [[nodiscard]] std::size_t getStride() const noexcept { return mSlab.getStride(); }
+    [[nodiscard]] bool isUsingHugePages() const noexcept { return mSlab.isUsingHugePages(); }
+    [[nodiscard]] AudioSlab const & getSlab() const noexcept { return mSlab; }
+    //==============================================================================
     [[nodiscard]] juce::Array<float const *> getArrayOfReadPointers(juce::Array<key_type> const & keys) const
     {
         JUCE_ASSERT_MESSAGE_THREAD;
@@ -110,34 +256,97 @@ public:
     {
         StaticVector<float *, CAPACITY> result{};
         for (auto const key : channels) {
-            result.push_back((*this)[key].getWritePointer(0));
+            result.push_back(getChannel(key));
         }
         return result;
     }
     //==============================================================================
+    /** Can be called concurrently. */
+    void markDirty(key_type const key) noexcept
+    {
+        jassert(!isReadOnly(key));
+        markDirty(getIndex(key));
+    }
+    //==============================================================================
     [[nodiscard]] int getNumSamples() const { return mNumSamples; }
     //==============================================================================
     void copyToPhysicalOutput(float * const * outs, int const numOutputs) const
     {
-        // TODO FU: this could probably be parallelized with fork_union
+        // See SpeakerOutputStage for a version that also applies the gains, the high-pass filters and the metering.
         for (auto const buffer : mBuffers) {
             auto const outIndex{ buffer.key.template removeOffset<int>() };
             jassert(outIndex >= 0);
             if (outIndex >= numOutputs) {
                 continue;
             }
-            auto const * const origin{ buffer.value->getReadPointer(0) };
+            auto const index{ getIndex(buffer.key) };
+            auto const * const origin{ mChannels[index] };
             auto * const dest{ outs[outIndex] };
+            if (origin == dest) {
+                // Bound to the physical output : already in place.
+                continue;
+            }
+            if (!isDirty(buffer.key)) {
+                juce::FloatVectorOperations::clear(dest, mNumSamples);
+                continue;
+            }
             std::copy_n(origin, mNumSamples, dest);
         }
     }
     //==============================================================================
-    [[nodiscard]] iterator begin() { return mBuffers.begin(); }
-    [[nodiscard]] iterator end() { return mBuffers.end(); }
+    /** Iteration is read-only : write through getChannel() or operator[] so that the channels get marked as dirty. */
     [[nodiscard]] const_iterator begin() const { return mBuffers.cbegin(); }
     [[nodiscard]] const_iterator end() const { return mBuffers.cend(); }
     [[nodiscard]] const_iterator cbegin() const { return mBuffers.cbegin(); }
     [[nodiscard]] const_iterator cend() const { return mBuffers.cend(); }
+
+private:
+    //==============================================================================
+    [[nodiscard]] static std::size_t getIndex(key_type const key) noexcept
+    {
+        return key.template removeOffset<std::size_t>();
+    }
+    //==============================================================================
+    void bind(key_type const key, float * const externalChannel, bool const isReadOnly) noexcept
+    {
+        jassert(externalChannel != nullptr);
+        auto const index{ getIndex(key) };
+        jassert(mChannels[index] != nullptr);
+        mChannels[index] = externalChannel;
+        mBoundChannels.set(index);
+        mReadOnlyChannels.set(index, isReadOnly);
+        // We don't know what is in there.
+        markDirty(index);
+        mBuffers[key].setDataToReferTo(&mChannels[index], 1, mNumSamples);
+    }
+    //==============================================================================
+    void unbind(std::size_t const index, value_type & buffer) noexcept
+    {
+        mChannels[index] = mSlabChannels[index];
+        mBoundChannels.reset(index);
+        mReadOnlyChannels.reset(index);
+        buffer.setDataToReferTo(&mChannels[index], 1, mNumSamples);
+    }
+    //==============================================================================
+    void clear(std::size_t const index) noexcept
+    {
+        if (mReadOnlyChannels.test(index)) {
+            // The memory can't be cleared : use the slab channel instead.
+            key_type const key{ narrow<typename key_type::type>(index) + key_type::OFFSET };
+            unbind(index, mBuffers[key]);
+        }
+        juce::FloatVectorOperations::clear(mChannels[index], mNumSamples);
+    }
+    //==============================================================================
+    void markDirty(std::size_t const index) noexcept
+    {
+        std::atomic_ref<std::uint64_t> word{ mDirtyChannels[index / 64] };
+        auto const bit{ std::uint64_t{ 1 } << (index % 64) };
+        // Most channels get marked many times per block : avoid the read-modify-write when possible.
+        if ((word.load(std::memory_order_relaxed) & bit) == 0) {
+            word.fetch_or(bit, std::memory_order_relaxed);
+        }
+    }
 };
 
 //==============================================================================
@@ -0,0 +1,133 @@
+/*
+ This file is part of SpatGRIS.
+
+ Developers: Gaël Lane Lépine, Samuel Béland, Olivier Bélanger, Nicolas Masson
+
+ SpatGRIS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ SpatGRIS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with SpatGRIS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "../Data/sg_Macros.hpp"
+
+namespace gris
+{
+//==============================================================================
+/** A single-writer/single-reader version of AtomicUpdater that only needs three tokens.
+ *
+ * The writer always owns one token (the back buffer), the reader owns another one (the front buffer) and the third one
+ * holds the latest published value. Publishing swaps the back buffer with the middle one and reading swaps the middle
+ * one with the front buffer, so neither side ever scans for a free token and both are wait-free.
+ *
+ * The interface is the same as AtomicUpdater's. Prefer it for large payloads with a single writer (e.g. the peaks sent
+ * from the audio thread to the message thread) : it only keeps three copies of the value instead of six.
+ */
+template<typename T>
+class TripleBuffer
+{
+    static constexpr size_t CAPACITY = 3;
+
+public:
+    //==============================================================================
+    /** An update token. Use the get() method to access its data. */
+    class Token
+    {
+        friend TripleBuffer;
+
+        // The actual data
+        T mValue{};
+
+    public:
+        [[nodiscard]] T & get() noexcept { return mValue; }
+        [[nodiscard]] T const & get() const noexcept { return mValue; }
+    };
+    static_assert(std::atomic<std::uint8_t>::is_always_lock_free);
+
+private:
+    //==============================================================================
+    // The low bits of the shared state hold the index of the middle token, NEW_DATA_BIT is set when it was published
+    // since the last read.
+    static constexpr std::uint8_t INDEX_MASK = 0x3;
+    static constexpr std::uint8_t NEW_DATA_BIT = 0x4;
+    //==============================================================================
+    std::array<Token, CAPACITY> mData{};
+    std::atomic<std::uint8_t> mMiddle{ 1 };
+    // Writer only
+    std::uint8_t mBack{ 0 };
+    // Reader only
+    std::uint8_t mFront{ 2 };
+
+public:
+    //==============================================================================
+    TripleBuffer() = default;
+    ~TripleBuffer() = default;
+    SG_DELETE_COPY_AND_MOVE(TripleBuffer)
+    //==============================================================================
+    /** @returns the writer's token. Use setMostRecent() to return the data to the updater after writing to it. Never
+     * fails. */
+    Token * acquire() noexcept;
+    /** Updates a local token pointer to the most recently pushed token.
+     *
+     * @param[out] tokenToUpdate the token address that should be updated (or not). This has to be nullptr when called
+     * for the first time. Subsequent calls must always pass the token that they got through the last getMostRecent()
+     * call.
+     */
+    void getMostRecent(Token *& tokenToUpdate) noexcept;
+    /** Publishes the writer's token. The writer gets a new token on its next call to acquire().
+     *
+     * @param newMostRecent the address of the token returned by acquire().
+     */
+    void setMostRecent(Token * newMostRecent) noexcept;
+};
+
+//==============================================================================
+template<typename T>
+typename TripleBuffer<T>::Token * TripleBuffer<T>::acquire() noexcept
+{
+    return &mData[mBack];
+}
+
+//==============================================================================
+template<typename T>
+void TripleBuffer<T>::getMostRecent(Token *& tokenToUpdate) noexcept
+{
+    jassert(tokenToUpdate == nullptr || tokenToUpdate == &mData[mFront]);
+
+    if ((mMiddle.load(std::memory_order_relaxed) & NEW_DATA_BIT) == 0) {
+        // No new token : tokenToUpdate is already the most recent one
+        return;
+    }
+    // Hand our old token to the writer's side and take the published one.
+    auto const published{ mMiddle.exchange(mFront, std::memory_order_acq_rel) };
+    mFront = static_cast<std::uint8_t>(published & INDEX_MASK);
+    tokenToUpdate = &mData[mFront];
+}
+
+//==============================================================================
+template<typename T>
+void TripleBuffer<T>::setMostRecent([[maybe_unused]] Token * newMostRecent) noexcept
+{
+    jassert(newMostRecent == &mData[mBack]);
+
+    // If the previous value was not read yet, it is simply replaced.
+    auto const previous{ mMiddle.exchange(static_cast<std::uint8_t>(mBack | NEW_DATA_BIT), std::memory_order_acq_rel) };
+    mBack = static_cast<std::uint8_t>(previous & INDEX_MASK);
+}
+
+} // namespace gris
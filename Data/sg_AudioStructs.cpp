@@ -22,6 +22,7 @@
 #include "Data/sg_constants.hpp"
 #include <cmath>
 #include <algorithm>
+#include <cstdint>
 
 namespace gris
 {
@@ -58,11 +59,48 @@ void SpeakerHighpassConfig::process(float * data,
     }
 }
 
+//==============================================================================
+bool SpeakerHighpassConfig::hasSameCoefficients(SpeakerHighpassConfig const & other) const noexcept
+{
+    return b1 == other.b1 && b2 == other.b2 && b3 == other.b3 && b4 == other.b4 && ha0 == other.ha0
+           && ha1 == other.ha1 && ha2 == other.ha2;
+}
+
+//==============================================================================
+void SpeakerRenderPlan::compile(SpeakersAudioConfig const & speakersAudioConfig) noexcept
+{
+    speakers.clear();
+    speakersAudioConfig.forEach([&](output_patch_t const outputPatch, SpeakerAudioConfig const & speaker) {
+        if (!speaker.isMuted && !speaker.isDirectOutOnly && speaker.gain >= SMALL_GAIN) {
+            speakers.push_back(outputPatch);
+        }
+    });
+}
+
+//==============================================================================
+bool SpeakerRenderPlan::isUpToDate(SpeakersAudioConfig const & speakersAudioConfig) const noexcept
+{
+    SpeakerRenderPlan expected{};
+    expected.compile(speakersAudioConfig);
+    return std::equal(speakers.begin(), speakers.end(), expected.speakers.begin(), expected.speakers.end());
+}
+
 //==============================================================================
 void MbapAttenuationConfig::process(float * data,
                                     int const numSamples,
                                     float const distance,
                                     MbapSourceAttenuationState & state) const
+{
+    auto const * result{ process(data, data, numSamples, distance, state) };
+    jassert(result == data);
+}
+
+//==============================================================================
+float const * MbapAttenuationConfig::process(float const * input,
+                                             float * scratch,
+                                             int const numSamples,
+                                             float const distance,
+                                             MbapSourceAttenuationState & state) const
 {
     auto const attenuationRatio{ std::clamp((distance - NORMAL_RADIUS) / EXTRA_DISTANCE, 0.0f, 1.0f) };
     auto const targetGain{ 1.0f - attenuationRatio * (1.0f - linearGain) };
@@ -80,37 +118,51 @@ void MbapAttenuationConfig::process(float * data,
     jassert(std::isfinite(state.currentCoefficient));
     jassert(std::isfinite(state.currentGain));
 
+    // The filter state is only read back once per block : keep it in locals so that it is not reloaded after every
+    // write to the output, which might alias it.
+    auto lowpassY{ state.lowpassY };
+    auto lowpassZ{ state.lowpassZ };
+
     if (coefficientStep == 0.0f && gainStep == 0.0f) {
         if (attenuationRatio == 0.0f) {
-            return;
+            return input;
         }
 
         // no ramp in coefficient and gain
+        auto const coefficient{ state.currentCoefficient };
+        auto const gain{ state.currentGain };
         for (int sampleIndex{}; sampleIndex < numSamples; ++sampleIndex) {
-            state.lowpassY = data[sampleIndex] + (state.lowpassY - data[sampleIndex]) * state.currentCoefficient;
-            state.lowpassZ = state.lowpassY + (state.lowpassZ - state.lowpassY) * state.currentCoefficient;
-            data[sampleIndex] = state.lowpassZ * state.currentGain;
-
-            jassert(std::isfinite(state.lowpassY));
-            jassert(std::isfinite(state.lowpassZ));
+            auto const sample{ input[sampleIndex] };
+            lowpassY = sample + (lowpassY - sample) * coefficient;
+            lowpassZ = lowpassY + (lowpassZ - lowpassY) * coefficient;
+            scratch[sampleIndex] = lowpassZ * gain;
         }
-
-        return;
-    }
-
-    // coefficient and/or gain ramp
-    for (int sampleIndex{}; sampleIndex < numSamples; ++sampleIndex) {
-        state.currentCoefficient += coefficientStep;
-        state.currentGain += gainStep;
-        state.lowpassY = data[sampleIndex] + (state.lowpassY - data[sampleIndex]) * state.currentCoefficient;
-        state.lowpassZ = state.lowpassY + (state.lowpassZ - state.lowpassY) * state.currentCoefficient;
-        data[sampleIndex] = state.lowpassZ * state.currentGain;
+    } else {
+        // coefficient and/or gain ramp
+        auto coefficient{ state.currentCoefficient };
+        auto gain{ state.currentGain };
+        for (int sampleIndex{}; sampleIndex < numSamples; ++sampleIndex) {
+            coefficient += coefficientStep;
+            gain += gainStep;
+            auto const sample{ input[sampleIndex] };
+            lowpassY = sample + (lowpassY - sample) * coefficient;
+            lowpassZ = lowpassY + (lowpassZ - lowpassY) * coefficient;
+            scratch[sampleIndex] = lowpassZ * gain;
+        }
+        state.currentCoefficient = coefficient;
+        state.currentGain = gain;
 
         jassert(std::isfinite(state.currentCoefficient));
         jassert(std::isfinite(state.currentGain));
-        jassert(std::isfinite(state.lowpassY));
-        jassert(std::isfinite(state.lowpassZ));
     }
+
+    state.lowpassY = lowpassY;
+    state.lowpassZ = lowpassZ;
+
+    jassert(std::isfinite(state.lowpassY));
+    jassert(std::isfinite(state.lowpassZ));
+
+    return scratch;
 }
 
 //==============================================================================
@@ -126,4 +178,237 @@ void ColdSpeakerHighpass::resetValues()
     y4 = 0.0;
 }
 
+//==============================================================================
+bool AudioConfigCommand::apply(AudioConfig & config) const noexcept
+{
+    switch (type) {
+    case Type::sourceMuted:
+        if (config.sourcesAudioConfig.contains(source)) {
+            config.sourcesAudioConfig[source].isMuted = isMuted;
+        }
+        return false;
+    case Type::speakerMuted:
+        if (!config.speakersAudioConfig.contains(speaker)) {
+            return false;
+        }
+        config.speakersAudioConfig[speaker].isMuted = isMuted;
+        return true;
+    case Type::speakerGain:
+        if (!config.speakersAudioConfig.contains(speaker)) {
+            return false;
+        }
+        config.speakersAudioConfig[speaker].gain = value;
+        return true;
+    case Type::speakerHighpass:
+        if (!config.speakersAudioConfig.contains(speaker)) {
+            return false;
+        }
+        // isNewConfig is true : only this speaker's filter gets reset.
+        config.speakersAudioConfig[speaker].highpassConfig = highpassConfig;
+        return true;
+    case Type::masterGain:
+        config.masterGain = value;
+        return false;
+    case Type::spatGainsInterpolation:
+        config.spatGainsInterpolation = value;
+        return false;
+    case Type::pinkNoiseGain:
+        config.pinkNoiseGain = optionalValue;
+        return false;
+    case Type::stereoMuted:
+        config.isStereoMuted = isMuted;
+        return false;
+    }
+    jassertfalse;
+    return false;
+}
+
+//==============================================================================
+AudioConfigCommand AudioConfigCommand::makeSourceMuted(source_index_t const source, bool const isMuted) noexcept
+{
+    AudioConfigCommand result{};
+    result.type = Type::sourceMuted;
+    result.source = source;
+    result.isMuted = isMuted;
+    return result;
+}
+
+//==============================================================================
+AudioConfigCommand AudioConfigCommand::makeSpeakerMuted(output_patch_t const speaker, bool const isMuted) noexcept
+{
+    AudioConfigCommand result{};
+    result.type = Type::speakerMuted;
+    result.speaker = speaker;
+    result.isMuted = isMuted;
+    return result;
+}
+
+//==============================================================================
+AudioConfigCommand AudioConfigCommand::makeSpeakerGain(output_patch_t const speaker, float const gain) noexcept
+{
+    AudioConfigCommand result{};
+    result.type = Type::speakerGain;
+    result.speaker = speaker;
+    result.value = gain;
+    return result;
+}
+
+//==============================================================================
+AudioConfigCommand
+    AudioConfigCommand::makeSpeakerHighpass(output_patch_t const speaker,
+                                            tl::optional<SpeakerHighpassConfig> const & highpassConfig) noexcept
+{
+    AudioConfigCommand result{};
+    result.type = Type::speakerHighpass;
+    result.speaker = speaker;
+    result.highpassConfig = highpassConfig;
+    if (result.highpassConfig) {
+        result.highpassConfig->isNewConfig = true;
+    }
+    return result;
+}
+
+//==============================================================================
+AudioConfigCommand AudioConfigCommand::makeMasterGain(float const gain) noexcept
+{
+    AudioConfigCommand result{};
+    result.type = Type::masterGain;
+    result.value = gain;
+    return result;
+}
+
+//==============================================================================
+AudioConfigCommand AudioConfigCommand::makeSpatGainsInterpolation(float const interpolation) noexcept
+{
+    AudioConfigCommand result{};
+    result.type = Type::spatGainsInterpolation;
+    result.value = interpolation;
+    return result;
+}
+
+//==============================================================================
+AudioConfigCommand AudioConfigCommand::makePinkNoiseGain(tl::optional<float> const gain) noexcept
+{
+    AudioConfigCommand result{};
+    result.type = Type::pinkNoiseGain;
+    result.optionalValue = gain;
+    return result;
+}
+
+//==============================================================================
+AudioConfigCommand AudioConfigCommand::makeStereoMuted(bool const isMuted) noexcept
+{
+    AudioConfigCommand result{};
+    result.type = Type::stereoMuted;
+    result.isMuted = isMuted;
+    return result;
+}
+
+//==============================================================================
+tl::optional<AudioConfigCommands> AudioConfig::diff(AudioConfig const & next) const
+{
+    if (next.spatMode != spatMode || next.isStereo != isStereo
+        || next.isStereoInnerRenderSkipped != isStereoInnerRenderSkipped || next.directOutPairs != directOutPairs
+        || !next.sourcesAudioConfig.hasSameKeys(sourcesAudioConfig)
+        || !next.speakersAudioConfig.hasSameKeys(speakersAudioConfig)
+        || next.mbapAttenuationConfig.linearGain != mbapAttenuationConfig.linearGain
+        || next.mbapAttenuationConfig.lowpassCoefficient != mbapAttenuationConfig.lowpassCoefficient
+        || next.mbapAttenuationConfig.shouldProcess != mbapAttenuationConfig.shouldProcess) {
+        return tl::nullopt;
+    }
+
+    AudioConfigCommands result{};
+
+    for (auto const & source : next.sourcesAudioConfig) {
+        auto const & current{ sourcesAudioConfig[source.key] };
+        if (source.value.directOut != current.directOut) {
+            return tl::nullopt;
+        }
+        if (source.value.isMuted != current.isMuted) {
+            result.add(AudioConfigCommand::makeSourceMuted(source.key, source.value.isMuted));
+        }
+    }
+
+    for (auto const & speaker : next.speakersAudioConfig) {
+        auto const & current{ speakersAudioConfig[speaker.key] };
+        if (speaker.value.isDirectOutOnly != current.isDirectOutOnly) {
+            return tl::nullopt;
+        }
+        if (speaker.value.isMuted != current.isMuted) {
+            result.add(AudioConfigCommand::makeSpeakerMuted(speaker.key, speaker.value.isMuted));
+        }
+        if (speaker.value.gain != current.gain) {
+            result.add(AudioConfigCommand::makeSpeakerGain(speaker.key, speaker.value.gain));
+        }
+        auto const & nextHighpass{ speaker.value.highpassConfig };
+        auto const & currentHighpass{ current.highpassConfig };
+        auto const isSameHighpass{ nextHighpass.has_value() == currentHighpass.has_value()
+                                   && (!nextHighpass || nextHighpass->hasSameCoefficients(*currentHighpass)) };
+        if (!isSameHighpass) {
+            result.add(AudioConfigCommand::makeSpeakerHighpass(speaker.key, nextHighpass));
+        }
+    }
+
+    if (next.masterGain != masterGain) {
+        result.add(AudioConfigCommand::makeMasterGain(next.masterGain));
+    }
+    if (next.spatGainsInterpolation != spatGainsInterpolation) {
+        result.add(AudioConfigCommand::makeSpatGainsInterpolation(next.spatGainsInterpolation));
+    }
+    if (next.pinkNoiseGain != pinkNoiseGain) {
+        result.add(AudioConfigCommand::makePinkNoiseGain(next.pinkNoiseGain));
+    }
+    if (next.isStereoMuted != isStereoMuted) {
+        result.add(AudioConfigCommand::makeStereoMuted(next.isStereoMuted));
+    }
+
+    for (auto & command : result) {
+        command.generation = generation;
+    }
+
+    return result;
+}
+
+//==============================================================================
+bool AudioData::pushConfigCommands(AudioConfigCommands const & commands) noexcept
+{
+    if (narrow<size_t>(commands.size()) > configCommands.getNumFreeSlots()) {
+        return false;
+    }
+
+    for (auto const & command : commands) {
+        [[maybe_unused]] auto const success{ configCommands.push(command) };
+        jassert(success);
+    }
+
+    return true;
+}
+
+//==============================================================================
+bool AudioData::applyConfigCommands() noexcept
+{
+    if (!config) {
+        return false;
+    }
+
+    auto speakersChanged{ false };
+    while (auto const * command{ configCommands.peek() }) {
+        auto const age{ static_cast<std::int32_t>(config->generation - command->generation) };
+        if (age < 0) {
+            // Meant for a snapshot that was not installed yet.
+            break;
+        }
+        if (age == 0) {
+            speakersChanged |= command->apply(*config);
+        }
+        configCommands.pop();
+    }
+
+    if (speakersChanged) {
+        config->speakerRenderPlan.compile(config->speakersAudioConfig);
+    }
+
+    return speakersChanged;
+}
+
 } // namespace gris
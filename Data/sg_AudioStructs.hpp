@@ -30,8 +30,10 @@
 #include <cstdint>
 #include <memory>
 #include <utility>
-#include "../Containers/sg_AtomicUpdater.hpp"
+#include "../Containers/sg_SnapshotUpdater.hpp"
+#include "../Containers/sg_SpscQueue.hpp"
 #include "../Containers/sg_StaticMap.hpp"
+#include "../Containers/sg_StaticVector.hpp"
 #include "../Containers/sg_StrongArray.hpp"
 
 /** This file contains most of the structures used in an audio context. */
@@ -68,6 +70,7 @@ struct SpeakerHighpassConfig {
     double ha2{};
     mutable bool isNewConfig{ true };
     //==============================================================================
+    [[nodiscard]] bool hasSameCoefficients(SpeakerHighpassConfig const & other) const noexcept;
     void process(float * data, int numSamples, ColdSpeakerHighpass & state, juce::Random & randNoise) const;
 };
 
@@ -99,6 +102,16 @@ struct MbapAttenuationConfig {
     bool shouldProcess{};
     //==============================================================================
     void process(float * data, int numSamples, float distance, MbapSourceAttenuationState & state) const;
+    /** Non-destructive version of process().
+     *
+     * @return the samples to use : either the input when there is nothing to attenuate, or the scratch buffer that
+     * received the attenuated samples.
+     */
+    [[nodiscard]] float const * process(float const * input,
+                                        float * scratch,
+                                        int numSamples,
+                                        float distance,
+                                        MbapSourceAttenuationState & state) const;
 };
 
 //==============================================================================
@@ -106,8 +119,6 @@ using SpeakersSpatGains = StrongArray<output_patch_t, float, MAX_NUM_SPEAKERS>;
 
 //==============================================================================
 struct SourceAudioState {
-    SpeakersSpatGains lastSpatGains{};
-
     // MBAP-specific
     MbapSourceAttenuationState mbapAttenuationState{};
     // STEREO-specific
@@ -124,15 +135,76 @@ struct SourceAudioConfig {
 using SourcesAudioConfig = StaticMap<source_index_t, SourceAudioConfig, MAX_NUM_SOURCES>;
 using SpeakersAudioConfig = StaticMap<output_patch_t, SpeakerAudioConfig, MAX_NUM_SPEAKERS>;
 
+//==============================================================================
+/** The speakers that the spatialization algorithms have to render to.
+ *
+ * Compiled once per speakers configuration so that the per-source loops iterate over a short contiguous list instead
+ * of skipping the muted, direct-out-only and silent speakers of a SpeakersAudioConfig for every source.
+ */
+struct SpeakerRenderPlan {
+    StaticVector<output_patch_t, MAX_NUM_SPEAKERS> speakers{};
+    //==============================================================================
+    void compile(SpeakersAudioConfig const & speakersAudioConfig) noexcept;
+    /** @return true if compiling the config would give the same plan. Meant for assertions. */
+    [[nodiscard]] bool isUpToDate(SpeakersAudioConfig const & speakersAudioConfig) const noexcept;
+};
+
+//==============================================================================
+struct AudioConfig;
+
+/** A small change to an AudioConfig that does not require sending a new snapshot to the audio thread. */
+struct AudioConfigCommand {
+    enum class Type : std::uint8_t {
+        sourceMuted,
+        speakerMuted,
+        speakerGain,
+        speakerHighpass,
+        masterGain,
+        spatGainsInterpolation,
+        pinkNoiseGain,
+        stereoMuted
+    };
+    //==============================================================================
+    Type type{};
+    /** The AudioConfig::generation of the snapshot this command applies to. */
+    std::uint32_t generation{};
+    source_index_t source{};
+    output_patch_t speaker{};
+    bool isMuted{};
+    float value{};
+    tl::optional<float> optionalValue{};
+    tl::optional<SpeakerHighpassConfig> highpassConfig{};
+    //==============================================================================
+    /** @return true if the speakers' configuration was modified. */
+    bool apply(AudioConfig & config) const noexcept;
+    //==============================================================================
+    [[nodiscard]] static AudioConfigCommand makeSourceMuted(source_index_t source, bool isMuted) noexcept;
+    [[nodiscard]] static AudioConfigCommand makeSpeakerMuted(output_patch_t speaker, bool isMuted) noexcept;
+    [[nodiscard]] static AudioConfigCommand makeSpeakerGain(output_patch_t speaker, float gain) noexcept;
+    [[nodiscard]] static AudioConfigCommand
+        makeSpeakerHighpass(output_patch_t speaker,
+                            tl::optional<SpeakerHighpassConfig> const & highpassConfig) noexcept;
+    [[nodiscard]] static AudioConfigCommand makeMasterGain(float gain) noexcept;
+    [[nodiscard]] static AudioConfigCommand makeSpatGainsInterpolation(float interpolation) noexcept;
+    [[nodiscard]] static AudioConfigCommand makePinkNoiseGain(tl::optional<float> gain) noexcept;
+    [[nodiscard]] static AudioConfigCommand makeStereoMuted(bool isMuted) noexcept;
+};
+
+using AudioConfigCommands = juce::Array<AudioConfigCommand>;
+
 //==============================================================================
 
 /** This structure is used as a cached copy of the ProjectData, done on a timer in
  * MainContentComponent::refreshAudioProcessor().
  */
 struct AudioConfig {
+    /** Set by the owner of the snapshots and incremented every time a new snapshot is sent to the audio thread. */
+    std::uint32_t generation{};
     SpatMode spatMode{};
     bool isStereo{};
     bool isStereoMuted{};
+    /** When true, a stereo reduction does not render the speakers of the project's spatialization mode. */
+    bool isStereoInnerRenderSkipped{};
     float masterGain{};
     float spatGainsInterpolation{};
 
@@ -140,11 +212,22 @@ struct AudioConfig {
 
     SourcesAudioConfig sourcesAudioConfig{};
     SpeakersAudioConfig speakersAudioConfig{};
+    SpeakerRenderPlan speakerRenderPlan{};
 
     tl::optional<float> pinkNoiseGain{};
 
     // MBAP-specific
     MbapAttenuationConfig mbapAttenuationConfig{};
+    //==============================================================================
+    /** Computes the commands that turn this configuration into another one.
+     *
+     * Mutes, solos, gains, high-passes and the interpolation can be sent as commands. Anything else (the
+     * spatialization mode, the stereo mode, the sources and speakers that exist, the direct outs, etc.) is a
+     * structural change that needs a new snapshot.
+     *
+     * @return the commands, stamped with this configuration's generation, or nullopt if the change is structural.
+     */
+    [[nodiscard]] tl::optional<AudioConfigCommands> diff(AudioConfig const & next) const;
 };
 
 //==============================================================================
@@ -157,19 +240,45 @@ struct AudioState {
 using SourcePeaks = StrongArray<source_index_t, float, MAX_NUM_SOURCES>;
 using SpeakerPeaks = StrongArray<output_patch_t, float, MAX_NUM_SPEAKERS>;
 using StereoPeaks = std::array<float, 2>;
+/** The peaks go from the audio thread to the message thread. */
+using SourcePeaksUpdater = SnapshotUpdater<SourcePeaks>;
+using SpeakerPeaksUpdater = SnapshotUpdater<SpeakerPeaks>;
+using StereoPeaksUpdater = SnapshotUpdater<StereoPeaks>;
 
 //==============================================================================
 struct AudioData {
+    static constexpr size_t MAX_PENDING_CONFIG_COMMANDS = 1024;
+
     // message thread -> audio thread (cold)
     std::unique_ptr<AudioConfig> config{};
 
+    // message thread -> audio thread (hot)
+    SpscQueue<AudioConfigCommand, MAX_PENDING_CONFIG_COMMANDS> configCommands{};
+
     // audio thread -> audio thread (hot)
     AudioState state{};
 
     // audio thread -> message thread (hot)
-    AtomicUpdater<SourcePeaks> sourcePeaksUpdater{};
-    AtomicUpdater<SpeakerPeaks> speakerPeaksUpdater{};
-    AtomicUpdater<StereoPeaks> stereoPeaksUpdater{};
+    SourcePeaksUpdater sourcePeaksUpdater{};
+    SpeakerPeaksUpdater speakerPeaksUpdater{};
+    StereoPeaksUpdater stereoPeaksUpdater{};
+    //==============================================================================
+    /** Message thread. Queues commands produced by AudioConfig::diff().
+     *
+     * @return false if there was not enough room for all of them, in which case none were queued and a new snapshot
+     * should be sent instead.
+     */
+    [[nodiscard]] bool pushConfigCommands(AudioConfigCommands const & commands) noexcept;
+    /** Audio thread. Applies the pending commands to the current config. Call at the start of a block, before swapping
+     * in a new snapshot.
+     *
+     * Commands meant for an older snapshot are dropped. Commands meant for a newer snapshot stay queued until that
+     * snapshot is installed.
+     *
+     * @return true if the speakers' configuration was modified : the render plan is already recompiled, but a
+     * SpeakerOutputStage has to be given the configuration again.
+     */
+    bool applyConfigCommands() noexcept;
 };
 
 } // namespace gris
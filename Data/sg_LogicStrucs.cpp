@@ -1096,6 +1096,7 @@ std::unique_ptr<AudioConfig> SpatGrisData::toAudioConfig() const
     auto result{ std::make_unique<AudioConfig>() };
 
     result->speakersAudioConfig = speakerSetup.toAudioConfig(appData.audioSettings.sampleRate);
+    result->speakerRenderPlan.compile(result->speakersAudioConfig);
 
     auto const isAtLeastOneSourceSolo{ std::any_of(
         project.sources.cbegin(),
@@ -1142,6 +1143,7 @@ std::unique_ptr<AudioConfig> SpatGrisData::toAudioConfig() const
 
     if (appData.stereoMode) {
         result->isStereo = appData.stereoMode.has_value();
+        result->isStereoInnerRenderSkipped = !appData.renderSpeakersInStereo;
 
         // direct outs are ignored in stereo mode
         result->directOutPairs.clearQuick();
@@ -24,7 +24,7 @@
 #include "StrongTypes/sg_Hz.hpp"
 #include "StrongTypes/sg_Radians.hpp"
 #include "StrongTypes/sg_SourceIndex.hpp"
-#include "Containers/sg_AtomicUpdater.hpp"
+#include "Containers/sg_SnapshotUpdater.hpp"
 #include "Containers/sg_StrongArray.hpp"
 #include "Data/StrongTypes/sg_OutputPatch.hpp"
 #include "Data/sg_LogicStrucs.hpp"
@@ -119,7 +119,7 @@ static_assert(std::atomic_ref<float>::is_always_lock_free, "float cannot be conv
  *
  * COLD  : no concurrent access. All reads and writes happen on the same thread.
  * WARM  : concurrent access, but never during a performance. Usually done with a lock.
- * HOT   : concurrent access DURING PERFORMANCE. Usually done with an AtomicUpdater<>.
+ * HOT   : concurrent access DURING PERFORMANCE. Usually done with an AtomicUpdater<> or a SnapshotUpdater<>.
  * MIXED : a top-level structure that holds multiple access patterns.
  *
  * Note that the term "Config" is associated with WARM data transmitted from the message thread to another thread and
@@ -176,7 +176,7 @@ struct ViewportSourceData {
 };
 
 /** The updater type used to send a source's data from the message thread to the OpenGL thread. */
-using ViewportSourceDataUpdater = AtomicUpdater<tl::optional<ViewportSourceData>>;
+using ViewportSourceDataUpdater = SnapshotUpdater<tl::optional<ViewportSourceData>>;
 
 //==============================================================================
 /** The data needed to display a speaker in the 3D viewport.
@@ -190,7 +190,7 @@ struct ViewportSpeakerConfig {
 };
 
 /** The updater type used to send a speaker's alpha level from the message thread to the OpenGL thread. */
-using ViewportSpeakerAlphaUpdater = AtomicUpdater<float>;
+using ViewportSpeakerAlphaUpdater = SnapshotUpdater<float>;
 
 //==============================================================================
 /** The data needed by the 3D viewport.
@@ -484,6 +484,8 @@ struct AppData {
     tl::optional<StereoMode> stereoMode{};
     StereoRouting stereoRouting{};
     bool playerExists{};
+    /** Whether the speakers still get rendered during a stereo reduction (e.g. when their levels are displayed). */
+    bool renderSpeakersInStereo{ true };
     int windowX{ 100 };
     int windowY{ 100 };
     int windowWidth{ 1200 };
@@ -550,9 +552,9 @@ struct SpatGrisData {
     ProjectData project{};
     AppData appData{};
     tl::optional<dbfs_t> pinkNoiseLevel{};
-    AtomicUpdater<SourcePeaks>::Token * mostRecentSourcePeaks{};
-    AtomicUpdater<SpeakerPeaks>::Token * mostRecentSpeakerPeaks{};
-    AtomicUpdater<StereoPeaks>::Token * mostRecentStereoPeaks{};
+    SourcePeaksUpdater::Token * mostRecentSourcePeaks{};
+    SpeakerPeaksUpdater::Token * mostRecentSpeakerPeaks{};
+    StereoPeaksUpdater::Token * mostRecentStereoPeaks{};
     //==============================================================================
     [[nodiscard]] std::unique_ptr<AudioConfig> toAudioConfig() const;
     [[nodiscard]] ViewportConfig toViewportConfig() const noexcept;
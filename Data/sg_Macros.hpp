@@ -40,3 +40,15 @@
     x & operator=(x &&) = default;
 
 #define SG_DEFAULT_COPY_AND_MOVE(x) SG_DEFAULT_COPY(x) SG_DEFAULT_MOVE(x)
+
+/** The name of the thread on which an AsyncSpatAlgorithmBuilder builds the spatialization algorithms. */
+#define SG_ALGORITHM_BUILDER_THREAD_NAME "AlgoGRIS algorithm builder"
+
+/** The name of the thread on which a ControlRateSpatAlgorithm computes the spatialization gains. */
+#define SG_CONTROL_RATE_THREAD_NAME "AlgoGRIS control rate"
+
+/** Algorithms are built either synchronously on the message thread or by an AsyncSpatAlgorithmBuilder. */
+#define SG_ASSERT_BUILDER_THREAD                                                                                       \
+    jassert(juce::MessageManager::existsAndIsCurrentThread()                                                           \
+            || (juce::Thread::getCurrentThread() != nullptr                                                            \
+                && juce::Thread::getCurrentThread()->getThreadName() == SG_ALGORITHM_BUILDER_THREAD_NAME))
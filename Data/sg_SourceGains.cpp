@@ -0,0 +1,75 @@
+/*
+ This file is part of SpatGRIS.
+
+ Developers: Gaël Lane Lépine, Samuel Béland, Olivier Bélanger, Nicolas Masson
+
+ SpatGRIS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ SpatGRIS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with SpatGRIS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sg_SourceGains.hpp"
+#include <algorithm>
+
+namespace gris
+{
+namespace
+{
+constexpr auto NUM_SOURCES{ static_cast<std::size_t>(MAX_NUM_SOURCES) };
+} // namespace
+
+//==============================================================================
+void SpeakerGainsRow::copyFrom(SpeakersSpatGains const & gains) noexcept
+{
+    std::copy_n(gains.data(), mSize, mData);
+}
+
+//==============================================================================
+void SpeakerGainsRow::copyFrom(SpeakerGainsRow const & other) noexcept
+{
+    std::copy_n(other.mData, std::min(mSize, other.mSize), mData);
+}
+
+//==============================================================================
+void SpeakerGainsRow::clear() noexcept
+{
+    std::fill_n(mData, mSize, 0.0f);
+}
+
+//==============================================================================
+void SourcesGainsSlab::allocate(SpeakersData const & speakers, std::size_t const numTokenRowsPerSource)
+{
+    std::size_t rowSize{};
+    for (auto const & speaker : speakers) {
+        rowSize = std::max(rowSize, speaker.key.removeOffset<std::size_t>() + 1);
+    }
+
+    mRowSize = rowSize;
+    mNumTokenRows = numTokenRowsPerSource;
+    mSlab.allocate(NUM_SOURCES * (1 + numTokenRowsPerSource), std::max(rowSize, std::size_t{ 1 }), false);
+}
+
+//==============================================================================
+SpeakerGainsRow SourcesGainsSlab::getLastGains(source_index_t const sourceIndex) noexcept
+{
+    return SpeakerGainsRow{ mSlab.getChannel(sourceIndex.removeOffset<std::size_t>()), mRowSize };
+}
+
+//==============================================================================
+SpeakerGainsRow SourcesGainsSlab::getTokenRow(source_index_t const sourceIndex, std::size_t const tokenIndex) noexcept
+{
+    jassert(tokenIndex < mNumTokenRows);
+    auto const row{ NUM_SOURCES + sourceIndex.removeOffset<std::size_t>() * mNumTokenRows + tokenIndex };
+    return SpeakerGainsRow{ mSlab.getChannel(row), mRowSize };
+}
+
+} // namespace gris
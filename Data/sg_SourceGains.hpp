@@ -0,0 +1,110 @@
+/*
+ This file is part of SpatGRIS.
+
+ Developers: Gaël Lane Lépine, Samuel Béland, Olivier Bélanger, Nicolas Masson
+
+ SpatGRIS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ SpatGRIS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with SpatGRIS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Containers/sg_AudioSlab.hpp"
+#include "Data/StrongTypes/sg_OutputPatch.hpp"
+#include "Data/StrongTypes/sg_SourceIndex.hpp"
+#include "Data/sg_AudioStructs.hpp"
+#include "Data/sg_LogicStrucs.hpp"
+#include "Data/sg_Macros.hpp"
+#include "juce_core/juce_core.h"
+#include <cstddef>
+
+namespace gris
+{
+//==============================================================================
+/** The gains of a source, indexed by output patch like a SpeakersSpatGains.
+ *
+ * A row only goes up to the highest output patch of the speaker setup it was made for. A speaker that comes from
+ * another configuration (e.g. while a new setup is being swapped in) may not be covered : check contains() first.
+ */
+class SpeakerGainsRow
+{
+    float * mData{};
+    std::size_t mSize{};
+
+public:
+    //==============================================================================
+    SpeakerGainsRow() = default;
+    SpeakerGainsRow(float * data, std::size_t const size) noexcept : mData(data), mSize(size) {}
+    //==============================================================================
+    [[nodiscard]] bool contains(output_patch_t const outputPatch) const noexcept
+    {
+        return outputPatch.removeOffset<std::size_t>() < mSize;
+    }
+    [[nodiscard]] float & operator[](output_patch_t const outputPatch) noexcept
+    {
+        jassert(contains(outputPatch));
+        return mData[outputPatch.removeOffset<std::size_t>()];
+    }
+    [[nodiscard]] float const & operator[](output_patch_t const outputPatch) const noexcept
+    {
+        jassert(contains(outputPatch));
+        return mData[outputPatch.removeOffset<std::size_t>()];
+    }
+    [[nodiscard]] std::size_t size() const noexcept { return mSize; }
+    //==============================================================================
+    /** Copies the gains of the speakers that the row covers. */
+    void copyFrom(SpeakersSpatGains const & gains) noexcept;
+    /** Copies the gains that both rows cover. */
+    void copyFrom(SpeakerGainsRow const & other) noexcept;
+    void clear() noexcept;
+};
+
+//==============================================================================
+/** The gain rows of every source of an algorithm, in a single AudioSlab.
+ *
+ * Every source gets one row for the gains that the audio thread ramps from (its last gains) and a few rows for the
+ * gain tokens that updateSpatData() fills. The rows are sized for the speakers of the setup instead of MAX_NUM_SPEAKERS
+ * and the rows of last gains are packed together at the start of the slab, so that the gain state that the audio thread
+ * touches for every source stays small and contiguous.
+ */
+class SourcesGainsSlab
+{
+    AudioSlab mSlab{};
+    std::size_t mRowSize{};
+    std::size_t mNumTokenRows{};
+
+public:
+    //==============================================================================
+    SourcesGainsSlab() = default;
+    ~SourcesGainsSlab() = default;
+    SG_DELETE_COPY_AND_MOVE(SourcesGainsSlab)
+    //==============================================================================
+    /** Allocates silent rows for every source. Rows cover the output patches up to the highest one of the speakers. */
+    void allocate(SpeakersData const & speakers, std::size_t numTokenRowsPerSource);
+    //==============================================================================
+    [[nodiscard]] SpeakerGainsRow getLastGains(source_index_t sourceIndex) noexcept;
+    [[nodiscard]] SpeakerGainsRow getTokenRow(source_index_t sourceIndex, std::size_t tokenIndex) noexcept;
+    //==============================================================================
+    /** @return how many speakers a row covers. */
+    [[nodiscard]] std::size_t getRowSize() const noexcept { return mRowSize; }
+    /** @return the size of a row, padding included. */
+    [[nodiscard]] std::size_t getNumBytesPerRow() const noexcept { return mSlab.getStride() * sizeof(float); }
+    [[nodiscard]] std::size_t getNumBytes() const noexcept { return mSlab.getNumChannels() * getNumBytesPerRow(); }
+    [[nodiscard]] AudioSlab const & getSlab() const noexcept { return mSlab; }
+
+private:
+    //==============================================================================
+    JUCE_LEAK_DETECTOR(SourcesGainsSlab)
+};
+
+} // namespace gris
@@ -70,8 +70,19 @@ struct SpatGrisVersion {
 
 extern const SpatGrisVersion SPAT_GRIS_VERSION;
 
-constexpr auto MAX_NUM_SOURCES = 256;
-constexpr auto MAX_NUM_SPEAKERS = 256;
+/* The limits are set at build time (see ALGOGRIS_MAX_NUM_SOURCES and ALGOGRIS_MAX_NUM_SPEAKERS in CMakeLists.txt). The
+ * per-source and per-speaker tables grow linearly with them, while everything that crosses sources with speakers is
+ * sized for the speaker setup actually loaded. */
+#ifndef ALGOGRIS_MAX_NUM_SOURCES
+    #define ALGOGRIS_MAX_NUM_SOURCES 256
+#endif
+#ifndef ALGOGRIS_MAX_NUM_SPEAKERS
+    #define ALGOGRIS_MAX_NUM_SPEAKERS 256
+#endif
+
+constexpr auto MAX_NUM_SOURCES = ALGOGRIS_MAX_NUM_SOURCES;
+constexpr auto MAX_NUM_SPEAKERS = ALGOGRIS_MAX_NUM_SPEAKERS;
+static_assert(MAX_NUM_SOURCES > 0 && MAX_NUM_SPEAKERS > 0);
 
 constexpr auto NORMAL_RADIUS = 1.0f;
 constexpr auto MBAP_EXTENDED_RADIUS = 1.6666667f;
@@ -81,6 +92,8 @@ constexpr dbfs_t DEFAULT_PINK_NOISE_DB{ -20.0f };
 constexpr auto DEFAULT_SAMPLE_RATE{ 48000.0 };
 constexpr auto DEFAULT_BUFFER_SIZE{ 512 };
 constexpr auto SQRT3{ 1.7320508075688772935274463415059f };
+/** Used to keep data written by different threads on separate cache lines. */
+constexpr std::size_t CACHE_LINE_SIZE{ 64 };
 
 constexpr auto SPAT_MODE_BUTTONS_RADIO_GROUP_ID = 1;
 constexpr auto PREPARE_TO_RECORD_WINDOW_FILE_FORMAT_GROUP_ID = 2;
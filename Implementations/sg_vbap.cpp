@@ -57,6 +57,37 @@ struct TripletData {
 
 using triplet_list_t = std::vector<TripletData>;
 
+//==============================================================================
+/* Which speakers are joined by a side of a candidate triangle. Sized for the speakers of the setup rather than for
+ * MAX_NUM_SPEAKERS, since the matrix grows with the square of the speaker count. */
+class SpeakerConnections
+{
+    std::size_t mNumSpeakers{};
+    std::vector<bool> mConnections{};
+
+public:
+    explicit SpeakerConnections(std::size_t const numSpeakers)
+        : mNumSpeakers(numSpeakers)
+        , mConnections(numSpeakers * numSpeakers)
+    {
+    }
+    [[nodiscard]] bool areConnected(std::size_t const a, std::size_t const b) const
+    {
+        jassert(a < mNumSpeakers && b < mNumSpeakers);
+        return mConnections[a * mNumSpeakers + b];
+    }
+    void connect(std::size_t const a, std::size_t const b) { set(a, b, true); }
+    void disconnect(std::size_t const a, std::size_t const b) { set(a, b, false); }
+
+private:
+    void set(std::size_t const a, std::size_t const b, bool const connected)
+    {
+        jassert(a < mNumSpeakers && b < mNumSpeakers);
+        mConnections[a * mNumSpeakers + b] = connected;
+        mConnections[b * mNumSpeakers + a] = connected;
+    }
+};
+
 //==============================================================================
 /* Selects a vector base of a virtual source.
  * Calculates gain factors in that base.
@@ -526,7 +557,7 @@ static triplet_list_t generateTriplets(std::array<Position, MAX_NUM_SPEAKERS> co
     std::iota(std::begin(speakerIndexesSortedByElevation), std::end(speakerIndexesSortedByElevation), 0);
 
     // ...then we sort it according to the elevation values
-    auto const sortIndexesBySpeakerElevation = [speakers](size_t const & indexA, size_t const & indexB) -> bool {
+    auto const sortIndexesBySpeakerElevation = [&speakers](size_t const & indexA, size_t const & indexB) -> bool {
         return speakers[indexA].getPolar().elevation < speakers[indexB].getPolar().elevation;
     };
     std::sort(std::begin(speakerIndexesSortedByElevation),
@@ -535,8 +566,7 @@ static triplet_list_t generateTriplets(std::array<Position, MAX_NUM_SPEAKERS> co
 
     // ...then we test for valid triplets ONLY when the elevation difference is within a specified range for two
     // speakers
-    auto const connectionsPtr{ std::make_unique<std::array<std::array<bool, MAX_NUM_SPEAKERS>, MAX_NUM_SPEAKERS>>() };
-    auto & connections{ *connectionsPtr };
+    SpeakerConnections connections{ numSpeakers };
     triplet_list_t triplets{};
     for (size_t i{}; i < speakerIndexesSortedByElevation.size(); ++i) {
         auto const speaker1Index{ speakerIndexesSortedByElevation[i] };
@@ -566,12 +596,9 @@ static triplet_list_t generateTriplets(std::array<Position, MAX_NUM_SPEAKERS> co
                 auto const parallelepipedVolume{ parallelepipedVolumeSideLength(speaker1, speaker2, speaker3) };
                 static constexpr auto MIN_VOL_P_SIDE_LENGTH = 0.01f;
                 if (parallelepipedVolume > MIN_VOL_P_SIDE_LENGTH) {
-                    connections[narrow<std::size_t>(speaker1Index)][narrow<std::size_t>(speaker2Index)] = true;
-                    connections[narrow<std::size_t>(speaker2Index)][narrow<std::size_t>(speaker1Index)] = true;
-                    connections[narrow<std::size_t>(speaker1Index)][narrow<std::size_t>(speaker3Index)] = true;
-                    connections[narrow<std::size_t>(speaker3Index)][narrow<std::size_t>(speaker1Index)] = true;
-                    connections[narrow<std::size_t>(speaker2Index)][narrow<std::size_t>(speaker3Index)] = true;
-                    connections[narrow<std::size_t>(speaker3Index)][narrow<std::size_t>(speaker2Index)] = true;
+                    connections.connect(narrow<std::size_t>(speaker1Index), narrow<std::size_t>(speaker2Index));
+                    connections.connect(narrow<std::size_t>(speaker1Index), narrow<std::size_t>(speaker3Index));
+                    connections.connect(narrow<std::size_t>(speaker2Index), narrow<std::size_t>(speaker3Index));
 
                     TripletData newTripletData{};
 
@@ -599,7 +626,7 @@ static triplet_list_t generateTriplets(std::array<Position, MAX_NUM_SPEAKERS> co
 
     for (std::size_t i{}; i < numSpeakers; ++i) {
         for (auto j{ i + 1 }; j < numSpeakers; ++j) {
-            if (connections[i][j]) {
+            if (connections.areConnected(i, j)) {
                 auto const distance{ speakers[i].getCartesian().angleWith(speakers[j].getCartesian()) };
                 std::size_t k{};
                 while (distanceTable[k] < distance) {
@@ -625,13 +652,12 @@ static triplet_list_t generateTriplets(std::array<Position, MAX_NUM_SPEAKERS> co
     for (std::size_t i{}; i < tableSize; ++i) {
         auto const fstLs = distanceTableI[i];
         auto const secLs = distanceTableJ[i];
-        if (connections[fstLs][secLs]) {
+        if (connections.areConnected(fstLs, secLs)) {
             for (std::size_t j{}; j < numSpeakers; ++j) {
                 for (auto k{ j + 1 }; k < numSpeakers; ++k) {
                     if (j != fstLs && k != secLs && k != fstLs && j != secLs) {
                         if (linesIntersect(fstLs, secLs, j, k, speakers)) {
-                            connections[j][k] = false;
-                            connections[k][j] = false;
+                            connections.disconnect(j, k);
                         }
                     }
                 }
@@ -641,7 +667,7 @@ static triplet_list_t generateTriplets(std::array<Position, MAX_NUM_SPEAKERS> co
 
     /* Remove triangles which had crossing sides with
      * smaller triangles or include loudspeakers. */
-    auto const predicate = [&connections, speakers, numSpeakers](TripletData const & triplet) -> bool {
+    auto const predicate = [&connections, &speakers, numSpeakers](TripletData const & triplet) -> bool {
         auto const & i = triplet.tripletSpeakerNumber[0];
         auto const & j = triplet.tripletSpeakerNumber[1];
         auto const & k = triplet.tripletSpeakerNumber[2];
@@ -650,7 +676,7 @@ static triplet_list_t generateTriplets(std::array<Position, MAX_NUM_SPEAKERS> co
             return false;
         }
 
-        return connections[i][j] && connections[i][k] && connections[j][k];
+        return connections.areConnected(i, j) && connections.areConnected(i, k) && connections.areConnected(j, k);
     };
     auto const newTripletEnd{ std::partition(std::begin(triplets), std::end(triplets), predicate) };
 
@@ -19,9 +19,11 @@
 
 #include "sg_AbstractSpatAlgorithm.hpp"
 #include "Data/sg_LogicStrucs.hpp"
+#include "Data/sg_Narrow.hpp"
 #include "Data/sg_SpatMode.hpp"
 #include "sg_HrtfSpatAlgorithm.hpp"
 #include "sg_HybridSpatAlgorithm.hpp"
+#include "sg_Kernels.hpp"
 #include "sg_MbapSpatAlgorithm.hpp"
 #include "sg_PinkNoiseGenerator.hpp"
 #include "sg_StereoSpatAlgorithm.hpp"
@@ -30,6 +32,10 @@
 #include "juce_core/system/juce_PlatformDefs.h"
 #include "juce_events/juce_events.h"
 #include "tl/optional.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
 #include <memory>
 
 #ifdef USE_DOPPLER
@@ -47,24 +53,86 @@ bool isOscThread()
     return currentThread->getThreadName() == "JUCE OSC server";
 }
 
+//==============================================================================
+bool isAlgorithmBuilderThread()
+{
+    auto * currentThread{ juce::Thread::getCurrentThread() };
+    if (!currentThread) {
+        return false;
+    }
+    return currentThread->getThreadName() == SG_ALGORITHM_BUILDER_THREAD_NAME;
+}
+
+//==============================================================================
+bool isControlRateThread()
+{
+    auto * currentThread{ juce::Thread::getCurrentThread() };
+    if (!currentThread) {
+        return false;
+    }
+    return currentThread->getThreadName() == SG_CONTROL_RATE_THREAD_NAME;
+}
+
 //==============================================================================
 bool isProbablyAudioThread()
 {
-    return (!isOscThread() && !juce::MessageManager::getInstance()->isThisTheMessageThread());
+    return (!isOscThread() && !isAlgorithmBuilderThread() && !isControlRateThread()
+            && !juce::MessageManager::getInstance()->isThisTheMessageThread());
 }
 
 //==============================================================================
-AbstractSpatAlgorithm::AbstractSpatAlgorithm()
+void ActiveSources::sortByCost() noexcept
 {
+    std::sort(mEntries.begin(), mEntries.end(), [](Entry const & lhs, Entry const & rhs) {
+        return lhs.cost > rhs.cost;
+    });
+}
+
 #if SG_USE_FORK_UNION
+//==============================================================================
+WorkerPools::WorkerPools() : mNumThreads(std::thread::hardware_concurrency())
+{
     // TODO FU: we need to handle this failure better
-    if (!threadPool.try_spawn(std::thread::hardware_concurrency())) {
+    if (!mWholePool.try_spawn(mNumThreads)) {
         std::fprintf(stderr, "Failed to fork the threads\n");
         jassertfalse;
     }
-#endif
+
+    for (std::size_t poolSize{ 2 }; poolSize < mNumThreads; poolSize *= 2) {
+        auto pool{ std::make_unique<pool_type>() };
+        if (!pool->try_spawn(poolSize)) {
+            // getPool() falls back to the whole pool for the sizes that are missing.
+            std::fprintf(stderr, "Failed to fork a pool of %zu threads\n", poolSize);
+            break;
+        }
+        mSmallerPools.push_back(std::move(pool));
+    }
+}
+
+//==============================================================================
+WorkerPools::Pool WorkerPools::getPool(std::size_t const numWorkers) noexcept
+{
+    // 2-3 workers use the 2 threads pool, 4-7 workers the 4 threads pool, and so on.
+    if (numWorkers >= 2 && numWorkers < mNumThreads) {
+        auto const poolIndex{ static_cast<std::size_t>(std::bit_width(numWorkers)) - 2 };
+        if (poolIndex < mSmallerPools.size()) {
+            return Pool{ *mSmallerPools[poolIndex], std::size_t{ 2 } << poolIndex };
+        }
+    }
+    return Pool{ mWholePool, mNumThreads };
 }
 
+//==============================================================================
+WorkerPools & WorkerPools::getInstance()
+{
+    static WorkerPools instance{};
+    return instance;
+}
+#endif
+
+//==============================================================================
+AbstractSpatAlgorithm::AbstractSpatAlgorithm() = default;
+
 #if SG_USE_FORK_UNION
 namespace fu = ashvardanian::fork_union;
     #if SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS
@@ -139,12 +207,137 @@ void AbstractSpatAlgorithm::copyForkUnionBuffer(const gris::SpeakersAudioConfig
     #endif
 #endif
 
+//==============================================================================
+SpeakerRenderPlan const & AbstractSpatAlgorithm::getRenderPlan(AudioConfig const & config,
+                                                               SpeakersAudioConfig const * altSpeakerConfig) noexcept
+{
+    if (!altSpeakerConfig) {
+        // An AudioConfig that was not made by SpatGrisData::toAudioConfig() has to compile its plan itself.
+        jassert(config.speakerRenderPlan.isUpToDate(config.speakersAudioConfig));
+        return config.speakerRenderPlan;
+    }
+    if (altSpeakerConfig != mAltRenderPlanConfig) {
+        mAltRenderPlan.compile(*altSpeakerConfig);
+        mAltRenderPlanConfig = altSpeakerConfig;
+    }
+    jassert(mAltRenderPlan.isUpToDate(*altSpeakerConfig));
+    return mAltRenderPlan;
+}
+
+//==============================================================================
+void AbstractSpatAlgorithm::selectRenderPath(int const numSpatializedSpeakers) noexcept
+{
+    SG_ASSERT_BUILDER_THREAD;
+
+    auto const numSpeakers{ narrow<std::size_t>(std::max(numSpatializedSpeakers, 0)) };
+    mFixedSpeakerCountIndex = getFixedSpeakerCountIndex(numSpeakers);
+    mNumFixedSpeakers = mFixedSpeakerCountIndex ? numSpeakers : 0;
+}
+
+//==============================================================================
+void AbstractSpatAlgorithm::activate(bool const lockMemory)
+{
+    ASSERT_NOT_AUDIO_THREAD;
+
+    mHotMemory.clear();
+    listHotMemory(mHotMemory);
+    // The advice has to come before the faults for them to be served with huge pages.
+    mHotMemory.adviseHugePages();
+    mHotMemory.prefault();
+    if (lockMemory && !mHotMemory.lock()) {
+        DBG("Could not lock all the hot memory of the spatialization algorithm (see RLIMIT_MEMLOCK).");
+    }
+}
+
+//==============================================================================
+float AbstractSpatAlgorithm::renderSourceToFixedSpeakers(float const * inputSamples,
+                                                         int const numSamples,
+                                                         SpeakerRenderPlan const & renderPlan,
+                                                         SpeakerGainsRow & lastGains,
+                                                         SpeakerGainsRow const & targetGains,
+                                                         float const gainInterpolation,
+                                                         float const gainFactor,
+                                                         SpeakerAudioBuffer & speakersBuffer) const noexcept
+{
+    jassert(canRenderToFixedSpeakers(renderPlan));
+
+    auto const & kernels{ getMixKernels() };
+    auto * const * speakersChannels{ speakersBuffer.getRawChannels() };
+
+    // Speakers with a constant gain or a linear ramp are gathered for the specialized kernel. Smoothed ramps are serial
+    // anyway and are mixed right away.
+    std::array<float *, MAX_FIXED_SPEAKER_COUNT> dests{};
+    std::array<float, MAX_FIXED_SPEAKER_COUNT> gains{};
+    std::array<float, MAX_FIXED_SPEAKER_COUNT> slopes{};
+    auto cost{ 0.0f };
+    for (std::size_t i{}; i < mNumFixedSpeakers; ++i) {
+        auto const outputPatch{ renderPlan.speakers[i] };
+        if (!lastGains.contains(outputPatch)) {
+            // not part of the setup that the gains were computed for
+            continue;
+        }
+        auto & currentGain{ lastGains[outputPatch] };
+        auto const & targetGain{ targetGains[outputPatch] };
+        auto const gainDiff{ targetGain - currentGain };
+        auto const gainSlope{ gainDiff / narrow<float>(numSamples) };
+        auto * outputSamples{ speakersChannels[outputPatch.removeOffset<std::size_t>()] };
+
+        if (juce::approximatelyEqual(gainSlope, 0.f) || std::abs(gainDiff) < SMALL_GAIN) {
+            // no interpolation
+            currentGain = targetGain;
+            if (currentGain >= SMALL_GAIN) {
+                speakersBuffer.markDirty(outputPatch);
+                cost += ActiveSources::STATIC_GAIN_COST;
+                dests[i] = outputSamples;
+                gains[i] = currentGain;
+            }
+            continue;
+        }
+
+        // interpolation necessary
+        speakersBuffer.markDirty(outputPatch);
+        cost += ActiveSources::RAMPING_GAIN_COST;
+        if (juce::approximatelyEqual(gainInterpolation, 0.f)) {
+            // linear interpolation over buffer size
+            dests[i] = outputSamples;
+            gains[i] = currentGain;
+            slopes[i] = gainSlope;
+            currentGain += gainSlope * narrow<float>(numSamples);
+        } else if (targetGain < SMALL_GAIN) {
+            // log interpolation with 1st order filter, targeting silence
+            currentGain = kernels.addWithSmoothedFadeOut(outputSamples,
+                                                         inputSamples,
+                                                         currentGain,
+                                                         targetGain,
+                                                         gainFactor,
+                                                         SMALL_GAIN,
+                                                         numSamples);
+        } else {
+            // log interpolation with 1st order filter
+            currentGain = kernels.addWithSmoothedRamp(outputSamples,
+                                                      inputSamples,
+                                                      currentGain,
+                                                      targetGain,
+                                                      gainFactor,
+                                                      numSamples);
+        }
+    }
+
+    jassert(mFixedSpeakerCountIndex);
+    kernels.addToFixedSpeakers[*mFixedSpeakerCountIndex](dests.data(),
+                                                          inputSamples,
+                                                          gains.data(),
+                                                          slopes.data(),
+                                                          numSamples);
+    return cost;
+}
+
 //==============================================================================
 void AbstractSpatAlgorithm::fixDirectOutsIntoPlace(SourcesData const & sources,
                                                    SpeakerSetup const & speakerSetup,
                                                    SpatMode const & projectSpatMode) noexcept
 {
-    JUCE_ASSERT_MESSAGE_THREAD;
+    SG_ASSERT_BUILDER_THREAD;
 
     auto const getFakeSourceData = [&](SourceData const & source, SpeakerData const & speaker) -> SourceData {
         auto fakeSourceData{ source };
@@ -188,14 +381,14 @@ std::unique_ptr<AbstractSpatAlgorithm> AbstractSpatAlgorithm::make(SpeakerSetup
                                                                    double const sampleRate,
                                                                    int const bufferSize)
 {
-    JUCE_ASSERT_MESSAGE_THREAD;
+    SG_ASSERT_BUILDER_THREAD;
 
     if (stereoMode) {
         switch (*stereoMode) {
         case StereoMode::hrtf:
             return HrtfSpatAlgorithm::make(speakerSetup, projectSpatMode, sources, sampleRate, bufferSize);
         case StereoMode::stereo:
-            return StereoSpatAlgorithm::make(speakerSetup, projectSpatMode, sources, sources.getKeys());
+            return StereoSpatAlgorithm::make(speakerSetup, projectSpatMode, sources);
 #ifdef USE_DOPPLER
         case StereoMode::doppler:
             return DopplerSpatAlgorithm::make(sampleRate, bufferSize);
@@ -206,11 +399,11 @@ std::unique_ptr<AbstractSpatAlgorithm> AbstractSpatAlgorithm::make(SpeakerSetup
 
     switch (projectSpatMode) {
     case SpatMode::vbap:
-        return VbapSpatAlgorithm::make(speakerSetup, sources.getKeys());
+        return VbapSpatAlgorithm::make(speakerSetup);
     case SpatMode::mbap:
-        return MbapSpatAlgorithm::make(speakerSetup, sources.getKeys());
+        return MbapSpatAlgorithm::make(speakerSetup);
     case SpatMode::hybrid:
-        return HybridSpatAlgorithm::make(speakerSetup, sources.getKeys());
+        return HybridSpatAlgorithm::make(speakerSetup);
     case SpatMode::invalid:
         break;
     }
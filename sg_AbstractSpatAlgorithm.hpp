@@ -19,19 +19,28 @@
 
 #pragma once
 
+#include "Containers/sg_HotMemory.hpp"
+#include "Containers/sg_StaticVector.hpp"
 #include "Containers/sg_TaggedAudioBuffer.hpp"
 #include "Data/StrongTypes/sg_SourceIndex.hpp"
 #include "Data/sg_AudioStructs.hpp"
 #include "Data/sg_LogicStrucs.hpp"
 #include "Data/sg_Macros.hpp"
+#include "Data/sg_SourceGains.hpp"
 #include "Data/sg_SpatMode.hpp"
 #include "Data/sg_Triplet.hpp"
+#include "sg_ParallelismGovernor.hpp"
 #include "juce_audio_basics/juce_audio_basics.h"
 #include "juce_core/juce_core.h"
 #include "juce_core/system/juce_PlatformDefs.h"
 #include "tl/optional.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
 #include <memory>
+#include <thread>
+#include <vector>
 
 #if SG_USE_FORK_UNION
     #if JUCE_WINDOWS
@@ -47,7 +56,14 @@ namespace gris
 /** @return true if executed from the OSC thread. */
 bool isOscThread();
 
-/** @return true if executed neither from the OSC thread nor from the message thread. */
+/** @return true if executed from the thread of an AsyncSpatAlgorithmBuilder. */
+bool isAlgorithmBuilderThread();
+
+/** @return true if executed from the thread of a ControlRateSpatAlgorithm. */
+bool isControlRateThread();
+
+/** @return true if executed neither from the OSC thread, the message thread, an algorithm builder thread nor a control
+ * rate thread. */
 bool isProbablyAudioThread();
 
 //==============================================================================
@@ -67,6 +83,96 @@ bool isProbablyAudioThread();
 #endif
 // clang-format on
 
+//==============================================================================
+/** A source to render and the estimated cost of rendering it. */
+struct ActiveSource {
+    source_index_t sourceIndex{};
+    float cost{};
+};
+
+//==============================================================================
+/** The sources that have something to render in the current block, with an estimate of what rendering them costs.
+ *
+ * The algorithms dispatch these instead of every source so that no task is spent on a muted or silent source. Sorted
+ * from the most to the least expensive, they also let a dynamic scheduler balance the load : the big tasks get started
+ * first and the small ones fill the gaps.
+ */
+class ActiveSources
+{
+public:
+    using Entry = ActiveSource;
+    /** The relative cost of mixing a source into a speaker with a constant gain (vectorized). */
+    static constexpr float STATIC_GAIN_COST = 1.0f;
+    /** The relative cost of mixing a source into a speaker while its gain is ramping (sample by sample). */
+    static constexpr float RAMPING_GAIN_COST = 4.0f;
+
+private:
+    using container_type = StaticVector<Entry, MAX_NUM_SOURCES>;
+    container_type mEntries{};
+    float mTotalCost{};
+
+public:
+    //==============================================================================
+    void clear() noexcept
+    {
+        mEntries.clear();
+        mTotalCost = 0.0f;
+    }
+    void add(source_index_t const sourceIndex, float const cost)
+    {
+        mEntries.push_back(Entry{ sourceIndex, cost });
+        mTotalCost += cost;
+    }
+    /** Puts the most expensive sources first. Does not allocate. */
+    void sortByCost() noexcept;
+    //==============================================================================
+    [[nodiscard]] std::size_t size() const noexcept { return mEntries.size(); }
+    [[nodiscard]] float getTotalCost() const noexcept { return mTotalCost; }
+    [[nodiscard]] source_index_t operator[](std::size_t const index) const { return mEntries[index].sourceIndex; }
+    [[nodiscard]] container_type::const_iterator begin() const { return mEntries.begin(); }
+    [[nodiscard]] container_type::const_iterator end() const { return mEntries.end(); }
+};
+
+#if SG_USE_FORK_UNION
+//==============================================================================
+/** The fork_union thread pools that the algorithms fork their work on.
+ *
+ * There is a single set per process : every algorithm instance forks on the same threads instead of spawning its own.
+ * The whole pool has one thread per core. The smaller pools of 2, 4, 8... threads let a fork only wake the threads
+ * that the governor asked for, since forking fewer tasks than threads on the whole pool still wakes all of them. The
+ * pools being shared, only one thread at a time may fork on them : the audio thread.
+ */
+class WorkerPools
+{
+public:
+    using pool_type = ashvardanian::fork_union::thread_pool_t;
+    /** A pool and the number of threads it has. */
+    struct Pool {
+        pool_type & threads;
+        std::size_t numThreads;
+    };
+
+private:
+    pool_type mWholePool{};
+    std::size_t mNumThreads{};
+    std::vector<std::unique_ptr<pool_type>> mSmallerPools{};
+    //==============================================================================
+    WorkerPools();
+
+public:
+    ~WorkerPools() = default;
+    SG_DELETE_COPY_AND_MOVE(WorkerPools)
+    //==============================================================================
+    [[nodiscard]] pool_type & getWholePool() noexcept { return mWholePool; }
+    /** @return the largest pool that does not have more than numWorkers threads, or the whole pool if none is smaller
+     * than numWorkers. */
+    [[nodiscard]] Pool getPool(std::size_t numWorkers) noexcept;
+    //==============================================================================
+    /** @return the pools of the process. They get spawned by the first call. */
+    [[nodiscard]] static WorkerPools & getInstance();
+};
+#endif
+
 //==============================================================================
 /** Base class for a spatialization algorithm. */
 class AbstractSpatAlgorithm
@@ -78,6 +184,23 @@ public:
         notEnoughCubeSpeakers,
         flatDomeSpeakersTooFarApart,
     };
+    /** How much memory an algorithm keeps for its sources. */
+    struct MemoryReport {
+        /** The algorithm itself and everything that it allocated for its sources. */
+        std::size_t numBytes{};
+        /** The part of it that holds the state of the sources. */
+        std::size_t numSourcesBytes{};
+        /** The gains that the audio thread reads or ramps for the sources : their current and their last gains. */
+        std::size_t numHotGainsBytes{};
+        //==============================================================================
+        MemoryReport & operator+=(MemoryReport const & other) noexcept
+        {
+            numBytes += other.numBytes;
+            numSourcesBytes += other.numSourcesBytes;
+            numHotGainsBytes += other.numHotGainsBytes;
+            return *this;
+        }
+    };
     //==============================================================================
     AbstractSpatAlgorithm();
     virtual ~AbstractSpatAlgorithm() = default;
@@ -106,7 +229,8 @@ public:
     /** Updates the data of a source (its position, span, etc.).
      *
      * This is a function that is called really often and that does not happen on the audio thread, so be very careful
-     * not to do anything here that might slow down the audio thread. */
+     * not to do anything here that might slow down the audio thread. It can be called from several threads at once
+     * (e.g. the OSC thread and the message thread), even for the same source : the most recent call wins. */
     virtual void updateSpatData(source_index_t sourceIndex, SourceData const & sourceData) noexcept = 0;
     /** Processes the actual audio spatialization.
      *
@@ -133,6 +257,39 @@ public:
     [[nodiscard]] virtual bool hasTriplets() const noexcept = 0;
     /** @return the error that happened during instantiation or tl::nullopt if none. */
     [[nodiscard]] virtual tl::optional<Error> getError() const noexcept = 0;
+    /** Picks the render path specialized for this number of spatialized speakers, if there is one (see
+     * FIXED_SPEAKER_COUNTS). Called by make(). */
+    virtual void selectRenderPath(int numSpatializedSpeakers) noexcept;
+    /** Jumps the gains that process() ramps from straight to the most recent targets, so that the next block renders
+     * without a ramp. Called from the audio thread when an algorithm that was not rendered for a while resumes. The
+     * default does nothing. */
+    virtual void snapToTargetGains() noexcept {}
+    /** Lists the memory that process() touches. Overrides list the algorithm itself and whatever it owns. */
+    virtual void listHotMemory(HotMemory & /*hotMemory*/) const {}
+    /** Adapts the instance to a new sample rate or maximum block size.
+     *
+     * Only what depends on those values gets reallocated : the gains, the fields and the sources' data are kept and
+     * nothing is reloaded from disk, which makes this a lot cheaper than make(). The default does nothing since most
+     * algorithms depend on neither. Should not be called from the audio thread, nor while another thread renders with
+     * this instance. Call activate() again afterwards if the hot state has to be ready.
+     *
+     * @param sampleRate the new sample rate.
+     * @param maxBlockSize the largest block that process() will be given.
+     */
+    virtual void prepare(double /*sampleRate*/, int /*maxBlockSize*/) {}
+    //==============================================================================
+    /** Gets the instance ready to go live.
+     *
+     * Takes the page faults of the hot state (see listHotMemory()) ahead of time, asks for transparent huge pages where
+     * available and optionally locks the pages in physical memory. Should not be called from the audio thread, nor
+     * while another thread renders with this instance.
+     */
+    void activate(bool lockMemory);
+    /** @return the size of the hot state listed by activate() and how much of it is resident right now. */
+    [[nodiscard]] HotMemory::Report getHotMemoryReport() const { return mHotMemory.getReport(); }
+    /** @return how much memory the sources' state takes. Algorithms that wrap others include them. The default reports
+     * nothing. */
+    [[nodiscard]] virtual MemoryReport getMemoryReport() const { return MemoryReport{}; }
     //==============================================================================
     /** Builds a spatialization algorithm. If the instantiation fails, this will hold a DummySpatAlgorithm.
      *
@@ -150,14 +307,102 @@ public:
                                                                      double sampleRate,
                                                                      int bufferSize);
 
+#if SG_USE_FORK_UNION
+    /** @return what the parallelism governor decided so far. Can be called from any thread. */
+    [[nodiscard]] ParallelismGovernor::Stats getParallelismStats() const noexcept
+    {
+        return mParallelismGovernor.getStats();
+    }
+#endif
+
 protected:
 #if SG_USE_FORK_UNION
-    ashvardanian::fork_union::thread_pool_t threadPool;
+    /** The whole pool of the process, shared with the other instances. */
+    ashvardanian::fork_union::thread_pool_t & threadPool{ WorkerPools::getInstance().getWholePool() };
+    ParallelismGovernor mParallelismGovernor{ std::thread::hardware_concurrency() };
+    //==============================================================================
+    /** Calls task(activeSourceIndex, threadIndex) for every active source, on as many workers as the governor decides.
+     *
+     * The work is forked on the largest of the WorkerPools that does not exceed that number of workers. The sources are
+     * picked in order, so sorting them by cost first gets the most expensive ones started first.
+     */
+    template<typename Task>
+    void dispatchActiveSources(ActiveSources const & activeSources, int numSamples, Task && task) noexcept;
 #endif
+    //==============================================================================
+    /** @return the render plan of the config, or the one of the altSpeakerConfig if there is one.
+     *
+     * The plan of an altSpeakerConfig is compiled the first time that config is seen. Alternative configs belong to the
+     * algorithm that wraps this one and don't change after it is built.
+     */
+    [[nodiscard]] SpeakerRenderPlan const & getRenderPlan(AudioConfig const & config,
+                                                          SpeakersAudioConfig const * altSpeakerConfig) noexcept;
+    /** @return true if the plan has exactly the number of speakers that selectRenderPath() specialized for. A plan can
+     * be smaller when speakers are muted, in which case the generic path has to be used. */
+    [[nodiscard]] bool canRenderToFixedSpeakers(SpeakerRenderPlan const & renderPlan) const noexcept
+    {
+        return mFixedSpeakerCountIndex.has_value() && renderPlan.speakers.size() == mNumFixedSpeakers;
+    }
+    /** Mixes a source into every speaker of the render plan with the kernels specialized for its speaker count.
+     *
+     * Follows the same gain rules as the generic VBAP and MBAP paths. The outputs are written without atomics, so this
+     * can only be used when a single thread writes the speakers. Only call when canRenderToFixedSpeakers() is true.
+     *
+     * @return the cost of the block, in ActiveSources units.
+     */
+    [[nodiscard]] float renderSourceToFixedSpeakers(float const * inputSamples,
+                                                    int numSamples,
+                                                    SpeakerRenderPlan const & renderPlan,
+                                                    SpeakerGainsRow & lastGains,
+                                                    SpeakerGainsRow const & targetGains,
+                                                    float gainInterpolation,
+                                                    float gainFactor,
+                                                    SpeakerAudioBuffer & speakersBuffer) const noexcept;
 
 private:
+    //==============================================================================
+    SpeakerRenderPlan mAltRenderPlan{};
+    /** The config that mAltRenderPlan was compiled from. */
+    SpeakersAudioConfig const * mAltRenderPlanConfig{};
+    HotMemory mHotMemory{};
+    tl::optional<std::size_t> mFixedSpeakerCountIndex{};
+    std::size_t mNumFixedSpeakers{};
     //==============================================================================
     JUCE_LEAK_DETECTOR(AbstractSpatAlgorithm)
 };
 
+#if SG_USE_FORK_UNION
+//==============================================================================
+template<typename Task>
+void AbstractSpatAlgorithm::dispatchActiveSources(ActiveSources const & activeSources,
+                                                  int const numSamples,
+                                                  Task && task) noexcept
+{
+    namespace fu = ashvardanian::fork_union;
+
+    auto const numTasks{ activeSources.size() };
+    auto const work{ static_cast<double>(activeSources.getTotalCost()) * numSamples };
+    auto const numWorkers{ std::min(mParallelismGovernor.update(work), numTasks) };
+
+    if (numWorkers < 2) {
+        // Not worth waking the pool. The calling thread is the pool's thread 0.
+        for (std::size_t taskIndex{}; taskIndex < numTasks; ++taskIndex) {
+            task(taskIndex, std::size_t{});
+        }
+        return;
+    }
+
+    auto const pool{ WorkerPools::getInstance().getPool(numWorkers) };
+
+    // One prong per thread of the pool. They pull the sources one at a time until there are none left.
+    std::atomic<std::size_t> nextTask{};
+    fu::for_n(pool.threads, pool.numThreads, [&](fu::prong_t prong) noexcept {
+        for (auto taskIndex{ nextTask.fetch_add(1, std::memory_order_relaxed) }; taskIndex < numTasks;
+             taskIndex = nextTask.fetch_add(1, std::memory_order_relaxed)) {
+            task(taskIndex, prong.thread_index);
+        }
+    });
+}
+#endif
+
 } // namespace gris
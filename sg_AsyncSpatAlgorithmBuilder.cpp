@@ -0,0 +1,181 @@
+/*
+ This file is part of SpatGRIS.
+
+ Developers: Gaël Lane Lépine, Samuel Béland, Olivier Bélanger, Nicolas Masson
+
+ SpatGRIS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ SpatGRIS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with SpatGRIS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sg_AsyncSpatAlgorithmBuilder.hpp"
+#include "sg_Reclaimer.hpp"
+#include <utility>
+
+namespace gris
+{
+//==============================================================================
+std::unique_ptr<AsyncSpatAlgorithmBuilder::Request>
+    AsyncSpatAlgorithmBuilder::Request::make(SpeakerSetup const & speakerSetup,
+                                             SpatMode const & projectSpatMode,
+                                             tl::optional<StereoMode> stereoMode,
+                                             SourcesData const & sources,
+                                             double const sampleRate,
+                                             int const bufferSize)
+{
+    JUCE_ASSERT_MESSAGE_THREAD;
+
+    auto request{ std::make_unique<Request>() };
+
+    // juce::ValueTree is reference-counted and not thread-safe : the builder gets its own.
+    request->speakerSetup.speakerSetupValueTree = speakerSetup.speakerSetupValueTree.createCopy();
+    for (auto const & speaker : speakerSetup.speakers) {
+        request->speakerSetup.speakers.add(speaker.key, std::make_unique<SpeakerData>(*speaker.value));
+    }
+    request->speakerSetup.ordering = speakerSetup.ordering;
+    request->speakerSetup.spatMode = speakerSetup.spatMode;
+    request->speakerSetup.diffusion = speakerSetup.diffusion;
+    request->speakerSetup.generalMute = speakerSetup.generalMute;
+
+    request->projectSpatMode = projectSpatMode;
+    request->stereoMode = stereoMode;
+    for (auto const & source : sources) {
+        request->sources.add(source.key, std::make_unique<SourceData>(*source.value));
+    }
+    request->sampleRate = sampleRate;
+    request->bufferSize = bufferSize;
+
+    return request;
+}
+
+//==============================================================================
+AsyncSpatAlgorithmBuilder::AsyncSpatAlgorithmBuilder()
+    : AsyncSpatAlgorithmBuilder([](std::function<void()> function) {
+        juce::MessageManager::callAsync(std::move(function));
+    })
+{
+}
+
+//==============================================================================
+AsyncSpatAlgorithmBuilder::AsyncSpatAlgorithmBuilder(Dispatcher dispatcher)
+    : juce::Thread(SG_ALGORITHM_BUILDER_THREAD_NAME)
+    , mDispatcher(std::move(dispatcher))
+{
+    jassert(mDispatcher);
+    startThread();
+}
+
+//==============================================================================
+AsyncSpatAlgorithmBuilder::~AsyncSpatAlgorithmBuilder()
+{
+    cancel();
+    signalThreadShouldExit();
+    notify();
+    // A negative timeout waits for as long as it takes.
+    stopThread(-1);
+}
+
+//==============================================================================
+void AsyncSpatAlgorithmBuilder::build(std::unique_ptr<Request> request, Callback onBuilt)
+{
+    JUCE_ASSERT_MESSAGE_THREAD;
+    jassert(request);
+    jassert(onBuilt);
+
+    {
+        juce::ScopedLock const lock{ mLock };
+        mPendingRequest = std::move(request);
+        mPendingCallback = std::move(onBuilt);
+        mPendingGeneration = ++mLatestGeneration;
+        mIsBuilding.store(true);
+    }
+    notify();
+}
+
+//==============================================================================
+void AsyncSpatAlgorithmBuilder::cancel()
+{
+    JUCE_ASSERT_MESSAGE_THREAD;
+
+    {
+        juce::ScopedLock const lock{ mLock };
+        mPendingRequest.reset();
+        mPendingCallback = nullptr;
+        ++mLatestGeneration;
+    }
+    // Lets the thread clear mIsBuilding if it was idle.
+    notify();
+}
+
+//==============================================================================
+bool AsyncSpatAlgorithmBuilder::isBuilding() const noexcept
+{
+    return mIsBuilding.load();
+}
+
+//==============================================================================
+void AsyncSpatAlgorithmBuilder::run()
+{
+    while (!threadShouldExit()) {
+        std::unique_ptr<Request> request{};
+        Callback onBuilt{};
+        std::uint64_t generation{};
+        {
+            juce::ScopedLock const lock{ mLock };
+            request = std::move(mPendingRequest);
+            onBuilt = std::exchange(mPendingCallback, nullptr);
+            generation = mPendingGeneration;
+            if (!request) {
+                mIsBuilding.store(false);
+            }
+        }
+
+        if (!request) {
+            wait(-1);
+            continue;
+        }
+
+        auto algorithm{ AbstractSpatAlgorithm::make(request->speakerSetup,
+                                                    request->projectSpatMode,
+                                                    request->stereoMode,
+                                                    request->sources,
+                                                    request->sampleRate,
+                                                    request->bufferSize) };
+
+        if (generation == mLatestGeneration.load()) {
+            // The first blocks would otherwise take the page faults.
+            algorithm->activate(request->lockMemory);
+        }
+
+        if (generation != mLatestGeneration.load()) {
+            // Superseded while it was being built : don't keep the next request waiting for its teardown.
+            Reclaimer::retire(std::move(algorithm), "superseded spatialization algorithm");
+            continue;
+        }
+
+        // std::function has to be copyable : the algorithm travels in a shared holder. If the message is never
+        // delivered (the app is shutting down), the holder still frees it.
+        auto holder{ std::make_shared<std::unique_ptr<AbstractSpatAlgorithm>>(std::move(algorithm)) };
+        mDispatcher(
+            [weakThis = juce::WeakReference<AsyncSpatAlgorithmBuilder>{ this },
+             holder,
+             generation,
+             onBuilt = std::move(onBuilt)]() {
+                if (weakThis == nullptr || generation != weakThis->mLatestGeneration.load()) {
+                    return;
+                }
+                onBuilt(std::move(*holder));
+            });
+    }
+}
+
+} // namespace gris
@@ -0,0 +1,109 @@
+/*
+ This file is part of SpatGRIS.
+
+ Developers: Gaël Lane Lépine, Samuel Béland, Olivier Bélanger, Nicolas Masson
+
+ SpatGRIS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ SpatGRIS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with SpatGRIS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "Data/sg_LogicStrucs.hpp"
+#include "Data/sg_Macros.hpp"
+#include "Data/sg_SpatMode.hpp"
+#include "sg_AbstractSpatAlgorithm.hpp"
+#include "tl/optional.hpp"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+namespace gris
+{
+//==============================================================================
+/** Builds spatialization algorithms on a background thread.
+ *
+ * AbstractSpatAlgorithm::make() triangulates the speakers, fills the MBAP field and loads the HRIRs : on big setups
+ * this takes seconds that the message thread would otherwise spend frozen. The algorithms are delivered on the message
+ * thread, activated (see AbstractSpatAlgorithm::activate()) and ready to be handed to a HotSwappableSpatAlgorithm.
+ *
+ * Only the latest request matters : a request replaces the one that is still waiting, and an algorithm that was built
+ * for a request that has since been superseded is handed to the Reclaimer instead of being delivered.
+ */
+class AsyncSpatAlgorithmBuilder final : private juce::Thread
+{
+public:
+    //==============================================================================
+    /** Everything make() needs. The data is copied so that the message thread can keep editing its own. */
+    struct Request {
+        SpeakerSetup speakerSetup{};
+        SpatMode projectSpatMode{};
+        tl::optional<StereoMode> stereoMode{};
+        SourcesData sources{};
+        double sampleRate{};
+        int bufferSize{};
+        /** Whether the hot state of the algorithm should be locked in physical memory. */
+        bool lockMemory{};
+        //==============================================================================
+        /** Deep-copies the data of a make() call. Should be called from the message thread. */
+        [[nodiscard]] static std::unique_ptr<Request> make(SpeakerSetup const & speakerSetup,
+                                                           SpatMode const & projectSpatMode,
+                                                           tl::optional<StereoMode> stereoMode,
+                                                           SourcesData const & sources,
+                                                           double sampleRate,
+                                                           int bufferSize);
+    };
+    /** Receives the built algorithm on the message thread. Check getError() as the instantiation might have failed. */
+    using Callback = std::function<void(std::unique_ptr<AbstractSpatAlgorithm>)>;
+    /** Posts a function to the message thread. */
+    using Dispatcher = std::function<void(std::function<void()>)>;
+
+private:
+    //==============================================================================
+    juce::CriticalSection mLock{};
+    std::unique_ptr<Request> mPendingRequest{};
+    Callback mPendingCallback{};
+    std::uint64_t mPendingGeneration{};
+    std::atomic<std::uint64_t> mLatestGeneration{};
+    std::atomic<bool> mIsBuilding{};
+    Dispatcher mDispatcher{};
+
+public:
+    //==============================================================================
+    /** Delivers the algorithms through juce::MessageManager::callAsync(). */
+    AsyncSpatAlgorithmBuilder();
+    /** Delivers the algorithms through a custom dispatcher (e.g. a queue that a test drains). */
+    explicit AsyncSpatAlgorithmBuilder(Dispatcher dispatcher);
+    /** Waits for the algorithm that is being built, if any : make() cannot be interrupted. */
+    ~AsyncSpatAlgorithmBuilder() override;
+    SG_DELETE_COPY_AND_MOVE(AsyncSpatAlgorithmBuilder)
+    //==============================================================================
+    /** Queues a request, replacing the one that is still waiting. onBuilt is only called if no other request was made
+     * in the meantime. Should be called from the message thread. */
+    void build(std::unique_ptr<Request> request, Callback onBuilt);
+    /** Drops the waiting request and makes sure that the one being built won't be delivered. */
+    void cancel();
+    /** @return true while a request is waiting or being built. */
+    [[nodiscard]] bool isBuilding() const noexcept;
+
+private:
+    //==============================================================================
+    void run() override;
+    //==============================================================================
+    JUCE_DECLARE_WEAK_REFERENCEABLE(AsyncSpatAlgorithmBuilder)
+    JUCE_LEAK_DETECTOR(AsyncSpatAlgorithmBuilder)
+};
+
+} // namespace gris
@@ -0,0 +1,232 @@
+/*
+ This file is part of SpatGRIS.
+
+ Developers: Gaël Lane Lépine, Samuel Béland, Olivier Bélanger, Nicolas Masson
+
+ SpatGRIS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ SpatGRIS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with SpatGRIS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sg_ControlRateSpatAlgorithm.hpp"
+#include "Data/sg_Narrow.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace gris
+{
+//==============================================================================
+double ControlRateSpatAlgorithm::LatencyHistogram::getBucketLimitMs(std::size_t const bucket) noexcept
+{
+    jassert(bucket < NUM_BUCKETS);
+    return std::ldexp(1.0, narrow<int>(bucket)) / 1000.0;
+}
+
+//==============================================================================
+double ControlRateSpatAlgorithm::LatencyHistogram::getPercentileMs(double const percentile) const noexcept
+{
+    jassert(percentile >= 0.0 && percentile <= 1.0);
+    if (numUpdates == 0) {
+        return 0.0;
+    }
+
+    auto const target{ std::max(
+        static_cast<std::uint64_t>(std::ceil(percentile * static_cast<double>(numUpdates))),
+        std::uint64_t{ 1 }) };
+    std::uint64_t numBelow{};
+    for (std::size_t bucket{}; bucket < NUM_BUCKETS; ++bucket) {
+        numBelow += counts[bucket];
+        if (numBelow >= target) {
+            return getBucketLimitMs(bucket);
+        }
+    }
+    return getBucketLimitMs(NUM_BUCKETS - 1);
+}
+
+//==============================================================================
+ControlRateSpatAlgorithm::ControlRateSpatAlgorithm(std::unique_ptr<AbstractSpatAlgorithm> innerAlgorithm,
+                                                   double const sampleRate,
+                                                   int const bufferSize)
+    : juce::Thread(SG_CONTROL_RATE_THREAD_NAME)
+    , mInnerAlgorithm(std::move(innerAlgorithm))
+{
+    jassert(mInnerAlgorithm);
+    setPeriod(sampleRate, bufferSize);
+    startThread(juce::Thread::Priority::high);
+}
+
+//==============================================================================
+ControlRateSpatAlgorithm::~ControlRateSpatAlgorithm()
+{
+    signalThreadShouldExit();
+    notify();
+    stopThread(-1);
+}
+
+//==============================================================================
+void ControlRateSpatAlgorithm::updateSpatData(source_index_t const sourceIndex,
+                                              SourceData const & sourceData) noexcept
+{
+    ASSERT_NOT_AUDIO_THREAD;
+
+    auto & updater{ mPendingSources[sourceIndex].updater };
+    auto * token{ updater.acquire() };
+    if (!token) {
+        return;
+    }
+    token->get() = ReceivedSourceData{ sourceData, juce::Time::getHighResolutionTicks() };
+    updater.setMostRecent(token);
+
+    // The release makes the token visible to the worker before the bit is.
+    auto const bit{ sourceIndex.removeOffset<std::size_t>() };
+    mDirtySources[bit / 64].fetch_or(std::uint64_t{ 1 } << (bit % 64), std::memory_order_release);
+}
+
+//==============================================================================
+void ControlRateSpatAlgorithm::process(AudioConfig const & config,
+                                       SourceAudioBuffer & sourcesBuffer,
+                                       SpeakerAudioBuffer & speakersBuffer,
+#if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
+                                       ForkUnionBuffer & forkUnionBuffer,
+#endif
+                                       juce::AudioBuffer<float> & stereoBuffer,
+                                       SourcePeaks const & sourcePeaks,
+                                       SpeakersAudioConfig const * altSpeakerConfig)
+{
+    ASSERT_AUDIO_THREAD;
+
+#if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
+    mInnerAlgorithm->process(config,
+                             sourcesBuffer,
+                             speakersBuffer,
+                             forkUnionBuffer,
+                             stereoBuffer,
+                             sourcePeaks,
+                             altSpeakerConfig);
+#else
+    mInnerAlgorithm->process(config, sourcesBuffer, speakersBuffer, stereoBuffer, sourcePeaks, altSpeakerConfig);
+#endif
+}
+
+//==============================================================================
+juce::Array<Triplet> ControlRateSpatAlgorithm::getTriplets() const noexcept
+{
+    return mInnerAlgorithm->getTriplets();
+}
+
+//==============================================================================
+bool ControlRateSpatAlgorithm::hasTriplets() const noexcept
+{
+    return mInnerAlgorithm->hasTriplets();
+}
+
+//==============================================================================
+tl::optional<AbstractSpatAlgorithm::Error> ControlRateSpatAlgorithm::getError() const noexcept
+{
+    return mInnerAlgorithm->getError();
+}
+
+//==============================================================================
+void ControlRateSpatAlgorithm::listHotMemory(HotMemory & hotMemory) const
+{
+    // The audio thread only reads the wrapped algorithm : the pending data belongs to the OSC and worker threads.
+    mInnerAlgorithm->listHotMemory(hotMemory);
+}
+
+//==============================================================================
+AbstractSpatAlgorithm::MemoryReport ControlRateSpatAlgorithm::getMemoryReport() const
+{
+    MemoryReport report{ sizeof(*this), sizeof(mPendingSources) };
+    report += mInnerAlgorithm->getMemoryReport();
+    return report;
+}
+
+//==============================================================================
+void ControlRateSpatAlgorithm::prepare(double const sampleRate, int const maxBlockSize)
+{
+    setPeriod(sampleRate, maxBlockSize);
+    mInnerAlgorithm->prepare(sampleRate, maxBlockSize);
+}
+
+//==============================================================================
+ControlRateSpatAlgorithm::LatencyHistogram ControlRateSpatAlgorithm::getLatencyHistogram() const noexcept
+{
+    LatencyHistogram histogram{};
+    for (std::size_t bucket{}; bucket < LatencyHistogram::NUM_BUCKETS; ++bucket) {
+        histogram.counts[bucket] = mLatencyCounts[bucket].load(std::memory_order_relaxed);
+    }
+    histogram.numUpdates = mNumUpdates.load();
+    histogram.maxMs = mMaxLatencyMs.load();
+    return histogram;
+}
+
+//==============================================================================
+void ControlRateSpatAlgorithm::setPeriod(double const sampleRate, int const bufferSize) noexcept
+{
+    jassert(sampleRate > 0.0 && bufferSize > 0);
+    auto const blockDurationMs{ static_cast<double>(bufferSize) * 1000.0 / sampleRate };
+    // Wake up at least once per block : juce::Thread::wait() only has a millisecond resolution.
+    mPeriodMs.store(std::max(static_cast<int>(blockDurationMs), 1));
+}
+
+//==============================================================================
+void ControlRateSpatAlgorithm::computeDirtySources()
+{
+    for (std::size_t word{}; word < NUM_DIRTY_WORDS; ++word) {
+        auto dirtyBits{ mDirtySources[word].exchange(0, std::memory_order_acquire) };
+        while (dirtyBits != 0) {
+            auto const bit{ word * 64 + narrow<std::size_t>(std::countr_zero(dirtyBits)) };
+            dirtyBits &= dirtyBits - 1;
+
+            source_index_t const sourceIndex{ narrow<int>(bit) + source_index_t::OFFSET };
+            auto & pendingSource{ mPendingSources[sourceIndex] };
+            auto * const previous{ pendingSource.mostRecent };
+            pendingSource.updater.getMostRecent(pendingSource.mostRecent);
+            if (pendingSource.mostRecent == previous) {
+                // Already computed : the bit was set by an update that was dropped as obsolete.
+                continue;
+            }
+
+            auto const & received{ pendingSource.mostRecent->get() };
+            mInnerAlgorithm->updateSpatData(sourceIndex, received.sourceData);
+            recordLatency(received.receivedTicks);
+        }
+    }
+}
+
+//==============================================================================
+void ControlRateSpatAlgorithm::recordLatency(std::int64_t const receivedTicks) noexcept
+{
+    auto const latencyMs{
+        juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - receivedTicks) * 1000.0
+    };
+
+    std::size_t bucket{};
+    while (bucket < LatencyHistogram::NUM_BUCKETS - 1 && latencyMs >= LatencyHistogram::getBucketLimitMs(bucket)) {
+        ++bucket;
+    }
+    mLatencyCounts[bucket].fetch_add(1, std::memory_order_relaxed);
+    mMaxLatencyMs.store(std::max(mMaxLatencyMs.load(), latencyMs));
+    mNumUpdates.fetch_add(1);
+}
+
+//==============================================================================
+void ControlRateSpatAlgorithm::run()
+{
+    while (!threadShouldExit()) {
+        wait(mPeriodMs.load());
+        computeDirtySources();
+    }
+}
+
+} // namespace gris
@@ -0,0 +1,154 @@
+/*
+ This file is part of SpatGRIS.
+
+ Developers: Gaël Lane Lépine, Samuel Béland, Olivier Bélanger, Nicolas Masson
+
+ SpatGRIS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ SpatGRIS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with SpatGRIS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Containers/sg_LatestWinsUpdater.hpp"
+#include "Containers/sg_StrongArray.hpp"
+#include "Containers/sg_TaggedAudioBuffer.hpp"
+#include "Data/StrongTypes/sg_SourceIndex.hpp"
+#include "Data/sg_AudioStructs.hpp"
+#include "Data/sg_LogicStrucs.hpp"
+#include "Data/sg_Macros.hpp"
+#include "Data/sg_Triplet.hpp"
+#include "sg_AbstractSpatAlgorithm.hpp"
+#include "juce_audio_basics/juce_audio_basics.h"
+#include "juce_core/juce_core.h"
+#include "tl/optional.hpp"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace gris
+{
+//==============================================================================
+/** Computes the spatialization gains of another algorithm at control rate, on a dedicated thread.
+ *
+ * updateSpatData() only records the latest data of the source and marks the source as dirty, so a burst of OSC
+ * messages never keeps the OSC thread busy in vbapCompute() or mbap(). A worker thread wakes up on a timer, once per
+ * period (see getPeriodMs()), and hands the latest data of every dirty source to the wrapped algorithm, which computes
+ * the gains and publishes them to the audio thread. A source is computed at most once per period, however fast its
+ * controller sends updates.
+ *
+ * The timer runs freely : it is not synchronized with the audio callback, which never has to signal the worker. The
+ * period is the duration of a block rounded down to whole milliseconds, and at least 1 ms.
+ *
+ * The time from the reception of an update to the publication of its gains is measured for every computed update.
+ */
+class ControlRateSpatAlgorithm final
+    : public AbstractSpatAlgorithm
+    , private juce::Thread
+{
+public:
+    //==============================================================================
+    /** How long the updates waited before their gains became visible to the audio thread.
+     *
+     * Bucket i counts the updates that took less than 2^i microseconds and at least 2^(i-1) microseconds. The last
+     * bucket also counts everything slower.
+     */
+    struct LatencyHistogram {
+        static constexpr std::size_t NUM_BUCKETS = 24;
+        std::array<std::uint64_t, NUM_BUCKETS> counts{};
+        std::uint64_t numUpdates{};
+        double maxMs{};
+        //==============================================================================
+        /** @return the upper bound of a bucket, in milliseconds. */
+        [[nodiscard]] static double getBucketLimitMs(std::size_t bucket) noexcept;
+        /** @return the upper bound of the bucket that contains the given percentile (from 0 to 1), in milliseconds. */
+        [[nodiscard]] double getPercentileMs(double percentile) const noexcept;
+    };
+
+private:
+    //==============================================================================
+    struct ReceivedSourceData {
+        SourceData sourceData{};
+        std::int64_t receivedTicks{};
+    };
+    using ReceivedSourceDataUpdater = LatestWinsUpdater<ReceivedSourceData>;
+    struct PendingSource {
+        ReceivedSourceDataUpdater updater{};
+        // Worker thread
+        ReceivedSourceDataUpdater::Token * mostRecent{};
+    };
+    static constexpr std::size_t NUM_DIRTY_WORDS = (MAX_NUM_SOURCES + 63) / 64;
+    //==============================================================================
+    std::unique_ptr<AbstractSpatAlgorithm> mInnerAlgorithm{};
+    StrongArray<source_index_t, PendingSource, MAX_NUM_SOURCES> mPendingSources{};
+    /** One bit per source, set by updateSpatData() and cleared by the worker. */
+    std::array<std::atomic<std::uint64_t>, NUM_DIRTY_WORDS> mDirtySources{};
+    std::atomic<int> mPeriodMs{ 1 };
+    //==============================================================================
+    // Worker thread -> any thread
+    std::array<std::atomic<std::uint64_t>, LatencyHistogram::NUM_BUCKETS> mLatencyCounts{};
+    std::atomic<std::uint64_t> mNumUpdates{};
+    std::atomic<double> mMaxLatencyMs{};
+
+public:
+    //==============================================================================
+    /** Starts the worker thread.
+     *
+     * @param innerAlgorithm the algorithm that computes the gains and renders the audio.
+     * @param sampleRate the expected sample rate.
+     * @param bufferSize the expected buffer size in samples. Sets the period of the worker.
+     */
+    ControlRateSpatAlgorithm(std::unique_ptr<AbstractSpatAlgorithm> innerAlgorithm,
+                             double sampleRate,
+                             int bufferSize);
+    /** Stops the worker thread. Updates that were not computed yet are dropped. */
+    ~ControlRateSpatAlgorithm() override;
+    SG_DELETE_COPY_AND_MOVE(ControlRateSpatAlgorithm)
+    //==============================================================================
+    /** Does not compute anything : can be called from any number of threads at once. */
+    void updateSpatData(source_index_t sourceIndex, SourceData const & sourceData) noexcept override;
+    void process(AudioConfig const & config,
+                 SourceAudioBuffer & sourcesBuffer,
+                 SpeakerAudioBuffer & speakersBuffer,
+#if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
+                 ForkUnionBuffer & forkUnionBuffer,
+#endif
+                 juce::AudioBuffer<float> & stereoBuffer,
+                 SourcePeaks const & sourcePeaks,
+                 SpeakersAudioConfig const * altSpeakerConfig) override;
+    [[nodiscard]] juce::Array<Triplet> getTriplets() const noexcept override;
+    [[nodiscard]] bool hasTriplets() const noexcept override;
+    [[nodiscard]] tl::optional<Error> getError() const noexcept override;
+    void listHotMemory(HotMemory & hotMemory) const override;
+    [[nodiscard]] MemoryReport getMemoryReport() const override;
+    /** Also adapts the period of the worker to the new block duration. */
+    void prepare(double sampleRate, int maxBlockSize) override;
+    //==============================================================================
+    /** @return the latencies measured so far. Can be called from any thread. */
+    [[nodiscard]] LatencyHistogram getLatencyHistogram() const noexcept;
+    /** @return how long the worker waits between two computations, in milliseconds. */
+    [[nodiscard]] int getPeriodMs() const noexcept { return mPeriodMs.load(); }
+
+private:
+    //==============================================================================
+    void setPeriod(double sampleRate, int bufferSize) noexcept;
+    /** Hands the latest data of every dirty source to the inner algorithm. */
+    void computeDirtySources();
+    void recordLatency(std::int64_t receivedTicks) noexcept;
+    void run() override;
+    //==============================================================================
+    JUCE_LEAK_DETECTOR(ControlRateSpatAlgorithm)
+};
+
+} // namespace gris
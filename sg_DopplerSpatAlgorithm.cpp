@@ -20,49 +20,55 @@
 #ifdef USE_DOPPLER
 
     #include "sg_DopplerSpatAlgorithm.hpp"
-    #include "sg_Meters.hpp"
+    #include "Data/StrongTypes/sg_Meters.hpp"
+    #include "sg_Kernels.hpp"
+    #include <thread>
 
 namespace gris
 {
-static void interpolate(float const * inputSamples,
-                        int const numInputSamples,
-                        float * outputSamples,
-                        int const numOutputSamples) noexcept
+namespace
 {
-    #ifndef NDEBUG
-    auto const * const inEnd{ inputSamples + numInputSamples };
-    #endif
-
-    if (numInputSamples == numOutputSamples) {
-        std::copy_n(inputSamples, numInputSamples, outputSamples);
-        return;
-    }
-
-    auto const * const outEnd{ outputSamples + numOutputSamples };
-    auto const inputPerOutput{ static_cast<double>(numInputSamples - 1) / static_cast<double>(numOutputSamples) };
-    auto subSamplePos{ inputPerOutput };
-    auto lastSample{ *inputSamples++ };
+//==============================================================================
+float distanceToGain(meters_t const distance) noexcept
+{
+    static constexpr auto POW{ 1.5f };
+    return std::min(1.0f / std::pow(distance.get(), POW), 1.0f);
+}
 
-    while (outputSamples < outEnd) {
-        while (subSamplePos >= 1.0) {
-            jassert(inputSamples < inEnd);
-            lastSample = *inputSamples++;
-            subSamplePos -= 1.0;
-        }
+} // namespace
 
-        *outputSamples++ = static_cast<float>(*inputSamples * subSamplePos + lastSample * (1.0 - subSamplePos));
-        subSamplePos += inputPerOutput;
-    }
+//==============================================================================
+DopplerSpatAlgorithm::DopplerSpatAlgorithm(double const sampleRate, int const bufferSize)
+{
+    #if SG_USE_FORK_UNION
+    mEarsBuffers.resize(std::thread::hardware_concurrency());
+    #endif
+    prepare(sampleRate, bufferSize);
 }
 
 //==============================================================================
-DopplerSpatAlgorithm::DopplerSpatAlgorithm(double const sampleRate, int const bufferSize)
+void DopplerSpatAlgorithm::prepare(double const sampleRate, int const maxBlockSize)
 {
-    mData.sampleRate = sampleRate;
-    auto const dopplerLength{ MAX_DISTANCE.get() / SOUND_METERS_PER_SECOND * sampleRate };
-    auto const requiredSamples{ narrow<int>(std::ceil(dopplerLength)) + bufferSize };
-    mData.dopplerLines.setSize(2, requiredSamples);
-    mData.dopplerLines.clear();
+    auto const maxDelay{ MAX_DISTANCE.get() / SOUND_METERS_PER_SECOND * sampleRate };
+    auto const requiredSamples{ narrow<int>(std::ceil(maxDelay + DOPPLER_MIN_DELAY_SAMPLES)) + maxBlockSize + 1 };
+    auto const delayLinesSize{ juce::nextPowerOfTwo(requiredSamples) };
+    if (sampleRate != mData.sampleRate || delayLinesSize != mData.delayLinesMask + 1) {
+        // What the lines hold was written at the old rate : start over from silence. The sources' positions are kept.
+        mData.sampleRate = sampleRate;
+        mData.delayLinesMask = delayLinesSize - 1;
+        mData.delayLines.setSize(MAX_NUM_SOURCES, delayLinesSize, false, false, true);
+        mData.delayLines.clear();
+        mData.writeHead = 0;
+    }
+
+    auto const numEars{ narrow<int>(EARS_POSITIONS.size()) };
+    #if SG_USE_FORK_UNION
+    for (auto & earsBuffer : mEarsBuffers) {
+        earsBuffer.setSize(numEars, maxBlockSize, false, false, true);
+    }
+    #else
+    mEarsBuffer.setSize(numEars, maxBlockSize, false, false, true);
+    #endif
 }
 
 //==============================================================================
@@ -91,6 +97,9 @@ void DopplerSpatAlgorithm::updateSpatData(source_index_t const sourceIndex, Sour
 void DopplerSpatAlgorithm::process(AudioConfig const & config,
                                    SourceAudioBuffer & sourcesBuffer,
                                    SpeakerAudioBuffer & speakersBuffer,
+    #if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
+                                   ForkUnionBuffer & /*forkUnionBuffer*/,
+    #endif
                                    juce::AudioBuffer<float> & /*stereoBuffer*/,
                                    SourcePeaks const & /*sourcePeaks*/,
                                    [[maybe_unused]] SpeakersAudioConfig const * altSpeakerConfig)
@@ -98,83 +107,139 @@ void DopplerSpatAlgorithm::process(AudioConfig const & config,
     ASSERT_AUDIO_THREAD;
     jassert(!altSpeakerConfig);
 
-    auto const bufferSize{ sourcesBuffer.getNumSamples() };
-    auto const dopplerBufferSize{ mData.dopplerLines.getNumSamples() };
+    auto const numSamples{ sourcesBuffer.getNumSamples() };
+    auto const numEars{ narrow<int>(EARS_POSITIONS.size()) };
+    // Fetched once here : getWritePointer() is not meant to be called concurrently on the same buffer.
+    auto * const * delayLines{ mData.delayLines.getArrayOfWritePointers() };
 
-    for (auto const & source : config.sourcesAudioConfig) {
-        if (source.value.directOut || source.value.isMuted) {
-            continue;
-        }
-
-        auto & sourceData{ mData.sourcesData[source.key] };
-        auto *& ticket{ sourceData.mostRecentSpatData };
-        sourceData.spatDataQueue.getMostRecent(ticket);
+    #if SG_USE_FORK_UNION
+    namespace fu = ashvardanian::fork_union;
 
-        if (ticket == nullptr) {
-            continue;
-        }
+    for (auto & earsBuffer : mEarsBuffers) {
+        jassert(numSamples <= earsBuffer.getNumSamples());
+        earsBuffer.clear(0, numSamples);
+    }
 
-        auto const & spatData{ ticket->get() };
-        auto & lastSpatData{ mData.lastSpatData[source.key] };
-        auto * sourceSamples{ sourcesBuffer[source.key].getWritePointer(0) };
+    auto const sourceIds{ config.sourcesAudioConfig.getUsedKeys() };
 
-        for (size_t earIndex{}; earIndex < EARS_POSITIONS.size(); ++earIndex) {
-            auto * dopplerSamples{ mData.dopplerLines.getWritePointer(narrow<int>(earIndex)) };
+    fu::for_n(threadPool, sourceIds.size(), [&](fu::prong_t prong) noexcept {
+        processSource(config,
+                      sourceIds[prong.task_index],
+                      sourcesBuffer,
+                      delayLines,
+                      mEarsBuffers[prong.thread_index]);
+    });
 
-            static constexpr meters_t MAX_DISTANCE_DIFF{ 1000.0f };
+    for (size_t i{ 1 }; i < mEarsBuffers.size(); ++i) {
+        for (int channel{}; channel < numEars; ++channel) {
+            mEarsBuffers.front().addFrom(channel, 0, mEarsBuffers[i], channel, 0, numSamples);
+        }
+    }
+    auto const & earsBuffer{ mEarsBuffers.front() };
+    #else
+    jassert(numSamples <= mEarsBuffer.getNumSamples());
+    mEarsBuffer.clear(0, numSamples);
 
-            auto const beginAbsoluteDistance{ FIELD_RADIUS * lastSpatData[earIndex] };
-            auto const endAbsoluteDistance{ std::clamp(FIELD_RADIUS * spatData[earIndex],
-                                                       beginAbsoluteDistance - MAX_DISTANCE_DIFF,
-                                                       beginAbsoluteDistance + MAX_DISTANCE_DIFF) };
+    for (auto const & source : config.sourcesAudioConfig) {
+        processSource(config, source.key, sourcesBuffer, delayLines, mEarsBuffer);
+    }
+    auto const & earsBuffer{ mEarsBuffer };
+    #endif
 
-            auto const beginDopplerIndex{ narrow<int>(
-                std::floor(beginAbsoluteDistance.get() * mData.sampleRate / SOUND_METERS_PER_SECOND)) };
-            auto const endDopplerIndex{ narrow<int>(std::floor(endAbsoluteDistance.get() * mData.sampleRate
-                                                               / SOUND_METERS_PER_SECOND))
-                                        + bufferSize };
+    mData.writeHead = (mData.writeHead + numSamples) & mData.delayLinesMask;
+    ++mData.blockIndex;
 
-            auto numOutSamples{ endDopplerIndex - beginDopplerIndex };
+    auto speakerIt{ speakersBuffer.cbegin() };
+    for (int channel{}; channel < numEars; ++channel) {
+        auto * speakerSamples{ speakersBuffer.getChannel(speakerIt++->key) };
+        std::copy_n(earsBuffer.getReadPointer(channel), numSamples, speakerSamples);
+    }
+}
 
-            auto const reverse{ numOutSamples < 1 };
+//==============================================================================
+void DopplerSpatAlgorithm::processSource(AudioConfig const & config,
+                                         source_index_t const sourceIndex,
+                                         SourceAudioBuffer const & sourcesBuffer,
+                                         float * const * delayLines,
+                                         juce::AudioBuffer<float> & earsBuffer) noexcept
+{
+    auto const numSamples{ sourcesBuffer.getNumSamples() };
+    auto const delayLinesSize{ mData.delayLinesMask + 1 };
+    auto const writeHead{ mData.writeHead };
+    auto * delayLine{ delayLines[sourceIndex.removeOffset<int>()] };
+
+    auto & sourceData{ mData.sourcesData[sourceIndex] };
+    if (sourceData.lastBlockIndex + 1 != mData.blockIndex) {
+        // The source was not part of the last block : its line still holds what it played before it got removed.
+        std::fill_n(delayLine, delayLinesSize, 0.0f);
+        sourceData.hasLastSpatData = false;
+    }
+    sourceData.lastBlockIndex = mData.blockIndex;
 
-            if (reverse) {
-                std::reverse(sourceSamples, sourceSamples + bufferSize);
-                numOutSamples *= -1;
-            }
+    // Write the new samples in the source's delay line. Muted sources still write silence so that their line does not
+    // replay stale samples when they get unmuted.
+    auto const firstPartSize{ std::min(numSamples, delayLinesSize - writeHead) };
+    auto const secondPartSize{ numSamples - firstPartSize };
 
-            auto * startingDopplerSample{ dopplerSamples + beginDopplerIndex };
-            if (numOutSamples != 0) {
-                interpolate(sourceSamples, bufferSize, startingDopplerSample, numOutSamples);
-            }
+    auto const & source{ config.sourcesAudioConfig[sourceIndex] };
+    if (source.directOut || source.isMuted) {
+        std::fill_n(delayLine + writeHead, firstPartSize, 0.0f);
+        std::fill_n(delayLine, secondPartSize, 0.0f);
+        return;
+    }
 
-            if (reverse) {
-                std::reverse(sourceSamples, sourceSamples + bufferSize);
-            }
+    auto const * sourceSamples{ sourcesBuffer[sourceIndex].getReadPointer(0) };
+    std::copy_n(sourceSamples, firstPartSize, delayLine + writeHead);
+    std::copy_n(sourceSamples + firstPartSize, secondPartSize, delayLine);
 
-            lastSpatData[earIndex] = endAbsoluteDistance / FIELD_RADIUS;
+    auto *& ticket{ sourceData.mostRecentSpatData };
+    sourceData.spatDataQueue.getMostRecent(ticket);
 
-            static constexpr auto POW{ 1.5f };
-            auto const startGain{ std::min(1.0f / std::pow(beginAbsoluteDistance.get(), POW), 1.0f) };
-            auto const endGain{ std::min(1.0f / std::pow(endAbsoluteDistance.get(), POW), 1.0f) };
+    if (ticket == nullptr) {
+        return;
+    }
 
-            juce::AudioBuffer<float>{ &startingDopplerSample, 1, numOutSamples }.applyGainRamp(0,
-                                                                                               0,
-                                                                                               numOutSamples,
-                                                                                               startGain,
-                                                                                               endGain);
-        }
+    auto const & spatData{ ticket->get() };
+    auto & lastSpatData{ sourceData.lastSpatData };
+    if (!sourceData.hasLastSpatData) {
+        // Don't sweep from the origin on the very first block
+        lastSpatData = spatData;
+        sourceData.hasLastSpatData = true;
     }
 
-    auto speakerIt{ speakersBuffer.begin() };
-    for (int channel{}; channel < mData.dopplerLines.getNumChannels(); ++channel) {
-        auto * dopplerSamplesBegin{ mData.dopplerLines.getWritePointer(channel) };
-        auto * dopplerSamplesEnd{ dopplerSamplesBegin + dopplerBufferSize };
-        auto * speakerSamples{ speakerIt++->value->getWritePointer(0) };
+    auto const samplesPerMeter{ mData.sampleRate / static_cast<double>(SOUND_METERS_PER_SECOND) };
+    auto const maxDelay{ static_cast<double>(mData.delayLinesMask - numSamples) };
+    auto const numSamples_d{ static_cast<double>(numSamples) };
+    auto const numSamples_f{ static_cast<float>(numSamples) };
+
+    for (size_t earIndex{}; earIndex < EARS_POSITIONS.size(); ++earIndex) {
+        auto * earSamples{ earsBuffer.getWritePointer(narrow<int>(earIndex)) };
+
+        auto const beginDistance{ FIELD_RADIUS * lastSpatData[earIndex] };
+        auto const endDistance{ FIELD_RADIUS * spatData[earIndex] };
+
+        // The delay and the gain are linearly interpolated across the block. A source moving away simply reads the
+        // line slower than it is written, so there is nothing to reverse.
+        auto const beginDelay{ std::clamp(static_cast<double>(beginDistance.get()) * samplesPerMeter,
+                                          DOPPLER_MIN_DELAY_SAMPLES,
+                                          maxDelay) };
+        auto const endDelay{ std::clamp(static_cast<double>(endDistance.get()) * samplesPerMeter,
+                                        DOPPLER_MIN_DELAY_SAMPLES,
+                                        maxDelay) };
+        auto const delayIncrement{ (endDelay - beginDelay) / numSamples_d };
+
+        auto const beginGain{ distanceToGain(beginDistance) };
+        auto const endGain{ distanceToGain(endDistance) };
+        auto const gainIncrement{ (endGain - beginGain) / numSamples_f };
+
+        for (int sampleIndex{}; sampleIndex < numSamples; ++sampleIndex) {
+            auto const delay{ beginDelay + delayIncrement * static_cast<double>(sampleIndex + 1) };
+            auto const gain{ beginGain + gainIncrement * static_cast<float>(sampleIndex + 1) };
+            auto const readPosition{ static_cast<double>(writeHead + sampleIndex) - delay };
+            earSamples[sampleIndex] += gain * readLagrange(delayLine, mData.delayLinesMask, readPosition);
+        }
 
-        std::copy_n(dopplerSamplesBegin, bufferSize, speakerSamples);
-        std::fill_n(dopplerSamplesBegin, bufferSize, 0.0f);
-        std::rotate(dopplerSamplesBegin, dopplerSamplesBegin + bufferSize, dopplerSamplesEnd);
+        lastSpatData[earIndex] = spatData[earIndex];
     }
 }
 
@@ -199,6 +264,26 @@ bool DopplerSpatAlgorithm::hasTriplets() const noexcept
     return false;
 }
 
+//==============================================================================
+void DopplerSpatAlgorithm::listHotMemory(HotMemory & hotMemory) const
+{
+    hotMemory.add(*this);
+    hotMemory.add(mData.delayLines);
+    #if SG_USE_FORK_UNION
+    for (auto const & earsBuffer : mEarsBuffers) {
+        hotMemory.add(earsBuffer);
+    }
+    #else
+    hotMemory.add(mEarsBuffer);
+    #endif
+}
+
+//==============================================================================
+AbstractSpatAlgorithm::MemoryReport DopplerSpatAlgorithm::getMemoryReport() const
+{
+    return MemoryReport{ sizeof(*this), sizeof(mData.sourcesData), MAX_NUM_SOURCES * 2 * sizeof(DopplerSpatData) };
+}
+
 } // namespace gris
 
 #endif
@@ -19,13 +19,16 @@
 
 #pragma once
 
-#include "AlgoGRIS/Data/sg_SpatMode.hpp"
+#include "Data/sg_SpatMode.hpp"
 
 /** Experimental : a stereo reduction algorithm based on doppler-shifting. */
 #if defined(USE_DOPPLER) || defined(DOXYGEN)
 
+    #include "Containers/sg_LatestWinsUpdater.hpp"
+    #include "Containers/sg_StrongArray.hpp"
+    #include "Data/StrongTypes/sg_Meters.hpp"
     #include "sg_AbstractSpatAlgorithm.hpp"
-    #include "sg_Meters.hpp"
+    #include <cstdint>
 
 namespace gris
 {
@@ -41,45 +44,55 @@ static constexpr CartesianVector UPPER_LEFT_CORNER{ 1.0f, 1.0f, 1.0f };
 static auto constexpr MAX_RELATIVE_DISTANCE{ (RIGHT_EAR_POSITION - UPPER_LEFT_CORNER).constexprLength() };
 static auto constexpr MAX_DISTANCE{ FIELD_RADIUS * MAX_RELATIVE_DISTANCE };
 
-static auto constexpr MAX_SAMPLE_RATE = 48000.0;
-static auto constexpr MAX_BUFFER_SIZE = 4096;
-static auto constexpr DOPPLER_BUFFER_SIZE
-    = static_cast<int>(MAX_DISTANCE.get() * MAX_SAMPLE_RATE + narrow<double>(MAX_BUFFER_SIZE) + 1.0);
-
 static constexpr auto SOUND_METERS_PER_SECOND = 400.0f;
 
+/** The delay line reads use 4-point Lagrange interpolation : one sample before and two samples after the read
+ * position have to be available. */
+static constexpr auto DOPPLER_MIN_DELAY_SAMPLES = 2.0;
+
 using DopplerSpatData = std::array<float, 2>;
-using DopplerSpatDataQueue = AtomicUpdater<DopplerSpatData>;
+using DopplerSpatDataQueue = LatestWinsUpdater<DopplerSpatData>;
 
 struct DopplerSourceData {
     DopplerSpatDataQueue spatDataQueue{};
     DopplerSpatDataQueue::Token * mostRecentSpatData{};
+    /** The ears distances reached at the end of the last block. */
+    DopplerSpatData lastSpatData{};
+    bool hasLastSpatData{};
+    /** The DopplerData::blockIndex of the last block that processed this source, or 0 if none did. */
+    std::uint64_t lastBlockIndex{};
 };
 
+/** Every source writes its samples in its own circular delay line. Each ear then reads the line at a fractional delay
+ * that follows the distance between the source and the ear, which produces the doppler shift.
+ *
+ * Sources can be added on the audio thread, so there is a line for every possible source. */
 struct DopplerData {
     StrongArray<source_index_t, DopplerSourceData, MAX_NUM_SOURCES> sourcesData{};
-    juce::AudioBuffer<float> dopplerLines{};
-    StrongArray<source_index_t, DopplerSpatData, MAX_NUM_SOURCES> lastSpatData{};
+    juce::AudioBuffer<float> delayLines{};
+    int delayLinesMask{};
+    int writeHead{};
     double sampleRate{};
+    /** Incremented after every block. A source that skips a block gets its line cleared when it comes back. */
+    std::uint64_t blockIndex{ 1 };
 };
 
 //==============================================================================
 class DopplerSpatAlgorithm final : public AbstractSpatAlgorithm
 {
-    using Interpolator = juce::Interpolators::Linear;
-
     DopplerData mData{};
-    StrongArray<source_index_t, std::array<Interpolator, 2>, MAX_NUM_SOURCES> mInterpolators{};
+    #if SG_USE_FORK_UNION
+    /** One stereo accumulator per worker thread so that the sources can be rendered in parallel. */
+    std::vector<juce::AudioBuffer<float>> mEarsBuffers{};
+    #else
+    juce::AudioBuffer<float> mEarsBuffer{};
+    #endif
 
 public:
     //==============================================================================
     DopplerSpatAlgorithm(double sampleRate, int bufferSize);
     ~DopplerSpatAlgorithm() override = default;
-    //==============================================================================
-    DopplerSpatAlgorithm(DopplerSpatAlgorithm const &) = delete;
-    DopplerSpatAlgorithm(DopplerSpatAlgorithm &&) = delete;
-    DopplerSpatAlgorithm & operator=(DopplerSpatAlgorithm const &) = delete;
-    DopplerSpatAlgorithm & operator=(DopplerSpatAlgorithm &&) = delete;
+    SG_DELETE_COPY_AND_MOVE(DopplerSpatAlgorithm)
     //==============================================================================
     void updateSpatData(source_index_t sourceIndex, SourceData const & sourceData) noexcept override;
     [[nodiscard]] juce::Array<Triplet> getTriplets() const noexcept override;
@@ -87,15 +100,27 @@ public:
     void process(AudioConfig const & config,
                  SourceAudioBuffer & sourcesBuffer,
                  SpeakerAudioBuffer & speakersBuffer,
+    #if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
+                 ForkUnionBuffer & forkUnionBuffer,
+    #endif
                  juce::AudioBuffer<float> & stereoBuffer,
                  SourcePeaks const & sourcePeaks,
                  SpeakersAudioConfig const * altSpeakerConfig) override;
     [[nodiscard]] tl::optional<Error> getError() const noexcept override { return tl::nullopt; }
+    void listHotMemory(HotMemory & hotMemory) const override;
+    [[nodiscard]] MemoryReport getMemoryReport() const override;
+    void prepare(double sampleRate, int maxBlockSize) override;
     //==============================================================================
     static std::unique_ptr<AbstractSpatAlgorithm> make(double sampleRate, int bufferSize) noexcept;
 
 private:
     //==============================================================================
+    void processSource(AudioConfig const & config,
+                       source_index_t sourceIndex,
+                       SourceAudioBuffer const & sourcesBuffer,
+                       float * const * delayLines,
+                       juce::AudioBuffer<float> & earsBuffer) noexcept;
+    //==============================================================================
     JUCE_LEAK_DETECTOR(DopplerSpatAlgorithm)
 };
 
@@ -0,0 +1,385 @@
+/*
+ This file is part of SpatGRIS.
+
+ Developers: Gaël Lane Lépine, Samuel Béland, Olivier Bélanger, Nicolas Masson
+
+ SpatGRIS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ SpatGRIS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with SpatGRIS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sg_HotSwappableSpatAlgorithm.hpp"
+#include "Data/sg_Narrow.hpp"
+#include "sg_Reclaimer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace gris
+{
+//==============================================================================
+HotSwappableSpatAlgorithm::HotSwappableSpatAlgorithm(std::unique_ptr<AbstractSpatAlgorithm> initialAlgorithm,
+                                                     double const sampleRate,
+                                                     int const bufferSize)
+{
+    JUCE_ASSERT_MESSAGE_THREAD;
+    jassert(initialAlgorithm);
+
+    // The fading out algorithm may render to any speaker of the current setup.
+    juce::Array<output_patch_t> allSpeakers{};
+    allSpeakers.ensureStorageAllocated(MAX_NUM_SPEAKERS);
+    for (int i{ 1 }; i <= MAX_NUM_SPEAKERS; ++i) {
+        allSpeakers.add(output_patch_t{ i });
+    }
+    mFadingOutSpeakersBuffer.init(allSpeakers);
+    prepareCrossfade(sampleRate, bufferSize);
+
+    mCurrentInstance = initialAlgorithm.get();
+    mOwnedTargets = std::make_unique<Targets const>(Targets{ initialAlgorithm.get(), nullptr });
+    mTargets.store(mOwnedTargets.get());
+    mInstances.push_back(std::move(initialAlgorithm));
+}
+
+//==============================================================================
+HotSwappableSpatAlgorithm::~HotSwappableSpatAlgorithm()
+{
+    for (auto & instance : mInstances) {
+        Reclaimer::retire(std::move(instance), "spatialization algorithm");
+    }
+}
+
+//==============================================================================
+void HotSwappableSpatAlgorithm::swapIn(std::unique_ptr<AbstractSpatAlgorithm> algorithm)
+{
+    JUCE_ASSERT_MESSAGE_THREAD;
+    jassert(algorithm);
+
+    collectRetired();
+
+    // Taken back, so the audio thread keeps rendering the same instance until the new one is ready.
+    auto * staleInstance{ mPendingInstance.exchange(nullptr) };
+
+    auto * newInstance{ algorithm.get() };
+    mInstances.push_back(std::move(algorithm));
+    auto * previousInstance{ staleInstance == nullptr ? mOwnedTargets->newest : mOwnedTargets->previous };
+    publishTargets(Targets{ newInstance, previousInstance });
+
+    if (staleInstance != nullptr) {
+        // The audio thread never saw it.
+        reclaimInstance(staleInstance);
+    }
+
+    // The updates that happen from now on are forwarded to the new instance as well.
+    replaySpatData(*newInstance);
+    mPendingInstance.store(newInstance);
+}
+
+//==============================================================================
+void HotSwappableSpatAlgorithm::collectRetired()
+{
+    JUCE_ASSERT_MESSAGE_THREAD;
+
+    if (auto * retiredInstance{ mRetiredInstance.exchange(nullptr) }) {
+        reclaimInstance(retiredInstance);
+    }
+}
+
+//==============================================================================
+void HotSwappableSpatAlgorithm::reclaimInstance(AbstractSpatAlgorithm * const instance)
+{
+    jassert(instance != mOwnedTargets->newest);
+    if (instance == mOwnedTargets->previous) {
+        publishTargets(Targets{ mOwnedTargets->newest, nullptr });
+    }
+
+    auto const it{ std::find_if(mInstances.begin(), mInstances.end(), [&](auto const & ownedInstance) {
+        return ownedInstance.get() == instance;
+    }) };
+    jassert(it != mInstances.end());
+    if (it == mInstances.end()) {
+        return;
+    }
+    auto reclaimed{ std::move(*it) };
+    mInstances.erase(it);
+    Reclaimer::retire(std::move(reclaimed), "spatialization algorithm");
+}
+
+//==============================================================================
+void HotSwappableSpatAlgorithm::publishTargets(Targets const & targets)
+{
+    JUCE_ASSERT_MESSAGE_THREAD;
+
+    auto newTargets{ std::make_unique<Targets const>(targets) };
+    mTargets.store(newTargets.get());
+    waitForForwarders();
+    mOwnedTargets = std::move(newTargets);
+}
+
+//==============================================================================
+void HotSwappableSpatAlgorithm::waitForForwarders() noexcept
+{
+    // A call can read the epoch right before it flips and only register afterwards : flipping twice waits for it too.
+    for (int flip{}; flip < 2; ++flip) {
+        auto const epoch{ mForwardingEpoch.load() };
+        mForwardingEpoch.store(1 - epoch);
+        auto const & numForwarding{ mNumForwarding[narrow<std::size_t>(epoch)] };
+        while (numForwarding.load() != 0) {
+            juce::Thread::yield();
+        }
+    }
+}
+
+//==============================================================================
+void HotSwappableSpatAlgorithm::replaySpatData(AbstractSpatAlgorithm & instance) noexcept
+{
+    JUCE_ASSERT_MESSAGE_THREAD;
+
+    for (int i{ 1 }; i <= MAX_NUM_SOURCES; ++i) {
+        source_index_t const sourceIndex{ i };
+        auto & slot{ mReplaySlots[sourceIndex] };
+        slot.updater.getMostRecent(slot.lastReplayed);
+        // An update recorded while replaying might reach the instance before the replayed data does : replay again
+        // until the slot stays the same, so the instance ends up with the latest data.
+        while (slot.lastReplayed != nullptr) {
+            auto const * replayed{ slot.lastReplayed };
+            instance.updateSpatData(sourceIndex, replayed->get());
+            slot.updater.getMostRecent(slot.lastReplayed);
+            if (slot.lastReplayed == replayed) {
+                break;
+            }
+        }
+    }
+}
+
+//==============================================================================
+void HotSwappableSpatAlgorithm::updateSpatData(source_index_t const sourceIndex, SourceData const & sourceData) noexcept
+{
+    // Recorded before forwarding : an instance that does not get this update is caught up by the replay.
+    auto & updater{ mReplaySlots[sourceIndex].updater };
+    if (auto * token{ updater.acquire() }) {
+        token->get() = sourceData;
+        updater.setMostRecent(token);
+    }
+
+    auto & numForwarding{ mNumForwarding[narrow<std::size_t>(mForwardingEpoch.load())] };
+    numForwarding.fetch_add(1);
+    auto const & targets{ *mTargets.load() };
+    targets.newest->updateSpatData(sourceIndex, sourceData);
+    if (targets.previous != nullptr) {
+        targets.previous->updateSpatData(sourceIndex, sourceData);
+    }
+    numForwarding.fetch_sub(1);
+}
+
+//==============================================================================
+void HotSwappableSpatAlgorithm::process(AudioConfig const & config,
+                                        SourceAudioBuffer & sourcesBuffer,
+                                        SpeakerAudioBuffer & speakersBuffer,
+#if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
+                                        ForkUnionBuffer & forkUnionBuffer,
+#endif
+                                        juce::AudioBuffer<float> & stereoBuffer,
+                                        SourcePeaks const & sourcePeaks,
+                                        SpeakersAudioConfig const * altSpeakerConfig)
+{
+    ASSERT_AUDIO_THREAD;
+
+    // A new swap waits for the previous one to be over and for its algorithm to be collected.
+    if (mFadingOutInstance == nullptr && mRetiredInstance.load() == nullptr) {
+        if (auto * pendingInstance{ mPendingInstance.exchange(nullptr) }) {
+            mFadingOutInstance = std::exchange(mCurrentInstance, pendingInstance);
+            mCrossfadePosition = 0;
+        }
+    }
+
+#if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
+    mCurrentInstance->process(config,
+                              sourcesBuffer,
+                              speakersBuffer,
+                              forkUnionBuffer,
+                              stereoBuffer,
+                              sourcePeaks,
+                              altSpeakerConfig);
+#else
+    mCurrentInstance->process(config, sourcesBuffer, speakersBuffer, stereoBuffer, sourcePeaks, altSpeakerConfig);
+#endif
+
+    if (mFadingOutInstance == nullptr) {
+        return;
+    }
+
+    auto const numSamples{ sourcesBuffer.getNumSamples() };
+    if (numSamples > mFadingOutSpeakersBuffer.getNumSamples()) {
+        // Rendering the old algorithm would need more memory than what was prepared : cut instead.
+        jassertfalse;
+        retireFadingOutInstance();
+        return;
+    }
+
+    mFadingOutSpeakersBuffer.silence();
+    mFadingOutStereoBuffer.setSize(2, numSamples, false, false, true);
+    mFadingOutStereoBuffer.clear();
+#if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
+    mFadingOutInstance->silenceForkUnionBuffer(forkUnionBuffer);
+    mFadingOutInstance->process(config,
+                                sourcesBuffer,
+                                mFadingOutSpeakersBuffer,
+                                forkUnionBuffer,
+                                mFadingOutStereoBuffer,
+                                sourcePeaks,
+                                altSpeakerConfig);
+#else
+    mFadingOutInstance->process(config,
+                                sourcesBuffer,
+                                mFadingOutSpeakersBuffer,
+                                mFadingOutStereoBuffer,
+                                sourcePeaks,
+                                altSpeakerConfig);
+#endif
+
+    computeCrossfadeGains(numSamples);
+    applyCrossfade(speakersBuffer, stereoBuffer, numSamples);
+
+    if (mCrossfadePosition >= mCrossfadeLength) {
+        retireFadingOutInstance();
+    }
+}
+
+//==============================================================================
+void HotSwappableSpatAlgorithm::computeCrossfadeGains(int const numSamples) noexcept
+{
+    auto const length{ static_cast<float>(mCrossfadeLength) };
+    for (int i{}; i < numSamples; ++i) {
+        auto const sampleIndex{ narrow<std::size_t>(i) };
+        auto const position{ mCrossfadePosition + i + 1 };
+        if (position >= mCrossfadeLength) {
+            mFadeInGains[sampleIndex] = 1.0f;
+            mFadeOutGains[sampleIndex] = 0.0f;
+            continue;
+        }
+        auto const angle{ juce::MathConstants<float>::halfPi * static_cast<float>(position) / length };
+        mFadeInGains[sampleIndex] = std::sin(angle);
+        mFadeOutGains[sampleIndex] = std::cos(angle);
+    }
+    mCrossfadePosition += numSamples;
+}
+
+//==============================================================================
+void HotSwappableSpatAlgorithm::applyCrossfade(SpeakerAudioBuffer & speakersBuffer,
+                                               juce::AudioBuffer<float> & stereoBuffer,
+                                               int const numSamples)
+{
+    auto const & fadingOutSpeakersBuffer{ mFadingOutSpeakersBuffer };
+    for (auto const & speaker : speakersBuffer) {
+        auto const wasRenderedByNew{ speakersBuffer.isDirty(speaker.key) };
+        auto const wasRenderedByOld{ fadingOutSpeakersBuffer.isDirty(speaker.key) };
+        if (!wasRenderedByNew && !wasRenderedByOld) {
+            continue;
+        }
+        // A clean channel is silent, so the new output can be faded in whether it was rendered or not.
+        auto * samples{ speakersBuffer.getChannel(speaker.key) };
+        juce::FloatVectorOperations::multiply(samples, mFadeInGains.data(), numSamples);
+        if (wasRenderedByOld) {
+            juce::FloatVectorOperations::addWithMultiply(samples,
+                                                         fadingOutSpeakersBuffer.getChannel(speaker.key),
+                                                         mFadeOutGains.data(),
+                                                         numSamples);
+        }
+    }
+
+    auto const numStereoChannels{ std::min(stereoBuffer.getNumChannels(), mFadingOutStereoBuffer.getNumChannels()) };
+    for (int channel{}; channel < numStereoChannels; ++channel) {
+        auto * samples{ stereoBuffer.getWritePointer(channel) };
+        juce::FloatVectorOperations::multiply(samples, mFadeInGains.data(), numSamples);
+        juce::FloatVectorOperations::addWithMultiply(samples,
+                                                     mFadingOutStereoBuffer.getReadPointer(channel),
+                                                     mFadeOutGains.data(),
+                                                     numSamples);
+    }
+}
+
+//==============================================================================
+void HotSwappableSpatAlgorithm::retireFadingOutInstance() noexcept
+{
+    jassert(mRetiredInstance.load() == nullptr);
+    mRetiredInstance.store(std::exchange(mFadingOutInstance, nullptr));
+}
+
+//==============================================================================
+juce::Array<Triplet> HotSwappableSpatAlgorithm::getTriplets() const noexcept
+{
+    JUCE_ASSERT_MESSAGE_THREAD;
+    return mOwnedTargets->newest->getTriplets();
+}
+
+//==============================================================================
+bool HotSwappableSpatAlgorithm::hasTriplets() const noexcept
+{
+    JUCE_ASSERT_MESSAGE_THREAD;
+    return mOwnedTargets->newest->hasTriplets();
+}
+
+//==============================================================================
+tl::optional<AbstractSpatAlgorithm::Error> HotSwappableSpatAlgorithm::getError() const noexcept
+{
+    JUCE_ASSERT_MESSAGE_THREAD;
+    return mOwnedTargets->newest->getError();
+}
+
+//==============================================================================
+void HotSwappableSpatAlgorithm::listHotMemory(HotMemory & hotMemory) const
+{
+    // Only the state of the swap itself : every instance gets activated on its own before it is swapped in.
+    hotMemory.add(*this);
+    hotMemory.add(mFadingOutSpeakersBuffer.getSlab());
+    hotMemory.add(mFadingOutStereoBuffer);
+    hotMemory.add(mFadeInGains);
+    hotMemory.add(mFadeOutGains);
+}
+
+//==============================================================================
+AbstractSpatAlgorithm::MemoryReport HotSwappableSpatAlgorithm::getMemoryReport() const
+{
+    JUCE_ASSERT_MESSAGE_THREAD;
+
+    MemoryReport report{ sizeof(*this), sizeof(mReplaySlots) };
+    for (auto const & instance : mInstances) {
+        report += instance->getMemoryReport();
+    }
+    return report;
+}
+
+//==============================================================================
+void HotSwappableSpatAlgorithm::prepare(double const sampleRate, int const maxBlockSize)
+{
+    JUCE_ASSERT_MESSAGE_THREAD;
+
+    prepareCrossfade(sampleRate, maxBlockSize);
+
+    for (auto const & instance : mInstances) {
+        instance->prepare(sampleRate, maxBlockSize);
+    }
+}
+
+//==============================================================================
+void HotSwappableSpatAlgorithm::prepareCrossfade(double const sampleRate, int const maxBlockSize)
+{
+    jassert(maxBlockSize > 0 && maxBlockSize <= SpeakerAudioBuffer::MAX_NUM_SAMPLES);
+
+    mCrossfadeLength = std::max(juce::roundToInt(sampleRate * CROSSFADE_DURATION_SECONDS), 1);
+    mFadingOutSpeakersBuffer.setNumSamples(maxBlockSize);
+    mFadingOutStereoBuffer.setSize(2, maxBlockSize, false, false, true);
+    mFadeInGains.resize(narrow<std::size_t>(maxBlockSize));
+    mFadeOutGains.resize(narrow<std::size_t>(maxBlockSize));
+}
+
+} // namespace gris
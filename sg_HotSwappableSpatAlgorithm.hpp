@@ -0,0 +1,170 @@
+/*
+ This file is part of SpatGRIS.
+
+ Developers: Gaël Lane Lépine, Samuel Béland, Olivier Bélanger, Nicolas Masson
+
+ SpatGRIS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ SpatGRIS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with SpatGRIS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Containers/sg_LatestWinsUpdater.hpp"
+#include "Containers/sg_StrongArray.hpp"
+#include "Containers/sg_TaggedAudioBuffer.hpp"
+#include "Data/StrongTypes/sg_SourceIndex.hpp"
+#include "Data/sg_AudioStructs.hpp"
+#include "Data/sg_LogicStrucs.hpp"
+#include "Data/sg_Macros.hpp"
+#include "Data/sg_Triplet.hpp"
+#include "sg_AbstractSpatAlgorithm.hpp"
+#include "juce_audio_basics/juce_audio_basics.h"
+#include "juce_core/juce_core.h"
+#include "tl/optional.hpp"
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace gris
+{
+//==============================================================================
+/** A spatialization algorithm that can be replaced without interrupting the audio.
+ *
+ * The message thread hands it a new algorithm (usually built by an AsyncSpatAlgorithmBuilder) and the audio thread
+ * picks it up at the start of a block. For CROSSFADE_DURATION_SECONDS, both algorithms render the block and their
+ * outputs are mixed with an equal-power crossfade. The old algorithm is then retired : the message thread hands it to
+ * the Reclaimer in collectRetired().
+ *
+ * Both algorithms render with the AudioConfig of the current block. Speakers that are only part of the new setup fade
+ * in, while the ones that were removed from it are cut.
+ *
+ * Spatialization data is only forwarded to the newest algorithm and to the one it replaces. The threads that send it
+ * never lock : they read the targets through an atomic pointer, and the message thread waits for them to be done
+ * with the old targets before reclaiming anything.
+ */
+class HotSwappableSpatAlgorithm final : public AbstractSpatAlgorithm
+{
+public:
+    static constexpr double CROSSFADE_DURATION_SECONDS = 0.02;
+
+private:
+    //==============================================================================
+    /** The instances that updateSpatData() forwards to. Never modified once published. */
+    struct Targets {
+        AbstractSpatAlgorithm * newest{};
+        /** The instance that renders until the newest one is picked up, then fades out. */
+        AbstractSpatAlgorithm * previous{};
+    };
+    /** The latest data of a source, replayed to every instance that gets swapped in. */
+    struct ReplaySlot {
+        LatestWinsUpdater<SourceData> updater{};
+        // Message thread
+        LatestWinsUpdater<SourceData>::Token * lastReplayed{};
+    };
+    //==============================================================================
+    // Message thread
+    std::vector<std::unique_ptr<AbstractSpatAlgorithm>> mInstances{};
+    std::unique_ptr<Targets const> mOwnedTargets{};
+    //==============================================================================
+    // Message thread -> updating threads
+    std::atomic<Targets const *> mTargets{};
+    std::atomic<int> mForwardingEpoch{};
+    std::array<std::atomic<int>, 2> mNumForwarding{};
+    // Updating threads -> message thread
+    StrongArray<source_index_t, ReplaySlot, MAX_NUM_SOURCES> mReplaySlots{};
+    //==============================================================================
+    // Message thread -> audio thread
+    std::atomic<AbstractSpatAlgorithm *> mPendingInstance{};
+    // Audio thread -> message thread
+    std::atomic<AbstractSpatAlgorithm *> mRetiredInstance{};
+    //==============================================================================
+    // Audio thread
+    AbstractSpatAlgorithm * mCurrentInstance{};
+    AbstractSpatAlgorithm * mFadingOutInstance{};
+    int mCrossfadeLength{};
+    int mCrossfadePosition{};
+    SpeakerAudioBuffer mFadingOutSpeakersBuffer{};
+    juce::AudioBuffer<float> mFadingOutStereoBuffer{};
+    std::vector<float> mFadeInGains{};
+    std::vector<float> mFadeOutGains{};
+
+public:
+    //==============================================================================
+    /** Should be called from the message thread.
+     *
+     * @param initialAlgorithm the algorithm to render with until the first swap.
+     * @param sampleRate the expected sample rate.
+     * @param bufferSize the expected buffer size in samples. Larger blocks swap without a crossfade.
+     */
+    HotSwappableSpatAlgorithm(std::unique_ptr<AbstractSpatAlgorithm> initialAlgorithm,
+                              double sampleRate,
+                              int bufferSize);
+    /** The algorithms are handed to the Reclaimer. */
+    ~HotSwappableSpatAlgorithm() override;
+    SG_DELETE_COPY_AND_MOVE(HotSwappableSpatAlgorithm)
+    //==============================================================================
+    /** Schedules a new algorithm. It receives the latest data of every source before the audio thread can pick it up.
+     *
+     * If the previous algorithm is still waiting to be picked up, it is replaced and retired right away. Should be
+     * called from the message thread.
+     */
+    void swapIn(std::unique_ptr<AbstractSpatAlgorithm> algorithm);
+    /** Hands the algorithm that the last crossfade retired, if any, to the Reclaimer. The audio thread does not start a
+     * new swap until this is done, so call it regularly (e.g. from a timer). Should be called from the message thread.
+     */
+    void collectRetired();
+    //==============================================================================
+    void updateSpatData(source_index_t sourceIndex, SourceData const & sourceData) noexcept override;
+    void process(AudioConfig const & config,
+                 SourceAudioBuffer & sourcesBuffer,
+                 SpeakerAudioBuffer & speakersBuffer,
+#if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
+                 ForkUnionBuffer & forkUnionBuffer,
+#endif
+                 juce::AudioBuffer<float> & stereoBuffer,
+                 SourcePeaks const & sourcePeaks,
+                 SpeakersAudioConfig const * altSpeakerConfig) override;
+    /** These report on the newest algorithm, even if the audio thread did not pick it up yet. */
+    [[nodiscard]] juce::Array<Triplet> getTriplets() const noexcept override;
+    [[nodiscard]] bool hasTriplets() const noexcept override;
+    [[nodiscard]] tl::optional<Error> getError() const noexcept override;
+    void listHotMemory(HotMemory & hotMemory) const override;
+    /** Includes every instance, so both algorithms count during a swap. Should be called from the message thread. */
+    [[nodiscard]] MemoryReport getMemoryReport() const override;
+    /** Also prepares every instance, including the one waiting to be picked up. Algorithms swapped in afterwards have
+     * to be built for the new values. Should be called from the message thread. */
+    void prepare(double sampleRate, int maxBlockSize) override;
+
+private:
+    //==============================================================================
+    /** Fills the gain tables for the next numSamples samples of the crossfade. */
+    void computeCrossfadeGains(int numSamples) noexcept;
+    /** Mixes the output of the fading out algorithm into the output of the current one. */
+    void applyCrossfade(SpeakerAudioBuffer & speakersBuffer, juce::AudioBuffer<float> & stereoBuffer, int numSamples);
+    void retireFadingOutInstance() noexcept;
+    /** Sizes the crossfade's scratch buffers and gain tables. */
+    void prepareCrossfade(double sampleRate, int maxBlockSize);
+    /** Removes an instance from the targets and from mInstances, and hands it to the Reclaimer. */
+    void reclaimInstance(AbstractSpatAlgorithm * instance);
+    /** Makes updateSpatData() forward to new targets. Returns once no thread can be using the previous ones. */
+    void publishTargets(Targets const & targets);
+    /** Returns once every updateSpatData() call that might have read the previous targets is over. */
+    void waitForForwarders() noexcept;
+    /** Sends the latest data of every source to an instance that is already part of the targets. */
+    void replaySpatData(AbstractSpatAlgorithm & instance) noexcept;
+    //==============================================================================
+    JUCE_LEAK_DETECTOR(HotSwappableSpatAlgorithm)
+};
+
+} // namespace gris
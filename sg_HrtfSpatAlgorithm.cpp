@@ -52,7 +52,7 @@ HrtfSpatAlgorithm::HrtfSpatAlgorithm(SpeakerSetup const & speakerSetup,
                                      double const sampleRate,
                                      int const bufferSize)
 {
-    JUCE_ASSERT_MESSAGE_THREAD;
+    SG_ASSERT_BUILDER_THREAD;
 
     static auto const hrtfDir{ getHrtfDirectory() };
     if (!hrtfDir.exists()) {
@@ -128,13 +128,13 @@ HrtfSpatAlgorithm::HrtfSpatAlgorithm(SpeakerSetup const & speakerSetup,
 
     switch (projectSpatMode) {
     case SpatMode::vbap:
-        mInnerAlgorithm = std::make_unique<VbapSpatAlgorithm>(binauralSpeakerData, sources.getKeys());
+        mInnerAlgorithm = std::make_unique<VbapSpatAlgorithm>(binauralSpeakerData);
         break;
     case SpatMode::mbap:
-        mInnerAlgorithm = std::make_unique<MbapSpatAlgorithm>(*binauralSpeakerSetup, sources.getKeys());
+        mInnerAlgorithm = std::make_unique<MbapSpatAlgorithm>(*binauralSpeakerSetup);
         break;
     case SpatMode::hybrid:
-        mInnerAlgorithm = std::make_unique<HybridSpatAlgorithm>(*binauralSpeakerSetup, sources.getKeys());
+        mInnerAlgorithm = std::make_unique<HybridSpatAlgorithm>(*binauralSpeakerSetup);
         break;
     case SpatMode::invalid:
         break;
@@ -151,13 +151,7 @@ HrtfSpatAlgorithm::HrtfSpatAlgorithm(SpeakerSetup const & speakerSetup,
                                                                   juce::dsp::Convolution::Normalise::no);
     }
 
-    juce::dsp::ProcessSpec const spec{ sampleRate, narrow<juce::uint32>(bufferSize), 2 };
-    for (auto & convolution : mConvolutions) {
-        convolution.prepare(spec);
-        convolution.reset();
-    }
-
-    convolutionBuffer.setSize(2, bufferSize);
+    prepare(sampleRate, bufferSize);
 
     fixDirectOutsIntoPlace(sources, speakerSetup, projectSpatMode);
 }
@@ -232,8 +226,8 @@ inline void HrtfSpatAlgorithm::processSpeaker(int speakerIndex,
                                               juce::AudioBuffer<float> & stereoBuffer)
 {
     auto const numSamples{ sourcesBuffer.getNumSamples() };
-    auto & hrtfBuffer{ mHrtfData.speakersBuffer };
-    auto const magnitude{ hrtfBuffer[speakerId].getMagnitude(0, numSamples) };
+    auto const & hrtfBuffer{ mHrtfData.speakersBuffer };
+    auto const magnitude{ hrtfBuffer.isDirty(speakerId) ? hrtfBuffer[speakerId].getMagnitude(0, numSamples) : 0.0f };
     auto & hadSoundLastBlock{ mHrtfData.hadSoundLastBlock[speakerId] };
 
     // We can skip the speaker if the gain is small enough, but we have to perform one last block so that the
@@ -247,10 +241,10 @@ inline void HrtfSpatAlgorithm::processSpeaker(int speakerIndex,
         hadSoundLastBlock = true;
     }
 
-    jassert(convolutionBuffer.getNumSamples() == numSamples);
+    jassert(numSamples <= convolutionBuffer.getNumSamples());
     convolutionBuffer.copyFrom(0, 0, hrtfBuffer[speakerId], 0, 0, numSamples);
     convolutionBuffer.copyFrom(1, 0, hrtfBuffer[speakerId], 0, 0, numSamples);
-    juce::dsp::AudioBlock<float> block{ convolutionBuffer };
+    auto block{ juce::dsp::AudioBlock<float>{ convolutionBuffer }.getSubBlock(0, narrow<std::size_t>(numSamples)) };
     juce::dsp::ProcessContextReplacing<float> const context{ block };
     mConvolutions[speakerIndex].process(context);
 
@@ -281,8 +275,48 @@ std::unique_ptr<AbstractSpatAlgorithm> HrtfSpatAlgorithm::make(SpeakerSetup cons
                                                                double const sampleRate,
                                                                int const bufferSize)
 {
-    JUCE_ASSERT_MESSAGE_THREAD;
+    SG_ASSERT_BUILDER_THREAD;
     return std::make_unique<HrtfSpatAlgorithm>(speakerSetup, projectSpatMode, sources, sampleRate, bufferSize);
 }
 
+//==============================================================================
+void HrtfSpatAlgorithm::listHotMemory(HotMemory & hotMemory) const
+{
+    // The convolutions keep their state behind a pimpl that cannot be listed.
+    hotMemory.add(*this);
+    hotMemory.add(mHrtfData.speakersBuffer.getSlab());
+    if (mInnerAlgorithm) {
+        mInnerAlgorithm->listHotMemory(hotMemory);
+    }
+}
+
+//==============================================================================
+AbstractSpatAlgorithm::MemoryReport HrtfSpatAlgorithm::getMemoryReport() const
+{
+    MemoryReport report{ sizeof(*this) };
+    if (mInnerAlgorithm) {
+        report += mInnerAlgorithm->getMemoryReport();
+    }
+    return report;
+}
+
+//==============================================================================
+void HrtfSpatAlgorithm::prepare(double const sampleRate, int const maxBlockSize)
+{
+    jassert(maxBlockSize > 0 && maxBlockSize <= SpeakerAudioBuffer::MAX_NUM_SAMPLES);
+
+    // The convolutions keep their impulse responses : preparing them only rebuilds their engines for the new spec.
+    juce::dsp::ProcessSpec const spec{ sampleRate, narrow<juce::uint32>(maxBlockSize), 2 };
+    for (auto & convolution : mConvolutions) {
+        convolution.prepare(spec);
+        convolution.reset();
+    }
+
+    convolutionBuffer.setSize(2, maxBlockSize, false, false, true);
+
+    if (mInnerAlgorithm) {
+        mInnerAlgorithm->prepare(sampleRate, maxBlockSize);
+    }
+}
+
 } // namespace gris
@@ -85,6 +85,9 @@ public:
     [[nodiscard]] juce::Array<Triplet> getTriplets() const noexcept override;
     [[nodiscard]] bool hasTriplets() const noexcept override { return false; }
     [[nodiscard]] tl::optional<Error> getError() const noexcept override { return tl::nullopt; }
+    void listHotMemory(HotMemory & hotMemory) const override;
+    [[nodiscard]] MemoryReport getMemoryReport() const override;
+    void prepare(double sampleRate, int maxBlockSize) override;
     //==============================================================================
     /** Instantiates an HRTF algorithm. This should never fail. */
     static std::unique_ptr<AbstractSpatAlgorithm> make(SpeakerSetup const & speakerSetup,
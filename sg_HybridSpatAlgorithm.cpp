@@ -23,9 +23,9 @@
 namespace gris
 {
 //==============================================================================
-HybridSpatAlgorithm::HybridSpatAlgorithm(SpeakerSetup const & speakerSetup, std::vector<source_index_t> && sourceIds)
-    : mVbap(std::make_unique<VbapSpatAlgorithm>(speakerSetup.speakers, sourceIds))
-    , mMbap(std::make_unique<MbapSpatAlgorithm>(speakerSetup, std::move(sourceIds)))
+HybridSpatAlgorithm::HybridSpatAlgorithm(SpeakerSetup const & speakerSetup)
+    : mVbap(std::make_unique<VbapSpatAlgorithm>(speakerSetup.speakers))
+    , mMbap(std::make_unique<MbapSpatAlgorithm>(speakerSetup))
 {
 }
 
@@ -94,13 +94,53 @@ tl::optional<AbstractSpatAlgorithm::Error> HybridSpatAlgorithm::getError() const
 }
 
 //==============================================================================
-std::unique_ptr<AbstractSpatAlgorithm> HybridSpatAlgorithm::make(SpeakerSetup const & speakerSetup,
-                                                                 std::vector<source_index_t> && sourceIds)
+void HybridSpatAlgorithm::selectRenderPath(int const numSpatializedSpeakers) noexcept
+{
+    mVbap->selectRenderPath(numSpatializedSpeakers);
+    mMbap->selectRenderPath(numSpatializedSpeakers);
+}
+
+//==============================================================================
+std::unique_ptr<AbstractSpatAlgorithm> HybridSpatAlgorithm::make(SpeakerSetup const & speakerSetup)
 {
     if (speakerSetup.numOfSpatializedSpeakers() < 3) {
         return std::make_unique<DummySpatAlgorithm>(Error::notEnoughDomeSpeakers);
     }
-    return std::make_unique<HybridSpatAlgorithm>(speakerSetup, std::move(sourceIds));
+    auto hybrid{ std::make_unique<HybridSpatAlgorithm>(speakerSetup) };
+    hybrid->selectRenderPath(speakerSetup.numOfSpatializedSpeakers());
+    return hybrid;
+}
+
+//==============================================================================
+void HybridSpatAlgorithm::snapToTargetGains() noexcept
+{
+    mVbap->snapToTargetGains();
+    mMbap->snapToTargetGains();
+}
+
+//==============================================================================
+void HybridSpatAlgorithm::listHotMemory(HotMemory & hotMemory) const
+{
+    hotMemory.add(*this);
+    mVbap->listHotMemory(hotMemory);
+    mMbap->listHotMemory(hotMemory);
+}
+
+//==============================================================================
+AbstractSpatAlgorithm::MemoryReport HybridSpatAlgorithm::getMemoryReport() const
+{
+    // Both algorithms keep the state of every source, since any source can switch between them.
+    MemoryReport report{ sizeof(*this) };
+    report += mVbap->getMemoryReport();
+    report += mMbap->getMemoryReport();
+    return report;
+}
+
+//==============================================================================
+void HybridSpatAlgorithm::prepare(double const sampleRate, int const maxBlockSize)
+{
+    mVbap->prepare(sampleRate, maxBlockSize);
+    mMbap->prepare(sampleRate, maxBlockSize);
 }
 
 } // namespace gris
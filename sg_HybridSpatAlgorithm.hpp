@@ -41,7 +41,7 @@ public:
     SG_DELETE_COPY_AND_MOVE(HybridSpatAlgorithm)
     //==============================================================================
     /** Note: do not use this function directly. Use HybridSpatAlgorithm::make() instead. */
-    explicit HybridSpatAlgorithm(SpeakerSetup const & speakerSetup, std::vector<source_index_t> && sourceIds);
+    explicit HybridSpatAlgorithm(SpeakerSetup const & speakerSetup);
     //==============================================================================
     void updateSpatData(source_index_t sourceIndex, SourceData const & sourceData) noexcept override;
     void process(AudioConfig const & config,
@@ -56,10 +56,14 @@ public:
     [[nodiscard]] juce::Array<Triplet> getTriplets() const noexcept override;
     [[nodiscard]] bool hasTriplets() const noexcept override;
     [[nodiscard]] tl::optional<Error> getError() const noexcept override;
+    void snapToTargetGains() noexcept override;
+    void listHotMemory(HotMemory & hotMemory) const override;
+    [[nodiscard]] MemoryReport getMemoryReport() const override;
+    void prepare(double sampleRate, int maxBlockSize) override;
+    void selectRenderPath(int numSpatializedSpeakers) noexcept override;
     //==============================================================================
     /** Instantiates an HybridSpatAlgorithm. Make sure to check getError() as this might fail. */
-    static std::unique_ptr<AbstractSpatAlgorithm> make(SpeakerSetup const & speakerSetup,
-                                                       std::vector<source_index_t> && sourceIds);
+    static std::unique_ptr<AbstractSpatAlgorithm> make(SpeakerSetup const & speakerSetup);
 
 private:
     //==============================================================================
@@ -0,0 +1,318 @@
+/*
+ This file is part of SpatGRIS.
+
+ Developers: Gaël Lane Lépine, Samuel Béland, Olivier Bélanger, Nicolas Masson
+
+ SpatGRIS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ SpatGRIS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with SpatGRIS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sg_Kernels.hpp"
+#include <algorithm>
+#include <atomic>
+
+namespace gris
+{
+namespace
+{
+//==============================================================================
+// The bodies are written once and inlined into every variant, which the compiler then vectorizes for its own
+// instruction set. They do not depend on the instruction set, and the build turns floating-point contraction off for
+// this file (an FMA would round differently), so that every variant produces the same results.
+forcedinline void addWithGainBody(float * __restrict dest,
+                                  float const * __restrict src,
+                                  float const gain,
+                                  int const numSamples) noexcept
+{
+    for (int sampleIndex{}; sampleIndex < numSamples; ++sampleIndex) {
+        dest[sampleIndex] += src[sampleIndex] * gain;
+    }
+}
+
+//==============================================================================
+forcedinline float addWithLinearRampBody(float * __restrict dest,
+                                         float const * __restrict src,
+                                         float const gain,
+                                         float const slope,
+                                         int const numSamples) noexcept
+{
+    // The gain of every sample is computed from the start of the ramp instead of being accumulated, so that the loop
+    // has no dependency between samples.
+    for (int sampleIndex{}; sampleIndex < numSamples; ++sampleIndex) {
+        dest[sampleIndex] += src[sampleIndex] * (gain + slope * static_cast<float>(sampleIndex + 1));
+    }
+    return gain + slope * static_cast<float>(numSamples);
+}
+
+//==============================================================================
+forcedinline float addWithSmoothedRampBody(float * __restrict dest,
+                                           float const * __restrict src,
+                                           float gain,
+                                           float const target,
+                                           float const factor,
+                                           int const numSamples) noexcept
+{
+    for (int sampleIndex{}; sampleIndex < numSamples; ++sampleIndex) {
+        gain = target + (gain - target) * factor;
+        dest[sampleIndex] += src[sampleIndex] * gain;
+    }
+    return gain;
+}
+
+//==============================================================================
+forcedinline float addWithSmoothedFadeOutBody(float * __restrict dest,
+                                              float const * __restrict src,
+                                              float gain,
+                                              float const target,
+                                              float const factor,
+                                              float const threshold,
+                                              int const numSamples) noexcept
+{
+    for (int sampleIndex{}; sampleIndex < numSamples && gain >= threshold; ++sampleIndex) {
+        gain = target + (gain - target) * factor;
+        dest[sampleIndex] += src[sampleIndex] * gain;
+    }
+    return gain;
+}
+
+//==============================================================================
+template<std::size_t NUM_SPEAKERS>
+forcedinline void addToFixedSpeakersBody(float * const * dests,
+                                         float const * __restrict src,
+                                         float const * gains,
+                                         float const * slopes,
+                                         int const numSamples) noexcept
+{
+    // Small enough for a tile of every speaker to stay in L1 along with the source tile.
+    static constexpr int TILE_SIZE{ 64 };
+
+    std::array<float *, NUM_SPEAKERS> localDests{};
+    std::array<float, NUM_SPEAKERS> localGains{};
+    std::array<float, NUM_SPEAKERS> localSlopes{};
+    for (std::size_t speaker{}; speaker < NUM_SPEAKERS; ++speaker) {
+        localDests[speaker] = dests[speaker];
+        localGains[speaker] = gains[speaker];
+        localSlopes[speaker] = slopes[speaker];
+    }
+
+    for (int tileStart{}; tileStart < numSamples; tileStart += TILE_SIZE) {
+        auto const tileEnd{ std::min(tileStart + TILE_SIZE, numSamples) };
+        for (std::size_t speaker{}; speaker < NUM_SPEAKERS; ++speaker) {
+            auto * const __restrict dest{ localDests[speaker] };
+            if (dest == nullptr) {
+                continue;
+            }
+            auto const gain{ localGains[speaker] };
+            auto const slope{ localSlopes[speaker] };
+            // Same expression as addWithLinearRampBody(), so that both paths produce the same samples.
+            for (int sampleIndex{ tileStart }; sampleIndex < tileEnd; ++sampleIndex) {
+                dest[sampleIndex] += src[sampleIndex] * (gain + slope * static_cast<float>(sampleIndex + 1));
+            }
+        }
+    }
+}
+
+//==============================================================================
+#define SG_DEFINE_MIX_KERNELS(suffix, target)                                                                          \
+    target void addWithGain##suffix(float * dest, float const * src, float gain, int numSamples) noexcept             \
+    {                                                                                                                  \
+        addWithGainBody(dest, src, gain, numSamples);                                                                  \
+    }                                                                                                                  \
+    target float addWithLinearRamp##suffix(float * dest,                                                               \
+                                           float const * src,                                                          \
+                                           float gain,                                                                 \
+                                           float slope,                                                                \
+                                           int numSamples) noexcept                                                    \
+    {                                                                                                                  \
+        return addWithLinearRampBody(dest, src, gain, slope, numSamples);                                              \
+    }                                                                                                                  \
+    target float addWithSmoothedRamp##suffix(float * dest,                                                             \
+                                             float const * src,                                                        \
+                                             float gain,                                                               \
+                                             float targetGain,                                                         \
+                                             float factor,                                                             \
+                                             int numSamples) noexcept                                                  \
+    {                                                                                                                  \
+        return addWithSmoothedRampBody(dest, src, gain, targetGain, factor, numSamples);                               \
+    }                                                                                                                  \
+    target float addWithSmoothedFadeOut##suffix(float * dest,                                                          \
+                                                float const * src,                                                     \
+                                                float gain,                                                            \
+                                                float targetGain,                                                      \
+                                                float factor,                                                          \
+                                                float threshold,                                                       \
+                                                int numSamples) noexcept                                               \
+    {                                                                                                                  \
+        return addWithSmoothedFadeOutBody(dest, src, gain, targetGain, factor, threshold, numSamples);                 \
+    }                                                                                                                  \
+    template<std::size_t NUM_SPEAKERS>                                                                                 \
+    target void addToFixedSpeakers##suffix(float * const * dests,                                                      \
+                                           float const * src,                                                          \
+                                           float const * gains,                                                        \
+                                           float const * slopes,                                                       \
+                                           int numSamples) noexcept                                                    \
+    {                                                                                                                  \
+        addToFixedSpeakersBody<NUM_SPEAKERS>(dests, src, gains, slopes, numSamples);                                   \
+    }
+
+SG_DEFINE_MIX_KERNELS(Generic, )
+#if SG_KERNELS_MULTIVERSIONING
+SG_DEFINE_MIX_KERNELS(Sse41, SG_KERNEL_TARGET_SSE41)
+SG_DEFINE_MIX_KERNELS(Avx2, SG_KERNEL_TARGET_AVX2)
+SG_DEFINE_MIX_KERNELS(Avx512, SG_KERNEL_TARGET_AVX512)
+#endif
+
+#undef SG_DEFINE_MIX_KERNELS
+
+//==============================================================================
+static_assert(FIXED_SPEAKER_COUNTS == std::array<std::size_t, 4>{ 8, 16, 32, 64 },
+              "SG_MIX_KERNELS has to be kept in sync with FIXED_SPEAKER_COUNTS");
+
+#define SG_MIX_KERNELS(isa, suffix)                                                                                    \
+    MixKernels                                                                                                         \
+    {                                                                                                                  \
+        isa, addWithGain##suffix, addWithLinearRamp##suffix, addWithSmoothedRamp##suffix,                              \
+            addWithSmoothedFadeOut##suffix,                                                                            \
+        {                                                                                                              \
+            addToFixedSpeakers##suffix<8>, addToFixedSpeakers##suffix<16>, addToFixedSpeakers##suffix<32>,             \
+                addToFixedSpeakers##suffix<64>                                                                         \
+        }                                                                                                              \
+    }
+
+#if SG_KERNELS_MULTIVERSIONING
+constexpr std::array<MixKernels, NUM_KERNEL_ISAS> MIX_KERNELS{
+    SG_MIX_KERNELS(KernelIsa::generic, Generic),
+    SG_MIX_KERNELS(KernelIsa::sse41, Sse41),
+    SG_MIX_KERNELS(KernelIsa::avx2, Avx2),
+    SG_MIX_KERNELS(KernelIsa::avx512, Avx512),
+};
+#else
+constexpr auto GENERIC_MIX_KERNELS{ SG_MIX_KERNELS(KernelIsa::generic, Generic) };
+constexpr std::array<MixKernels, NUM_KERNEL_ISAS> MIX_KERNELS{
+    GENERIC_MIX_KERNELS,
+    GENERIC_MIX_KERNELS,
+    GENERIC_MIX_KERNELS,
+    GENERIC_MIX_KERNELS,
+};
+#endif
+
+#undef SG_MIX_KERNELS
+
+//==============================================================================
+KernelIsa detectKernelIsaUncached() noexcept
+{
+#if SG_KERNELS_MULTIVERSIONING
+    __builtin_cpu_init();
+    auto const hasAvx2{ __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") };
+    if (hasAvx2 && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl")) {
+        return KernelIsa::avx512;
+    }
+    if (hasAvx2) {
+        return KernelIsa::avx2;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return KernelIsa::sse41;
+    }
+#endif
+    return KernelIsa::generic;
+}
+
+//==============================================================================
+KernelIsa capToDetectedKernelIsa(KernelIsa const isa) noexcept
+{
+    return isKernelIsaSupported(isa) ? isa : detectKernelIsa();
+}
+
+//==============================================================================
+std::atomic<KernelIsa> & getActiveKernelIsaStorage() noexcept
+{
+    static std::atomic<KernelIsa> activeIsa{ [] {
+        auto const requestedIsa{ stringToKernelIsa(
+            juce::SystemStats::getEnvironmentVariable("ALGOGRIS_KERNEL_ISA", {}).trim().toLowerCase()) };
+        return requestedIsa ? capToDetectedKernelIsa(*requestedIsa) : detectKernelIsa();
+    }() };
+    return activeIsa;
+}
+
+} // namespace
+
+//==============================================================================
+juce::String kernelIsaToString(KernelIsa const isa)
+{
+    switch (isa) {
+    case KernelIsa::generic:
+        return "generic";
+    case KernelIsa::sse41:
+        return "sse41";
+    case KernelIsa::avx2:
+        return "avx2";
+    case KernelIsa::avx512:
+        return "avx512";
+    }
+    jassertfalse;
+    return {};
+}
+
+//==============================================================================
+tl::optional<KernelIsa> stringToKernelIsa(juce::String const & string)
+{
+    for (std::size_t index{}; index < NUM_KERNEL_ISAS; ++index) {
+        auto const isa{ static_cast<KernelIsa>(index) };
+        if (string == kernelIsaToString(isa)) {
+            return isa;
+        }
+    }
+    return tl::nullopt;
+}
+
+//==============================================================================
+KernelIsa detectKernelIsa() noexcept
+{
+    static auto const DETECTED_ISA{ detectKernelIsaUncached() };
+    return DETECTED_ISA;
+}
+
+//==============================================================================
+bool isKernelIsaSupported(KernelIsa const isa) noexcept
+{
+    // Every instruction set that kernels are specialized for is a superset of the previous one.
+    return static_cast<int>(isa) <= static_cast<int>(detectKernelIsa());
+}
+
+//==============================================================================
+KernelIsa getActiveKernelIsa() noexcept
+{
+    return getActiveKernelIsaStorage().load(std::memory_order_relaxed);
+}
+
+//==============================================================================
+KernelIsa setActiveKernelIsa(KernelIsa const isa) noexcept
+{
+    auto const cappedIsa{ capToDetectedKernelIsa(isa) };
+    getActiveKernelIsaStorage().store(cappedIsa, std::memory_order_relaxed);
+    return cappedIsa;
+}
+
+//==============================================================================
+MixKernels const & getMixKernels(KernelIsa const isa) noexcept
+{
+    return MIX_KERNELS[static_cast<std::size_t>(isa)];
+}
+
+//==============================================================================
+MixKernels const & getMixKernels() noexcept
+{
+    return getMixKernels(getActiveKernelIsa());
+}
+
+} // namespace gris
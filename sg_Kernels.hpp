@@ -0,0 +1,178 @@
+/*
+ This file is part of SpatGRIS.
+
+ Developers: Gaël Lane Lépine, Samuel Béland, Olivier Bélanger, Nicolas Masson
+
+ SpatGRIS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ SpatGRIS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with SpatGRIS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "tl/optional.hpp"
+#include <array>
+#include <cmath>
+#include <cstddef>
+
+/** Kernels can only be specialized per instruction set with GCC and Clang on x86. Other targets use the generic
+ * variants. */
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+    #define SG_KERNELS_MULTIVERSIONING 1
+    #define SG_KERNEL_TARGET_SSE41 __attribute__((target("sse4.1")))
+    #define SG_KERNEL_TARGET_AVX2 __attribute__((target("avx2,fma")))
+    #define SG_KERNEL_TARGET_AVX512 __attribute__((target("avx512f,avx512vl,avx2,fma")))
+#else
+    #define SG_KERNELS_MULTIVERSIONING 0
+#endif
+
+namespace gris
+{
+//==============================================================================
+/** The instruction sets that kernels are specialized for, from the most to the least portable. */
+enum class KernelIsa { generic, sse41, avx2, avx512 };
+
+constexpr std::size_t NUM_KERNEL_ISAS = 4;
+
+[[nodiscard]] juce::String kernelIsaToString(KernelIsa isa);
+[[nodiscard]] tl::optional<KernelIsa> stringToKernelIsa(juce::String const & string);
+
+//==============================================================================
+/** The best instruction set supported by the CPU and the OS, as reported by cpuid. */
+[[nodiscard]] KernelIsa detectKernelIsa() noexcept;
+[[nodiscard]] bool isKernelIsaSupported(KernelIsa isa) noexcept;
+
+/** The instruction set that the kernels currently use.
+ *
+ * It defaults to detectKernelIsa(), capped by the ALGOGRIS_KERNEL_ISA environment variable if it is set to one of
+ * "generic", "sse41", "avx2" or "avx512".
+ */
+[[nodiscard]] KernelIsa getActiveKernelIsa() noexcept;
+/** Overrides the instruction set used by the kernels, e.g. for A/B comparisons. Unsupported instruction sets are capped
+ * to detectKernelIsa(). Kernels that are already running finish with their current variant.
+ *
+ * @return the instruction set that is actually used.
+ */
+KernelIsa setActiveKernelIsa(KernelIsa isa) noexcept;
+
+//==============================================================================
+/** One kernel compiled for every instruction set.
+ *
+ * Missing variants are nullptr and fall back to the next most portable one. The generic variant is mandatory.
+ */
+template<typename Fn>
+struct KernelVariants {
+    std::array<Fn, NUM_KERNEL_ISAS> variants{};
+    //==============================================================================
+    [[nodiscard]] Fn select(KernelIsa const isa) const noexcept
+    {
+        for (auto index{ static_cast<std::size_t>(isa) }; index > 0; --index) {
+            if (variants[index] != nullptr) {
+                return variants[index];
+            }
+        }
+        jassert(variants.front() != nullptr);
+        return variants.front();
+    }
+    [[nodiscard]] Fn select() const noexcept { return select(getActiveKernelIsa()); }
+};
+
+//==============================================================================
+/** The speaker counts that get mixing kernels specialized at compile time. Common rig layouts. */
+constexpr std::array<std::size_t, 4> FIXED_SPEAKER_COUNTS{ 8, 16, 32, 64 };
+constexpr std::size_t MAX_FIXED_SPEAKER_COUNT = FIXED_SPEAKER_COUNTS.back();
+
+/** @return the index of numSpeakers in FIXED_SPEAKER_COUNTS, or nullopt if it has no specialized kernels. */
+[[nodiscard]] constexpr tl::optional<std::size_t> getFixedSpeakerCountIndex(std::size_t const numSpeakers) noexcept
+{
+    for (std::size_t index{}; index < FIXED_SPEAKER_COUNTS.size(); ++index) {
+        if (FIXED_SPEAKER_COUNTS[index] == numSpeakers) {
+            return index;
+        }
+    }
+    return tl::nullopt;
+}
+
+//==============================================================================
+/** The kernels that mix a source into a speaker while its gain ramps.
+ *
+ * Fetch them once per block with getMixKernels() and keep the reference for the whole block.
+ */
+struct MixKernels {
+    /** dest += src * gain */
+    using add_with_gain_t = void (*)(float * dest, float const * src, float gain, int numSamples) noexcept;
+    /** dest[i] += src[i] * (gain + slope * (i + 1)). Returns the gain reached after the last sample. */
+    using add_with_linear_ramp_t
+        = float (*)(float * dest, float const * src, float gain, float slope, int numSamples) noexcept;
+    /** gain = target + (gain - target) * factor, then dest[i] += src[i] * gain. Returns the gain reached after the last
+     * sample. */
+    using add_with_smoothed_ramp_t
+        = float (*)(float * dest, float const * src, float gain, float target, float factor, int numSamples) noexcept;
+    /** Same as add_with_smoothed_ramp_t, but stops as soon as the gain falls under threshold. */
+    using add_with_smoothed_fade_out_t = float (*)(float * dest,
+                                                   float const * src,
+                                                   float gain,
+                                                   float target,
+                                                   float factor,
+                                                   float threshold,
+                                                   int numSamples) noexcept;
+    /** dests[j][i] += src[i] * (gains[j] + slopes[j] * (i + 1)) for the FIXED_SPEAKER_COUNTS[k] speakers of a fixed
+     * layout. The speaker loop is unrolled and the samples are processed tile by tile, so that every source sample is
+     * loaded once for all the speakers. A nullptr destination is skipped. */
+    using add_to_fixed_speakers_t = void (*)(float * const * dests,
+                                             float const * src,
+                                             float const * gains,
+                                             float const * slopes,
+                                             int numSamples) noexcept;
+    //==============================================================================
+    KernelIsa isa{};
+    add_with_gain_t addWithGain{};
+    add_with_linear_ramp_t addWithLinearRamp{};
+    add_with_smoothed_ramp_t addWithSmoothedRamp{};
+    add_with_smoothed_fade_out_t addWithSmoothedFadeOut{};
+    /** Indexed like FIXED_SPEAKER_COUNTS. */
+    std::array<add_to_fixed_speakers_t, FIXED_SPEAKER_COUNTS.size()> addToFixedSpeakers{};
+};
+
+/** The mix kernels of a specific instruction set. The caller is responsible for checking isKernelIsaSupported(). */
+[[nodiscard]] MixKernels const & getMixKernels(KernelIsa isa) noexcept;
+/** The mix kernels of the active instruction set. */
+[[nodiscard]] MixKernels const & getMixKernels() noexcept;
+
+//==============================================================================
+/** Reads a circular buffer at a fractional position using a 4-point (3rd order) Lagrange interpolator.
+ *
+ * @param line the circular buffer. Its size has to be a power of two.
+ * @param mask the size of the circular buffer minus one.
+ * @param readPosition the fractional position to read from. Can be negative : it wraps around the buffer.
+ */
+[[nodiscard]] inline float readLagrange(float const * line, int const mask, double const readPosition) noexcept
+{
+    auto const floorPosition{ std::floor(readPosition) };
+    auto const index{ static_cast<int>(floorPosition) };
+    auto const fraction{ static_cast<float>(readPosition - floorPosition) };
+
+    auto const fractionPlusOne{ fraction + 1.0f };
+    auto const fractionMinusOne{ fraction - 1.0f };
+    auto const fractionMinusTwo{ fraction - 2.0f };
+
+    auto const coefficientMinusOne{ -fraction * fractionMinusOne * fractionMinusTwo / 6.0f };
+    auto const coefficient0{ fractionPlusOne * fractionMinusOne * fractionMinusTwo / 2.0f };
+    auto const coefficient1{ -fractionPlusOne * fraction * fractionMinusTwo / 2.0f };
+    auto const coefficient2{ fractionPlusOne * fraction * fractionMinusOne / 6.0f };
+
+    return coefficientMinusOne * line[(index - 1) & mask] + coefficient0 * line[index & mask]
+           + coefficient1 * line[(index + 1) & mask] + coefficient2 * line[(index + 2) & mask];
+}
+
+} // namespace gris
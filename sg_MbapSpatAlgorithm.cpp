@@ -29,25 +29,29 @@
 #include "Implementations/sg_mbap.hpp"
 #include "sg_AbstractSpatAlgorithm.hpp"
 #include "sg_DummySpatAlgorithm.hpp"
+#include "sg_Kernels.hpp"
+#include "sg_Reclaimer.hpp"
 #include "juce_audio_basics/juce_audio_basics.h"
 #include "juce_core/juce_core.h"
 #include "juce_core/system/juce_PlatformDefs.h"
 #include "juce_events/juce_events.h"
 #include <cmath>
+#include <algorithm>
 #include <cassert>
 #include <cstdlib>
 #include <memory>
+#include <thread>
 
 namespace gris
 {
 //==============================================================================
-MbapSpatAlgorithm::MbapSpatAlgorithm(SpeakerSetup const & speakerSetup, std::vector<source_index_t> && theSourceIds)
+MbapSpatAlgorithm::MbapSpatAlgorithm(SpeakerSetup const & speakerSetup)
     : mField(mbapInit(speakerSetup.speakers))
 #if SG_USE_FORK_UNION
-    , sourceIds{ std::move(theSourceIds) }
+    , mAttenuationScratches(std::thread::hardware_concurrency())
 #endif
 {
-    JUCE_ASSERT_MESSAGE_THREAD;
+    SG_ASSERT_BUILDER_THREAD;
 
     auto constexpr DIFFUSION_IN_MIN{ 1.0f };
     auto constexpr DIFFUSION_IN_MAX{ 0.0f };
@@ -60,6 +64,51 @@ MbapSpatAlgorithm::MbapSpatAlgorithm(SpeakerSetup const & speakerSetup, std::vec
                              + DIFFUSION_OUT_MIN };
 
     mField.fieldExponent = newDiffusion;
+
+    mGains.allocate(speakerSetup.speakers, MbapSpatDataQueue::NUM_TOKENS);
+    for (int i{ 1 }; i <= MAX_NUM_SOURCES; ++i) {
+        source_index_t const sourceIndex{ i };
+        auto & data{ mData[sourceIndex] };
+        data.lastGains = mGains.getLastGains(sourceIndex);
+        data.dataQueue.initializeTokens([&](MbapSpatData & spatData, std::size_t const tokenIndex) {
+            spatData.gains = mGains.getTokenRow(sourceIndex, tokenIndex);
+        });
+    }
+}
+
+//==============================================================================
+void MbapSpatAlgorithm::listHotMemory(HotMemory & hotMemory) const
+{
+    // The sources' data (gain tokens, attenuation state and last gains) lives inside the algorithm and its gains slab.
+    hotMemory.add(*this);
+    hotMemory.add(mGains.getSlab());
+    hotMemory.add(mField.outputOrder);
+    hotMemory.add(mField.amplitudeMatrix);
+    hotMemory.add(mField.speakerPositions);
+#if SG_USE_FORK_UNION
+    hotMemory.add(mAttenuationScratches);
+#endif
+}
+
+//==============================================================================
+AbstractSpatAlgorithm::MemoryReport MbapSpatAlgorithm::getMemoryReport() const
+{
+    // Every source reads one gain token and ramps its last gains.
+    auto const numSourcesBytes{ sizeof(mData) + mGains.getNumBytes() };
+    return MemoryReport{ sizeof(*this) + mGains.getNumBytes(),
+                         numSourcesBytes,
+                         MAX_NUM_SOURCES * 2 * mGains.getNumBytesPerRow() };
+}
+
+//==============================================================================
+MbapSpatAlgorithm::~MbapSpatAlgorithm()
+{
+    if (Reclaimer::isReclaimerThread()) {
+        // This algorithm is already being reclaimed : the field goes with it.
+        return;
+    }
+    // The amplitude matrices weigh hundreds of megabytes on big setups.
+    Reclaimer::retire(std::make_unique<MbapField>(std::move(mField)), "MbapField");
 }
 
 //==============================================================================
@@ -75,30 +124,35 @@ void MbapSpatAlgorithm::updateSpatData(source_index_t const sourceIndex, SourceD
     auto & spatData{ ticket->get() };
 
     if (sourceData.position) {
-        auto const distXY{ std::sqrt(std::pow(sourceData.position->getCartesian().x, 2.0f)
-                                     + std::pow(sourceData.position->getCartesian().y, 2.0f)) };
-        auto const distZ{ sourceData.position->getCartesian().z };
-        auto const attenuationRadius{ 1.0f };
-
-        mbap(sourceData, spatData.gains, mField);
-
-        // mbapAttenuation when source is under the floor
-        if (distZ < 0.0f && distXY < attenuationRadius) {
-            spatData.mbapSourceDistance = std::abs(distZ - attenuationRadius);
-        } else if (distZ < 0.0f) {
-            spatData.mbapSourceDistance = distXY + std::abs(distZ);
-        } else {
-            spatData.mbapSourceDistance = std::sqrt(std::pow(sourceData.position->getCartesian().x, 2.0f)
-                                                    + std::pow(sourceData.position->getCartesian().y, 2.0f)
-                                                    + std::pow(sourceData.position->getCartesian().z, 2.0f));
-        }
+        SpeakersSpatGains allGains{};
+        mbap(sourceData, allGains, mField);
+        spatData.gains.copyFrom(allGains);
+        spatData.mbapSourceDistance = getSourceDistance(*sourceData.position);
     } else {
-        spatData.gains = SpeakersSpatGains{};
+        spatData.gains.clear();
     }
 
     exchanger.setMostRecent(ticket);
 }
 
+//==============================================================================
+float MbapSpatAlgorithm::getSourceDistance(Position const & position) noexcept
+{
+    auto const & cartesian{ position.getCartesian() };
+    auto const distXY{ std::sqrt(std::pow(cartesian.x, 2.0f) + std::pow(cartesian.y, 2.0f)) };
+    auto const distZ{ cartesian.z };
+    auto const attenuationRadius{ 1.0f };
+
+    // mbapAttenuation when source is under the floor
+    if (distZ < 0.0f && distXY < attenuationRadius) {
+        return std::abs(distZ - attenuationRadius);
+    }
+    if (distZ < 0.0f) {
+        return distXY + std::abs(distZ);
+    }
+    return std::sqrt(std::pow(cartesian.x, 2.0f) + std::pow(cartesian.y, 2.0f) + std::pow(cartesian.z, 2.0f));
+}
+
 //==============================================================================
 void MbapSpatAlgorithm::process(AudioConfig const & config,
                                 SourceAudioBuffer & sourcesBuffer,
@@ -112,40 +166,87 @@ void MbapSpatAlgorithm::process(AudioConfig const & config,
 {
     ASSERT_AUDIO_THREAD;
 
-    auto const & speakersAudioConfig{ altSpeakerConfig ? *altSpeakerConfig : config.speakersAudioConfig };
+    auto const & renderPlan{ getRenderPlan(config, altSpeakerConfig) };
+    collectActiveSources(config, sourcePeaks);
 
 #if SG_USE_FORK_UNION
-    namespace fu = ashvardanian::fork_union;
-
-    jassert(sourceIds.size() > 0);
-
-    fu::for_n(threadPool, sourceIds.size(), [&](fu::prong_t prong) noexcept {
+    // The governor decides how many workers take part. They pick the most expensive sources first and the cheap ones
+    // fill the gaps.
+    mActiveSources.sortByCost();
+    auto const processActiveSource = [&](std::size_t const taskIndex, std::size_t const threadIndex) noexcept {
         processSource(config,
-                      sourceIds[prong.task_index],
-                      sourcePeaks,
+                      mActiveSources[taskIndex],
                       sourcesBuffer,
-                      speakersAudioConfig,
+                      renderPlan,
+                      mAttenuationScratches[threadIndex],
     #if SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS
                       forkUnionBuffer,
     #elif SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD
-                      forkUnionBuffer[prong.thread_index],
+                      forkUnionBuffer[threadIndex],
     #endif
                       speakersBuffer);
-    });
+    };
+    dispatchActiveSources(mActiveSources, sourcesBuffer.getNumSamples(), processActiveSource);
     #if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
-    copyForkUnionBuffer(speakersAudioConfig, sourcesBuffer, speakersBuffer, forkUnionBuffer);
+    copyForkUnionBuffer(altSpeakerConfig ? *altSpeakerConfig : config.speakersAudioConfig,
+                        sourcesBuffer,
+                        speakersBuffer,
+                        forkUnionBuffer);
     #endif
 #else
-    for (auto const & source : config.sourcesAudioConfig)
-        processSource(config, source.key, sourcePeaks, sourcesBuffer, speakersAudioConfig, speakersBuffer);
+    for (auto const & activeSource : mActiveSources)
+        processSource(config,
+                      activeSource.sourceIndex,
+                      sourcesBuffer,
+                      renderPlan,
+                      mAttenuationScratch,
+                      speakersBuffer);
 #endif
 }
 
+//==============================================================================
+void MbapSpatAlgorithm::collectActiveSources(AudioConfig const & config, SourcePeaks const & sourcePeaks) noexcept
+{
+    mActiveSources.clear();
+    for (auto const & source : config.sourcesAudioConfig) {
+        if (source.value.isMuted || source.value.directOut || sourcePeaks[source.key] < SMALL_GAIN) {
+            // source silent
+            continue;
+        }
+
+        auto & data{ mData[source.key] };
+        auto const * const previousData{ data.currentData };
+        data.dataQueue.getMostRecent(data.currentData);
+        if (data.currentData == nullptr) {
+            // no spat data
+            continue;
+        }
+
+        // New gains mean that the audible speakers are going to ramp during this block.
+        auto const hasNewGains{ data.currentData != previousData };
+        auto const ratio{ hasNewGains ? ActiveSources::RAMPING_GAIN_COST / ActiveSources::STATIC_GAIN_COST : 1.0f };
+        mActiveSources.add(source.key, std::max(data.lastBlockCost, ActiveSources::STATIC_GAIN_COST) * ratio);
+    }
+}
+
+//==============================================================================
+void MbapSpatAlgorithm::snapToTargetGains() noexcept
+{
+    ASSERT_AUDIO_THREAD;
+
+    for (auto & data : mData) {
+        data.dataQueue.getMostRecent(data.currentData);
+        if (data.currentData != nullptr) {
+            data.lastGains.copyFrom(data.currentData->get().gains);
+        }
+    }
+}
+
 inline void MbapSpatAlgorithm::processSource(const gris::AudioConfig & config,
                                              const gris::source_index_t & sourceId,
-                                             const gris::SourcePeaks & sourcePeaks,
-                                             gris::SourceAudioBuffer & sourceBuffer,
-                                             const gris::SpeakersAudioConfig & speakersAudioConfig,
+                                             gris::SourceAudioBuffer const & sourceBuffer,
+                                             SpeakerRenderPlan const & renderPlan,
+                                             MbapAttenuationScratch & attenuationScratch,
 #if SG_USE_FORK_UNION
     #if SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS
                                              ForkUnionBuffer & forkUnionBuffer,
@@ -155,18 +256,9 @@ inline void MbapSpatAlgorithm::processSource(const gris::AudioConfig & config,
 #endif
                                              gris::SpeakerAudioBuffer & speakerBuffers)
 {
-    auto const & source = config.sourcesAudioConfig[sourceId];
-    if (source.isMuted || source.directOut || sourcePeaks[sourceId] < SMALL_GAIN) {
-        // speaker silent
-        return;
-    }
-
     auto & data{ mData[sourceId] };
-    data.dataQueue.getMostRecent(data.currentData);
-    if (data.currentData == nullptr) {
-        // no spat data
-        return;
-    }
+    // collectActiveSources() already fetched the most recent spat data.
+    jassert(data.currentData != nullptr);
 
     auto const numSamples{ sourceBuffer.getNumSamples() };
     auto const & spatData{ data.currentData->get() };
@@ -175,44 +267,65 @@ inline void MbapSpatAlgorithm::processSource(const gris::AudioConfig & config,
     auto const & gainInterpolation{ config.spatGainsInterpolation };
     auto const gainFactor{ std::pow(gainInterpolation, 0.1f) * 0.0099f + 0.99f };
 
-    // process attenuation if Player does not exist
-    auto * inputSamples{ sourceBuffer[sourceId].getWritePointer(0) };
+    // process attenuation if Player does not exist. The source buffer is left untouched so that it can be shared with
+    // other algorithms and threads.
+    auto const * inputSamples{ sourceBuffer[sourceId].getReadPointer(0) };
     if (config.mbapAttenuationConfig.shouldProcess) {
-        config.mbapAttenuationConfig.process(inputSamples,
-                                             numSamples,
-                                             spatData.mbapSourceDistance,
-                                             data.attenuationState);
+        inputSamples = config.mbapAttenuationConfig.process(inputSamples,
+                                                            attenuationScratch.samples.data(),
+                                                            numSamples,
+                                                            spatData.mbapSourceDistance,
+                                                            data.attenuationState);
     }
 
     // Process spatialization
-    [[maybe_unused]] size_t i = 0;
-    for (auto const & speaker : speakersAudioConfig) {
-        if (speaker.value.isMuted || speaker.value.isDirectOutOnly || speaker.value.gain < SMALL_GAIN) {
-            // speaker silent
+#if !SG_USE_FORK_UNION
+    // Layouts with a specialized kernel mix every speaker in a single pass over the source samples.
+    if (canRenderToFixedSpeakers(renderPlan)) {
+        data.lastBlockCost = renderSourceToFixedSpeakers(inputSamples,
+                                                         numSamples,
+                                                         renderPlan,
+                                                         lastGains,
+                                                         targetGains,
+                                                         gainInterpolation,
+                                                         gainFactor,
+                                                         speakerBuffers);
+        return;
+    }
+#endif
+
+    [[maybe_unused]] auto * const * speakersChannels{ speakerBuffers.getRawChannels() };
+    [[maybe_unused]] auto const & kernels{ getMixKernels() };
+    auto cost{ 0.0f };
+    for (std::size_t i{}; i < renderPlan.speakers.size(); ++i) {
+        auto const outputPatch{ renderPlan.speakers[i] };
+        if (!lastGains.contains(outputPatch)) {
+            // not part of the setup that the gains were computed for
             continue;
         }
-
-        auto & currentGain{ lastGains[speaker.key] };
-        auto const & targetGain{ targetGains[speaker.key] };
+        auto & currentGain{ lastGains[outputPatch] };
+        auto const & targetGain{ targetGains[outputPatch] };
         auto const gainDiff{ targetGain - currentGain };
         auto const gainSlope{ gainDiff / narrow<float>(numSamples) };
 
 #if SG_USE_FORK_UNION
     #if SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS
-        auto & outputSamples{ forkUnionBuffer[i++] };
+        auto & outputSamples{ forkUnionBuffer[i] };
     #elif SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD
-        auto & outputSamples{ speakerBuffer[i++] };
+        auto & outputSamples{ speakerBuffer[i] };
     #elif SG_FU_METHOD == SG_FU_USE_ATOMIC_CAST
-        auto * outputSamples{ speakerBuffers[speaker.key].getWritePointer(0) };
+        auto * outputSamples{ speakersChannels[outputPatch.removeOffset<std::size_t>()] };
     #endif
 #else
-        auto * outputSamples{ speakerBuffers[speaker.key].getWritePointer(0) };
+        auto * outputSamples{ speakersChannels[outputPatch.removeOffset<std::size_t>()] };
 #endif
 
         if (juce::approximatelyEqual(gainSlope, 0.f) || std::abs(gainDiff) < SMALL_GAIN) {
             // no interpolation
             currentGain = targetGain;
             if (currentGain >= SMALL_GAIN) {
+                speakerBuffers.markDirty(outputPatch);
+                cost += ActiveSources::STATIC_GAIN_COST;
 #if SG_USE_FORK_UNION
     #if SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS
                 for (int sampleIndex{}; sampleIndex < numSamples; ++sampleIndex)
@@ -227,18 +340,20 @@ inline void MbapSpatAlgorithm::processSource(const gris::AudioConfig & config,
                     std::atomic_ref<float>(outputSamples[sampleIndex]) += inputSamples[sampleIndex] * currentGain;
     #endif
 #else
-                juce::FloatVectorOperations::addWithMultiply(outputSamples, inputSamples, currentGain, numSamples);
+                kernels.addWithGain(outputSamples, inputSamples, currentGain, numSamples);
 #endif
             }
             continue;
         }
 
         // interpolation necessary
+        speakerBuffers.markDirty(outputPatch);
+        cost += ActiveSources::RAMPING_GAIN_COST;
         if (juce::approximatelyEqual(gainInterpolation, 0.f)) {
             // linear interpolation over buffer size
+#if SG_USE_FORK_UNION
             for (int sampleIndex{}; sampleIndex < numSamples; ++sampleIndex) {
                 currentGain += gainSlope;
-#if SG_USE_FORK_UNION
     #if SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS
                 outputSamples[sampleIndex]._a += inputSamples[sampleIndex] * currentGain;
     #elif SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD
@@ -248,17 +363,17 @@ inline void MbapSpatAlgorithm::processSource(const gris::AudioConfig & config,
     #else
         #error "Invalid FORK_UNION_METHOD selected"
     #endif
+            }
 #else
-                outputSamples[sampleIndex] += inputSamples[sampleIndex] * currentGain;
+            currentGain = kernels.addWithLinearRamp(outputSamples, inputSamples, currentGain, gainSlope, numSamples);
 #endif
-            }
         } else {
             // log interpolation with 1st order filter
             if (targetGain < SMALL_GAIN) {
                 // targeting silence
+#if SG_USE_FORK_UNION
                 for (int sampleIndex{}; sampleIndex < numSamples && currentGain >= SMALL_GAIN; ++sampleIndex) {
                     currentGain = targetGain + (currentGain - targetGain) * gainFactor;
-#if SG_USE_FORK_UNION
     #if SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS
                     outputSamples[sampleIndex]._a += inputSamples[sampleIndex] * currentGain;
     #elif SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD
@@ -268,17 +383,23 @@ inline void MbapSpatAlgorithm::processSource(const gris::AudioConfig & config,
     #else
         #error "Invalid FORK_UNION_METHOD selected"
     #endif
+                }
 #else
-                    outputSamples[sampleIndex] += inputSamples[sampleIndex] * currentGain;
+                currentGain = kernels.addWithSmoothedFadeOut(outputSamples,
+                                                             inputSamples,
+                                                             currentGain,
+                                                             targetGain,
+                                                             gainFactor,
+                                                             SMALL_GAIN,
+                                                             numSamples);
 #endif
-                }
                 continue;
             }
 
             // not targeting silence
+#if SG_USE_FORK_UNION
             for (int sampleIndex{}; sampleIndex < numSamples; ++sampleIndex) {
                 currentGain = (currentGain - targetGain) * gainFactor + targetGain;
-#if SG_USE_FORK_UNION
     #if SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS
                 outputSamples[sampleIndex]._a += inputSamples[sampleIndex] * currentGain;
     #elif SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD
@@ -288,12 +409,19 @@ inline void MbapSpatAlgorithm::processSource(const gris::AudioConfig & config,
     #else
         #error "Invalid FORK_UNION_METHOD selected"
     #endif
+            }
 #else
-                outputSamples[sampleIndex] += inputSamples[sampleIndex] * currentGain;
+            currentGain = kernels.addWithSmoothedRamp(outputSamples,
+                                                      inputSamples,
+                                                      currentGain,
+                                                      targetGain,
+                                                      gainFactor,
+                                                      numSamples);
 #endif
-            }
         }
     }
+
+    data.lastBlockCost = cost;
 }
 
 //==============================================================================
@@ -305,16 +433,17 @@ juce::Array<Triplet> MbapSpatAlgorithm::getTriplets() const noexcept
 }
 
 //==============================================================================
-std::unique_ptr<AbstractSpatAlgorithm> MbapSpatAlgorithm::make(SpeakerSetup const & speakerSetup,
-                                                               std::vector<source_index_t> && theSourceIds)
+std::unique_ptr<AbstractSpatAlgorithm> MbapSpatAlgorithm::make(SpeakerSetup const & speakerSetup)
 {
-    JUCE_ASSERT_MESSAGE_THREAD;
+    SG_ASSERT_BUILDER_THREAD;
 
     if (speakerSetup.numOfSpatializedSpeakers() < 2) {
         return std::make_unique<DummySpatAlgorithm>(Error::notEnoughCubeSpeakers);
     }
 
-    return std::make_unique<MbapSpatAlgorithm>(speakerSetup, std::move(theSourceIds));
+    auto mbap{ std::make_unique<MbapSpatAlgorithm>(speakerSetup) };
+    mbap->selectRenderPath(speakerSetup.numOfSpatializedSpeakers());
+    return mbap;
 }
 
 } // namespace gris
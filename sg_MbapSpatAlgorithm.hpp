@@ -19,13 +19,14 @@
 
 #pragma once
 
-#include "Containers/sg_AtomicUpdater.hpp"
+#include "Containers/sg_LatestWinsUpdater.hpp"
 #include "Containers/sg_StrongArray.hpp"
 #include "Containers/sg_TaggedAudioBuffer.hpp"
 #include "Data/StrongTypes/sg_SourceIndex.hpp"
 #include "Data/sg_AudioStructs.hpp"
 #include "Data/sg_LogicStrucs.hpp"
 #include "Data/sg_Macros.hpp"
+#include "Data/sg_SourceGains.hpp"
 #include "Data/sg_Triplet.hpp"
 #include "Data/sg_constants.hpp"
 #include "Implementations/sg_mbap.hpp"
@@ -33,37 +34,55 @@
 #include "juce_audio_basics/juce_audio_basics.h"
 #include "juce_core/juce_core.h"
 #include "tl/optional.hpp"
+#include <array>
 #include <memory>
 
 namespace gris
 {
 struct MbapSpatData {
-    SpeakersSpatGains gains{};
+    /** A row of the algorithm's SourcesGainsSlab. */
+    SpeakerGainsRow gains{};
     float mbapSourceDistance{};
 };
 
-using MbapSpatDataQueue = AtomicUpdater<MbapSpatData>;
+using MbapSpatDataQueue = LatestWinsUpdater<MbapSpatData>;
 
 struct MbapSourceData {
     MbapSpatDataQueue dataQueue{};
     MbapSpatDataQueue::Token * currentData{};
     MbapSourceAttenuationState attenuationState{};
-    SpeakersSpatGains lastGains{};
+    SpeakerGainsRow lastGains{};
+    /** What rendering this source cost during the last block, in ActiveSources units. */
+    float lastBlockCost{};
+};
+
+/** Receives the attenuated samples of a source, so that the source buffer can stay read-only. */
+struct alignas(CACHE_LINE_SIZE) MbapAttenuationScratch {
+    std::array<float, SourceAudioBuffer::MAX_NUM_SAMPLES> samples{};
 };
 
 //==============================================================================
 class MbapSpatAlgorithm final : public AbstractSpatAlgorithm
 {
     MbapField mField{};
+    SourcesGainsSlab mGains{};
     StrongArray<source_index_t, MbapSourceData, MAX_NUM_SOURCES> mData{};
+    ActiveSources mActiveSources{};
+#if SG_USE_FORK_UNION
+    /** One per worker thread. */
+    std::vector<MbapAttenuationScratch> mAttenuationScratches{};
+#else
+    MbapAttenuationScratch mAttenuationScratch{};
+#endif
 
 public:
     //==============================================================================
     MbapSpatAlgorithm() = delete;
-    ~MbapSpatAlgorithm() override = default;
+    /** The field is handed to the Reclaimer. */
+    ~MbapSpatAlgorithm() override;
     SG_DELETE_COPY_AND_MOVE(MbapSpatAlgorithm)
     //==============================================================================
-    explicit MbapSpatAlgorithm(SpeakerSetup const & speakerSetup, std::vector<source_index_t> && sourceIds);
+    explicit MbapSpatAlgorithm(SpeakerSetup const & speakerSetup);
     //==============================================================================
     void updateSpatData(source_index_t sourceIndex, SourceData const & sourceData) noexcept override;
     void process(AudioConfig const & config,
@@ -78,16 +97,22 @@ public:
     [[nodiscard]] juce::Array<Triplet> getTriplets() const noexcept override;
     [[nodiscard]] bool hasTriplets() const noexcept override { return false; }
     [[nodiscard]] tl::optional<Error> getError() const noexcept override { return tl::nullopt; }
+    void snapToTargetGains() noexcept override;
+    void listHotMemory(HotMemory & hotMemory) const override;
+    [[nodiscard]] MemoryReport getMemoryReport() const override;
     //==============================================================================
-    static std::unique_ptr<AbstractSpatAlgorithm> make(SpeakerSetup const & speakerSetup,
-                                                       std::vector<source_index_t> && sourceIds);
+    static std::unique_ptr<AbstractSpatAlgorithm> make(SpeakerSetup const & speakerSetup);
+    /** @return the distance that drives the distance attenuation of a source at this position. */
+    [[nodiscard]] static float getSourceDistance(Position const & position) noexcept;
 
 private:
+    /** Fills mActiveSources with the sources that have something to render and fetches their spat data. */
+    void collectActiveSources(AudioConfig const & config, SourcePeaks const & sourcePeaks) noexcept;
     void processSource(const gris::AudioConfig & config,
                        const gris::source_index_t & sourceId,
-                       const gris::SourcePeaks & sourcePeaks,
-                       gris::SourceAudioBuffer & sourcesBuffer,
-                       const gris::SpeakersAudioConfig & speakersAudioConfig,
+                       gris::SourceAudioBuffer const & sourcesBuffer,
+                       SpeakerRenderPlan const & renderPlan,
+                       MbapAttenuationScratch & attenuationScratch,
 #if SG_USE_FORK_UNION
     #if SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS
                        ForkUnionBuffer & forkUnionBuffer,
@@ -97,10 +122,6 @@ private:
 #endif
                        gris::SpeakerAudioBuffer & speakerBuffers);
 
-#if SG_USE_FORK_UNION
-    std::vector<source_index_t> sourceIds;
-#endif
-
     JUCE_LEAK_DETECTOR(MbapSpatAlgorithm)
 };
 } // namespace gris
@@ -0,0 +1,71 @@
+/*
+ This file is part of SpatGRIS.
+
+ Developers: Gaël Lane Lépine, Samuel Béland, Olivier Bélanger, Nicolas Masson
+
+ SpatGRIS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ SpatGRIS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with SpatGRIS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sg_ParallelismGovernor.hpp"
+#include <algorithm>
+
+namespace gris
+{
+//==============================================================================
+ParallelismGovernor::ParallelismGovernor(std::size_t const maxNumWorkers) noexcept
+    : mMaxNumWorkers(std::max(maxNumWorkers, std::size_t{ 1 }))
+{
+}
+
+//==============================================================================
+std::size_t ParallelismGovernor::update(double const work) noexcept
+{
+    auto const wasParallel{ mIsParallel };
+    if (mIsParallel) {
+        mIsParallel = work >= LEAVE_PARALLEL_WORK;
+    } else {
+        mIsParallel = work > ENTER_PARALLEL_WORK && mMaxNumWorkers > 1;
+    }
+
+    std::size_t numWorkers{};
+    if (mIsParallel) {
+        auto const wantedNumWorkers{ static_cast<std::size_t>(work / WORK_PER_WORKER) };
+        numWorkers = std::clamp(wantedNumWorkers, std::size_t{ 2 }, mMaxNumWorkers);
+        mNumParallelBlocks.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        mNumSerialBlocks.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (mIsParallel != wasParallel) {
+        mNumSwitches.fetch_add(1, std::memory_order_relaxed);
+    }
+    mLastNumWorkers.store(numWorkers, std::memory_order_relaxed);
+    mLastWork.store(work, std::memory_order_relaxed);
+
+    return numWorkers;
+}
+
+//==============================================================================
+ParallelismGovernor::Stats ParallelismGovernor::getStats() const noexcept
+{
+    Stats result{};
+    result.numSerialBlocks = mNumSerialBlocks.load(std::memory_order_relaxed);
+    result.numParallelBlocks = mNumParallelBlocks.load(std::memory_order_relaxed);
+    result.numSwitches = mNumSwitches.load(std::memory_order_relaxed);
+    result.lastNumWorkers = mLastNumWorkers.load(std::memory_order_relaxed);
+    result.lastWork = mLastWork.load(std::memory_order_relaxed);
+    return result;
+}
+
+} // namespace gris
@@ -0,0 +1,96 @@
+/*
+ This file is part of SpatGRIS.
+
+ Developers: Gaël Lane Lépine, Samuel Béland, Olivier Bélanger, Nicolas Masson
+
+ SpatGRIS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ SpatGRIS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with SpatGRIS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "Data/sg_Macros.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace gris
+{
+//==============================================================================
+/** Decides, block by block, how many workers should take part in rendering the sources.
+ *
+ * Waking a thread pool has a fixed cost that small scenes and small buffers never recoup, so light blocks run on the
+ * audio thread alone. The work of a block is estimated as the cost of its active sources (see ActiveSources) times its
+ * number of samples. A hysteresis keeps scenes that hover around the threshold from switching at every block.
+ *
+ * The decisions are counted in atomics so that they can be read from any thread.
+ */
+class ParallelismGovernor
+{
+public:
+    /* The unit of work is one sample mixed into one speaker with a static gain, about 0.25 ns once vectorized. Waking
+     * a worker and joining it costs a few microseconds, so a worker has to be handed ~16k units (~4 us) to pay for
+     * itself. These are estimates, not measurements : retune them with the benchmarks of test_spatAlgorithms. */
+    /** How much work justifies waking one more worker. */
+    static constexpr double WORK_PER_WORKER = 16384.0;
+    /** Above this amount of work, a serial block switches to parallel : enough for the 2 workers of the smallest
+     * parallel block. 32 static sources on 1 speaker, or 8 ramping ones, over a 1024 samples buffer. */
+    static constexpr double ENTER_PARALLEL_WORK = 2.0 * WORK_PER_WORKER;
+    /** Below this amount of work, a parallel block switches back to serial. Half of the enter threshold, so that a
+     * scene has to lose half of its work before it flips back. */
+    static constexpr double LEAVE_PARALLEL_WORK = ENTER_PARALLEL_WORK / 2.0;
+    //==============================================================================
+    /** A snapshot of the decisions taken so far. */
+    struct Stats {
+        std::uint64_t numSerialBlocks{};
+        std::uint64_t numParallelBlocks{};
+        std::uint64_t numSwitches{};
+        std::size_t lastNumWorkers{};
+        double lastWork{};
+    };
+
+private:
+    //==============================================================================
+    std::size_t mMaxNumWorkers{};
+    bool mIsParallel{};
+    std::atomic<std::uint64_t> mNumSerialBlocks{};
+    std::atomic<std::uint64_t> mNumParallelBlocks{};
+    std::atomic<std::uint64_t> mNumSwitches{};
+    std::atomic<std::size_t> mLastNumWorkers{};
+    std::atomic<double> mLastWork{};
+
+public:
+    //==============================================================================
+    explicit ParallelismGovernor(std::size_t maxNumWorkers) noexcept;
+    ~ParallelismGovernor() = default;
+    SG_DELETE_COPY_AND_MOVE(ParallelismGovernor)
+    //==============================================================================
+    /** Takes the decision for a block. Only call from the audio thread.
+     *
+     * @param work the estimated work of the block.
+     * @return the number of workers that should take part. 0 means that the block should run on the calling thread
+     * without involving the pool at all.
+     */
+    [[nodiscard]] std::size_t update(double work) noexcept;
+    /** Can be called from any thread. */
+    [[nodiscard]] Stats getStats() const noexcept;
+    /** @return the most workers update() can return. */
+    [[nodiscard]] std::size_t getMaxNumWorkers() const noexcept { return mMaxNumWorkers; }
+
+private:
+    //==============================================================================
+    JUCE_LEAK_DETECTOR(ParallelismGovernor)
+};
+
+} // namespace gris
@@ -0,0 +1,156 @@
+/*
+ This file is part of SpatGRIS.
+
+ Developers: Gaël Lane Lépine, Samuel Béland, Olivier Bélanger, Nicolas Masson
+
+ SpatGRIS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ SpatGRIS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with SpatGRIS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sg_Reclaimer.hpp"
+#include <algorithm>
+#include <utility>
+
+namespace gris
+{
+namespace
+{
+//==============================================================================
+auto constexpr RECLAIMER_THREAD_NAME = "AlgoGRIS reclaimer";
+} // namespace
+
+JUCE_IMPLEMENT_SINGLETON(Reclaimer)
+
+//==============================================================================
+Reclaimer::Reclaimer() : juce::Thread(RECLAIMER_THREAD_NAME)
+{
+    mIdleEvent.signal();
+    startThread(juce::Thread::Priority::low);
+}
+
+//==============================================================================
+Reclaimer::~Reclaimer()
+{
+    {
+        // From now on, enqueue() destroys the retirees itself.
+        juce::ScopedLock const lock{ mLock };
+        sHasShutDown.store(true);
+    }
+
+    // The thread drains the queue before it exits.
+    signalThreadShouldExit();
+    notify();
+    stopThread(-1);
+    clearSingletonInstance();
+}
+
+//==============================================================================
+void Reclaimer::start()
+{
+    JUCE_ASSERT_MESSAGE_THREAD;
+    jassert(!sHasShutDown.load());
+    getInstance();
+}
+
+//==============================================================================
+void Reclaimer::flush()
+{
+    jassert(!isReclaimerThread());
+    while (mNumPending.load() > 0) {
+        mIdleEvent.wait(10);
+    }
+}
+
+//==============================================================================
+Reclaimer::Stats Reclaimer::getStats() const noexcept
+{
+    return Stats{ mNumReclaimed.load(), mTotalMs.load(), mMaxMs.load() };
+}
+
+//==============================================================================
+bool Reclaimer::isReclaimerThread() noexcept
+{
+    auto * currentThread{ juce::Thread::getCurrentThread() };
+    if (!currentThread) {
+        return false;
+    }
+    return currentThread->getThreadName() == RECLAIMER_THREAD_NAME;
+}
+
+//==============================================================================
+void Reclaimer::enqueue(std::unique_ptr<Retiree> retiree, char const * const description)
+{
+    {
+        juce::ScopedLock const lock{ mLock };
+        if (!sHasShutDown.load()) {
+            mQueue.push_back(Entry{ std::move(retiree), description });
+            mNumPending.fetch_add(1);
+            mIdleEvent.reset();
+        }
+    }
+
+    if (retiree) {
+        // The thread is stopping and might never see it : the object is destroyed right here.
+        retiree.reset();
+        return;
+    }
+    notify();
+}
+
+//==============================================================================
+void Reclaimer::reclaim(Entry & entry)
+{
+    auto const startTicks{ juce::Time::getHighResolutionTicks() };
+    entry.retiree.reset();
+    auto const ms{ juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks)
+                   * 1000.0 };
+
+    mNumReclaimed.fetch_add(1);
+    mTotalMs.store(mTotalMs.load() + ms);
+    mMaxMs.store(std::max(mMaxMs.load(), ms));
+
+    DBG("Reclaimed " << entry.description << " in " << juce::String(ms, 2) << " ms");
+}
+
+//==============================================================================
+void Reclaimer::run()
+{
+    std::vector<Entry> entries{};
+    while (true) {
+        {
+            juce::ScopedLock const lock{ mLock };
+            std::swap(entries, mQueue);
+        }
+
+        if (entries.empty()) {
+            if (threadShouldExit()) {
+                return;
+            }
+            wait(-1);
+            continue;
+        }
+
+        for (auto & entry : entries) {
+            reclaim(entry);
+        }
+        auto const numReclaimed{ entries.size() };
+        entries.clear();
+
+        juce::ScopedLock const lock{ mLock };
+        if (mNumPending.fetch_sub(numReclaimed) == numReclaimed) {
+            mIdleEvent.signal();
+        }
+    }
+}
+
+} // namespace gris
@@ -0,0 +1,136 @@
+/*
+ This file is part of SpatGRIS.
+
+ Developers: Gaël Lane Lépine, Samuel Béland, Olivier Bélanger, Nicolas Masson
+
+ SpatGRIS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ SpatGRIS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with SpatGRIS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "Data/sg_Macros.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace gris
+{
+//==============================================================================
+/** Destroys retired objects on a low-priority thread.
+ *
+ * Tearing down a spatialization algorithm can take a while : an MBAP field over 256 speakers holds hundreds of
+ * megabytes of amplitude matrices, and every source owns a few AtomicUpdater tokens. Handing the object to the
+ * reclaimer keeps that work off the audio and message threads. Every teardown is timed and counted in getStats().
+ *
+ * The reclaimer has to be created with start() before anything gets retired. Objects that get retired while the
+ * reclaimer is already destroying something (e.g. the members of a retired algorithm) are destroyed right away. Once
+ * the shutdown has begun, objects are destroyed by the thread that retires them.
+ */
+class Reclaimer final
+    : private juce::Thread
+    , private juce::DeletedAtShutdown
+{
+public:
+    //==============================================================================
+    /** What was reclaimed so far. */
+    struct Stats {
+        std::uint64_t numReclaimed{};
+        double totalMs{};
+        double maxMs{};
+    };
+
+private:
+    //==============================================================================
+    struct Retiree {
+        Retiree() = default;
+        virtual ~Retiree() = default;
+        SG_DELETE_COPY_AND_MOVE(Retiree)
+    };
+    template<typename T>
+    struct OwnedRetiree final : Retiree {
+        std::unique_ptr<T> object;
+        explicit OwnedRetiree(std::unique_ptr<T> theObject) : object(std::move(theObject)) {}
+    };
+    struct Entry {
+        std::unique_ptr<Retiree> retiree{};
+        /** Has to be a string literal. */
+        char const * description{};
+    };
+    //==============================================================================
+    juce::CriticalSection mLock{};
+    std::vector<Entry> mQueue{};
+    std::atomic<std::size_t> mNumPending{};
+    juce::WaitableEvent mIdleEvent{ true };
+    std::atomic<std::uint64_t> mNumReclaimed{};
+    std::atomic<double> mTotalMs{};
+    std::atomic<double> mMaxMs{};
+    /** Set under mLock when the destructor starts : nothing gets queued afterwards. */
+    static inline std::atomic<bool> sHasShutDown{};
+
+public:
+    //==============================================================================
+    Reclaimer();
+    /** Reclaims whatever is still queued before returning. */
+    ~Reclaimer() override;
+    SG_DELETE_COPY_AND_MOVE(Reclaimer)
+    //==============================================================================
+    /** Creates the reclaimer. Call once at startup, from the message thread. */
+    static void start();
+    /** Hands an object over to the reclaimer. Should not be called from the audio thread.
+     *
+     * @param object the object to destroy. Can be nullptr.
+     * @param description what the object is, for debug builds' log. Has to be a string literal.
+     */
+    template<typename T>
+    static void retire(std::unique_ptr<T> object, char const * description);
+    /** Blocks until everything retired so far has been destroyed. */
+    void flush();
+    [[nodiscard]] Stats getStats() const noexcept;
+    /** @return true if executed from the reclaimer's thread, i.e. while something is being reclaimed. */
+    [[nodiscard]] static bool isReclaimerThread() noexcept;
+    //==============================================================================
+    JUCE_DECLARE_SINGLETON(Reclaimer, true)
+
+private:
+    //==============================================================================
+    void enqueue(std::unique_ptr<Retiree> retiree, char const * description);
+    void reclaim(Entry & entry);
+    void run() override;
+    //==============================================================================
+    JUCE_LEAK_DETECTOR(Reclaimer)
+};
+
+//==============================================================================
+template<typename T>
+void Reclaimer::retire(std::unique_ptr<T> object, char const * description)
+{
+    if (!object || isReclaimerThread()) {
+        // Part of something that is already being reclaimed : its teardown is timed with its owner's.
+        return;
+    }
+
+    auto * reclaimer{ getInstanceWithoutCreating() };
+    if (reclaimer == nullptr) {
+        // start() was not called, or the reclaimer was already deleted : the object is destroyed right here.
+        jassert(sHasShutDown.load());
+        return;
+    }
+
+    reclaimer->enqueue(std::make_unique<OwnedRetiree<T>>(std::move(object)), description);
+}
+
+} // namespace gris
@@ -0,0 +1,274 @@
+/*
+ This file is part of SpatGRIS.
+
+ Developers: Gaël Lane Lépine, Samuel Béland, Olivier Bélanger, Nicolas Masson
+
+ SpatGRIS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ SpatGRIS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with SpatGRIS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sg_SpeakerHighpassBank.hpp"
+#include "Data/StrongTypes/sg_OutputPatch.hpp"
+#include "Data/sg_Narrow.hpp"
+#include "sg_Kernels.hpp"
+#include <cmath>
+#include <algorithm>
+
+namespace gris
+{
+//==============================================================================
+void SpeakerHighpassBank::Group::deactivate(std::size_t const lane) noexcept
+{
+    // An inactive lane is a pass-through : y = x.
+    isActive[lane] = false;
+    b1[lane] = 0.0;
+    b2[lane] = 0.0;
+    b3[lane] = 0.0;
+    b4[lane] = 0.0;
+    ha0[lane] = 1.0;
+    ha1[lane] = 0.0;
+    ha2[lane] = 0.0;
+    ha4[lane] = 0.0;
+    resetState(lane);
+}
+
+//==============================================================================
+void SpeakerHighpassBank::Group::resetState(std::size_t const lane) noexcept
+{
+    x1[lane] = 0.0;
+    x2[lane] = 0.0;
+    x3[lane] = 0.0;
+    x4[lane] = 0.0;
+    y1[lane] = 0.0;
+    y2[lane] = 0.0;
+    y3[lane] = 0.0;
+    y4[lane] = 0.0;
+}
+
+//==============================================================================
+SpeakerHighpassBank::SpeakerHighpassBank() noexcept
+{
+    reset();
+}
+
+//==============================================================================
+void SpeakerHighpassBank::setConfig(SpeakersAudioConfig const & speakersAudioConfig) noexcept
+{
+    std::array<std::array<bool, NUM_LANES>, NUM_GROUPS> wasActive{};
+    for (std::size_t groupIndex{}; groupIndex < NUM_GROUPS; ++groupIndex) {
+        wasActive[groupIndex] = mGroups[groupIndex].isActive;
+        mGroups[groupIndex].isActive.fill(false);
+    }
+
+    for (auto const & speaker : speakersAudioConfig) {
+        auto const & highpassConfig{ speaker.value.highpassConfig };
+        if (!highpassConfig) {
+            continue;
+        }
+
+        auto const index{ speaker.key.removeOffset<std::size_t>() };
+        auto const groupIndex{ index / NUM_LANES };
+        auto const lane{ index % NUM_LANES };
+        auto & group{ mGroups[groupIndex] };
+
+        group.b1[lane] = highpassConfig->b1;
+        group.b2[lane] = highpassConfig->b2;
+        group.b3[lane] = highpassConfig->b3;
+        group.b4[lane] = highpassConfig->b4;
+        group.ha0[lane] = highpassConfig->ha0;
+        group.ha1[lane] = highpassConfig->ha1;
+        group.ha2[lane] = highpassConfig->ha2;
+        group.ha4[lane] = highpassConfig->ha0;
+
+        if (highpassConfig->isNewConfig || !wasActive[groupIndex][lane]) {
+            group.resetState(lane);
+            highpassConfig->isNewConfig = false;
+        }
+        group.isActive[lane] = true;
+    }
+
+    mActiveGroups.clear();
+    for (std::size_t groupIndex{}; groupIndex < NUM_GROUPS; ++groupIndex) {
+        auto & group{ mGroups[groupIndex] };
+        auto isGroupActive{ false };
+        for (std::size_t lane{}; lane < NUM_LANES; ++lane) {
+            if (group.isActive[lane]) {
+                isGroupActive = true;
+            } else if (wasActive[groupIndex][lane]) {
+                group.deactivate(lane);
+            }
+        }
+        if (isGroupActive) {
+            mActiveGroups.push_back(groupIndex);
+        }
+    }
+}
+
+//==============================================================================
+void SpeakerHighpassBank::process(SpeakerAudioBuffer & speakersBuffer) noexcept
+{
+    juce::ScopedNoDenormals const noDenormals{};
+
+    auto const numSamples{ speakersBuffer.getNumSamples() };
+    jassert(numSamples <= narrow<int>(mSilentChannel.size()));
+
+    for (auto const groupIndex : mActiveGroups) {
+        auto & group{ mGroups[groupIndex] };
+
+        std::array<float const *, NUM_LANES> inputs{};
+        std::array<float *, NUM_LANES> outputs{};
+        for (std::size_t lane{}; lane < NUM_LANES; ++lane) {
+            output_patch_t const outputPatch{ narrow<int>(groupIndex * NUM_LANES + lane) + output_patch_t::OFFSET };
+            if (group.isActive[lane] && speakersBuffer.contains(outputPatch)) {
+                outputs[lane] = speakersBuffer[outputPatch].getWritePointer(0);
+                inputs[lane] = outputs[lane];
+            } else {
+                jassert(!group.isActive[lane]);
+                inputs[lane] = mSilentChannel.data();
+            }
+        }
+
+        static constexpr std::array<float, NUM_LANES> UNITY_GAINS{ 1.0f, 1.0f, 1.0f, 1.0f };
+        std::array<float, NUM_LANES> unusedPeaks{};
+        processGroup(group, inputs, outputs, UNITY_GAINS, unusedPeaks, numSamples);
+    }
+}
+
+//==============================================================================
+void SpeakerHighpassBank::reset() noexcept
+{
+    for (auto & group : mGroups) {
+        for (std::size_t lane{}; lane < NUM_LANES; ++lane) {
+            group.deactivate(lane);
+        }
+    }
+    mActiveGroups.clear();
+}
+
+namespace
+{
+//==============================================================================
+// Written once and inlined into every kernel variant, which the compiler then vectorizes for its own instruction set.
+// The template parameters are only there to reach the private types of SpeakerHighpassBank.
+template<typename Group, std::size_t NUM_LANES>
+forcedinline void processGroupBody(Group & group,
+                                   std::array<float const *, NUM_LANES> const & inputs,
+                                   std::array<float *, NUM_LANES> const & outputs,
+                                   std::array<float, NUM_LANES> const & gains,
+                                   std::array<float, NUM_LANES> & peaks,
+                                   int const numSamples) noexcept
+{
+    // Work on local copies of the state so that it stays in registers for the whole block.
+    auto x1{ group.x1 };
+    auto x2{ group.x2 };
+    auto x3{ group.x3 };
+    auto x4{ group.x4 };
+    auto y1{ group.y1 };
+    auto y2{ group.y2 };
+    auto y3{ group.y3 };
+    auto y4{ group.y4 };
+
+    for (int sampleIndex{}; sampleIndex < numSamples; ++sampleIndex) {
+        decltype(x1) x0{};
+        for (std::size_t lane{}; lane < NUM_LANES; ++lane) {
+            x0[lane] = static_cast<double>(inputs[lane][sampleIndex]);
+        }
+
+        decltype(y1) y0{};
+        for (std::size_t lane{}; lane < NUM_LANES; ++lane) {
+            y0[lane] = group.ha0[lane] * x0[lane] + group.ha1[lane] * x1[lane] + group.ha2[lane] * x2[lane]
+                       + group.ha1[lane] * x3[lane] + group.ha4[lane] * x4[lane] - group.b1[lane] * y1[lane]
+                       - group.b2[lane] * y2[lane] - group.b3[lane] * y3[lane] - group.b4[lane] * y4[lane];
+        }
+
+        x4 = x3;
+        x3 = x2;
+        x2 = x1;
+        x1 = x0;
+        y4 = y3;
+        y3 = y2;
+        y2 = y1;
+        y1 = y0;
+
+        for (std::size_t lane{}; lane < NUM_LANES; ++lane) {
+            auto const sample{ static_cast<float>(y0[lane]) * gains[lane] };
+            peaks[lane] = std::max(peaks[lane], std::abs(sample));
+            if (outputs[lane] != nullptr) {
+                outputs[lane][sampleIndex] = sample;
+            }
+        }
+    }
+
+    group.x1 = x1;
+    group.x2 = x2;
+    group.x3 = x3;
+    group.x4 = x4;
+    group.y1 = y1;
+    group.y2 = y2;
+    group.y3 = y3;
+    group.y4 = y4;
+
+    // Checked once per block instead of once per sample.
+    jassert(std::all_of(y1.cbegin(), y1.cend(), [](double const value) { return std::isfinite(value); }));
+}
+
+//==============================================================================
+#define SG_DEFINE_PROCESS_GROUP_KERNEL(suffix, target)                                                                 \
+    template<typename Group, std::size_t NUM_LANES>                                                                    \
+    target void processGroup##suffix(Group & group,                                                                    \
+                                     std::array<float const *, NUM_LANES> const & inputs,                              \
+                                     std::array<float *, NUM_LANES> const & outputs,                                  \
+                                     std::array<float, NUM_LANES> const & gains,                                       \
+                                     std::array<float, NUM_LANES> & peaks,                                             \
+                                     int const numSamples) noexcept                                                    \
+    {                                                                                                                  \
+        processGroupBody(group, inputs, outputs, gains, peaks, numSamples);                                            \
+    }
+
+SG_DEFINE_PROCESS_GROUP_KERNEL(Generic, )
+#if SG_KERNELS_MULTIVERSIONING
+SG_DEFINE_PROCESS_GROUP_KERNEL(Sse41, SG_KERNEL_TARGET_SSE41)
+SG_DEFINE_PROCESS_GROUP_KERNEL(Avx2, SG_KERNEL_TARGET_AVX2)
+SG_DEFINE_PROCESS_GROUP_KERNEL(Avx512, SG_KERNEL_TARGET_AVX512)
+#endif
+
+#undef SG_DEFINE_PROCESS_GROUP_KERNEL
+
+} // namespace
+
+//==============================================================================
+void SpeakerHighpassBank::processGroup(Group & group,
+                                       std::array<float const *, NUM_LANES> const & inputs,
+                                       std::array<float *, NUM_LANES> const & outputs,
+                                       std::array<float, NUM_LANES> const & gains,
+                                       std::array<float, NUM_LANES> & peaks,
+                                       int const numSamples) noexcept
+{
+    using kernel_t = void (*)(Group &,
+                              std::array<float const *, NUM_LANES> const &,
+                              std::array<float *, NUM_LANES> const &,
+                              std::array<float, NUM_LANES> const &,
+                              std::array<float, NUM_LANES> &,
+                              int) noexcept;
+#if SG_KERNELS_MULTIVERSIONING
+    static constexpr KernelVariants<kernel_t> KERNELS{ { processGroupGeneric<Group, NUM_LANES>,
+                                                         processGroupSse41<Group, NUM_LANES>,
+                                                         processGroupAvx2<Group, NUM_LANES>,
+                                                         processGroupAvx512<Group, NUM_LANES> } };
+#else
+    static constexpr KernelVariants<kernel_t> KERNELS{ { processGroupGeneric<Group, NUM_LANES> } };
+#endif
+    KERNELS.select()(group, inputs, outputs, gains, peaks, numSamples);
+}
+
+} // namespace gris
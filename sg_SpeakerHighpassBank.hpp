@@ -0,0 +1,113 @@
+/*
+ This file is part of SpatGRIS.
+
+ Developers: Gaël Lane Lépine, Samuel Béland, Olivier Bélanger, Nicolas Masson
+
+ SpatGRIS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ SpatGRIS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with SpatGRIS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Containers/sg_StaticVector.hpp"
+#include "Containers/sg_TaggedAudioBuffer.hpp"
+#include "Data/sg_AudioStructs.hpp"
+#include "Data/sg_Macros.hpp"
+#include "Data/sg_constants.hpp"
+#include <array>
+#include <cstddef>
+
+namespace gris
+{
+//==============================================================================
+/** Runs the 4th order speaker high-pass filters of a whole speaker setup.
+ *
+ * The speakers are packed by output patch in groups of NUM_LANES. Every group keeps its coefficients and its state in a
+ * structure-of-arrays layout, so that the filters of NUM_LANES speakers run side by side and can be vectorized by the
+ * compiler. Groups that have no speaker with a high-pass are skipped.
+ *
+ * Denormals are flushed to zero for the duration of process() instead of being avoided with a random dither.
+ */
+class SpeakerHighpassBank
+{
+    friend class SpeakerOutputStage;
+
+public:
+    static constexpr std::size_t NUM_LANES = 4;
+    static constexpr std::size_t NUM_GROUPS = (MAX_NUM_SPEAKERS + NUM_LANES - 1) / NUM_LANES;
+
+private:
+    using Lanes = std::array<double, NUM_LANES>;
+    //==============================================================================
+    struct alignas(CACHE_LINE_SIZE) Group {
+        Lanes b1{};
+        Lanes b2{};
+        Lanes b3{};
+        Lanes b4{};
+        Lanes ha0{};
+        Lanes ha1{};
+        Lanes ha2{};
+        /** The weight of x4 : ha0 for a high-pass, 0 for a pass-through, whose ha0 is 1. */
+        Lanes ha4{};
+        Lanes x1{};
+        Lanes x2{};
+        Lanes x3{};
+        Lanes x4{};
+        Lanes y1{};
+        Lanes y2{};
+        Lanes y3{};
+        Lanes y4{};
+        std::array<bool, NUM_LANES> isActive{};
+        //==============================================================================
+        void deactivate(std::size_t lane) noexcept;
+        void resetState(std::size_t lane) noexcept;
+    };
+    //==============================================================================
+    std::array<Group, NUM_GROUPS> mGroups{};
+    StaticVector<std::size_t, NUM_GROUPS> mActiveGroups{};
+    /** Where the lanes that don't belong to an active speaker read from. Never written to. */
+    std::array<float, SpeakerAudioBuffer::MAX_NUM_SAMPLES> mSilentChannel{};
+
+public:
+    //==============================================================================
+    SpeakerHighpassBank() noexcept;
+    ~SpeakerHighpassBank() = default;
+    SG_DELETE_COPY_AND_MOVE(SpeakerHighpassBank)
+    //==============================================================================
+    /** Loads the coefficients of a new speakers configuration. Does not allocate.
+     *
+     * The state of a speaker is kept unless its high-pass config is new or it just got a high-pass.
+     */
+    void setConfig(SpeakersAudioConfig const & speakersAudioConfig) noexcept;
+    /** Filters in place every speaker that has a high-pass. */
+    void process(SpeakerAudioBuffer & speakersBuffer) noexcept;
+    /** Clears the state of every filter. */
+    void reset() noexcept;
+
+private:
+    //==============================================================================
+    /** Filters the lanes of a group, applies their gains and accumulates their peaks.
+     *
+     * An output can be the same as its input. Lanes with a nullptr output are computed but not written.
+     */
+    static void processGroup(Group & group,
+                             std::array<float const *, NUM_LANES> const & inputs,
+                             std::array<float *, NUM_LANES> const & outputs,
+                             std::array<float, NUM_LANES> const & gains,
+                             std::array<float, NUM_LANES> & peaks,
+                             int numSamples) noexcept;
+    //==============================================================================
+    JUCE_LEAK_DETECTOR(SpeakerHighpassBank)
+};
+
+} // namespace gris
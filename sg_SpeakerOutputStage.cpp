@@ -0,0 +1,187 @@
+/*
+ This file is part of SpatGRIS.
+
+ Developers: Gaël Lane Lépine, Samuel Béland, Olivier Bélanger, Nicolas Masson
+
+ SpatGRIS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ SpatGRIS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with SpatGRIS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sg_SpeakerOutputStage.hpp"
+#include "Data/sg_Narrow.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace gris
+{
+namespace
+{
+//==============================================================================
+[[nodiscard]] float getSpeakerGain(SpeakerAudioConfig const & speakerAudioConfig, float const masterGain) noexcept
+{
+    return speakerAudioConfig.isMuted ? 0.0f : speakerAudioConfig.gain * masterGain;
+}
+
+} // namespace
+
+//==============================================================================
+void SpeakerOutputStage::setConfig(SpeakersAudioConfig const & speakersAudioConfig) noexcept
+{
+    mHighpassBank.setConfig(speakersAudioConfig);
+
+    mUnfilteredSpeakers.clear();
+    for (auto const & speaker : speakersAudioConfig) {
+        auto const index{ speaker.key.removeOffset<std::size_t>() };
+        auto const & isActive{ mHighpassBank.mGroups[index / SpeakerHighpassBank::NUM_LANES].isActive };
+        if (std::none_of(isActive.cbegin(), isActive.cend(), [](bool const value) { return value; })) {
+            mUnfilteredSpeakers.push_back(speaker.key);
+        }
+    }
+}
+
+//==============================================================================
+void SpeakerOutputStage::process(SpeakersAudioConfig const & speakersAudioConfig,
+                                 float const masterGain,
+                                 SpeakerAudioBuffer const & speakersBuffer,
+                                 float * const * outs,
+                                 int const numOutputs,
+                                 SpeakerPeaks & peaks) noexcept
+{
+    auto const numTasks{ getNumTasks() };
+    for (std::size_t taskIndex{}; taskIndex < numTasks; ++taskIndex) {
+        processTask(taskIndex, speakersAudioConfig, masterGain, speakersBuffer, outs, numOutputs, peaks);
+    }
+}
+
+#if SG_USE_FORK_UNION
+//==============================================================================
+void SpeakerOutputStage::process(SpeakersAudioConfig const & speakersAudioConfig,
+                                 float const masterGain,
+                                 SpeakerAudioBuffer const & speakersBuffer,
+                                 float * const * outs,
+                                 int const numOutputs,
+                                 SpeakerPeaks & peaks,
+                                 ashvardanian::fork_union::thread_pool_t & threadPool) noexcept
+{
+    namespace fu = ashvardanian::fork_union;
+    fu::for_n(threadPool, getNumTasks(), [&](fu::prong_t prong) noexcept {
+        processTask(prong.task_index, speakersAudioConfig, masterGain, speakersBuffer, outs, numOutputs, peaks);
+    });
+}
+#endif
+
+//==============================================================================
+void SpeakerOutputStage::reset() noexcept
+{
+    mHighpassBank.reset();
+    mUnfilteredSpeakers.clear();
+}
+
+//==============================================================================
+std::size_t SpeakerOutputStage::getNumTasks() const noexcept
+{
+    return mHighpassBank.mActiveGroups.size() + mUnfilteredSpeakers.size();
+}
+
+//==============================================================================
+void SpeakerOutputStage::processTask(std::size_t const taskIndex,
+                                     SpeakersAudioConfig const & speakersAudioConfig,
+                                     float const masterGain,
+                                     SpeakerAudioBuffer const & speakersBuffer,
+                                     float * const * outs,
+                                     int const numOutputs,
+                                     SpeakerPeaks & peaks) noexcept
+{
+    // Set here rather than in process() since the tasks might run on other threads.
+    juce::ScopedNoDenormals const noDenormals{};
+
+    static constexpr auto NUM_LANES{ SpeakerHighpassBank::NUM_LANES };
+
+    auto const numSamples{ speakersBuffer.getNumSamples() };
+    auto const & activeGroups{ mHighpassBank.mActiveGroups };
+
+    if (taskIndex < activeGroups.size()) {
+        auto const groupIndex{ activeGroups[taskIndex] };
+
+        std::array<float const *, NUM_LANES> inputs{};
+        std::array<float *, NUM_LANES> outputs{};
+        std::array<float, NUM_LANES> gains{};
+        std::array<float, NUM_LANES> groupPeaks{};
+        std::array<bool, NUM_LANES> isSpeaker{};
+        for (std::size_t lane{}; lane < NUM_LANES; ++lane) {
+            output_patch_t const outputPatch{ narrow<int>(groupIndex * NUM_LANES + lane) + output_patch_t::OFFSET };
+            isSpeaker[lane] = speakersAudioConfig.contains(outputPatch) && speakersBuffer.contains(outputPatch);
+            if (!isSpeaker[lane]) {
+                inputs[lane] = mHighpassBank.mSilentChannel.data();
+                continue;
+            }
+            inputs[lane] = speakersBuffer[outputPatch].getReadPointer(0);
+            gains[lane] = getSpeakerGain(speakersAudioConfig[outputPatch], masterGain);
+            auto const outIndex{ outputPatch.removeOffset<int>() };
+            if (outIndex < numOutputs) {
+                outputs[lane] = outs[outIndex];
+            }
+        }
+
+        SpeakerHighpassBank::processGroup(mHighpassBank.mGroups[groupIndex],
+                                          inputs,
+                                          outputs,
+                                          gains,
+                                          groupPeaks,
+                                          numSamples);
+
+        for (std::size_t lane{}; lane < NUM_LANES; ++lane) {
+            if (isSpeaker[lane]) {
+                output_patch_t const outputPatch{ narrow<int>(groupIndex * NUM_LANES + lane)
+                                                  + output_patch_t::OFFSET };
+                peaks[outputPatch] = groupPeaks[lane];
+            }
+        }
+        return;
+    }
+
+    auto const outputPatch{ mUnfilteredSpeakers[taskIndex - activeGroups.size()] };
+    if (!speakersBuffer.contains(outputPatch)) {
+        return;
+    }
+
+    auto const outIndex{ outputPatch.removeOffset<int>() };
+    auto * const output{ outIndex < numOutputs ? outs[outIndex] : nullptr };
+
+    if (!speakersBuffer.isDirty(outputPatch)) {
+        if (output != nullptr) {
+            juce::FloatVectorOperations::clear(output, numSamples);
+        }
+        peaks[outputPatch] = 0.0f;
+        return;
+    }
+
+    auto const * const input{ speakersBuffer[outputPatch].getReadPointer(0) };
+    auto const gain{ getSpeakerGain(speakersAudioConfig[outputPatch], masterGain) };
+
+    float peak{};
+    if (output != nullptr) {
+        for (int sampleIndex{}; sampleIndex < numSamples; ++sampleIndex) {
+            auto const sample{ input[sampleIndex] * gain };
+            peak = std::max(peak, std::abs(sample));
+            output[sampleIndex] = sample;
+        }
+    } else {
+        auto const range{ juce::FloatVectorOperations::findMinAndMax(input, numSamples) };
+        peak = std::max(std::abs(range.getStart()), std::abs(range.getEnd())) * std::abs(gain);
+    }
+    peaks[outputPatch] = peak;
+}
+
+} // namespace gris
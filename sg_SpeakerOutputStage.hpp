@@ -0,0 +1,104 @@
+/*
+ This file is part of SpatGRIS.
+
+ Developers: Gaël Lane Lépine, Samuel Béland, Olivier Bélanger, Nicolas Masson
+
+ SpatGRIS is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ SpatGRIS is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with SpatGRIS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Containers/sg_StaticVector.hpp"
+#include "Containers/sg_TaggedAudioBuffer.hpp"
+#include "Data/StrongTypes/sg_OutputPatch.hpp"
+#include "Data/sg_AudioStructs.hpp"
+#include "Data/sg_LogicStrucs.hpp"
+#include "Data/sg_Macros.hpp"
+#include "sg_SpeakerHighpassBank.hpp"
+#include <cstddef>
+
+#if SG_USE_FORK_UNION
+    #include <fork_union.hpp>
+#endif
+
+namespace gris
+{
+//==============================================================================
+/** The last stage of the speakers' processing.
+ *
+ * Applies the high-pass filters, the speakers' gains and the master gain, measures the speakers' peaks and writes the
+ * result to the physical outputs. Every speaker buffer is read exactly once and never written back : this replaces
+ * filtering the buffers in place, scaling them, metering them and then calling
+ * SpeakerAudioBuffer::copyToPhysicalOutput().
+ *
+ * The work is split in tasks that are independent from each other : one task per group of speakers that have a
+ * high-pass and one task per speaker without one.
+ */
+class SpeakerOutputStage
+{
+    SpeakerHighpassBank mHighpassBank{};
+    /** The speakers that are not part of an active high-pass group. */
+    StaticVector<output_patch_t, MAX_NUM_SPEAKERS> mUnfilteredSpeakers{};
+
+public:
+    //==============================================================================
+    SpeakerOutputStage() = default;
+    ~SpeakerOutputStage() = default;
+    SG_DELETE_COPY_AND_MOVE(SpeakerOutputStage)
+    //==============================================================================
+    /** Loads a new speakers configuration. Does not allocate. */
+    void setConfig(SpeakersAudioConfig const & speakersAudioConfig) noexcept;
+    /** Processes the speakers and writes them to the physical outputs.
+     *
+     * @param speakersAudioConfig the configuration last passed to setConfig().
+     * @param masterGain the gain applied to every speaker.
+     * @param speakersBuffer the speakers, as left by the spatialization algorithm. Not modified.
+     * @param outs the host's output channels, indexed by output patch minus one.
+     * @param numOutputs the number of channels in outs. Speakers patched past the last one are not written.
+     * @param peaks where to write the peak of every speaker, after the gains.
+     */
+    void process(SpeakersAudioConfig const & speakersAudioConfig,
+                 float masterGain,
+                 SpeakerAudioBuffer const & speakersBuffer,
+                 float * const * outs,
+                 int numOutputs,
+                 SpeakerPeaks & peaks) noexcept;
+#if SG_USE_FORK_UNION
+    /** Same as above, but runs the tasks on a thread pool. */
+    void process(SpeakersAudioConfig const & speakersAudioConfig,
+                 float masterGain,
+                 SpeakerAudioBuffer const & speakersBuffer,
+                 float * const * outs,
+                 int numOutputs,
+                 SpeakerPeaks & peaks,
+                 ashvardanian::fork_union::thread_pool_t & threadPool) noexcept;
+#endif
+    /** Clears the state of every filter. */
+    void reset() noexcept;
+
+private:
+    //==============================================================================
+    [[nodiscard]] std::size_t getNumTasks() const noexcept;
+    void processTask(std::size_t taskIndex,
+                     SpeakersAudioConfig const & speakersAudioConfig,
+                     float masterGain,
+                     SpeakerAudioBuffer const & speakersBuffer,
+                     float * const * outs,
+                     int numOutputs,
+                     SpeakerPeaks & peaks) noexcept;
+    //==============================================================================
+    JUCE_LEAK_DETECTOR(SpeakerOutputStage)
+};
+
+} // namespace gris
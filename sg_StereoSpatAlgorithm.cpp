@@ -29,6 +29,7 @@
 #include "Data/sg_Triplet.hpp"
 #include "sg_AbstractSpatAlgorithm.hpp"
 #include "sg_HybridSpatAlgorithm.hpp"
+#include "sg_Kernels.hpp"
 #include "sg_MbapSpatAlgorithm.hpp"
 #include "sg_VbapSpatAlgorithm.hpp"
 #include "juce_audio_basics/juce_audio_basics.h"
@@ -41,6 +42,7 @@
 #include <cassert>
 #include <cstddef>
 #include <memory>
+#include <thread>
 
 namespace gris
 {
@@ -60,7 +62,9 @@ void StereoSpatAlgorithm::updateSpatData(source_index_t const sourceIndex, Sourc
     auto & queue{ mData[sourceIndex].gainsUpdater };
     auto * ticket{ queue.acquire() };
     assert(ticket);
-    auto & gains{ ticket->get() };
+    auto & spatData{ ticket->get() };
+    auto & gains{ spatData.gains };
+    spatData.mbapSourceDistance.reset();
 
     if (sourceData.position) {
         auto const x{ std::clamp(sourceData.position->getCartesian().x, -1.0f, 1.0f)
@@ -73,6 +77,10 @@ void StereoSpatAlgorithm::updateSpatData(source_index_t const sourceIndex, Sourc
 
         gains[0] = std::pow(leftGain, 0.5f);
         gains[1] = std::pow(rightGain, 0.5f);
+
+        if (isRenderedWithMbap(sourceData)) {
+            spatData.mbapSourceDistance = MbapSpatAlgorithm::getSourceDistance(*sourceData.position);
+        }
     } else {
         gains[0] = 0.0f;
         gains[1] = 0.0f;
@@ -81,6 +89,21 @@ void StereoSpatAlgorithm::updateSpatData(source_index_t const sourceIndex, Sourc
     queue.setMostRecent(ticket);
 }
 
+//==============================================================================
+bool StereoSpatAlgorithm::isRenderedWithMbap(SourceData const & sourceData) const noexcept
+{
+    switch (mProjectSpatMode) {
+    case SpatMode::mbap:
+        return true;
+    case SpatMode::hybrid:
+        return sourceData.hybridSpatMode == SpatMode::mbap;
+    case SpatMode::vbap:
+    case SpatMode::invalid:
+        break;
+    }
+    return false;
+}
+
 //==============================================================================
 void StereoSpatAlgorithm::process(AudioConfig const & config,
                                   SourceAudioBuffer & sourcesBuffer,
@@ -96,22 +119,57 @@ void StereoSpatAlgorithm::process(AudioConfig const & config,
     jassert(!altSpeakerConfig);
     jassert(stereoBuffer.getNumChannels() == 2);
 
+    // The inner algorithm keeps receiving its spat data in updateSpatData(), so it can be skipped here and resumed at
+    // any time. Its last gains went stale while it was skipped : it resumes on its current targets instead of ramping
+    // from wherever it stopped.
+    if (config.isStereoInnerRenderSkipped) {
+        mIsInnerRenderSkipped = true;
+    } else {
+        if (mIsInnerRenderSkipped) {
+            mInnerAlgorithm->snapToTargetGains();
+            mIsInnerRenderSkipped = false;
+        }
 #if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
-    mInnerAlgorithm
-        ->process(config, sourcesBuffer, speakersBuffer, forkUnionBuffer, stereoBuffer, sourcePeaks, altSpeakerConfig);
+        mInnerAlgorithm->process(config,
+                                 sourcesBuffer,
+                                 speakersBuffer,
+                                 forkUnionBuffer,
+                                 stereoBuffer,
+                                 sourcePeaks,
+                                 altSpeakerConfig);
 #else
-    mInnerAlgorithm->process(config, sourcesBuffer, speakersBuffer, stereoBuffer, sourcePeaks, altSpeakerConfig);
+        mInnerAlgorithm->process(config, sourcesBuffer, speakersBuffer, stereoBuffer, sourcePeaks, altSpeakerConfig);
 #endif
+    }
+
+    collectActiveSources(config, sourcePeaks);
 
 #if SG_USE_FORK_UNION
-    jassert(sourceIds.size() > 0);
+    auto const numSamples{ sourcesBuffer.getNumSamples() };
+    for (std::size_t channel{}; channel < mWorkerBuffers.getNumChannels(); ++channel) {
+        std::fill_n(mWorkerBuffers.getChannel(channel), numSamples, 0.0f);
+    }
 
-    ashvardanian::fork_union::for_n(threadPool, sourceIds.size(), [&](std::size_t i) noexcept {
-        processSource(config, sourceIds[(int)i], sourcePeaks, sourcesBuffer, stereoBuffer);
-    });
+    // Every worker accumulates into its own buffer, so there is no need for atomics here. The governor decides how many
+    // workers take part. They pick the most expensive sources first and the cheap ones fill the gaps.
+    mActiveSources.sortByCost();
+    auto const processActiveSource = [&](std::size_t const taskIndex, std::size_t const threadIndex) noexcept {
+        processSource(config,
+                      mActiveSources[taskIndex],
+                      sourcesBuffer,
+                      mAttenuationScratches[threadIndex],
+                      { mWorkerBuffers.getChannel(threadIndex * 2), mWorkerBuffers.getChannel(threadIndex * 2 + 1) });
+    };
+    dispatchActiveSources(mActiveSources, numSamples, processActiveSource);
+
+    // Reduce the partial sums.
+    for (std::size_t channel{}; channel < mWorkerBuffers.getNumChannels(); ++channel) {
+        stereoBuffer.addFrom(narrow<int>(channel % 2), 0, mWorkerBuffers.getChannel(channel), numSamples);
+    }
 #else
-    for (auto const & source : config.sourcesAudioConfig)
-        processSource(config, source.key, sourcePeaks, sourcesBuffer, stereoBuffer);
+    std::array<float *, 2> const outputs{ stereoBuffer.getWritePointer(0), stereoBuffer.getWritePointer(1) };
+    for (auto const & activeSource : mActiveSources)
+        processSource(config, activeSource.sourceIndex, sourcesBuffer, mAttenuationScratch, outputs);
 #endif
 
     // Apply gain compensation.
@@ -120,38 +178,65 @@ void StereoSpatAlgorithm::process(AudioConfig const & config,
 }
 
 //==============================================================================
-inline void StereoSpatAlgorithm::processSource(const gris::AudioConfig & config,
-                                               const gris::source_index_t & sourceId,
-                                               const gris::SourcePeaks & sourcePeaks,
-                                               gris::SourceAudioBuffer & sourcesBuffer,
-                                               juce::AudioBuffer<float> & stereoBuffer)
+void StereoSpatAlgorithm::collectActiveSources(AudioConfig const & config, SourcePeaks const & sourcePeaks) noexcept
 {
-    auto const & source = config.sourcesAudioConfig[sourceId];
-    if (source.isMuted || source.directOut || sourcePeaks[sourceId] < SMALL_GAIN) {
-        return;
-    }
+    mActiveSources.clear();
+    for (auto const & source : config.sourcesAudioConfig) {
+        if (source.value.isMuted || source.value.directOut || sourcePeaks[source.key] < SMALL_GAIN) {
+            continue;
+        }
 
-    auto & data{ mData[sourceId] };
+        auto & data{ mData[source.key] };
+        auto const * const previousGains{ data.currentGains };
+        data.gainsUpdater.getMostRecent(data.currentGains);
+        if (data.currentGains == nullptr) {
+            continue;
+        }
 
-    data.gainsUpdater.getMostRecent(data.currentGains);
-    if (data.currentGains == nullptr) {
-        return;
+        // New gains mean that the audible speakers are going to ramp during this block.
+        auto const hasNewGains{ data.currentGains != previousGains };
+        auto const ratio{ hasNewGains ? ActiveSources::RAMPING_GAIN_COST / ActiveSources::STATIC_GAIN_COST : 1.0f };
+        mActiveSources.add(source.key, std::max(data.lastBlockCost, ActiveSources::STATIC_GAIN_COST) * ratio);
     }
+}
+
+//==============================================================================
+inline void StereoSpatAlgorithm::processSource(const gris::AudioConfig & config,
+                                               const gris::source_index_t & sourceId,
+                                               gris::SourceAudioBuffer const & sourcesBuffer,
+                                               MbapAttenuationScratch & attenuationScratch,
+                                               std::array<float *, 2> const & outputs)
+{
+    auto & data{ mData[sourceId] };
+    // collectActiveSources() already fetched the most recent gains.
+    jassert(data.currentGains != nullptr);
 
     auto & lastGains{ data.lastGains };
-    auto const & gains{ data.currentGains->get() };
+    auto const & spatData{ data.currentGains->get() };
+    auto const & gains{ spatData.gains };
     auto const & gainInterpolation{ config.spatGainsInterpolation };
     auto const numSamples{ sourcesBuffer.getNumSamples() };
     auto const * inputSamples{ sourcesBuffer[sourceId].getReadPointer(0) };
+
+    // The speakers hear the MBAP sources attenuated with their distance, so the stereo reduction attenuates them too.
+    // The inner algorithm leaves the source buffer untouched and may not even render : this keeps its own state.
+    if (spatData.mbapSourceDistance && config.mbapAttenuationConfig.shouldProcess) {
+        inputSamples = config.mbapAttenuationConfig.process(inputSamples,
+                                                            attenuationScratch.samples.data(),
+                                                            numSamples,
+                                                            *spatData.mbapSourceDistance,
+                                                            data.attenuationState);
+    }
     auto const gainFactor{ std::pow(gainInterpolation, 0.1f) * 0.0099f + 0.99f };
 
     static constexpr std::array<size_t, 2> SPEAKERS{ 0, 1 };
-    auto * const * const buffers{ stereoBuffer.getArrayOfWritePointers() };
+    auto const & kernels{ getMixKernels() };
 
+    auto cost{ 0.0f };
     for (auto const & speaker : SPEAKERS) {
         auto & currentGain{ lastGains[speaker] };
         auto const & targetGain{ gains[speaker] };
-        auto * outputSamples{ buffers[speaker] };
+        auto * outputSamples{ outputs[speaker] };
         if (gainInterpolation == 0.0f) {
             // linear interpolation over buffer size
             auto const gainSlope = (targetGain - currentGain) / narrow<float>(numSamples);
@@ -159,33 +244,34 @@ inline void StereoSpatAlgorithm::processSource(const gris::AudioConfig & config,
                 // this is not going to produce any more sounds!
                 continue;
             }
-            for (int sampleIndex{}; sampleIndex < numSamples; ++sampleIndex) {
-                currentGain += gainSlope;
-                // TODO FU: SG_FU_METHOD == SG_FU_USE_ATOMIC_CAST and == SG_FU_USE_BUFFER_PER_THREAD
-#if SG_USE_FORK_UNION // && SG_FU_METHOD == SG_FU_USE_ATOMIC_CAST
-                std::atomic_ref<float>(outputSamples[sampleIndex]) += inputSamples[sampleIndex] * currentGain;
-#else
-                outputSamples[sampleIndex] += inputSamples[sampleIndex] * currentGain;
-#endif
-            }
+            cost += std::abs(targetGain - currentGain) < SMALL_GAIN ? ActiveSources::STATIC_GAIN_COST
+                                                                    : ActiveSources::RAMPING_GAIN_COST;
+            currentGain = kernels.addWithLinearRamp(outputSamples, inputSamples, currentGain, gainSlope, numSamples);
         } else {
             // log interpolation with 1st order filter
-            for (int sampleIndex{}; sampleIndex < numSamples; ++sampleIndex) {
-                currentGain = targetGain + (currentGain - targetGain) * gainFactor;
-                if (currentGain < SMALL_GAIN && targetGain < SMALL_GAIN) {
-                    // If the gain is near zero and the target gain is also near zero, this means that
-                    // currentGain will no ever increase over this buffer
-                    break;
-                }
-                // TODO FU: SG_FU_METHOD == SG_FU_USE_ATOMIC_CAST and == SG_FU_USE_BUFFER_PER_THREAD
-#if SG_USE_FORK_UNION //&& SG_FU_METHOD == SG_FU_USE_ATOMIC_CAST
-                std::atomic_ref<float>(outputSamples[sampleIndex]) += inputSamples[sampleIndex] * currentGain;
-#else
-                outputSamples[sampleIndex] += inputSamples[sampleIndex] * currentGain;
-#endif
+            cost += std::abs(targetGain - currentGain) < SMALL_GAIN ? ActiveSources::STATIC_GAIN_COST
+                                                                    : ActiveSources::RAMPING_GAIN_COST;
+            if (targetGain < SMALL_GAIN) {
+                // Once the gain is near zero, it will not increase again over this buffer.
+                currentGain = kernels.addWithSmoothedFadeOut(outputSamples,
+                                                             inputSamples,
+                                                             currentGain,
+                                                             targetGain,
+                                                             gainFactor,
+                                                             SMALL_GAIN,
+                                                             numSamples);
+            } else {
+                currentGain = kernels.addWithSmoothedRamp(outputSamples,
+                                                          inputSamples,
+                                                          currentGain,
+                                                          targetGain,
+                                                          gainFactor,
+                                                          numSamples);
             }
         }
     }
+
+    data.lastBlockCost = cost;
 }
 
 //==============================================================================
@@ -199,34 +285,39 @@ juce::Array<Triplet> StereoSpatAlgorithm::getTriplets() const noexcept
 //==============================================================================
 std::unique_ptr<AbstractSpatAlgorithm> StereoSpatAlgorithm::make(SpeakerSetup const & speakerSetup,
                                                                  SpatMode const & projectSpatMode,
-                                                                 SourcesData const & sources,
-                                                                 std::vector<source_index_t> && sourceIds)
+                                                                 SourcesData const & sources)
 {
-    JUCE_ASSERT_MESSAGE_THREAD;
+    SG_ASSERT_BUILDER_THREAD;
 
-    return std::make_unique<StereoSpatAlgorithm>(speakerSetup, projectSpatMode, sources, std::move(sourceIds));
+    return std::make_unique<StereoSpatAlgorithm>(speakerSetup, projectSpatMode, sources);
 }
 
 //==============================================================================
 StereoSpatAlgorithm::StereoSpatAlgorithm(SpeakerSetup const & speakerSetup,
                                          SpatMode const & projectSpatMode,
-                                         SourcesData const & sources,
-                                         [[maybe_unused]] std::vector<source_index_t> && theSourceIds)
+                                         SourcesData const & sources)
+    : mProjectSpatMode(projectSpatMode)
 #if SG_USE_FORK_UNION
-    : sourceIds{ theSourceIds }
+    , mAttenuationScratches(std::thread::hardware_concurrency())
 #endif
 {
-    JUCE_ASSERT_MESSAGE_THREAD;
+    SG_ASSERT_BUILDER_THREAD;
+
+#if SG_USE_FORK_UNION
+    mWorkerBuffers.allocate(std::size_t{ std::thread::hardware_concurrency() } * 2,
+                            SourceAudioBuffer::MAX_NUM_SAMPLES,
+                            false);
+#endif
 
     switch (projectSpatMode) {
     case SpatMode::vbap:
-        mInnerAlgorithm = VbapSpatAlgorithm::make(speakerSetup, sources.getKeys());
+        mInnerAlgorithm = VbapSpatAlgorithm::make(speakerSetup);
         break;
     case SpatMode::mbap:
-        mInnerAlgorithm = MbapSpatAlgorithm::make(speakerSetup, sources.getKeys());
+        mInnerAlgorithm = MbapSpatAlgorithm::make(speakerSetup);
         break;
     case SpatMode::hybrid:
-        mInnerAlgorithm = HybridSpatAlgorithm::make(speakerSetup, sources.getKeys());
+        mInnerAlgorithm = HybridSpatAlgorithm::make(speakerSetup);
         break;
     case SpatMode::invalid:
         break;
@@ -237,4 +328,36 @@ StereoSpatAlgorithm::StereoSpatAlgorithm(SpeakerSetup const & speakerSetup,
     fixDirectOutsIntoPlace(sources, speakerSetup, projectSpatMode);
 }
 
+//==============================================================================
+void StereoSpatAlgorithm::listHotMemory(HotMemory & hotMemory) const
+{
+    hotMemory.add(*this);
+#if SG_USE_FORK_UNION
+    hotMemory.add(mWorkerBuffers);
+    hotMemory.add(mAttenuationScratches);
+#endif
+    if (mInnerAlgorithm) {
+        mInnerAlgorithm->listHotMemory(hotMemory);
+    }
+}
+
+//==============================================================================
+AbstractSpatAlgorithm::MemoryReport StereoSpatAlgorithm::getMemoryReport() const
+{
+    MemoryReport report{ sizeof(*this), sizeof(mData), MAX_NUM_SOURCES * 2 * sizeof(StereoSpeakerGains) };
+    if (mInnerAlgorithm) {
+        report += mInnerAlgorithm->getMemoryReport();
+    }
+    return report;
+}
+
+//==============================================================================
+void StereoSpatAlgorithm::prepare(double const sampleRate, int const maxBlockSize)
+{
+    // The worker buffers are already sized for the largest possible block.
+    if (mInnerAlgorithm) {
+        mInnerAlgorithm->prepare(sampleRate, maxBlockSize);
+    }
+}
+
 } // namespace gris
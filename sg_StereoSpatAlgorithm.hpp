@@ -19,7 +19,8 @@
 
 #pragma once
 
-#include "Containers/sg_AtomicUpdater.hpp"
+#include "Containers/sg_AudioSlab.hpp"
+#include "Containers/sg_LatestWinsUpdater.hpp"
 #include "Containers/sg_StrongArray.hpp"
 #include "Containers/sg_TaggedAudioBuffer.hpp"
 #include "Data/StrongTypes/sg_SourceIndex.hpp"
@@ -30,21 +31,33 @@
 #include "Data/sg_Triplet.hpp"
 #include "Data/sg_constants.hpp"
 #include "sg_AbstractSpatAlgorithm.hpp"
+#include "sg_MbapSpatAlgorithm.hpp"
 #include "juce_audio_basics/juce_audio_basics.h"
 #include "juce_core/juce_core.h"
 #include "tl/optional.hpp"
 #include <array>
 #include <memory>
+#include <vector>
 
 namespace gris
 {
 using StereoSpeakerGains = std::array<float, 2>;
-using StereoGainsUpdater = AtomicUpdater<StereoSpeakerGains>;
+
+struct StereoSpatData {
+    StereoSpeakerGains gains{};
+    /** Only set when the inner algorithm renders the source with MBAP, which attenuates it with the distance. */
+    tl::optional<float> mbapSourceDistance{};
+};
+
+using StereoGainsUpdater = LatestWinsUpdater<StereoSpatData>;
 
 struct StereoSourceData {
     StereoGainsUpdater gainsUpdater{};
     StereoGainsUpdater::Token * currentGains{};
+    MbapSourceAttenuationState attenuationState{};
     StereoSpeakerGains lastGains{};
+    /** What rendering this source cost during the last block, in ActiveSources units. */
+    float lastBlockCost{};
 };
 
 using StereoSourcesData = StrongArray<source_index_t, StereoSourceData, MAX_NUM_SOURCES>;
@@ -53,14 +66,23 @@ using StereoSourcesData = StrongArray<source_index_t, StereoSourceData, MAX_NUM_
 class StereoSpatAlgorithm final : public AbstractSpatAlgorithm
 {
     std::unique_ptr<AbstractSpatAlgorithm> mInnerAlgorithm{};
+    SpatMode mProjectSpatMode{};
     StereoSourcesData mData{};
+    ActiveSources mActiveSources{};
+    /** Whether the last block skipped the inner algorithm. Only used by the audio thread. */
+    bool mIsInnerRenderSkipped{};
+#if SG_USE_FORK_UNION
+    /** One per worker thread. */
+    std::vector<MbapAttenuationScratch> mAttenuationScratches{};
+#else
+    MbapAttenuationScratch mAttenuationScratch{};
+#endif
 
 public:
     //==============================================================================
     StereoSpatAlgorithm(SpeakerSetup const & speakerSetup,
                         SpatMode const & projectSpatMode,
-                        SourcesData const & sources,
-                        std::vector<source_index_t> && theSourceIds);
+                        SourcesData const & sources);
     ~StereoSpatAlgorithm() override = default;
     SG_DELETE_COPY_AND_MOVE(StereoSpatAlgorithm)
     //==============================================================================
@@ -77,21 +99,29 @@ public:
     [[nodiscard]] juce::Array<Triplet> getTriplets() const noexcept override;
     [[nodiscard]] bool hasTriplets() const noexcept override { return false; }
     [[nodiscard]] tl::optional<Error> getError() const noexcept override { return tl::nullopt; }
+    void listHotMemory(HotMemory & hotMemory) const override;
+    [[nodiscard]] MemoryReport getMemoryReport() const override;
+    void prepare(double sampleRate, int maxBlockSize) override;
     //==============================================================================
     static std::unique_ptr<AbstractSpatAlgorithm> make(SpeakerSetup const & speakerSetup,
                                                        SpatMode const & projectSpatMode,
-                                                       SourcesData const & sources,
-                                                       std::vector<source_index_t> && sourceIds);
+                                                       SourcesData const & sources);
 
 private:
+    /** Fills mActiveSources with the sources that have something to render and fetches their gains. */
+    void collectActiveSources(AudioConfig const & config, SourcePeaks const & sourcePeaks) noexcept;
+    /** @return true if the inner algorithm renders the source with MBAP. */
+    [[nodiscard]] bool isRenderedWithMbap(SourceData const & sourceData) const noexcept;
     void processSource(const gris::AudioConfig & config,
                        const gris::source_index_t & sourceId,
-                       const gris::SourcePeaks & sourcePeaks,
-                       gris::SourceAudioBuffer & sourcesBuffer,
-                       juce::AudioBuffer<float> & stereoBuffer);
+                       gris::SourceAudioBuffer const & sourcesBuffer,
+                       MbapAttenuationScratch & attenuationScratch,
+                       std::array<float *, 2> const & outputs);
 
 #if SG_USE_FORK_UNION
-    std::vector<source_index_t> sourceIds;
+    /** A stereo partial sum per worker thread : channels 2 * threadIndex and 2 * threadIndex + 1. Every channel starts
+     * on its own cache line, so two workers never write to the same line. */
+    AudioSlab mWorkerBuffers{};
 #endif
 
     JUCE_LEAK_DETECTOR(StereoSpatAlgorithm)
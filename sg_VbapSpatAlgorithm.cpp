@@ -30,8 +30,10 @@
 #include "Data/sg_Triplet.hpp"
 #include "Data/sg_constants.hpp"
 #include "Implementations/sg_vbap.hpp"
+#include "sg_Kernels.hpp"
 #include "sg_AbstractSpatAlgorithm.hpp"
 #include "sg_DummySpatAlgorithm.hpp"
+#include "sg_Reclaimer.hpp"
 #include "juce_audio_basics/juce_audio_basics.h"
 #include "juce_core/juce_core.h"
 #include "juce_core/system/juce_PlatformDefs.h"
@@ -64,13 +66,9 @@ VbapType getVbapType(SpeakersData const & speakers)
 }
 
 //==============================================================================
-VbapSpatAlgorithm::VbapSpatAlgorithm(SpeakersData const & speakers,
-                                     [[maybe_unused]] std::vector<source_index_t> theSourceIds)
-#if SG_USE_FORK_UNION
-    : sourceIds{ theSourceIds }
-#endif
+VbapSpatAlgorithm::VbapSpatAlgorithm(SpeakersData const & speakers)
 {
-    JUCE_ASSERT_MESSAGE_THREAD;
+    SG_ASSERT_BUILDER_THREAD;
 
     std::array<Position, MAX_NUM_SPEAKERS> loudSpeakers{};
     std::array<output_patch_t, MAX_NUM_SPEAKERS> outputPatches{};
@@ -88,6 +86,45 @@ VbapSpatAlgorithm::VbapSpatAlgorithm(SpeakersData const & speakers,
     auto const numSpeakers{ narrow<int>(index) };
 
     mSetupData = vbapInit(loudSpeakers, numSpeakers, dimensions, outputPatches);
+
+    mGains.allocate(speakers, VbapSpatDataQueue::NUM_TOKENS);
+    for (int i{ 1 }; i <= MAX_NUM_SOURCES; ++i) {
+        source_index_t const sourceIndex{ i };
+        auto & data{ mData[sourceIndex] };
+        data.lastGains = mGains.getLastGains(sourceIndex);
+        data.spatDataQueue.initializeTokens([&](SpeakerGainsRow & gains, std::size_t const tokenIndex) {
+            gains = mGains.getTokenRow(sourceIndex, tokenIndex);
+        });
+    }
+}
+
+//==============================================================================
+void VbapSpatAlgorithm::listHotMemory(HotMemory & hotMemory) const
+{
+    // The sources' data (gain tokens and last gains) lives inside the algorithm and its gains slab.
+    hotMemory.add(*this);
+    hotMemory.add(mGains.getSlab());
+    if (mSetupData) {
+        hotMemory.add(*mSetupData);
+        hotMemory.add(mSetupData->speakerSets.begin(),
+                      narrow<std::size_t>(mSetupData->speakerSets.size()) * sizeof(SpeakerSet));
+    }
+}
+
+//==============================================================================
+AbstractSpatAlgorithm::MemoryReport VbapSpatAlgorithm::getMemoryReport() const
+{
+    // Every source reads one gain token and ramps its last gains.
+    auto const numSourcesBytes{ sizeof(mData) + mGains.getNumBytes() };
+    return MemoryReport{ sizeof(*this) + mGains.getNumBytes(),
+                         numSourcesBytes,
+                         MAX_NUM_SOURCES * 2 * mGains.getNumBytesPerRow() };
+}
+
+//==============================================================================
+VbapSpatAlgorithm::~VbapSpatAlgorithm()
+{
+    Reclaimer::retire(std::move(mSetupData), "VbapData");
 }
 
 //==============================================================================
@@ -101,9 +138,11 @@ void VbapSpatAlgorithm::updateSpatData(source_index_t const sourceIndex, SourceD
     auto & gains{ ticket->get() };
 
     if (sourceData.position) {
-        vbapCompute(sourceData, gains, *mSetupData);
+        SpeakersSpatGains allGains{};
+        vbapCompute(sourceData, allGains, *mSetupData);
+        gains.copyFrom(allGains);
     } else {
-        gains = SpeakersSpatGains{};
+        gains.clear();
     }
 
     spatDataQueue.setMostRecent(ticket);
@@ -122,44 +161,85 @@ void VbapSpatAlgorithm::process(AudioConfig const & config,
 {
     ASSERT_AUDIO_THREAD;
 
-    auto const & speakersAudioConfig{ altSpeakerConfig ? *altSpeakerConfig : config.speakersAudioConfig };
+    auto const & renderPlan{ getRenderPlan(config, altSpeakerConfig) };
+    collectActiveSources(config, sourcePeaks);
 
 #if SG_USE_FORK_UNION
-    namespace fu = ashvardanian::fork_union;
-
-    jassert(sourceIds.size() > 0);
-
-    fu::for_n(threadPool, sourceIds.size(), [&](fu::prong_t prong) noexcept {
+    // The governor decides how many workers take part. They pick the most expensive sources first and the cheap ones
+    // fill the gaps.
+    mActiveSources.sortByCost();
+    auto const processActiveSource = [&](std::size_t const taskIndex,
+                                         [[maybe_unused]] std::size_t const threadIndex) noexcept {
         jassert(threadPool.is_lock_free());
 
         processSource(config,
-                      sourceIds[prong.task_index],
-                      sourcePeaks,
+                      mActiveSources[taskIndex],
                       sourcesBuffer,
-                      speakersAudioConfig,
+                      renderPlan,
     #if SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS
                       forkUnionBuffer,
     #elif SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD
-                      forkUnionBuffer[prong.thread_index],
+                      forkUnionBuffer[threadIndex],
     #endif
                       speakersBuffer);
-    });
+    };
+    dispatchActiveSources(mActiveSources, sourcesBuffer.getNumSamples(), processActiveSource);
 
     #if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
-    copyForkUnionBuffer(speakersAudioConfig, sourcesBuffer, speakersBuffer, forkUnionBuffer);
+    copyForkUnionBuffer(altSpeakerConfig ? *altSpeakerConfig : config.speakersAudioConfig,
+                        sourcesBuffer,
+                        speakersBuffer,
+                        forkUnionBuffer);
     #endif
 
 #else
-    for (auto const & source : config.sourcesAudioConfig)
-        processSource(config, source.key, sourcePeaks, sourcesBuffer, speakersAudioConfig, speakersBuffer);
+    for (auto const & activeSource : mActiveSources)
+        processSource(config, activeSource.sourceIndex, sourcesBuffer, renderPlan, speakersBuffer);
 #endif
 }
 
+//==============================================================================
+void VbapSpatAlgorithm::collectActiveSources(AudioConfig const & config, SourcePeaks const & sourcePeaks) noexcept
+{
+    mActiveSources.clear();
+    for (auto const & source : config.sourcesAudioConfig) {
+        if (source.value.isMuted || source.value.directOut || sourcePeaks[source.key] < SMALL_GAIN) {
+            // source silent
+            continue;
+        }
+
+        auto & data{ mData[source.key] };
+        auto const * const previousData{ data.currentSpatData };
+        data.spatDataQueue.getMostRecent(data.currentSpatData);
+        if (data.currentSpatData == nullptr) {
+            // no spat data
+            continue;
+        }
+
+        // New gains mean that the audible speakers are going to ramp during this block.
+        auto const hasNewGains{ data.currentSpatData != previousData };
+        auto const ratio{ hasNewGains ? ActiveSources::RAMPING_GAIN_COST / ActiveSources::STATIC_GAIN_COST : 1.0f };
+        mActiveSources.add(source.key, std::max(data.lastBlockCost, ActiveSources::STATIC_GAIN_COST) * ratio);
+    }
+}
+
+//==============================================================================
+void VbapSpatAlgorithm::snapToTargetGains() noexcept
+{
+    ASSERT_AUDIO_THREAD;
+
+    for (auto & data : mData) {
+        data.spatDataQueue.getMostRecent(data.currentSpatData);
+        if (data.currentSpatData != nullptr) {
+            data.lastGains.copyFrom(data.currentSpatData->get());
+        }
+    }
+}
+
 inline void VbapSpatAlgorithm::processSource(const gris::AudioConfig & config,
                                              const gris::source_index_t & sourceId,
-                                             const gris::SourcePeaks & sourcePeaks,
-                                             gris::SourceAudioBuffer & sourcesBuffer,
-                                             const gris::SpeakersAudioConfig & speakersAudioConfig,
+                                             gris::SourceAudioBuffer const & sourcesBuffer,
+                                             SpeakerRenderPlan const & renderPlan,
 #if SG_USE_FORK_UNION
     #if SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS
                                              ForkUnionBuffer & forkUnionBuffer,
@@ -169,18 +249,9 @@ inline void VbapSpatAlgorithm::processSource(const gris::AudioConfig & config,
 #endif
                                              SpeakerAudioBuffer & speakerBuffers)
 {
-    auto const & source = config.sourcesAudioConfig[sourceId];
-    if (source.isMuted || source.directOut || sourcePeaks[sourceId] < SMALL_GAIN) {
-        // source silent
-        return;
-    }
-
     auto & data{ mData[sourceId] };
-    data.spatDataQueue.getMostRecent(data.currentSpatData);
-    if (data.currentSpatData == nullptr) {
-        // no spat data
-        return;
-    }
+    // collectActiveSources() already fetched the most recent spat data.
+    jassert(data.currentSpatData != nullptr);
 
     auto const numSamples{ sourcesBuffer.getNumSamples() };
     auto const & gains{ data.currentSpatData->get() };
@@ -189,34 +260,53 @@ inline void VbapSpatAlgorithm::processSource(const gris::AudioConfig & config,
     auto const & gainInterpolation{ config.spatGainsInterpolation };
     auto const gainFactor{ std::pow(gainInterpolation, 0.1f) * 0.0099f + 0.99f };
 
-    [[maybe_unused]] size_t i = 0;
-    for (auto const & speaker : speakersAudioConfig) {
-        if (speaker.value.isMuted || speaker.value.isDirectOutOnly || speaker.value.gain < SMALL_GAIN) {
-            // speaker silent
+#if !SG_USE_FORK_UNION
+    // Layouts with a specialized kernel mix every speaker in a single pass over the source samples.
+    if (canRenderToFixedSpeakers(renderPlan)) {
+        data.lastBlockCost = renderSourceToFixedSpeakers(inputSamples,
+                                                         numSamples,
+                                                         renderPlan,
+                                                         lastGains,
+                                                         gains,
+                                                         gainInterpolation,
+                                                         gainFactor,
+                                                         speakerBuffers);
+        return;
+    }
+#endif
+
+    [[maybe_unused]] auto * const * speakersChannels{ speakerBuffers.getRawChannels() };
+    [[maybe_unused]] auto const & kernels{ getMixKernels() };
+    auto cost{ 0.0f };
+    for (std::size_t i{}; i < renderPlan.speakers.size(); ++i) {
+        auto const outputPatch{ renderPlan.speakers[i] };
+        if (!lastGains.contains(outputPatch)) {
+            // not part of the setup that the gains were computed for
             continue;
         }
-
-        auto & currentGain{ lastGains[speaker.key] };
-        auto const & targetGain{ gains[speaker.key] };
+        auto & currentGain{ lastGains[outputPatch] };
+        auto const & targetGain{ gains[outputPatch] };
         auto const gainDiff{ targetGain - currentGain };
         auto const gainSlope{ gainDiff / narrow<float>(numSamples) };
 
 #if SG_USE_FORK_UNION
     #if SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS
-        auto & outputSamples{ forkUnionBuffer[i++] };
+        auto & outputSamples{ forkUnionBuffer[i] };
     #elif SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD
-        auto & outputSamples{ speakerBuffer[i++] };
+        auto & outputSamples{ speakerBuffer[i] };
     #elif SG_FU_METHOD == SG_FU_USE_ATOMIC_CAST
-        auto * outputSamples{ speakerBuffers[speaker.key].getWritePointer(0) };
+        auto * outputSamples{ speakersChannels[outputPatch.removeOffset<std::size_t>()] };
     #endif
 #else
-        auto * outputSamples{ speakerBuffers[speaker.key].getWritePointer(0) };
+        auto * outputSamples{ speakersChannels[outputPatch.removeOffset<std::size_t>()] };
 #endif
 
         if (juce::approximatelyEqual(gainSlope, 0.f) || std::abs(gainDiff) < SMALL_GAIN) {
             // no interpolation
             currentGain = targetGain;
             if (currentGain >= SMALL_GAIN) {
+                speakerBuffers.markDirty(outputPatch);
+                cost += ActiveSources::STATIC_GAIN_COST;
 #if SG_USE_FORK_UNION
     #if SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS
                 for (int sampleIndex{}; sampleIndex < numSamples; ++sampleIndex)
@@ -231,18 +321,20 @@ inline void VbapSpatAlgorithm::processSource(const gris::AudioConfig & config,
                     std::atomic_ref<float>(outputSamples[sampleIndex]) += inputSamples[sampleIndex] * currentGain;
     #endif
 #else
-                juce::FloatVectorOperations::addWithMultiply(outputSamples, inputSamples, currentGain, numSamples);
+                kernels.addWithGain(outputSamples, inputSamples, currentGain, numSamples);
 #endif
             }
             continue;
         }
 
         // interpolation necessary
+        speakerBuffers.markDirty(outputPatch);
+        cost += ActiveSources::RAMPING_GAIN_COST;
         if (juce::approximatelyEqual(gainInterpolation, 0.f)) {
             // linear interpolation over buffer size
+#if SG_USE_FORK_UNION
             for (int sampleIndex{}; sampleIndex < numSamples; ++sampleIndex) {
                 currentGain += gainSlope;
-#if SG_USE_FORK_UNION
     #if SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS
                 outputSamples[sampleIndex]._a += inputSamples[sampleIndex] * currentGain;
     #elif SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD
@@ -252,17 +344,17 @@ inline void VbapSpatAlgorithm::processSource(const gris::AudioConfig & config,
     #else
         #error "Invalid FORK_UNION_METHOD selected"
     #endif
+            }
 #else
-                outputSamples[sampleIndex] += inputSamples[sampleIndex] * currentGain;
+            currentGain = kernels.addWithLinearRamp(outputSamples, inputSamples, currentGain, gainSlope, numSamples);
 #endif
-            }
         } else {
             // log interpolation with 1st order filter
             if (targetGain < SMALL_GAIN) {
                 // targeting silence
+#if SG_USE_FORK_UNION
                 for (int sampleIndex{}; sampleIndex < numSamples && currentGain >= SMALL_GAIN; ++sampleIndex) {
                     currentGain = targetGain + (currentGain - targetGain) * gainFactor;
-#if SG_USE_FORK_UNION
     #if SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS
                     outputSamples[sampleIndex]._a += inputSamples[sampleIndex] * currentGain;
     #elif SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD
@@ -272,17 +364,23 @@ inline void VbapSpatAlgorithm::processSource(const gris::AudioConfig & config,
     #else
         #error "Invalid FORK_UNION_METHOD selected"
     #endif
+                }
 #else
-                    outputSamples[sampleIndex] += inputSamples[sampleIndex] * currentGain;
+                currentGain = kernels.addWithSmoothedFadeOut(outputSamples,
+                                                             inputSamples,
+                                                             currentGain,
+                                                             targetGain,
+                                                             gainFactor,
+                                                             SMALL_GAIN,
+                                                             numSamples);
 #endif
-                }
                 continue;
             }
 
             // not targeting silence
+#if SG_USE_FORK_UNION
             for (int sampleIndex{}; sampleIndex < numSamples; ++sampleIndex) {
                 currentGain = targetGain + (currentGain - targetGain) * gainFactor;
-#if SG_USE_FORK_UNION
     #if SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS
                 outputSamples[sampleIndex]._a += inputSamples[sampleIndex] * currentGain;
     #elif SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD
@@ -292,12 +390,19 @@ inline void VbapSpatAlgorithm::processSource(const gris::AudioConfig & config,
     #else
         #error "Invalid FORK_UNION_METHOD selected"
     #endif
+            }
 #else
-                outputSamples[sampleIndex] += inputSamples[sampleIndex] * currentGain;
+            currentGain = kernels.addWithSmoothedRamp(outputSamples,
+                                                      inputSamples,
+                                                      currentGain,
+                                                      targetGain,
+                                                      gainFactor,
+                                                      numSamples);
 #endif
-            }
         }
     }
+
+    data.lastBlockCost = cost;
 }
 
 //==============================================================================
@@ -319,11 +424,13 @@ bool VbapSpatAlgorithm::hasTriplets() const noexcept
 }
 
 //==============================================================================
-std::unique_ptr<AbstractSpatAlgorithm> VbapSpatAlgorithm::make(SpeakerSetup const & speakerSetup,
-                                                               std::vector<source_index_t> sourceIds)
+std::unique_ptr<AbstractSpatAlgorithm> VbapSpatAlgorithm::make(SpeakerSetup const & speakerSetup)
 {
-    auto const getVbap
-        = [&]() { return std::make_unique<VbapSpatAlgorithm>(speakerSetup.speakers, std::move(sourceIds)); };
+    auto const getVbap = [&]() {
+        auto vbap{ std::make_unique<VbapSpatAlgorithm>(speakerSetup.speakers) };
+        vbap->selectRenderPath(speakerSetup.numOfSpatializedSpeakers());
+        return vbap;
+    };
 
     if (speakerSetup.numOfSpatializedSpeakers() < 3) {
         return std::make_unique<DummySpatAlgorithm>(Error::notEnoughDomeSpeakers);
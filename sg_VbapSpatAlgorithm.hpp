@@ -19,13 +19,14 @@
 
 #pragma once
 
-#include "Containers/sg_AtomicUpdater.hpp"
+#include "Containers/sg_LatestWinsUpdater.hpp"
 #include "Containers/sg_StrongArray.hpp"
 #include "Containers/sg_TaggedAudioBuffer.hpp"
 #include "Data/StrongTypes/sg_SourceIndex.hpp"
 #include "Data/sg_AudioStructs.hpp"
 #include "Data/sg_LogicStrucs.hpp"
 #include "Data/sg_Macros.hpp"
+#include "Data/sg_SourceGains.hpp"
 #include "Data/sg_Triplet.hpp"
 #include "Data/sg_constants.hpp"
 #include "Implementations/sg_vbap.hpp"
@@ -39,10 +40,15 @@ namespace gris
 {
 VbapType getVbapType(SpeakersData const & speakers);
 
+/** The tokens point to rows of the algorithm's SourcesGainsSlab. */
+using VbapSpatDataQueue = LatestWinsUpdater<SpeakerGainsRow>;
+
 struct VbapSourceData {
-    AtomicUpdater<SpeakersSpatGains> spatDataQueue{};
-    AtomicUpdater<SpeakersSpatGains>::Token * currentSpatData{};
-    SpeakersSpatGains lastGains{};
+    VbapSpatDataQueue spatDataQueue{};
+    VbapSpatDataQueue::Token * currentSpatData{};
+    SpeakerGainsRow lastGains{};
+    /** What rendering this source cost during the last block, in ActiveSources units. */
+    float lastBlockCost{};
 };
 
 using VbapSourcesData = StrongArray<source_index_t, VbapSourceData, MAX_NUM_SOURCES>;
@@ -51,12 +57,15 @@ using VbapSourcesData = StrongArray<source_index_t, VbapSourceData, MAX_NUM_SOUR
 class VbapSpatAlgorithm final : public AbstractSpatAlgorithm
 {
     std::unique_ptr<VbapData> mSetupData{};
+    SourcesGainsSlab mGains{};
     VbapSourcesData mData{};
+    ActiveSources mActiveSources{};
 
 public:
     //==============================================================================
-    explicit VbapSpatAlgorithm(SpeakersData const & speakers, std::vector<source_index_t> theSourceIds);
-    ~VbapSpatAlgorithm() override = default;
+    explicit VbapSpatAlgorithm(SpeakersData const & speakers);
+    /** The speaker data is handed to the Reclaimer. */
+    ~VbapSpatAlgorithm() override;
     SG_DELETE_COPY_AND_MOVE(VbapSpatAlgorithm)
     //==============================================================================
     void updateSpatData(source_index_t sourceIndex, SourceData const & sourceData) noexcept override;
@@ -72,16 +81,21 @@ public:
     [[nodiscard]] juce::Array<Triplet> getTriplets() const noexcept override;
     [[nodiscard]] bool hasTriplets() const noexcept override;
     [[nodiscard]] tl::optional<Error> getError() const noexcept override { return tl::nullopt; }
+    void snapToTargetGains() noexcept override;
+    void listHotMemory(HotMemory & hotMemory) const override;
+    [[nodiscard]] MemoryReport getMemoryReport() const override;
+    /** @return the sources that the last call to process() rendered, with their estimated cost. */
+    [[nodiscard]] ActiveSources const & getActiveSources() const noexcept { return mActiveSources; }
     //==============================================================================
-    static std::unique_ptr<AbstractSpatAlgorithm> make(SpeakerSetup const & speakerSetup,
-                                                       std::vector<source_index_t> theSourceIds);
+    static std::unique_ptr<AbstractSpatAlgorithm> make(SpeakerSetup const & speakerSetup);
 
 private:
+    /** Fills mActiveSources with the sources that have something to render and fetches their spat data. */
+    void collectActiveSources(AudioConfig const & config, SourcePeaks const & sourcePeaks) noexcept;
     void processSource(const gris::AudioConfig & config,
                        const gris::source_index_t & sourceId,
-                       const gris::SourcePeaks & sourcePeaks,
-                       gris::SourceAudioBuffer & sourcesBuffer,
-                       const gris::SpeakersAudioConfig & speakersAudioConfig,
+                       gris::SourceAudioBuffer const & sourcesBuffer,
+                       SpeakerRenderPlan const & renderPlan,
 #if SG_USE_FORK_UNION
     #if SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS
                        ForkUnionBuffer & forkUnionBuffer,
@@ -91,10 +105,6 @@ private:
 #endif
                        SpeakerAudioBuffer & speakersBuffer);
 
-#if SG_USE_FORK_UNION
-    std::vector<source_index_t> sourceIds;
-#endif
-
     JUCE_LEAK_DETECTOR(VbapSpatAlgorithm)
 };
 
@@ -2,6 +2,7 @@
 
 #include "juce_gui_basics/juce_gui_basics.h"
 #include <catch2/catch_session.hpp>
+#include <sg_Reclaimer.hpp>
 
 int main(int argc, char * argv[])
 {
@@ -11,6 +12,9 @@ int main(int argc, char * argv[])
     // It's nicer DX when placed here vs. manually in Catch2 SECTIONs
     juce::ScopedJuceInitialiser_GUI gui;
 
+    // Retired algorithms are destroyed on the reclaimer's thread.
+    gris::Reclaimer::start();
+
     const int result = Catch::Session().run(argc, argv);
 
     return result;
@@ -33,8 +33,15 @@ namespace gris::tests
 {
 auto constexpr static vbapTestName = "VBAP";
 auto constexpr static stereoTestName = "STEREO";
+auto constexpr static stereoSkippedInnerRenderTestName = "STEREO SKIPPED INNER RENDER";
 auto constexpr static mbapTestName = "MBAP";
+auto constexpr static stereoMbapAttenuationTestName = "STEREO MBAP ATTENUATION";
 auto constexpr static hrtfTestName = "HRTF";
+auto constexpr static activeSourcesTestName = "ACTIVE SOURCES";
+auto constexpr static hotSwapTestName = "HOT SWAP";
+auto constexpr static hotSwapUpdatesTestName = "HOT SWAP UPDATES";
+auto constexpr static asyncBuilderTestName = "ASYNC BUILDER";
+auto constexpr static controlRateTestName = "CONTROL RATE";
 
 #if USE_FIXED_NUM_LOOPS
 /** Number of loops over the processing call during tests. */
@@ -1,4 +1,32 @@
 #include <catch2/catch_all.hpp>
+#include <sg_ParallelismGovernor.hpp>
+#include <sg_Reclaimer.hpp>
+#include <tests/sg_TestUtils.hpp>
+#include <Containers/sg_AtomicUpdater.hpp>
+#include <Containers/sg_AudioSlab.hpp>
+#include <Containers/sg_HotMemory.hpp>
+#include <Containers/sg_LatestWinsUpdater.hpp>
+#include <Containers/sg_OwnedMap.hpp>
+#include <Containers/sg_SnapshotUpdater.hpp>
+#include <Containers/sg_StaticMap.hpp>
+#include <Containers/sg_TaggedAudioBuffer.hpp>
+#include <Data/sg_AudioStructs.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if JUCE_LINUX
+    #include <unistd.h>
+#endif
 
 TEST_CASE("check things are setup", "[core]")
 {
@@ -10,3 +38,565 @@ TEST_CASE("check things are setup", "[core]")
         }
     }
 }
+
+TEST_CASE("retired objects are destroyed by the reclaimer", "[core]")
+{
+    struct Tracked {
+        std::atomic<bool> & destroyed;
+        std::atomic<bool> & destroyedOnCallingThread;
+        juce::Thread::ThreadID callingThread;
+        Tracked(std::atomic<bool> & theDestroyed, std::atomic<bool> & theDestroyedOnCallingThread)
+            : destroyed(theDestroyed)
+            , destroyedOnCallingThread(theDestroyedOnCallingThread)
+            , callingThread(juce::Thread::getCurrentThreadId())
+        {
+        }
+        ~Tracked()
+        {
+            destroyed = true;
+            destroyedOnCallingThread = juce::Thread::getCurrentThreadId() == callingThread;
+        }
+    };
+
+    std::atomic<bool> destroyed{};
+    std::atomic<bool> destroyedOnCallingThread{};
+    auto * reclaimer{ gris::Reclaimer::getInstanceWithoutCreating() };
+    REQUIRE(reclaimer != nullptr);
+    auto const numReclaimedBefore{ reclaimer->getStats().numReclaimed };
+
+    gris::Reclaimer::retire(std::make_unique<Tracked>(destroyed, destroyedOnCallingThread), "Tracked");
+    reclaimer->flush();
+
+    REQUIRE(destroyed);
+    REQUIRE(!destroyedOnCallingThread);
+    REQUIRE(reclaimer->getStats().numReclaimed == numReclaimedBefore + 1);
+}
+
+TEST_CASE("audio config changes are sent as commands", "[core]")
+{
+    using namespace gris;
+
+    auto makeConfig = [] {
+        AudioConfig config{};
+        config.masterGain = 1.0f;
+        for (int i{ 1 }; i <= 4; ++i) {
+            config.sourcesAudioConfig.add(source_index_t{ i }, SourceAudioConfig{});
+            config.speakersAudioConfig.add(output_patch_t{ i }, SpeakerAudioConfig{ false, 1.0f, false, tl::nullopt });
+        }
+        config.speakerRenderPlan.compile(config.speakersAudioConfig);
+        return config;
+    };
+
+    auto audioDataPtr{ std::make_unique<AudioData>() };
+    auto & audioData{ *audioDataPtr };
+    audioData.config = std::make_unique<AudioConfig>(makeConfig());
+    auto mirror{ makeConfig() };
+
+    GIVEN("mutes, gains and a high-pass")
+    {
+        auto next{ mirror };
+        next.sourcesAudioConfig[source_index_t{ 2 }].isMuted = true;
+        next.speakersAudioConfig[output_patch_t{ 3 }].isMuted = true;
+        next.speakersAudioConfig[output_patch_t{ 4 }].gain = 0.5f;
+        next.speakersAudioConfig[output_patch_t{ 1 }].highpassConfig = SpeakerHighpassConfig{ 1.0, 2.0, 3.0, 4.0 };
+        next.masterGain = 0.25f;
+
+        auto const commands{ mirror.diff(next) };
+        REQUIRE(commands.has_value());
+        REQUIRE(commands->size() == 5);
+        REQUIRE(audioData.pushConfigCommands(*commands));
+
+        THEN("the audio thread applies them at the next block")
+        {
+            REQUIRE(audioData.applyConfigCommands());
+            auto const & config{ *audioData.config };
+            REQUIRE(config.sourcesAudioConfig[source_index_t{ 2 }].isMuted);
+            REQUIRE(config.speakersAudioConfig[output_patch_t{ 3 }].isMuted);
+            REQUIRE(config.speakersAudioConfig[output_patch_t{ 4 }].gain == 0.5f);
+            REQUIRE(config.speakersAudioConfig[output_patch_t{ 1 }].highpassConfig.has_value());
+            REQUIRE(config.masterGain == 0.25f);
+            REQUIRE(config.speakerRenderPlan.speakers.size() == 3);
+            REQUIRE(config.speakerRenderPlan.isUpToDate(config.speakersAudioConfig));
+            REQUIRE(!mirror.speakerRenderPlan.isUpToDate(config.speakersAudioConfig));
+            REQUIRE(audioData.configCommands.isEmpty());
+        }
+    }
+
+    GIVEN("a structural change")
+    {
+        auto next{ mirror };
+        next.speakersAudioConfig.add(output_patch_t{ 5 }, SpeakerAudioConfig{});
+
+        THEN("a new snapshot is needed")
+        {
+            REQUIRE(!mirror.diff(next).has_value());
+        }
+    }
+
+    GIVEN("commands meant for other snapshots")
+    {
+        auto stale{ AudioConfigCommand::makeMasterGain(0.1f) };
+        stale.generation = audioData.config->generation - 1;
+        auto early{ AudioConfigCommand::makeMasterGain(0.2f) };
+        early.generation = audioData.config->generation + 1;
+        REQUIRE(audioData.pushConfigCommands(AudioConfigCommands{ stale, early }));
+
+        THEN("stale ones are dropped and early ones wait for their snapshot")
+        {
+            REQUIRE(!audioData.applyConfigCommands());
+            REQUIRE(audioData.config->masterGain == 1.0f);
+            REQUIRE(!audioData.configCommands.isEmpty());
+
+            ++audioData.config->generation;
+            audioData.applyConfigCommands();
+            REQUIRE(audioData.config->masterGain == 0.2f);
+            REQUIRE(audioData.configCommands.isEmpty());
+        }
+    }
+}
+
+TEST_CASE("concurrent writers never make the reader go back in time", "[core]")
+{
+    using Value = std::pair<int, int>; // writer, write count
+    static constexpr auto NUM_WRITERS = 3;
+    static constexpr auto NUM_WRITES = 20000;
+
+    gris::LatestWinsUpdater<Value> updater{};
+    // Catch2 assertions are not thread-safe.
+    std::atomic<bool> ranOutOfTokens{};
+    std::vector<std::thread> writers{};
+    for (int writer{}; writer < NUM_WRITERS; ++writer) {
+        writers.emplace_back([&updater, &ranOutOfTokens, writer] {
+            for (int count{}; count < NUM_WRITES; ++count) {
+                auto * token{ updater.acquire() };
+                if (token == nullptr) {
+                    ranOutOfTokens = true;
+                    return;
+                }
+                token->get() = Value{ writer, count };
+                updater.setMostRecent(token);
+            }
+        });
+    }
+
+    std::vector<int> lastCounts(NUM_WRITERS, -1);
+    gris::LatestWinsUpdater<Value>::Token * token{};
+    auto const read = [&] {
+        updater.getMostRecent(token);
+        if (token != nullptr) {
+            auto const [writer, count] = token->get();
+            REQUIRE(count >= lastCounts[static_cast<std::size_t>(writer)]);
+            lastCounts[static_cast<std::size_t>(writer)] = count;
+        }
+    };
+
+    for (int i{}; i < NUM_WRITES; ++i) {
+        read();
+    }
+    for (auto & writer : writers) {
+        writer.join();
+    }
+    read();
+
+    REQUIRE(!ranOutOfTokens);
+    // The write that started last is the last write of one of the writers.
+    REQUIRE(token != nullptr);
+    REQUIRE(token->get().second == NUM_WRITES - 1);
+}
+
+/** One writer publishes increasing counts, in every word of the payload, while the reader checks that it never sees a
+ * torn value nor goes back in time. */
+template<typename Updater, std::size_t NUM_VALUES>
+static void checkSingleWriterUpdater()
+{
+    using Value = std::array<int, NUM_VALUES>;
+    static constexpr auto NUM_WRITES = 20000;
+
+    Updater updater{};
+    std::thread writer{ [&updater] {
+        for (int count{}; count < NUM_WRITES; ++count) {
+            auto * token{ updater.acquire() };
+            token->get().fill(count);
+            updater.setMostRecent(token);
+        }
+    } };
+
+    typename Updater::Token * token{};
+    auto lastCount{ -1 };
+    auto const read = [&] {
+        updater.getMostRecent(token);
+        if (token != nullptr) {
+            auto const & value{ token->get() };
+            REQUIRE(std::all_of(value.begin(), value.end(), [&](int const count) { return count == value.front(); }));
+            REQUIRE(value.front() >= lastCount);
+            lastCount = value.front();
+        }
+    };
+
+    for (int i{}; i < NUM_WRITES; ++i) {
+        read();
+    }
+    writer.join();
+    read();
+
+    REQUIRE(token != nullptr);
+    REQUIRE(token->get().front() == NUM_WRITES - 1);
+}
+
+TEST_CASE("single writer updaters never tear nor go back in time", "[core]")
+{
+    using SmallValue = std::array<int, 4>;
+    using LargeValue = std::array<int, 256>;
+    static_assert(std::is_same_v<gris::SnapshotUpdater<SmallValue>, gris::SeqLock<SmallValue>>);
+    static_assert(std::is_same_v<gris::SnapshotUpdater<LargeValue>, gris::TripleBuffer<LargeValue>>);
+
+    checkSingleWriterUpdater<gris::TripleBuffer<LargeValue>, 256>();
+    checkSingleWriterUpdater<gris::SeqLock<SmallValue>, 4>();
+    checkSingleWriterUpdater<gris::SeqLock<std::array<int, 32>>, 32>();
+}
+
+TEST_CASE("maps iterate over their used keys in order", "[core]")
+{
+    using gris::source_index_t;
+    std::vector<int> const keys{ 200, 3, 97, 1, 256, 42 };
+
+    gris::StaticMap<source_index_t, int, 256> staticMap{};
+    gris::OwnedMap<source_index_t, int, 256> ownedMap{};
+    for (auto const key : keys) {
+        staticMap.add(source_index_t{ key }, key * 2);
+        ownedMap.add(source_index_t{ key }, std::make_unique<int>(key * 3));
+    }
+    staticMap.remove(source_index_t{ 97 });
+    ownedMap.remove(source_index_t{ 97 });
+    std::vector<int> const expectedKeys{ 1, 3, 42, 200, 256 };
+
+    std::vector<int> staticKeys{};
+    for (auto const & node : staticMap) {
+        REQUIRE(node.value == node.key.get() * 2);
+        staticKeys.push_back(node.key.get());
+    }
+    REQUIRE(staticKeys == expectedKeys);
+
+    std::vector<int> ownedKeys{};
+    ownedMap.forEach([&](source_index_t const key, int const & value) {
+        REQUIRE(value == key.get() * 3);
+        ownedKeys.push_back(key.get());
+    });
+    REQUIRE(ownedKeys == expectedKeys);
+
+    auto const usedKeys{ staticMap.getUsedKeys() };
+    REQUIRE(usedKeys.size() == expectedKeys.size());
+    REQUIRE(std::equal(usedKeys.begin(), usedKeys.end(), ownedMap.getUsedKeys().begin()));
+
+    staticMap.clear();
+    ownedMap.clear();
+    REQUIRE(staticMap.begin() == staticMap.end());
+    REQUIRE(ownedMap.begin() == ownedMap.end());
+}
+
+TEST_CASE("audio slabs hold silent channels on separate cache lines", "[core]")
+{
+    static constexpr std::size_t numChannels{ 3 };
+    // 4 KiB per channel : the stride has to be padded.
+    static constexpr std::size_t numSamples{ 1024 };
+
+    for (auto const useHugePages : { false, true }) {
+        INFO("Huge pages: " << useHugePages);
+        gris::AudioSlab slab{};
+        // The second allocation is likely to reuse the memory that the first one filled.
+        for (int allocation{}; allocation < 2; ++allocation) {
+            slab.allocate(numChannels, numSamples, useHugePages);
+            REQUIRE(slab.getNumChannels() == numChannels);
+            REQUIRE(slab.getStride() >= numSamples);
+            REQUIRE(slab.getStride() * sizeof(float) % 4096 != 0);
+            if (slab.isUsingHugePages())
+                REQUIRE(reinterpret_cast<std::uintptr_t>(slab.data()) % (2 * 1024 * 1024) == 0);
+
+            for (std::size_t channel{}; channel < numChannels; ++channel) {
+                auto * const samples{ slab.getChannel(channel) };
+                REQUIRE(reinterpret_cast<std::uintptr_t>(samples) % gris::CACHE_LINE_SIZE == 0);
+                REQUIRE(std::all_of(samples, samples + numSamples, [](float const sample) { return sample == 0.0f; }));
+                std::fill_n(samples, numSamples, 1.0f);
+            }
+        }
+
+        slab.release();
+        REQUIRE(slab.getNumChannels() == 0);
+        REQUIRE(slab.data() == nullptr);
+        REQUIRE(!slab.isUsingHugePages());
+    }
+
+    gris::AudioSlab empty{};
+    empty.allocate(0, numSamples, false);
+    REQUIRE(empty.data() == nullptr);
+}
+
+#if JUCE_LINUX
+/** @return the memory that the process has locked, in KiB, as the kernel sees it. */
+static std::size_t getNumLockedKiB()
+{
+    std::ifstream status{ "/proc/self/status" };
+    std::string line{};
+    while (std::getline(status, line)) {
+        if (line.rfind("VmLck:", 0) == 0) {
+            return static_cast<std::size_t>(std::stoul(line.substr(6)));
+        }
+    }
+    return 0;
+}
+#endif
+
+TEST_CASE("hot memory keeps the pages it shares with another instance locked", "[core]")
+{
+    // An algorithm that gets retired can share pages with the one that replaced it : it must not unlock them.
+    std::vector<float> samples(16384);
+    auto const numPagesBefore{ gris::HotMemory::getNumLockedPages() };
+#if JUCE_LINUX
+    auto const pageKiB{ static_cast<std::size_t>(sysconf(_SC_PAGESIZE)) / 1024 };
+    auto const numKiBBefore{ getNumLockedKiB() };
+#endif
+
+    gris::HotMemory live{};
+    live.add(samples.data() + 4096, 4096 * sizeof(float));
+    std::size_t numRetiredPages{};
+    {
+        gris::HotMemory retired{};
+        retired.add(samples);
+        if (!retired.lock()) {
+            // RLIMIT_MEMLOCK is too low : nothing may stay locked.
+            REQUIRE(gris::HotMemory::getNumLockedPages() == numPagesBefore);
+            return;
+        }
+        numRetiredPages = gris::HotMemory::getNumLockedPages() - numPagesBefore;
+        REQUIRE(numRetiredPages > 0);
+
+        // The pages of live are all pages of retired already.
+        REQUIRE(live.lock());
+        REQUIRE(gris::HotMemory::getNumLockedPages() - numPagesBefore == numRetiredPages);
+        REQUIRE(live.getReport().numLockedBytes == 4096 * sizeof(float));
+    }
+
+    auto const numLivePages{ gris::HotMemory::getNumLockedPages() - numPagesBefore };
+    REQUIRE(numLivePages > 0);
+    REQUIRE(numLivePages < numRetiredPages);
+#if JUCE_LINUX
+    REQUIRE(getNumLockedKiB() == numKiBBefore + numLivePages * pageKiB);
+#endif
+
+    live.unlock();
+    REQUIRE(gris::HotMemory::getNumLockedPages() == numPagesBefore);
+    REQUIRE(live.getReport().numLockedBytes == 0);
+#if JUCE_LINUX
+    REQUIRE(getNumLockedKiB() == numKiBBefore);
+#endif
+}
+
+TEST_CASE("tagged audio buffers track the channels that were written to", "[core]")
+{
+    using gris::output_patch_t;
+    static constexpr int numSamples{ 32 };
+    auto const isSilent = [](float const * samples) {
+        return std::all_of(samples, samples + numSamples, [](float const sample) { return sample == 0.0f; });
+    };
+
+    gris::SpeakerAudioBuffer speakers{};
+    speakers.init(juce::Array<output_patch_t>{ output_patch_t{ 1 }, output_patch_t{ 2 }, output_patch_t{ 3 } });
+    speakers.setNumSamples(numSamples);
+    auto const & constSpeakers{ speakers };
+    auto const isAnyDirty = [&] {
+        return std::any_of(constSpeakers.cbegin(), constSpeakers.cend(), [&](auto const & speaker) {
+            return speakers.isDirty(speaker.key);
+        });
+    };
+    REQUIRE(!isAnyDirty());
+
+    // Reading and iterating never mark a channel.
+    for (auto const & speaker : speakers)
+        REQUIRE(isSilent(speaker.value->getReadPointer(0)));
+    REQUIRE(isSilent(constSpeakers.getChannel(output_patch_t{ 1 })));
+    REQUIRE(isSilent(constSpeakers[output_patch_t{ 2 }].getReadPointer(0)));
+    REQUIRE(!isAnyDirty());
+
+    // Every mutable accessor does.
+    speakers.getChannel(output_patch_t{ 1 })[0] = 1.0f;
+    speakers[output_patch_t{ 2 }].getWritePointer(0)[1] = 2.0f;
+    REQUIRE(speakers.isDirty(output_patch_t{ 1 }));
+    REQUIRE(speakers.isDirty(output_patch_t{ 2 }));
+    REQUIRE(!speakers.isDirty(output_patch_t{ 3 }));
+    speakers.getRawChannels()[2][2] = 3.0f;
+    speakers.markDirty(output_patch_t{ 3 });
+    REQUIRE(speakers.isDirty(output_patch_t{ 3 }));
+
+    // The clean channels are zero-filled rather than copied.
+    speakers.silence(output_patch_t{ 3 });
+    REQUIRE(!speakers.isDirty(output_patch_t{ 3 }));
+    std::vector<std::vector<float>> outputs(3, std::vector<float>(numSamples, 9.0f));
+    std::vector<float *> outs{ outputs[0].data(), outputs[1].data(), outputs[2].data() };
+    speakers.copyToPhysicalOutput(outs.data(), static_cast<int>(outs.size()));
+    REQUIRE(outputs[0][0] == 1.0f);
+    REQUIRE(outputs[1][1] == 2.0f);
+    REQUIRE(isSilent(outputs[2].data()));
+
+    // silence() clears the dirty channels and forgets about them.
+    speakers.silence();
+    REQUIRE(!isAnyDirty());
+    for (auto const & speaker : speakers)
+        REQUIRE(isSilent(speaker.value->getReadPointer(0)));
+}
+
+TEST_CASE("tagged audio buffers can be bound to external channels", "[core]")
+{
+    using gris::output_patch_t;
+    using gris::source_index_t;
+    static constexpr int numSamples{ 64 };
+    auto const isSilent = [](float const * samples) {
+        return std::all_of(samples, samples + numSamples, [](float const sample) { return sample == 0.0f; });
+    };
+
+    // Speakers are bound to writable memory, such as the host's outputs.
+    gris::SpeakerAudioBuffer speakers{};
+    speakers.init(juce::Array<output_patch_t>{ output_patch_t{ 1 }, output_patch_t{ 2 }, output_patch_t{ 3 } });
+    speakers.setNumSamples(numSamples);
+    auto const & constSpeakers{ speakers };
+
+    std::vector<std::vector<float>> outputs(2, std::vector<float>(numSamples, 0.5f));
+    std::vector<float *> outs{ outputs[0].data(), outputs[1].data() };
+    speakers.bindAll(outs.data(), static_cast<int>(outs.size()));
+    REQUIRE(speakers.isBound(output_patch_t{ 1 }));
+    REQUIRE(speakers.isBound(output_patch_t{ 2 }));
+    REQUIRE(!speakers.isBound(output_patch_t{ 3 }));
+    REQUIRE(!speakers.isReadOnly(output_patch_t{ 1 }));
+    // Nothing is known about the external memory.
+    REQUIRE(speakers.isDirty(output_patch_t{ 1 }));
+    REQUIRE(!speakers.isDirty(output_patch_t{ 3 }));
+
+    speakers.getChannel(output_patch_t{ 2 })[0] = 2.0f;
+    REQUIRE(outputs[1][0] == 2.0f);
+
+    // Bound writable channels are cleared in place.
+    speakers.silence();
+    REQUIRE(isSilent(outputs[0].data()));
+    REQUIRE(isSilent(outputs[1].data()));
+    REQUIRE(speakers.isBound(output_patch_t{ 1 }));
+    REQUIRE(!speakers.isDirty(output_patch_t{ 1 }));
+
+    speakers.unbindAll();
+    REQUIRE(!speakers.isBound(output_patch_t{ 1 }));
+    REQUIRE(constSpeakers.getChannel(output_patch_t{ 1 }) != outputs[0].data());
+    // Whatever was left in the slab before the binding is dirty again.
+    REQUIRE(speakers.isDirty(output_patch_t{ 1 }));
+    speakers.silence();
+    REQUIRE(isSilent(constSpeakers.getChannel(output_patch_t{ 1 })));
+
+    // Sources can be bound to read-only memory, such as the host's inputs.
+    gris::SourceAudioBuffer sources{};
+    sources.init(juce::Array<source_index_t>{ source_index_t{ 1 }, source_index_t{ 2 } });
+    sources.setNumSamples(numSamples);
+    auto const & constSources{ sources };
+
+    std::vector<float> const input(numSamples, 0.25f);
+    std::vector<float const *> const ins{ input.data(), input.data() };
+    sources.bindAll(ins.data(), static_cast<int>(ins.size()));
+    REQUIRE(sources.isReadOnly(source_index_t{ 1 }));
+    REQUIRE(constSources.getChannel(source_index_t{ 1 }) == input.data());
+    REQUIRE(constSources[source_index_t{ 2 }].getReadPointer(0) == input.data());
+
+    // Read-only channels are given their own memory back instead of being cleared.
+    sources.silence(source_index_t{ 1 });
+    REQUIRE(!sources.isBound(source_index_t{ 1 }));
+    REQUIRE(!sources.isDirty(source_index_t{ 1 }));
+    REQUIRE(isSilent(constSources.getChannel(source_index_t{ 1 })));
+    REQUIRE(sources.isBound(source_index_t{ 2 }));
+
+    sources.silence();
+    REQUIRE(!sources.isBound(source_index_t{ 2 }));
+    REQUIRE(isSilent(constSources.getChannel(source_index_t{ 2 })));
+    REQUIRE(std::all_of(input.cbegin(), input.cend(), [](float const sample) { return sample == 0.25f; }));
+    sources.unbindAll();
+}
+
+//==============================================================================
+TEST_CASE("the parallelism governor only switches past its hysteresis", "[core]")
+{
+    using gris::ParallelismGovernor;
+    static constexpr auto ENTER{ ParallelismGovernor::ENTER_PARALLEL_WORK };
+    static constexpr auto LEAVE{ ParallelismGovernor::LEAVE_PARALLEL_WORK };
+    static constexpr auto BETWEEN{ (ENTER + LEAVE) / 2.0 };
+
+    ParallelismGovernor governor{ 8 };
+
+    // A serial block needs more than ENTER to go parallel.
+    REQUIRE(governor.update(0.0) == 0);
+    REQUIRE(governor.update(BETWEEN) == 0);
+    REQUIRE(governor.update(ENTER) == 0);
+
+    // A parallel block stays parallel until it drops below LEAVE.
+    REQUIRE(governor.update(ENTER * 1.25) == 2);
+    REQUIRE(governor.update(BETWEEN) == 2);
+    REQUIRE(governor.update(LEAVE) == 2);
+    REQUIRE(governor.update(LEAVE * 0.5) == 0);
+    REQUIRE(governor.update(BETWEEN) == 0);
+
+    // The number of workers grows with the work, up to the maximum.
+    REQUIRE(governor.update(ParallelismGovernor::WORK_PER_WORKER * 5.5) == 5);
+    REQUIRE(governor.update(ParallelismGovernor::WORK_PER_WORKER * 100.0) == 8);
+
+    auto const stats{ governor.getStats() };
+    REQUIRE(stats.numSerialBlocks == 5);
+    REQUIRE(stats.numParallelBlocks == 5);
+    REQUIRE(stats.numSwitches == 3);
+    REQUIRE(stats.lastNumWorkers == 8);
+
+    // With a single worker, there is no one to share the work with.
+    ParallelismGovernor singleWorkerGovernor{ 1 };
+    REQUIRE(singleWorkerGovernor.update(ENTER * 100.0) == 0);
+}
+
+#if ENABLE_BENCHMARKS
+/** Compares the cost of publishing and reading a value of NUM_FLOATS floats through every updater. */
+template<std::size_t NUM_FLOATS>
+static void benchmarkUpdaters(std::string const & payloadName)
+{
+    using Value = std::array<float, NUM_FLOATS>;
+
+    auto const benchmarkUpdater = [&](auto & updater, std::string const & updaterName) {
+        std::cout << updaterName << "<" << payloadName << "> : " << sizeof(updater) << " bytes" << std::endl;
+
+        using Updater = std::remove_reference_t<decltype(updater)>;
+        typename Updater::Token * readerToken{};
+        auto value{ 0.0f };
+        BENCHMARK(updaterName + " publish (" + payloadName + ")")
+        {
+            auto * token{ updater.acquire() };
+            token->get().fill(value);
+            value += 1.0f;
+            updater.setMostRecent(token);
+        };
+        BENCHMARK(updaterName + " publish and read (" + payloadName + ")")
+        {
+            auto * token{ updater.acquire() };
+            token->get().fill(value);
+            value += 1.0f;
+            updater.setMostRecent(token);
+            updater.getMostRecent(readerToken);
+            return readerToken->get().back();
+        };
+    };
+
+    gris::AtomicUpdater<Value> atomicUpdater{};
+    benchmarkUpdater(atomicUpdater, "AtomicUpdater");
+    gris::LatestWinsUpdater<Value> latestWinsUpdater{};
+    benchmarkUpdater(latestWinsUpdater, "LatestWinsUpdater");
+    gris::TripleBuffer<Value> tripleBuffer{};
+    benchmarkUpdater(tripleBuffer, "TripleBuffer");
+    gris::SeqLock<Value> seqLock{};
+    benchmarkUpdater(seqLock, "SeqLock");
+}
+
+TEST_CASE("Updaters publish and read latency", "[core][!benchmark]")
+{
+    // The size of a DopplerSpatData and of a SpeakersSpatGains.
+    benchmarkUpdaters<2>("2 floats");
+    benchmarkUpdaters<gris::MAX_NUM_SPEAKERS>(std::to_string(gris::MAX_NUM_SPEAKERS) + " floats");
+}
+#endif
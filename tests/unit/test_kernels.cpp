@@ -0,0 +1,394 @@
+#include <catch2/catch_all.hpp>
+#include <tests/sg_TestUtils.hpp>
+#include <sg_Kernels.hpp>
+#include <sg_SpeakerHighpassBank.hpp>
+#include <sg_SpeakerOutputStage.hpp>
+#include <vector>
+
+using namespace gris;
+using namespace gris::tests;
+
+static constexpr int numKernelSamples{ SourceAudioBuffer::MAX_NUM_SAMPLES };
+
+static std::vector<float> makeKernelInput()
+{
+    std::vector<float> samples(numKernelSamples);
+    std::mt19937 generator{ 42 };
+    std::uniform_real_distribution<float> distribution{ -1.0f, 1.0f };
+    for (auto & sample : samples)
+        sample = distribution(generator);
+    return samples;
+}
+
+static void requireSameSamples(std::vector<float> const & expected, std::vector<float> const & actual)
+{
+    REQUIRE(expected.size() == actual.size());
+    for (size_t i{}; i < expected.size(); ++i)
+        REQUIRE_THAT(actual[i], Catch::Matchers::WithinAbs(expected[i], 1e-5f));
+}
+
+TEST_CASE("Kernel ISA selection", "[kernels]")
+{
+    auto const detectedIsa{ detectKernelIsa() };
+    INFO("Detected ISA: " << kernelIsaToString(detectedIsa));
+
+    REQUIRE(isKernelIsaSupported(KernelIsa::generic));
+    REQUIRE(isKernelIsaSupported(detectedIsa));
+
+    for (size_t index{}; index < NUM_KERNEL_ISAS; ++index) {
+        auto const isa{ static_cast<KernelIsa>(index) };
+        REQUIRE(stringToKernelIsa(kernelIsaToString(isa)) == isa);
+    }
+    REQUIRE(!stringToKernelIsa("neon"));
+
+    // the override is capped to what the CPU supports
+    auto const previousIsa{ getActiveKernelIsa() };
+    REQUIRE(setActiveKernelIsa(KernelIsa::generic) == KernelIsa::generic);
+    REQUIRE(getMixKernels().isa == KernelIsa::generic);
+    REQUIRE(setActiveKernelIsa(KernelIsa::avx512) == detectedIsa);
+    setActiveKernelIsa(previousIsa);
+}
+
+TEST_CASE("Mix kernels match the generic variant", "[kernels]")
+{
+    auto const input{ makeKernelInput() };
+    auto const & reference{ getMixKernels(KernelIsa::generic) };
+
+    for (size_t index{}; index < NUM_KERNEL_ISAS; ++index) {
+        auto const isa{ static_cast<KernelIsa>(index) };
+        if (!isKernelIsaSupported(isa))
+            continue;
+        INFO("ISA: " << kernelIsaToString(isa));
+        auto const & kernels{ getMixKernels(isa) };
+
+        // odd sizes exercise the remainders of the vectorized loops
+        for (auto const numSamples : { 1, 7, 33, 512, numKernelSamples }) {
+            std::vector<float> expected(numKernelSamples, 0.5f);
+            std::vector<float> actual(numKernelSamples, 0.5f);
+
+            reference.addWithGain(expected.data(), input.data(), 0.7f, numSamples);
+            kernels.addWithGain(actual.data(), input.data(), 0.7f, numSamples);
+            requireSameSamples(expected, actual);
+
+            auto const slope{ 0.5f / static_cast<float>(numSamples) };
+            auto const expectedLinearGain{
+                reference.addWithLinearRamp(expected.data(), input.data(), 0.2f, slope, numSamples)
+            };
+            auto const actualLinearGain{
+                kernels.addWithLinearRamp(actual.data(), input.data(), 0.2f, slope, numSamples)
+            };
+            REQUIRE_THAT(actualLinearGain, Catch::Matchers::WithinAbs(expectedLinearGain, 1e-6f));
+            REQUIRE_THAT(actualLinearGain, Catch::Matchers::WithinAbs(0.7f, 1e-5f));
+            requireSameSamples(expected, actual);
+
+            auto const expectedSmoothedGain{
+                reference.addWithSmoothedRamp(expected.data(), input.data(), 0.2f, 0.9f, 0.995f, numSamples)
+            };
+            auto const actualSmoothedGain{
+                kernels.addWithSmoothedRamp(actual.data(), input.data(), 0.2f, 0.9f, 0.995f, numSamples)
+            };
+            REQUIRE_THAT(actualSmoothedGain, Catch::Matchers::WithinAbs(expectedSmoothedGain, 1e-6f));
+            requireSameSamples(expected, actual);
+
+            auto const expectedFadeOutGain{ reference.addWithSmoothedFadeOut(expected.data(),
+                                                                             input.data(),
+                                                                             0.8f,
+                                                                             0.0f,
+                                                                             0.99f,
+                                                                             SMALL_GAIN,
+                                                                             numSamples) };
+            auto const actualFadeOutGain{
+                kernels.addWithSmoothedFadeOut(actual.data(), input.data(), 0.8f, 0.0f, 0.99f, SMALL_GAIN, numSamples)
+            };
+            REQUIRE_THAT(actualFadeOutGain, Catch::Matchers::WithinAbs(expectedFadeOutGain, 1e-6f));
+            requireSameSamples(expected, actual);
+        }
+    }
+}
+
+TEST_CASE("Fixed speaker kernels match the per-speaker kernels", "[kernels]")
+{
+    REQUIRE(getFixedSpeakerCountIndex(16) == 1);
+    REQUIRE(!getFixedSpeakerCountIndex(17));
+    REQUIRE(!getFixedSpeakerCountIndex(MAX_NUM_SPEAKERS));
+
+    auto const input{ makeKernelInput() };
+    auto const & reference{ getMixKernels(KernelIsa::generic) };
+
+    for (size_t index{}; index < NUM_KERNEL_ISAS; ++index) {
+        auto const isa{ static_cast<KernelIsa>(index) };
+        if (!isKernelIsaSupported(isa))
+            continue;
+        INFO("ISA: " << kernelIsaToString(isa));
+        auto const & kernels{ getMixKernels(isa) };
+
+        for (size_t countIndex{}; countIndex < FIXED_SPEAKER_COUNTS.size(); ++countIndex) {
+            auto const numSpeakers{ FIXED_SPEAKER_COUNTS[countIndex] };
+            INFO("Speakers: " << numSpeakers);
+            for (auto const numSamples : { 1, 100, numKernelSamples }) {
+                std::vector<std::vector<float>> expected(numSpeakers, std::vector<float>(numKernelSamples, 0.25f));
+                std::vector<std::vector<float>> actual(expected);
+                std::vector<float *> dests(numSpeakers);
+                std::vector<float> gains(numSpeakers);
+                std::vector<float> slopes(numSpeakers);
+
+                // every third speaker is skipped, every other one ramps
+                for (size_t speaker{}; speaker < numSpeakers; ++speaker) {
+                    gains[speaker] = static_cast<float>(speaker + 1) / static_cast<float>(numSpeakers);
+                    slopes[speaker] = speaker % 2 == 0 ? 0.0f : -gains[speaker] / static_cast<float>(numSamples);
+                    if (speaker % 3 == 2)
+                        continue;
+                    dests[speaker] = actual[speaker].data();
+                    reference.addWithLinearRamp(expected[speaker].data(),
+                                                input.data(),
+                                                gains[speaker],
+                                                slopes[speaker],
+                                                numSamples);
+                }
+
+                kernels.addToFixedSpeakers[countIndex](dests.data(),
+                                                       input.data(),
+                                                       gains.data(),
+                                                       slopes.data(),
+                                                       numSamples);
+                for (size_t speaker{}; speaker < numSpeakers; ++speaker)
+                    requireSameSamples(expected[speaker], actual[speaker]);
+            }
+        }
+    }
+}
+
+TEST_CASE("Lagrange reads interpolate cubics exactly and wrap around", "[kernels]")
+{
+    // A 3rd order Lagrange interpolator reproduces any cubic polynomial.
+    static constexpr int lineSize{ 16 };
+    static constexpr int mask{ lineSize - 1 };
+    auto const cubic = [](double const x) {
+        return static_cast<float>(0.01 * x * x * x - 0.1 * x * x + 0.3 * x - 0.5);
+    };
+    std::vector<float> line(lineSize);
+    for (int i{}; i < lineSize; ++i)
+        line[static_cast<size_t>(i)] = cubic(i);
+
+    for (double position{ 1.0 }; position <= lineSize - 3; position += 0.125)
+        REQUIRE_THAT(readLagrange(line.data(), mask, position), Catch::Matchers::WithinAbs(cubic(position), 1e-5f));
+
+    // Whole positions return the samples themselves.
+    REQUIRE(readLagrange(line.data(), mask, 5.0) == line[5]);
+
+    // Negative positions read from the end of the line.
+    std::vector<float> ramp(lineSize);
+    for (int i{}; i < lineSize; ++i)
+        ramp[static_cast<size_t>(i)] = static_cast<float>((i + 4) & mask);
+    REQUIRE_THAT(readLagrange(ramp.data(), mask, -2.5), Catch::Matchers::WithinAbs(1.5f, 1e-5f));
+}
+
+TEST_CASE("Speaker high-passes match the per-speaker filter", "[kernels]")
+{
+    // Patches 1 to 4 share a group in which only patch 2 is filtered. Patch 5 is filtered and patch 6 isn't.
+    static constexpr int numSpeakers{ 6 };
+    static constexpr int numSamples{ 256 };
+    static constexpr float masterGain{ 0.5f };
+    auto const highpassConfig{ SpeakerHighpassData{ hz_t{ 120.0f } }.toConfig(48000.0) };
+
+    SpeakersAudioConfig speakersAudioConfig{};
+    juce::Array<output_patch_t> patches{};
+    for (int i{ 1 }; i <= numSpeakers; ++i) {
+        output_patch_t const patch{ i };
+        SpeakerAudioConfig speaker{};
+        speaker.gain = static_cast<float>(i) / static_cast<float>(numSpeakers);
+        speaker.isMuted = i == 3;
+        if (i == 2 || i == 5)
+            speaker.highpassConfig = highpassConfig;
+        speakersAudioConfig.add(patch, speaker);
+        patches.add(patch);
+    }
+
+    SpeakerHighpassBank bank{};
+    bank.setConfig(speakersAudioConfig);
+    SpeakerOutputStage outputStage{};
+    outputStage.setConfig(speakersAudioConfig);
+
+    SpeakerAudioBuffer speakersBuffer{};
+    speakersBuffer.init(patches);
+    speakersBuffer.setNumSamples(numSamples);
+
+    std::vector<ColdSpeakerHighpass> states(numSpeakers);
+    juce::Random random{};
+    std::mt19937 generator{ 42 };
+    std::uniform_real_distribution<float> distribution{ -1.0f, 1.0f };
+
+    // A few blocks, so that the filters' state is carried over.
+    for (int block{}; block < 3; ++block) {
+        std::vector<std::vector<float>> expected(numSpeakers, std::vector<float>(numSamples));
+        for (int i{}; i < numSpeakers; ++i) {
+            output_patch_t const patch{ i + 1 };
+            auto & channel{ expected[static_cast<size_t>(i)] };
+            for (auto & sample : channel)
+                sample = distribution(generator);
+            std::copy(channel.cbegin(), channel.cend(), speakersBuffer.getChannel(patch));
+            if (auto const & config{ speakersAudioConfig[patch].highpassConfig })
+                config->process(channel.data(), numSamples, states[static_cast<size_t>(i)], random);
+        }
+
+        std::vector<std::vector<float>> outputs(numSpeakers, std::vector<float>(numSamples));
+        std::vector<float *> outs{};
+        for (auto & output : outputs)
+            outs.push_back(output.data());
+        SpeakerPeaks peaks{};
+        outputStage.process(speakersAudioConfig, masterGain, speakersBuffer, outs.data(), numSpeakers, peaks);
+
+        bank.process(speakersBuffer);
+
+        for (int i{}; i < numSpeakers; ++i) {
+            output_patch_t const patch{ i + 1 };
+            INFO("Block " << block << ", patch " << i + 1);
+            auto const & speaker{ speakersAudioConfig[patch] };
+            auto const gain{ speaker.isMuted ? 0.0f : speaker.gain * masterGain };
+            auto const & reference{ expected[static_cast<size_t>(i)] };
+
+            std::vector<float> const filtered(speakersBuffer.getChannel(patch),
+                                              speakersBuffer.getChannel(patch) + numSamples);
+            requireSameSamples(reference, filtered);
+
+            auto scaled{ reference };
+            float peak{};
+            for (auto & sample : scaled) {
+                sample *= gain;
+                peak = std::max(peak, std::abs(sample));
+            }
+            requireSameSamples(scaled, outputs[static_cast<size_t>(i)]);
+            REQUIRE_THAT(peaks[patch], Catch::Matchers::WithinAbs(peak, 1e-5f));
+        }
+    }
+}
+
+TEST_CASE("Speaker high-pass bank keeps the state of the filters that did not change", "[kernels]")
+{
+    static constexpr int numSpeakers{ 5 };
+    static constexpr int numSamples{ 128 };
+
+    SpeakersAudioConfig speakersAudioConfig{};
+    juce::Array<output_patch_t> patches{};
+    for (int i{ 1 }; i <= numSpeakers; ++i) {
+        speakersAudioConfig.add(output_patch_t{ i }, SpeakerAudioConfig{});
+        patches.add(output_patch_t{ i });
+    }
+    auto const setHighpass = [&](int const patch, tl::optional<float> const freq) {
+        auto & highpassConfig{ speakersAudioConfig[output_patch_t{ patch }].highpassConfig };
+        highpassConfig = freq.map([](float const value) {
+            return SpeakerHighpassData{ hz_t{ value } }.toConfig(48000.0);
+        });
+    };
+
+    SpeakerHighpassBank bank{};
+    SpeakerAudioBuffer speakersBuffer{};
+    speakersBuffer.init(patches);
+    speakersBuffer.setNumSamples(numSamples);
+
+    std::vector<ColdSpeakerHighpass> states(numSpeakers);
+    juce::Random random{};
+    std::mt19937 generator{ 42 };
+    std::uniform_real_distribution<float> distribution{ -1.0f, 1.0f };
+
+    auto const processAndCompare = [&] {
+        std::vector<std::vector<float>> expected(numSpeakers, std::vector<float>(numSamples));
+        for (int i{}; i < numSpeakers; ++i) {
+            output_patch_t const patch{ i + 1 };
+            auto & channel{ expected[static_cast<size_t>(i)] };
+            for (auto & sample : channel)
+                sample = distribution(generator);
+            std::copy(channel.cbegin(), channel.cend(), speakersBuffer.getChannel(patch));
+            if (auto const & config{ speakersAudioConfig[patch].highpassConfig })
+                config->process(channel.data(), numSamples, states[static_cast<size_t>(i)], random);
+        }
+
+        bank.process(speakersBuffer);
+
+        for (int i{}; i < numSpeakers; ++i) {
+            output_patch_t const patch{ i + 1 };
+            INFO("Patch " << i + 1);
+            std::vector<float> const filtered(speakersBuffer.getChannel(patch),
+                                              speakersBuffer.getChannel(patch) + numSamples);
+            requireSameSamples(expected[static_cast<size_t>(i)], filtered);
+        }
+    };
+
+    // Patches 1, 2 and 5 are filtered : the first group is partially active.
+    setHighpass(1, 100.0f);
+    setHighpass(2, 100.0f);
+    setHighpass(5, 100.0f);
+    bank.setConfig(speakersAudioConfig);
+    processAndCompare();
+
+    // Loading the same configuration again keeps the state.
+    bank.setConfig(speakersAudioConfig);
+    processAndCompare();
+
+    // A new config for patch 2 and a new high-pass for patch 3 start from silence. Patch 5 becomes a pass-through.
+    setHighpass(2, 200.0f);
+    setHighpass(3, 80.0f);
+    setHighpass(5, tl::nullopt);
+    states[1].resetValues();
+    states[2].resetValues();
+    bank.setConfig(speakersAudioConfig);
+    processAndCompare();
+    processAndCompare();
+}
+
+#if ENABLE_BENCHMARKS
+TEST_CASE("Mix kernels throughput per ISA", "[kernels][!benchmark]")
+{
+    auto const input{ makeKernelInput() };
+    std::vector<float> output(numKernelSamples);
+    auto const slope{ 0.5f / static_cast<float>(numKernelSamples) };
+
+    // Every benchmark mixes numKernelSamples samples, so the throughput of the ISAs can be compared directly.
+    for (size_t index{}; index < NUM_KERNEL_ISAS; ++index) {
+        auto const isa{ static_cast<KernelIsa>(index) };
+        if (!isKernelIsaSupported(isa))
+            continue;
+        auto const & kernels{ getMixKernels(isa) };
+        auto const suffix{ " (" + kernelIsaToString(isa).toStdString() + ")" };
+
+        BENCHMARK("addWithGain" + suffix)
+        {
+            kernels.addWithGain(output.data(), input.data(), 0.7f, numKernelSamples);
+            return output.front();
+        };
+        BENCHMARK("addWithLinearRamp" + suffix)
+        {
+            return kernels.addWithLinearRamp(output.data(), input.data(), 0.2f, slope, numKernelSamples);
+        };
+        BENCHMARK("addWithSmoothedRamp" + suffix)
+        {
+            return kernels.addWithSmoothedRamp(output.data(), input.data(), 0.2f, 0.9f, 0.995f, numKernelSamples);
+        };
+
+        // a fixed layout of 32 speakers, compared to 32 calls to addWithGain
+        static constexpr size_t numFixedSpeakers{ 32 };
+        std::vector<float> fixedOutputs(numFixedSpeakers * numKernelSamples);
+        std::vector<float *> dests(numFixedSpeakers);
+        for (size_t speaker{}; speaker < numFixedSpeakers; ++speaker)
+            dests[speaker] = fixedOutputs.data() + speaker * numKernelSamples;
+        std::vector<float> const gains(numFixedSpeakers, 0.7f);
+        std::vector<float> const slopes(numFixedSpeakers, 0.0f);
+
+        BENCHMARK("addWithGain x32" + suffix)
+        {
+            for (auto * dest : dests)
+                kernels.addWithGain(dest, input.data(), 0.7f, numKernelSamples);
+            return fixedOutputs.front();
+        };
+        BENCHMARK("addToFixedSpeakers<32>" + suffix)
+        {
+            kernels.addToFixedSpeakers[*getFixedSpeakerCountIndex(numFixedSpeakers)](dests.data(),
+                                                                                      input.data(),
+                                                                                      gains.data(),
+                                                                                      slopes.data(),
+                                                                                      numKernelSamples);
+            return fixedOutputs.front();
+        };
+    }
+}
+#endif
@@ -1,6 +1,19 @@
 #include <catch2/catch_all.hpp>
 #include <tests/sg_TestUtils.hpp>
 #include <sg_AbstractSpatAlgorithm.hpp>
+#include <sg_AsyncSpatAlgorithmBuilder.hpp>
+#include <sg_ControlRateSpatAlgorithm.hpp>
+#include <sg_HotSwappableSpatAlgorithm.hpp>
+#include <sg_Kernels.hpp>
+#include <sg_VbapSpatAlgorithm.hpp>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
 #include "../../StructGRIS/ValueTreeUtilities.hpp"
 
 using namespace gris;
@@ -251,31 +264,40 @@ static void benchmarkUsingProjectData(gris::SpatGrisData & data,
     fillSourceBuffersWithNoise(numSources, sourceBuffer, bufferSize, sourcePeaks);
     checkSourceBufferValidity(sourceBuffer);
 
-    // process the audio
-    BENCHMARK("processing loop")
-    {
-        // catch2 will run this benchmark section in a loop, so we need to clear the output buffers before each run
-        speakerBuffer.silence();
-        stereoBuffer.clear();
+    // process the audio, once per instruction set that the kernels can use
+    auto const previousIsa{ getActiveKernelIsa() };
+    for (size_t isaIndex{}; isaIndex < NUM_KERNEL_ISAS; ++isaIndex) {
+        auto const isa{ static_cast<KernelIsa>(isaIndex) };
+        if (!isKernelIsaSupported(isa))
+            continue;
+        setActiveKernelIsa(isa);
+
+        BENCHMARK("processing loop (" + kernelIsaToString(isa).toStdString() + ")")
+        {
+            // catch2 will run this benchmark section in a loop, so we need to clear the output buffers before each run
+            speakerBuffer.silence();
+            stereoBuffer.clear();
 
     #if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
-        algo->silenceForkUnionBuffer(forkUnionBuffer);
+            algo->silenceForkUnionBuffer(forkUnionBuffer);
     #endif
 
-        algo->process(*config,
-                      sourceBuffer,
-                      speakerBuffer,
+            algo->process(*config,
+                          sourceBuffer,
+                          speakerBuffer,
     #if SG_USE_FORK_UNION
         #if SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS
-                      forkUnionBuffer,
+                          forkUnionBuffer,
         #elif SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD
-                      forkUnionBuffer,
+                          forkUnionBuffer,
         #endif
     #endif
-                      stereoBuffer,
-                      sourcePeaks,
-                      nullptr);
-    };
+                          stereoBuffer,
+                          sourcePeaks,
+                          nullptr);
+        };
+    }
+    setActiveKernelIsa(previousIsa);
 #endif
 }
 
@@ -394,6 +416,132 @@ TEST_CASE(stereoTestName, "[spat]")
                               sourcePeaks);
 }
 
+TEST_CASE(stereoSkippedInnerRenderTestName, "[spat]")
+{
+    SpatGrisData data = getSpatGrisDataFromFiles("default_preset.xml", "default_speaker_setup.xml");
+    data.project.spatMode = SpatMode::vbap;
+    data.appData.stereoMode = StereoMode::stereo;
+    // Linear ramps land exactly on their targets at the end of a block.
+    data.project.spatGainsInterpolation = 0.0f;
+
+    data.appData.renderSpeakersInStereo = true;
+    auto const renderedConfig{ data.toAudioConfig() };
+    data.appData.renderSpeakersInStereo = false;
+    auto const skippedConfig{ data.toAudioConfig() };
+    REQUIRE(!renderedConfig->isStereoInnerRenderSkipped);
+    REQUIRE(skippedConfig->isStereoInnerRenderSkipped);
+
+    auto const numSources{ renderedConfig->sourcesAudioConfig.size() };
+    auto const numSpeakers{ renderedConfig->speakersAudioConfig.size() };
+    auto const speakerKeys{ renderedConfig->speakersAudioConfig.getKeys() };
+    auto const bufferSize{ 512 };
+    auto const sampleRate{ data.appData.audioSettings.sampleRate };
+
+    // The reference always renders its speakers, the other one skips them for a while.
+    SourceAudioBuffer sourceBuffer;
+    SpeakerAudioBuffer referenceSpeakerBuffer;
+    SpeakerAudioBuffer skippedSpeakerBuffer;
+#if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
+    ForkUnionBuffer forkUnionBuffer;
+#endif
+    juce::AudioBuffer<float> referenceStereoBuffer;
+    juce::AudioBuffer<float> skippedStereoBuffer;
+    SourcePeaks sourcePeaks;
+
+    initBuffers(bufferSize,
+                numSources,
+                numSpeakers,
+                sourceBuffer,
+                referenceSpeakerBuffer,
+#if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
+                forkUnionBuffer,
+#endif
+                referenceStereoBuffer);
+    initBuffers(bufferSize,
+                numSources,
+                numSpeakers,
+                sourceBuffer,
+                skippedSpeakerBuffer,
+#if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
+                forkUnionBuffer,
+#endif
+                skippedStereoBuffer);
+
+    auto const makeAlgorithm = [&]() {
+        return AbstractSpatAlgorithm::make(data.speakerSetup,
+                                           SpatMode::vbap,
+                                           StereoMode::stereo,
+                                           data.project.sources,
+                                           sampleRate,
+                                           bufferSize);
+    };
+    auto reference{ makeAlgorithm() };
+    auto skipped{ makeAlgorithm() };
+    distributeSourcesOnSphere(reference.get(), data);
+    distributeSourcesOnSphere(skipped.get(), data);
+
+    auto const moveSources = [&]() {
+        incrementAllSourcesAzimuth(reference.get(), data, TWO_PI / bufferSize);
+        for (auto const & source : data.project.sources) {
+            skipped->updateSpatData(source.key, *source.value);
+        }
+    };
+
+    auto const processBlock = [&](AbstractSpatAlgorithm & algo,
+                                  AudioConfig const & config,
+                                  SpeakerAudioBuffer & speakerBuffer,
+                                  juce::AudioBuffer<float> & stereoBuffer) {
+        speakerBuffer.silence();
+        stereoBuffer.clear();
+#if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
+        algo.silenceForkUnionBuffer(forkUnionBuffer);
+        algo.process(config, sourceBuffer, speakerBuffer, forkUnionBuffer, stereoBuffer, sourcePeaks, nullptr);
+#else
+        algo.process(config, sourceBuffer, speakerBuffer, stereoBuffer, sourcePeaks, nullptr);
+#endif
+    };
+
+    float lastPhase{ 0.f };
+    for (int i{}; i < 4; ++i) {
+        fillSourceBuffersWithSine(numSources, sourceBuffer, bufferSize, sourcePeaks, lastPhase);
+        processBlock(*reference, *renderedConfig, referenceSpeakerBuffer, referenceStereoBuffer);
+        processBlock(*skipped, *renderedConfig, skippedSpeakerBuffer, skippedStereoBuffer);
+    }
+
+    // While its inner render is skipped, the stereo reduction leaves the speakers alone and still sounds the same.
+    for (int i{}; i < 8; ++i) {
+        moveSources();
+        fillSourceBuffersWithSine(numSources, sourceBuffer, bufferSize, sourcePeaks, lastPhase);
+        processBlock(*reference, *renderedConfig, referenceSpeakerBuffer, referenceStereoBuffer);
+        processBlock(*skipped, *skippedConfig, skippedSpeakerBuffer, skippedStereoBuffer);
+
+        for (auto const & speaker : speakerKeys) {
+            REQUIRE(!skippedSpeakerBuffer.isDirty(speaker));
+        }
+        for (int channel{}; channel < 2; ++channel) {
+            for (int sample{}; sample < bufferSize; ++sample) {
+                REQUIRE_THAT(skippedStereoBuffer.getSample(channel, sample),
+                             Catch::Matchers::WithinAbs(referenceStereoBuffer.getSample(channel, sample), 1e-6f));
+            }
+        }
+    }
+
+    // Once resumed, the inner render starts on the current gains instead of ramping from the ones it had stopped on.
+    fillSourceBuffersWithSine(numSources, sourceBuffer, bufferSize, sourcePeaks, lastPhase);
+    processBlock(*reference, *renderedConfig, referenceSpeakerBuffer, referenceStereoBuffer);
+    processBlock(*skipped, *renderedConfig, skippedSpeakerBuffer, skippedStereoBuffer);
+
+    SpeakerAudioBuffer const & constReferenceSpeakerBuffer{ referenceSpeakerBuffer };
+    SpeakerAudioBuffer const & constSkippedSpeakerBuffer{ skippedSpeakerBuffer };
+    for (auto const & speaker : speakerKeys) {
+        auto const * expected{ constReferenceSpeakerBuffer.getChannel(speaker) };
+        auto const * actual{ constSkippedSpeakerBuffer.getChannel(speaker) };
+        for (int sample{}; sample < bufferSize; ++sample) {
+            REQUIRE_THAT(actual[sample], Catch::Matchers::WithinAbs(expected[sample], 1e-5f));
+        }
+    }
+}
+
 TEST_CASE(mbapTestName, "[spat]")
 {
     SpatGrisData mbapData
@@ -435,6 +583,105 @@ TEST_CASE(mbapTestName, "[spat]")
                               sourcePeaks);
 }
 
+TEST_CASE(stereoMbapAttenuationTestName, "[spat]")
+{
+    SpatGrisData data
+        = getSpatGrisDataFromFiles("default_project18(8X2-Subs2).xml", "Cube_default_speaker_setup.xml");
+    data.project.spatMode = SpatMode::mbap;
+    data.appData.stereoMode = StereoMode::stereo;
+    data.appData.playerExists = false;
+    data.project.mbapDistanceAttenuationData.attenuation = dbfs_t{ -24.0f };
+
+    data.project.mbapDistanceAttenuationData.attenuationBypassState = AttenuationBypassSate::on;
+    auto const bypassedConfig{ data.toAudioConfig() };
+    data.project.mbapDistanceAttenuationData.attenuationBypassState = AttenuationBypassSate::off;
+    auto const attenuatedConfig{ data.toAudioConfig() };
+    REQUIRE(!bypassedConfig->mbapAttenuationConfig.shouldProcess);
+    REQUIRE(attenuatedConfig->mbapAttenuationConfig.shouldProcess);
+
+    auto const numSources{ attenuatedConfig->sourcesAudioConfig.size() };
+    auto const numSpeakers{ attenuatedConfig->speakersAudioConfig.size() };
+    auto const bufferSize{ 512 };
+    auto const sampleRate{ data.appData.audioSettings.sampleRate };
+
+    SourceAudioBuffer sourceBuffer;
+    SpeakerAudioBuffer speakerBuffer;
+#if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
+    ForkUnionBuffer forkUnionBuffer;
+#endif
+    juce::AudioBuffer<float> bypassedStereoBuffer;
+    juce::AudioBuffer<float> attenuatedStereoBuffer;
+    SourcePeaks sourcePeaks;
+
+    initBuffers(bufferSize,
+                numSources,
+                numSpeakers,
+                sourceBuffer,
+                speakerBuffer,
+#if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
+                forkUnionBuffer,
+#endif
+                bypassedStereoBuffer);
+    attenuatedStereoBuffer.setSize(2, bufferSize);
+
+    auto const makeAlgorithm = [&]() {
+        return AbstractSpatAlgorithm::make(data.speakerSetup,
+                                           SpatMode::mbap,
+                                           StereoMode::stereo,
+                                           data.project.sources,
+                                           sampleRate,
+                                           bufferSize);
+    };
+    auto bypassed{ makeAlgorithm() };
+    auto attenuated{ makeAlgorithm() };
+
+    // Every source sits far enough to get the whole attenuation.
+    auto azimuth{ 0.0f };
+    for (auto const & source : data.project.sources) {
+        source.value->position = PolarVector{ radians_t{ azimuth }, radians_t{ 0.3f }, MBAP_EXTENDED_RADIUS };
+        azimuth += 0.7f;
+        bypassed->updateSpatData(source.key, *source.value);
+        attenuated->updateSpatData(source.key, *source.value);
+    }
+
+    auto const processBlock = [&](AbstractSpatAlgorithm & algo,
+                                  AudioConfig const & config,
+                                  juce::AudioBuffer<float> & stereoBuffer) {
+        speakerBuffer.silence();
+        stereoBuffer.clear();
+#if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
+        algo.silenceForkUnionBuffer(forkUnionBuffer);
+        algo.process(config, sourceBuffer, speakerBuffer, forkUnionBuffer, stereoBuffer, sourcePeaks, nullptr);
+#else
+        algo.process(config, sourceBuffer, speakerBuffer, stereoBuffer, sourcePeaks, nullptr);
+#endif
+    };
+
+    // The first blocks ramp the attenuation in.
+    float lastPhase{ 0.f };
+    auto bypassedEnergy{ 0.0f };
+    auto attenuatedEnergy{ 0.0f };
+    for (int i{}; i < 8; ++i) {
+        fillSourceBuffersWithSine(numSources, sourceBuffer, bufferSize, sourcePeaks, lastPhase);
+        processBlock(*bypassed, *bypassedConfig, bypassedStereoBuffer);
+        processBlock(*attenuated, *attenuatedConfig, attenuatedStereoBuffer);
+        if (i < 4) {
+            continue;
+        }
+        for (int channel{}; channel < 2; ++channel) {
+            for (int sample{}; sample < bufferSize; ++sample) {
+                bypassedEnergy += std::pow(bypassedStereoBuffer.getSample(channel, sample), 2.0f);
+                attenuatedEnergy += std::pow(attenuatedStereoBuffer.getSample(channel, sample), 2.0f);
+            }
+        }
+    }
+
+    // The stereo reduction hears the sources at the attenuation's gain, like the speakers do.
+    auto const attenuationGain{ attenuatedConfig->mbapAttenuationConfig.linearGain };
+    REQUIRE(bypassedEnergy > 0.0f);
+    REQUIRE(attenuatedEnergy < bypassedEnergy * attenuationGain * attenuationGain * 1.5f);
+}
+
 TEST_CASE(hrtfTestName, "[spat]")
 {
     SpatGrisData hrtfData = getSpatGrisDataFromFiles("default_preset.xml", "BINAURAL_SPEAKER_SETUP.xml");
@@ -473,3 +720,571 @@ TEST_CASE(hrtfTestName, "[spat]")
                               stereoBuffer,
                               sourcePeaks);
 }
+
+TEST_CASE(activeSourcesTestName, "[spat]")
+{
+    SpatGrisData data = getSpatGrisDataFromFiles("default_preset.xml", "default_speaker_setup.xml");
+    data.project.spatMode = SpatMode::vbap;
+    data.appData.stereoMode = {};
+    // Linear ramps land exactly on their targets, so that the sources that do not move stop ramping.
+    data.project.spatGainsInterpolation = 0.0f;
+    // Without a span, a source never reaches more speakers than a ramp costs on a single one.
+    for (auto const & source : data.project.sources) {
+        source.value->azimuthSpan = 0.0f;
+        source.value->zenithSpan = 0.0f;
+    }
+
+    auto const config{ data.toAudioConfig() };
+    auto const numSources{ config->sourcesAudioConfig.size() };
+    auto const numSpeakers{ config->speakersAudioConfig.size() };
+    auto const sourceKeys{ config->sourcesAudioConfig.getKeys() };
+    auto const speakerKeys{ config->speakersAudioConfig.getKeys() };
+    auto const bufferSize{ 512 };
+    REQUIRE(numSources >= 4);
+
+    SourceAudioBuffer sourceBuffer;
+    SpeakerAudioBuffer speakerBuffer;
+#if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
+    ForkUnionBuffer forkUnionBuffer;
+#endif
+    juce::AudioBuffer<float> stereoBuffer;
+    SourcePeaks sourcePeaks;
+
+    initBuffers(bufferSize,
+                numSources,
+                numSpeakers,
+                sourceBuffer,
+                speakerBuffer,
+#if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
+                forkUnionBuffer,
+#endif
+                stereoBuffer);
+
+    VbapSpatAlgorithm algo{ data.speakerSetup.speakers };
+    VbapSpatAlgorithm reference{ data.speakerSetup.speakers };
+    distributeSourcesOnSphere(&algo, data);
+    distributeSourcesOnSphere(&reference, data);
+    float lastPhase{ 0.f };
+
+    // One muted source and one silent source.
+    auto const mutedSource{ sourceKeys[0] };
+    auto const silentSource{ sourceKeys[1] };
+    config->sourcesAudioConfig[mutedSource].isMuted = true;
+
+    // The reference renders the sources one at a time, in the order of the config, and sums them.
+    std::vector<std::vector<float>> expectedSpeakers(numSpeakers);
+    auto const renderBlock = [&]() {
+        fillSourceBuffersWithSine(numSources, sourceBuffer, bufferSize, sourcePeaks, lastPhase);
+        juce::FloatVectorOperations::clear(sourceBuffer[silentSource].getWritePointer(0), bufferSize);
+        sourcePeaks[silentSource] = 0.0f;
+
+        for (auto & expected : expectedSpeakers) {
+            expected.assign(narrow<std::size_t>(bufferSize), 0.0f);
+        }
+        for (auto const & source : config->sourcesAudioConfig) {
+            AudioConfig singleSourceConfig{ *config };
+            singleSourceConfig.sourcesAudioConfig.clear();
+            singleSourceConfig.sourcesAudioConfig.add(source.key, source.value);
+            speakerBuffer.silence();
+#if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
+            reference.silenceForkUnionBuffer(forkUnionBuffer);
+            reference.process(singleSourceConfig,
+                              sourceBuffer,
+                              speakerBuffer,
+                              forkUnionBuffer,
+                              stereoBuffer,
+                              sourcePeaks,
+                              nullptr);
+#else
+            reference.process(singleSourceConfig, sourceBuffer, speakerBuffer, stereoBuffer, sourcePeaks, nullptr);
+#endif
+            SpeakerAudioBuffer const & constSpeakerBuffer{ speakerBuffer };
+            for (int i{}; i < speakerKeys.size(); ++i) {
+                auto const * samples{ constSpeakerBuffer.getChannel(speakerKeys[i]) };
+                auto & expected{ expectedSpeakers[narrow<std::size_t>(i)] };
+                for (int sample{}; sample < bufferSize; ++sample) {
+                    expected[narrow<std::size_t>(sample)] += samples[sample];
+                }
+            }
+        }
+
+        speakerBuffer.silence();
+#if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
+        algo.silenceForkUnionBuffer(forkUnionBuffer);
+        algo.process(*config, sourceBuffer, speakerBuffer, forkUnionBuffer, stereoBuffer, sourcePeaks, nullptr);
+#else
+        algo.process(*config, sourceBuffer, speakerBuffer, stereoBuffer, sourcePeaks, nullptr);
+#endif
+        SpeakerAudioBuffer const & constSpeakerBuffer{ speakerBuffer };
+        for (int i{}; i < speakerKeys.size(); ++i) {
+            auto const * samples{ constSpeakerBuffer.getChannel(speakerKeys[i]) };
+            auto const & expected{ expectedSpeakers[narrow<std::size_t>(i)] };
+            for (int sample{}; sample < bufferSize; ++sample) {
+                REQUIRE_THAT(samples[sample], Catch::Matchers::WithinAbs(expected[narrow<std::size_t>(sample)], 1e-5f));
+            }
+        }
+    };
+
+    // Let the gains settle, so that the next block only ramps the sources that move.
+    renderBlock();
+    renderBlock();
+    auto const firstMovingSource{ sourceKeys[2] };
+    auto const secondMovingSource{ sourceKeys[3] };
+    for (auto const & sourceIndex : { firstMovingSource, secondMovingSource }) {
+        auto & source{ data.project.sources[sourceIndex] };
+        source.position = source.position->withAzimuth(source.position->getPolar().azimuth + radians_t{ 0.3f });
+        algo.updateSpatData(sourceIndex, source);
+        reference.updateSpatData(sourceIndex, source);
+    }
+    renderBlock();
+
+    // The muted and the silent sources were dropped.
+    auto activeSources{ algo.getActiveSources() };
+    REQUIRE(activeSources.size() == numSources - 2);
+    for (auto const & activeSource : activeSources) {
+        REQUIRE(activeSource.sourceIndex != mutedSource);
+        REQUIRE(activeSource.sourceIndex != silentSource);
+    }
+
+    // The ramping sources come first, and the costs only go down from there.
+    activeSources.sortByCost();
+    std::set<source_index_t> const firstSources{ activeSources[0], activeSources[1] };
+    REQUIRE((firstSources == std::set<source_index_t>{ firstMovingSource, secondMovingSource }));
+    auto lastCost{ std::numeric_limits<float>::max() };
+    for (auto const & activeSource : activeSources) {
+        REQUIRE(activeSource.cost <= lastCost);
+        lastCost = activeSource.cost;
+    }
+}
+
+/** Writes a constant 1 to its speakers, so that the gains of a crossfade can be read from the output. */
+class ConstantSpatAlgorithm final : public AbstractSpatAlgorithm
+{
+    std::vector<output_patch_t> mSpeakers{};
+
+public:
+    explicit ConstantSpatAlgorithm(std::vector<output_patch_t> speakers) : mSpeakers(std::move(speakers)) {}
+    void updateSpatData(source_index_t /*sourceIndex*/, SourceData const & /*sourceData*/) noexcept override {}
+    void process(AudioConfig const & /*config*/,
+                 SourceAudioBuffer & sourcesBuffer,
+                 SpeakerAudioBuffer & speakersBuffer,
+#if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
+                 ForkUnionBuffer & /*forkUnionBuffer*/,
+#endif
+                 juce::AudioBuffer<float> & /*stereoBuffer*/,
+                 SourcePeaks const & /*sourcePeaks*/,
+                 SpeakersAudioConfig const * /*altSpeakerConfig*/) override
+    {
+        for (auto const & speaker : mSpeakers) {
+            juce::FloatVectorOperations::fill(speakersBuffer.getChannel(speaker), 1.0f, sourcesBuffer.getNumSamples());
+        }
+    }
+    [[nodiscard]] juce::Array<Triplet> getTriplets() const noexcept override { return {}; }
+    [[nodiscard]] bool hasTriplets() const noexcept override { return false; }
+    [[nodiscard]] tl::optional<Error> getError() const noexcept override { return tl::nullopt; }
+};
+
+TEST_CASE(hotSwapTestName, "[spat]")
+{
+    SpatGrisData data = getSpatGrisDataFromFiles("default_preset.xml", "default_speaker_setup.xml");
+    data.project.spatMode = SpatMode::vbap;
+    data.appData.stereoMode = {};
+
+    auto const config{ data.toAudioConfig() };
+    auto const numSources{ config->sourcesAudioConfig.size() };
+    auto const numSpeakers{ config->speakersAudioConfig.size() };
+    auto const bufferSize{ 512 };
+    auto const sampleRate{ data.appData.audioSettings.sampleRate };
+
+    SourceAudioBuffer sourceBuffer;
+    SpeakerAudioBuffer speakerBuffer;
+#if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
+    ForkUnionBuffer forkUnionBuffer;
+#endif
+    juce::AudioBuffer<float> stereoBuffer;
+    SourcePeaks sourcePeaks;
+
+    initBuffers(bufferSize,
+                numSources,
+                numSpeakers,
+                sourceBuffer,
+                speakerBuffer,
+#if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
+                forkUnionBuffer,
+#endif
+                stereoBuffer);
+
+    auto const makeAlgorithm = [&](SpatMode const spatMode) {
+        return AbstractSpatAlgorithm::make(data.speakerSetup,
+                                           spatMode,
+                                           {},
+                                           data.project.sources,
+                                           sampleRate,
+                                           bufferSize);
+    };
+
+    HotSwappableSpatAlgorithm algo{ makeAlgorithm(SpatMode::vbap), sampleRate, bufferSize };
+    distributeSourcesOnSphere(&algo, data);
+    REQUIRE(!algo.getError());
+
+    float lastPhase{ 0.f };
+    auto const processBlocks = [&](int const numBlocks) {
+        for (int i{}; i < numBlocks; ++i) {
+            incrementAllSourcesAzimuth(&algo, data, TWO_PI / bufferSize);
+            fillSourceBuffersWithSine(numSources, sourceBuffer, bufferSize, sourcePeaks, lastPhase);
+
+            speakerBuffer.silence();
+            stereoBuffer.clear();
+#if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
+            algo.silenceForkUnionBuffer(forkUnionBuffer);
+            algo.process(*config, sourceBuffer, speakerBuffer, forkUnionBuffer, stereoBuffer, sourcePeaks, nullptr);
+#else
+            algo.process(*config, sourceBuffer, speakerBuffer, stereoBuffer, sourcePeaks, nullptr);
+#endif
+            checkSpeakerBufferValidity(speakerBuffer);
+        }
+    };
+
+    // Enough blocks to go through a whole crossfade.
+    auto const numCrossfadeBlocks{
+        static_cast<int>(std::ceil(sampleRate * HotSwappableSpatAlgorithm::CROSSFADE_DURATION_SECONDS / bufferSize)) + 1
+    };
+
+    processBlocks(4);
+
+    // A swap that is replaced before the audio thread picks it up never gets rendered.
+    algo.swapIn(makeAlgorithm(SpatMode::vbap));
+    algo.swapIn(makeAlgorithm(SpatMode::mbap));
+    REQUIRE(!algo.hasTriplets());
+    processBlocks(numCrossfadeBlocks);
+    algo.collectRetired();
+
+    // Activation takes the page faults of the hot state before the instance goes live.
+    auto vbap{ makeAlgorithm(SpatMode::vbap) };
+    vbap->activate(false);
+    auto const report{ vbap->getHotMemoryReport() };
+    REQUIRE(report.numBytes > 0);
+    if (report.numResidentBytes) {
+        REQUIRE(*report.numResidentBytes == report.numBytes);
+    }
+
+    // The gains of the sources are sized for the speakers of the setup, not for MAX_NUM_SPEAKERS.
+    auto const memoryReport{ vbap->getMemoryReport() };
+    REQUIRE(memoryReport.numHotGainsBytes > 0);
+    REQUIRE(memoryReport.numHotGainsBytes < MAX_NUM_SOURCES * 2 * sizeof(SpeakersSpatGains));
+    REQUIRE(memoryReport.numSourcesBytes < memoryReport.numBytes);
+
+    algo.swapIn(std::move(vbap));
+    REQUIRE(algo.hasTriplets());
+    processBlocks(numCrossfadeBlocks);
+    algo.collectRetired();
+    processBlocks(4);
+
+    // A device change prepares the instances again instead of rebuilding them. Blocks can be smaller than the maximum.
+    algo.prepare(sampleRate * 2.0, bufferSize * 2);
+    REQUIRE(algo.hasTriplets());
+    processBlocks(4);
+    algo.swapIn(makeAlgorithm(SpatMode::mbap));
+    processBlocks(numCrossfadeBlocks * 2);
+    algo.collectRetired();
+    processBlocks(4);
+
+    // The crossfade itself, between algorithms whose outputs are known : the old one writes to speakers A and B, the
+    // new one to speakers B and C.
+    REQUIRE(numSpeakers >= 3);
+    auto const speakerKeys{ config->speakersAudioConfig.getKeys() };
+    auto const oldOnlySpeaker{ speakerKeys[0] };
+    auto const sharedSpeaker{ speakerKeys[1] };
+    auto const newOnlySpeaker{ speakerKeys[2] };
+
+    HotSwappableSpatAlgorithm constantAlgo{
+        std::make_unique<ConstantSpatAlgorithm>(std::vector<output_patch_t>{ oldOnlySpeaker, sharedSpeaker }),
+        sampleRate,
+        bufferSize
+    };
+    constantAlgo.swapIn(
+        std::make_unique<ConstantSpatAlgorithm>(std::vector<output_patch_t>{ sharedSpeaker, newOnlySpeaker }));
+
+    SpeakerAudioBuffer const & constSpeakerBuffer{ speakerBuffer };
+    auto lastFadeOutGain{ 1.0f };
+    auto lastFadeInGain{ 0.0f };
+    for (int block{}; block < numCrossfadeBlocks; ++block) {
+        speakerBuffer.silence();
+        stereoBuffer.clear();
+#if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
+        constantAlgo.process(*config, sourceBuffer, speakerBuffer, forkUnionBuffer, stereoBuffer, sourcePeaks, nullptr);
+#else
+        constantAlgo.process(*config, sourceBuffer, speakerBuffer, stereoBuffer, sourcePeaks, nullptr);
+#endif
+        auto const * fadeOut{ constSpeakerBuffer.getChannel(oldOnlySpeaker) };
+        auto const * shared{ constSpeakerBuffer.getChannel(sharedSpeaker) };
+        auto const * fadeIn{ constSpeakerBuffer.getChannel(newOnlySpeaker) };
+        for (int i{}; i < bufferSize; ++i) {
+            // Equal power : the two gains are the cosine and the sine of the same angle.
+            REQUIRE_THAT(fadeOut[i] * fadeOut[i] + fadeIn[i] * fadeIn[i], Catch::Matchers::WithinAbs(1.0f, 1e-5f));
+            REQUIRE_THAT(shared[i], Catch::Matchers::WithinAbs(fadeOut[i] + fadeIn[i], 1e-6f));
+            REQUIRE(fadeOut[i] <= lastFadeOutGain);
+            REQUIRE(fadeIn[i] >= lastFadeInGain);
+            lastFadeOutGain = fadeOut[i];
+            lastFadeInGain = fadeIn[i];
+        }
+    }
+
+    // The last block of the crossfade ends on the new algorithm alone, which then renders without the old one.
+    REQUIRE(lastFadeOutGain == 0.0f);
+    REQUIRE(lastFadeInGain == 1.0f);
+    constantAlgo.collectRetired();
+    speakerBuffer.silence();
+#if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
+    constantAlgo.process(*config, sourceBuffer, speakerBuffer, forkUnionBuffer, stereoBuffer, sourcePeaks, nullptr);
+#else
+    constantAlgo.process(*config, sourceBuffer, speakerBuffer, stereoBuffer, sourcePeaks, nullptr);
+#endif
+    REQUIRE(!speakerBuffer.isDirty(oldOnlySpeaker));
+    REQUIRE(constSpeakerBuffer.getChannel(sharedSpeaker)[0] == 1.0f);
+    REQUIRE(constSpeakerBuffer.getChannel(newOnlySpeaker)[bufferSize - 1] == 1.0f);
+}
+
+/** Records the updates that it gets, in storage that outlives it. */
+class RecordingSpatAlgorithm final : public AbstractSpatAlgorithm
+{
+public:
+    struct Record {
+        std::atomic<int> numUpdates{};
+        std::atomic<float> lastAzimuthSpan{ -1.0f };
+    };
+
+private:
+    Record & mRecord;
+
+public:
+    explicit RecordingSpatAlgorithm(Record & record) : mRecord(record) {}
+    void updateSpatData(source_index_t /*sourceIndex*/, SourceData const & sourceData) noexcept override
+    {
+        mRecord.lastAzimuthSpan.store(sourceData.azimuthSpan);
+        mRecord.numUpdates.fetch_add(1);
+    }
+    void process(AudioConfig const & /*config*/,
+                 SourceAudioBuffer & /*sourcesBuffer*/,
+                 SpeakerAudioBuffer & /*speakersBuffer*/,
+#if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
+                 ForkUnionBuffer & /*forkUnionBuffer*/,
+#endif
+                 juce::AudioBuffer<float> & /*stereoBuffer*/,
+                 SourcePeaks const & /*sourcePeaks*/,
+                 SpeakersAudioConfig const * /*altSpeakerConfig*/) override
+    {
+    }
+    [[nodiscard]] juce::Array<Triplet> getTriplets() const noexcept override { return {}; }
+    [[nodiscard]] bool hasTriplets() const noexcept override { return false; }
+    [[nodiscard]] tl::optional<Error> getError() const noexcept override { return tl::nullopt; }
+};
+
+TEST_CASE(hotSwapUpdatesTestName, "[spat]")
+{
+    static constexpr auto NUM_SWAPS = 64;
+    std::vector<std::unique_ptr<RecordingSpatAlgorithm::Record>> records{};
+    auto const makeAlgorithm = [&]() {
+        records.push_back(std::make_unique<RecordingSpatAlgorithm::Record>());
+        return std::make_unique<RecordingSpatAlgorithm>(*records.back());
+    };
+
+    HotSwappableSpatAlgorithm algo{ makeAlgorithm(), 48000.0, 512 };
+    source_index_t const sourceIndex{ 1 };
+    SourceData sourceData{};
+    auto const update = [&](float const azimuthSpan) {
+        sourceData.azimuthSpan = azimuthSpan;
+        algo.updateSpatData(sourceIndex, sourceData);
+    };
+
+    // A new instance catches up with the latest data.
+    update(1.0f);
+    algo.swapIn(makeAlgorithm());
+    REQUIRE(records[1]->lastAzimuthSpan == 1.0f);
+
+    // Only the newest instance and the one that renders until it is picked up get the updates : an instance that was
+    // replaced before the audio thread picked it up does not.
+    algo.swapIn(makeAlgorithm());
+    update(2.0f);
+    REQUIRE(records[0]->lastAzimuthSpan == 2.0f);
+    REQUIRE(records[1]->lastAzimuthSpan == 1.0f);
+    REQUIRE(records[2]->lastAzimuthSpan == 2.0f);
+
+    // Swapping while another thread sends updates : none of them is lost.
+    static constexpr auto NUM_UPDATES = 100000;
+    std::atomic<bool> isSending{ true };
+    std::thread sender{ [&]() {
+        SourceData senderData{};
+        for (int i{ 1 }; i <= NUM_UPDATES; ++i) {
+            senderData.azimuthSpan = static_cast<float>(i);
+            algo.updateSpatData(sourceIndex, senderData);
+        }
+        isSending.store(false);
+    } };
+    for (int i{}; i < NUM_SWAPS && isSending.load(); ++i) {
+        algo.swapIn(makeAlgorithm());
+    }
+    sender.join();
+    REQUIRE(records.back()->lastAzimuthSpan == static_cast<float>(NUM_UPDATES));
+    REQUIRE(records.front()->lastAzimuthSpan == static_cast<float>(NUM_UPDATES));
+}
+
+TEST_CASE(asyncBuilderTestName, "[spat]")
+{
+    SpatGrisData data = getSpatGrisDataFromFiles("default_preset.xml", "default_speaker_setup.xml");
+    auto const sampleRate{ data.appData.audioSettings.sampleRate };
+    auto const bufferSize{ 512 };
+
+    // The test thread plays the message thread : it drains the deliveries itself.
+    std::mutex deliveriesLock{};
+    std::vector<std::function<void()>> deliveries{};
+    AsyncSpatAlgorithmBuilder builder{ [&](std::function<void()> delivery) {
+        std::lock_guard<std::mutex> const lock{ deliveriesLock };
+        deliveries.push_back(std::move(delivery));
+    } };
+
+    auto const makeRequest = [&](SpatMode const spatMode) {
+        return AsyncSpatAlgorithmBuilder::Request::make(data.speakerSetup,
+                                                        spatMode,
+                                                        {},
+                                                        data.project.sources,
+                                                        sampleRate,
+                                                        bufferSize);
+    };
+    auto const waitAndDeliver = [&]() {
+        for (int i{}; i < 3000 && builder.isBuilding(); ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds{ 10 });
+        }
+        REQUIRE(!builder.isBuilding());
+        std::vector<std::function<void()>> pendingDeliveries{};
+        {
+            std::lock_guard<std::mutex> const lock{ deliveriesLock };
+            pendingDeliveries.swap(deliveries);
+        }
+        for (auto const & delivery : pendingDeliveries) {
+            delivery();
+        }
+    };
+
+    std::vector<SpatMode> builtModes{};
+    auto const makeCallback = [&](SpatMode const spatMode) {
+        return [&builtModes, spatMode](std::unique_ptr<AbstractSpatAlgorithm> algorithm) {
+            REQUIRE(algorithm);
+            REQUIRE(!algorithm->getError());
+            builtModes.push_back(spatMode);
+        };
+    };
+
+    // Only the latest of a burst of requests is delivered, however far the older ones got.
+    builder.build(makeRequest(SpatMode::vbap), makeCallback(SpatMode::vbap));
+    REQUIRE(builder.isBuilding());
+    builder.build(makeRequest(SpatMode::hybrid), makeCallback(SpatMode::hybrid));
+    builder.build(makeRequest(SpatMode::mbap), makeCallback(SpatMode::mbap));
+    waitAndDeliver();
+    REQUIRE(builtModes == std::vector<SpatMode>{ SpatMode::mbap });
+
+    // A cancelled request is never delivered, whether it was still waiting or already being built.
+    builtModes.clear();
+    builder.build(makeRequest(SpatMode::vbap), makeCallback(SpatMode::vbap));
+    builder.cancel();
+    waitAndDeliver();
+    REQUIRE(builtModes.empty());
+
+    // A delivery that arrives after a cancel() is dropped.
+    builder.build(makeRequest(SpatMode::vbap), makeCallback(SpatMode::vbap));
+    for (int i{}; i < 3000 && builder.isBuilding(); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{ 10 });
+    }
+    builder.cancel();
+    waitAndDeliver();
+    REQUIRE(builtModes.empty());
+
+    // The builder still works after a cancel().
+    builder.build(makeRequest(SpatMode::vbap), makeCallback(SpatMode::vbap));
+    waitAndDeliver();
+    REQUIRE(builtModes == std::vector<SpatMode>{ SpatMode::vbap });
+}
+
+TEST_CASE(controlRateTestName, "[spat]")
+{
+    SpatGrisData data = getSpatGrisDataFromFiles("default_preset.xml", "default_speaker_setup.xml");
+    data.project.spatMode = SpatMode::vbap;
+    data.appData.stereoMode = {};
+
+    auto const config{ data.toAudioConfig() };
+    auto const numSources{ config->sourcesAudioConfig.size() };
+    auto const numSpeakers{ config->speakersAudioConfig.size() };
+    auto const bufferSize{ 512 };
+    auto const sampleRate{ data.appData.audioSettings.sampleRate };
+
+    SourceAudioBuffer sourceBuffer;
+    SpeakerAudioBuffer speakerBuffer;
+#if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
+    ForkUnionBuffer forkUnionBuffer;
+#endif
+    juce::AudioBuffer<float> stereoBuffer;
+    SourcePeaks sourcePeaks;
+
+    initBuffers(bufferSize,
+                numSources,
+                numSpeakers,
+                sourceBuffer,
+                speakerBuffer,
+#if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
+                forkUnionBuffer,
+#endif
+                stereoBuffer);
+
+    auto vbap{
+        AbstractSpatAlgorithm::make(data.speakerSetup, SpatMode::vbap, {}, data.project.sources, sampleRate, bufferSize)
+    };
+    ControlRateSpatAlgorithm algo{ std::move(vbap), sampleRate, bufferSize };
+    REQUIRE(!algo.getError());
+    REQUIRE(algo.hasTriplets());
+
+    auto const waitForUpdates = [&](std::uint64_t const minNumUpdates) {
+        for (int i{}; i < 1000 && algo.getLatencyHistogram().numUpdates < minNumUpdates; ++i) {
+            juce::Thread::sleep(1);
+        }
+        return algo.getLatencyHistogram();
+    };
+
+    // Every source gets computed, at the latest one period after it was updated.
+    distributeSourcesOnSphere(&algo, data);
+    auto const numSourcesU64{ static_cast<std::uint64_t>(numSources) };
+    auto histogram{ waitForUpdates(numSourcesU64) };
+    REQUIRE(histogram.numUpdates == numSourcesU64);
+
+    // A burst of updates is coalesced : however many updates a source receives, it is computed at most once per pass of
+    // the worker. Passes start at least one period apart. One more pass may already be running when the burst starts,
+    // and another one computes what is still pending when it ends.
+    auto const numBursts{ 100 };
+    auto const burstStartMs{ juce::Time::getMillisecondCounterHiRes() };
+    for (int i{}; i < numBursts; ++i) {
+        incrementAllSourcesAzimuth(&algo, data, TWO_PI / bufferSize);
+    }
+    auto const burstMs{ juce::Time::getMillisecondCounterHiRes() - burstStartMs };
+    auto const maxNumPasses{ static_cast<std::uint64_t>(burstMs / algo.getPeriodMs()) + 3 };
+    waitForUpdates(numSourcesU64 * 2);
+    // Lets the worker compute whatever the burst left pending.
+    juce::Thread::sleep(algo.getPeriodMs() * 2);
+    histogram = algo.getLatencyHistogram();
+    REQUIRE(histogram.numUpdates >= numSourcesU64 * 2);
+    REQUIRE(histogram.numUpdates - numSourcesU64 <= numSourcesU64 * maxNumPasses);
+    REQUIRE(histogram.getPercentileMs(0.5) <= histogram.getPercentileMs(0.99));
+    REQUIRE(histogram.maxMs > 0.0);
+
+    float lastPhase{ 0.f };
+    for (int i{}; i < 4; ++i) {
+        fillSourceBuffersWithSine(numSources, sourceBuffer, bufferSize, sourcePeaks, lastPhase);
+        speakerBuffer.silence();
+        stereoBuffer.clear();
+#if SG_USE_FORK_UNION && (SG_FU_METHOD == SG_FU_USE_ARRAY_OF_ATOMICS || SG_FU_METHOD == SG_FU_USE_BUFFER_PER_THREAD)
+        algo.silenceForkUnionBuffer(forkUnionBuffer);
+        algo.process(*config, sourceBuffer, speakerBuffer, forkUnionBuffer, stereoBuffer, sourcePeaks, nullptr);
+#else
+        algo.process(*config, sourceBuffer, speakerBuffer, stereoBuffer, sourcePeaks, nullptr);
+#endif
+        checkSpeakerBufferValidity(speakerBuffer);
+    }
+}